@@ -27,7 +27,9 @@
 
 #include "buffer.h"
 #include "buffer_decode.h"
+#include "config.h"
 #include "log.h"
+#include "memstat.h"
 #include "nvrm.h"
 
 struct gpu_object *gpu_objects = NULL;
@@ -234,6 +236,9 @@ void gpu_mapping_destroy(struct gpu_mapping *gpu_mapping)
 
 void gpu_object_destroy(struct gpu_object *obj)
 {
+	if (memory_budget)
+		pushbuf_drop_object(obj);
+
 	if (obj->class_data_destroy)
 		obj->class_data_destroy(obj);
 
@@ -274,6 +279,8 @@ void gpu_object_destroy(struct gpu_object *obj)
 				gpu_objects = obj->next;
 
 			obj->next = NULL;
+			if (obj->data)
+				memstat_add(MEMSTAT_GPU_OBJECTS, -(int64_t)obj->length);
 			free(obj->data);
 			free(obj);
 			//mmt_debug("object destroyed%s\n", "");
@@ -292,6 +299,7 @@ void buffer_mmap(uint32_t id, uint32_t fd, uint64_t cpu_start, uint64_t len, uin
 	mapping->mmap_offset = mmap_offset;
 	mapping->data = calloc(len, 1);
 	mapping->length = len;
+	memstat_add(MEMSTAT_CPU_MAPPINGS, len);
 	mapping->id = id;
 	mapping->cpu_addr = cpu_start;
 
@@ -306,6 +314,8 @@ void buffer_munmap(uint32_t id)
 		mmt_error("inconsistent mapping data%s\n", "");
 		demmt_abort();
 	}
+	if (mapping->data)
+		memstat_add(MEMSTAT_CPU_MAPPINGS, -(int64_t)mapping->length);
 	free(mapping->data);
 	// catch use-after-free bugs ASAP
 	memset(mapping, 0xff, sizeof(*mapping));
@@ -321,6 +331,8 @@ void buffer_mremap(struct mmt_mremap *mm)
 		mapping->data = realloc(mapping->data, mm->len);
 		if (mm->len > mapping->length)
 			memset(mapping->data + mapping->length, 0, mm->len - mapping->length);
+		if (!mapping->object)
+			memstat_add(MEMSTAT_CPU_MAPPINGS, (int64_t)mm->len - (int64_t)mapping->length);
 	}
 
 	mapping->mmap_offset = mm->offset;
@@ -100,6 +100,27 @@ void buffer_decode_register_write(struct cpu_mapping *mapping, uint32_t start, u
 				}
 			}
 		}
+		else if (ib_supported && !mapping->ib.is && gpu_addr)
+		{
+			/* IB buffers of other channels, known from their fifo create arguments */
+			uint32_t idx = start / 4;
+			uint32_t *data = (uint32_t *)mapping->data;
+			if ((idx & 1) == 1 && data[idx - 1] && data[idx] && !(data[idx - 1] & 0x3))
+			{
+				struct gpu_object *fifo = nvrm_get_fifo(mapping->object, gpu_addr + addr, 1);
+				if (fifo && is_fifo_and_addr_belongs(fifo, gpu_addr + addr))
+				{
+					struct fifo_state *state = get_fifo_state(fifo);
+
+					if (info && decode_pb)
+						mmt_printf("IB buffer: %d\n", mapping->id);
+
+					mapping->ib.is = 1;
+					mapping->ib.offset = state->ib.addr - gpu_addr;
+					mapping->ib.entries = state->ib.entries;
+				}
+			}
+		}
 		else if (!pb_pointer_found)
 		{
 			if (start == 0x40)
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "chanq.h"
+#include "demmt.h"
+#include "log.h"
+#include "util.h"
+
+/* decode queued work early when that many submissions or bytes are pending */
+#define CHANQ_MAX_CHUNKS 4096
+#define CHANQ_MAX_BYTES (64 << 20)
+
+/*
+ * Output is kept as a sequence of chunks in trace order. A chunk is either
+ * a queued submission (pstate != NULL) or the output of messages processed
+ * between two submissions.
+ */
+struct chanq_chunk
+{
+	struct pushbuf_decode_state *pstate;
+	struct gpu_object *fifo;
+	uint32_t *cmds;
+	int commands;
+	uint64_t gpu_address;
+	/* the pushbuffer bytes cmds were copied from */
+	struct gpu_object *object;
+	uint64_t object_offset;
+	struct chanq_chunk *next_in_chan;
+
+	FILE *f;
+	char *buf;
+	size_t len;
+};
+
+struct chanq_chan
+{
+	struct pushbuf_decode_state *pstate;
+	struct chanq_chunk *first, *last;
+};
+
+int chanq_enabled;
+
+/* memstreams keep pointers to buf and len, so chunks must not move */
+static struct chanq_chunk **chunks;
+static int chunksnum, chunksmax;
+static uint64_t pending_bytes;
+
+static struct chanq_chan *chans;
+static int chansnum, chansmax;
+
+/* protected by queue_lock */
+static int next_chan, chans_done, generation;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t decode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void chanq_lock(void)
+{
+	if (chanq_enabled)
+		pthread_mutex_lock(&decode_lock);
+}
+
+void chanq_unlock(void)
+{
+	if (chanq_enabled)
+		pthread_mutex_unlock(&decode_lock);
+}
+
+static void decode_chan(struct chanq_chan *chan)
+{
+	FILE *out = mmt_out;
+	struct chanq_chunk *c;
+
+	for (c = chan->first; c; c = c->next_in_chan)
+	{
+		c->f = open_memstream(&c->buf, &c->len);
+		if (!c->f)
+			demmt_abort();
+		mmt_out = c->f;
+
+		c->pstate->fifo = c->fifo;
+		__pushbuf_print(c->pstate, c->cmds, c->cmds + c->commands, c->gpu_address, c->commands);
+
+		flockfile(c->f);
+		fflush_unlocked(c->f);
+		funlockfile(c->f);
+	}
+
+	mmt_out = out;
+}
+
+/* called and returns with queue_lock held */
+static void run_chans(void)
+{
+	while (next_chan < chansnum)
+	{
+		struct chanq_chan *chan = &chans[next_chan++];
+
+		pthread_mutex_unlock(&queue_lock);
+		decode_chan(chan);
+		pthread_mutex_lock(&queue_lock);
+
+		if (++chans_done == chansnum)
+			pthread_cond_signal(&done_cond);
+	}
+}
+
+static void *worker(void *arg)
+{
+	int seen = 0;
+
+	pthread_mutex_lock(&queue_lock);
+	for (;;)
+	{
+		while (generation == seen)
+			pthread_cond_wait(&work_cond, &queue_lock);
+		seen = generation;
+		run_chans();
+	}
+
+	return NULL;
+}
+
+static void new_segment(void)
+{
+	struct chanq_chunk *c = calloc(1, sizeof(*c));
+
+	c->f = open_memstream(&c->buf, &c->len);
+	if (!c->f)
+		demmt_abort();
+	ADDARRAY(chunks, c);
+	mmt_out = c->f;
+}
+
+/*
+ * If demmt aborts while queued work is being decoded, writes out what was
+ * captured so far, up to the first submission whose decode did not start.
+ */
+static void chanq_flush_on_exit(void)
+{
+	int i;
+
+	for (i = 0; i < chunksnum; ++i)
+	{
+		struct chanq_chunk *c = chunks[i];
+		if (c->f)
+		{
+			flockfile(c->f);
+			fflush_unlocked(c->f);
+			fwrite(c->buf, 1, c->len, stdout);
+			funlockfile(c->f);
+		}
+		else if (c->buf)
+			fwrite(c->buf, 1, c->len, stdout);
+		else
+			break;
+	}
+	fflush(stdout);
+}
+
+void chanq_init(int threads)
+{
+	int i;
+
+	for (i = 1; i < threads; ++i)
+	{
+		pthread_t thr;
+		if (pthread_create(&thr, NULL, worker, NULL))
+		{
+			perror("pthread_create");
+			demmt_abort();
+		}
+	}
+
+	atexit(chanq_flush_on_exit);
+	chanq_enabled = 1;
+}
+
+void chanq_submit(struct pushbuf_decode_state *pstate, struct gpu_object *object,
+		uint64_t object_offset, int commands, uint64_t gpu_address)
+{
+	int uploads = pushbuf_fifo_uploads(pstate->fifo);
+	struct chanq_chunk *c;
+
+	/*
+	 * Decoders writing to gpu buffers may change what submissions of other
+	 * channels read, so such submissions are decoded alone, in trace order.
+	 */
+	if (uploads)
+		chanq_sync();
+
+	c = calloc(1, sizeof(*c));
+	if (chunksnum)
+	{
+		/* the message output segment is complete */
+		struct chanq_chunk *seg = chunks[chunksnum - 1];
+		fclose(seg->f);
+		seg->f = NULL;
+	}
+	else
+		fflush(stdout);
+
+	c->pstate = pstate;
+	c->fifo = pstate->fifo;
+	c->commands = commands;
+	c->gpu_address = gpu_address;
+	c->object = object;
+	c->object_offset = object_offset;
+	c->cmds = malloc(commands * 4);
+	memcpy(c->cmds, &object->data[object_offset], commands * 4);
+	ADDARRAY(chunks, c);
+	pending_bytes += commands * 4;
+
+	new_segment();
+
+	if (uploads || chunksnum >= CHANQ_MAX_CHUNKS || pending_bytes >= CHANQ_MAX_BYTES)
+		chanq_sync();
+}
+
+int chanq_queued(const struct gpu_object *object, uint64_t offset, uint64_t len)
+{
+	int i;
+	for (i = chunksnum - 1; i >= 0; --i)
+	{
+		struct chanq_chunk *c = chunks[i];
+		if (c->pstate && c->object == object && offset >= c->object_offset &&
+				offset + len <= c->object_offset + c->commands * 4)
+			return 1;
+	}
+	return 0;
+}
+
+void chanq_sync(void)
+{
+	int i, j;
+
+	if (!chunksnum)
+		return;
+
+	struct chanq_chunk *seg = chunks[chunksnum - 1];
+	fclose(seg->f);
+	seg->f = NULL;
+	mmt_out = stdout;
+
+	for (i = 0; i < chunksnum; ++i)
+	{
+		struct chanq_chunk *c = chunks[i];
+		if (!c->pstate)
+			continue;
+
+		for (j = 0; j < chansnum; ++j)
+			if (chans[j].pstate == c->pstate)
+				break;
+		if (j == chansnum)
+		{
+			struct chanq_chan chan = { c->pstate, c, c };
+			ADDARRAY(chans, chan);
+		}
+		else
+		{
+			chans[j].last->next_in_chan = c;
+			chans[j].last = c;
+		}
+	}
+
+	pthread_mutex_lock(&queue_lock);
+	next_chan = 0;
+	chans_done = 0;
+	if (chansnum > 1)
+	{
+		generation++;
+		pthread_cond_broadcast(&work_cond);
+	}
+	run_chans();
+	while (chans_done < chansnum)
+		pthread_cond_wait(&done_cond, &queue_lock);
+	pthread_mutex_unlock(&queue_lock);
+
+	for (i = 0; i < chunksnum; ++i)
+	{
+		struct chanq_chunk *c = chunks[i];
+		if (c->pstate)
+			fclose(c->f);
+		fwrite(c->buf, 1, c->len, stdout);
+		free(c->buf);
+		free(c->cmds);
+		free(c);
+	}
+
+	chunksnum = 0;
+	chansnum = 0;
+	pending_bytes = 0;
+}
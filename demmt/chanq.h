@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DEMMT_CHANQ_H
+#define DEMMT_CHANQ_H
+
+#include <stdint.h>
+#include "pushbuf.h"
+
+/*
+ * Parallel decode of pushbuffers submitted to different channels (-j).
+ *
+ * IB submissions are copied and queued per channel instead of being decoded
+ * immediately. Queued work is decoded by a pool of threads at the next sync
+ * point - any trace message that may change buffers, mappings or objects -
+ * with each channel decoded in submission order by one thread at a time.
+ * Submissions to channels with objects whose decoders write to gpu buffers
+ * are not decoded in parallel with anything else. Output of every submission
+ * and of the messages between them is captured and written out in trace
+ * order, so it is identical to serial decode.
+ */
+
+extern int chanq_enabled;
+
+void chanq_init(int threads);
+void chanq_submit(struct pushbuf_decode_state *pstate, struct gpu_object *object,
+		uint64_t object_offset, int commands, uint64_t gpu_address);
+void chanq_sync(void);
+
+/*
+ * Whether a byte range of an object lies within the pushbuffer of a queued
+ * submission. Those bytes were copied, so writing them needs no sync.
+ */
+int chanq_queued(const struct gpu_object *object, uint64_t offset, uint64_t len);
+
+/*
+ * Serializes object decoders (which read and write gpu buffers shared
+ * between channels) and other updates of global decoder state.
+ */
+void chanq_lock(void);
+void chanq_unlock(void);
+
+#endif
@@ -64,6 +64,8 @@ int indent_logs = 0;
 int dump_memory_writes = 1;
 int dump_memory_reads = 1;
 int info = 1;
+uint64_t memory_budget = 0;
+int decode_jobs = 1;
 
 #ifdef LIBSECCOMP_AVAILABLE
 int seccomp_level = 2;
@@ -95,6 +97,12 @@ static void usage()
 			"         \tscripts/mmiotrace/mmt-app-demmt-mmiotrace.sh)\n"
 			"  -x 0/1/2\tdisable/enable loose/enable strict sandboxing (default: 2\n"
 			"          \tif libseccomp is available)\n"
+			"  -M size\tlive mode: drop state of destroyed objects and evict cold\n"
+			"         \tdecode caches while memory use is over \"size\" MB (buffer\n"
+			"         \tcontents of live objects are always kept); reports memory\n"
+			"         \tuse per subsystem on stderr\n"
+			"  -j num\tdecode pushbuffers of different channels in \"num\" threads;\n"
+			"        \tignored with -s\n"
 			"\n"
 			"  -d msg_type1[,msg_type2[,msg_type3....]] - disable messages\n"
 			"  -e msg_type1[,msg_type2[,msg_type3....]] - enable messages\n"
@@ -442,7 +450,7 @@ char *read_opts(int argc, char *argv[])
 		colors = &envy_null_colors;
 
 	int c;
-	while ((c = getopt (argc, argv, "m:o:g:qac:l:i:r:he:d:p:s:x:")) != -1)
+	while ((c = getopt (argc, argv, "m:o:g:qac:l:i:r:he:d:p:s:x:M:j:")) != -1)
 	{
 		switch (c)
 		{
@@ -574,6 +582,28 @@ char *read_opts(int argc, char *argv[])
 			case 's':
 				mmt_sync_fd = open(optarg, O_WRONLY);
 				break;
+			case 'M':
+			{
+				char *end;
+				memory_budget = strtoull(optarg, &end, 10) << 20;
+				if (*end || memory_budget == 0)
+				{
+					fprintf(stderr, "-M accepts only positive sizes in MB\n");
+					exit(1);
+				}
+				break;
+			}
+			case 'j':
+			{
+				char *end;
+				decode_jobs = strtol(optarg, &end, 10);
+				if (*end || decode_jobs < 1)
+				{
+					fprintf(stderr, "-j accepts only positive numbers\n");
+					exit(1);
+				}
+				break;
+			}
 		}
 	}
 
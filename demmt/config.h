@@ -1,6 +1,7 @@
 #ifndef DEMMT_CONFIG_H
 #define DEMMT_CONFIG_H
 
+#include <stdint.h>
 #include "colors.h"
 
 extern const struct envy_colors *colors;
@@ -32,6 +33,8 @@ extern int dump_memory_writes;
 extern int dump_memory_reads;
 extern int dump_object_tree_on_create_destroy;
 extern int seccomp_level;
+extern uint64_t memory_budget;
+extern int decode_jobs;
 
 char *read_opts(int argc, char *argv[]);
 
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VA LINUX SYSTEMS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * demmt-bench generates synthetic traces with mmt_gen and runs demmt on
+ * them in several modes, reporting messages/s, methods/s and peak RSS.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct bench_trace
+{
+	const char *name;
+	const char *chipset;
+};
+
+static const struct bench_trace traces[] =
+{
+	{ "g80", "50" },
+	{ "gf100", "c0" },
+	{ "gk104", "e4" },
+};
+
+struct bench_mode
+{
+	const char *name;
+	const char *args[8];
+};
+
+static const struct bench_mode modes[] =
+{
+	{ "default", { NULL } },
+	{ "quiet",   { "-q", NULL } },
+	{ "pb-only", { "-d", "all", "-e", "pb", NULL } },
+	{ "silent",  { "-d", "all", NULL } },
+	{ "live",    { "-M", "64", NULL } },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* runs argv with stdin/stdout redirected, returns exit status */
+static int run(char **argv, const char *in, const char *out, const char *err,
+		struct rusage *ru, double *secs)
+{
+	double start = now();
+	pid_t pid = fork();
+	int status;
+
+	if (pid < 0)
+	{
+		perror("fork");
+		exit(2);
+	}
+	if (pid == 0)
+	{
+		int fd0 = open(in, O_RDONLY);
+		int fd1 = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		int fd2 = open(err, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd0 < 0 || fd1 < 0 || fd2 < 0)
+		{
+			perror("open");
+			_exit(127);
+		}
+		dup2(fd0, 0);
+		dup2(fd1, 1);
+		dup2(fd2, 2);
+		execv(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	while (wait4(pid, &status, 0, ru) < 0)
+		if (errno != EINTR)
+		{
+			perror("wait4");
+			exit(2);
+		}
+	*secs = now() - start;
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: demmt-bench [-f NUM] [-d DIR] MMT_GEN DEMMT\n"
+			"Generates synthetic traces and reports demmt throughput.\n"
+			"\n"
+			"  -f NUM\tIB submissions per trace (default: 2000)\n"
+			"  -d DIR\tdirectory for traces and logs (default: .)\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *frames = "2000", *dir = ".";
+	unsigned int t, m;
+	int c, failed = 0;
+
+	while ((c = getopt(argc, argv, "f:d:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'f':
+				frames = optarg;
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			default:
+				usage();
+		}
+	}
+	if (optind + 2 != argc)
+		usage();
+
+	char *gen = argv[optind], *demmt = argv[optind + 1];
+
+	printf("%-8s %-8s %8s %12s %12s %10s\n", "trace", "mode", "time[s]",
+			"msgs/s", "methods/s", "RSS[KiB]");
+
+	for (t = 0; t < ARRAY_SIZE(traces); ++t)
+	{
+		char mmt[4096], log[4096];
+		struct rusage ru;
+		double secs;
+		uint64_t msgs = 0, methods = 0;
+
+		snprintf(mmt, sizeof(mmt), "%s/bench-%s.mmt", dir, traces[t].name);
+		snprintf(log, sizeof(log), "%s/bench-%s.gen", dir, traces[t].name);
+
+		char *gen_argv[] = { gen, "-g", (char *)traces[t].chipset, "-f", (char *)frames, NULL };
+		if (run(gen_argv, "/dev/null", mmt, log, &ru, &secs))
+		{
+			fprintf(stderr, "demmt-bench: mmt_gen failed, see %s\n", log);
+			exit(2);
+		}
+
+		FILE *f = fopen(log, "r");
+		if (!f || fscanf(f, "mmt_gen: %" SCNu64 " messages, %" SCNu64 " methods", &msgs, &methods) != 2)
+		{
+			fprintf(stderr, "demmt-bench: can't parse %s\n", log);
+			exit(2);
+		}
+		fclose(f);
+
+		for (m = 0; m < ARRAY_SIZE(modes); ++m)
+		{
+			char *dargv[16];
+			int n = 0, i, ret;
+
+			dargv[n++] = demmt;
+			for (i = 0; modes[m].args[i]; ++i)
+				dargv[n++] = (char *)modes[m].args[i];
+			dargv[n] = NULL;
+
+			snprintf(log, sizeof(log), "%s/bench-%s-%s.err", dir, traces[t].name, modes[m].name);
+			ret = run(dargv, mmt, "/dev/null", log, &ru, &secs);
+			if (ret)
+			{
+				printf("%-8s %-8s failed with status %d, see %s\n",
+						traces[t].name, modes[m].name, ret, log);
+				failed = 1;
+				continue;
+			}
+
+			printf("%-8s %-8s %8.2f %12.0f %12.0f %10ld\n", traces[t].name,
+					modes[m].name, secs, msgs / secs, methods / secs, ru.ru_maxrss);
+			fflush(stdout);
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,1568 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * demmt-diff: semantic comparison of two MMT binary traces.
+ *
+ * Every trace is decoded by its own child process (mmt_decode keeps its
+ * input state in globals), which normalizes messages into fixed-size records
+ * and streams them through a pipe.  File descriptors, mmap serials, nvrm
+ * handles, pointers to dumped ioctl arguments and gpu virtual addresses are
+ * renumbered in order of appearance, so they compare equal between runs.
+ *
+ * The parent pairs records per stream (ioctls per fd, objects, mmaps, writes
+ * per mapping) by a key - ioctl number and object handle, object handle,
+ * mapping serial or offset into the mapping.  A record identical to one
+ * queued from the other trace under the same key pairs with it right away.
+ * Others stay queued up to a memory budget; once it runs out, or at the end,
+ * the oldest one is compared against the oldest record of the other trace
+ * with its key, or reported as missing from the other trace if there is none.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "mmt_bin_decode.h"
+#include "mmt_bin_decode_nvidia.h"
+#include "nvrm_create.h"
+#include "nvrm_ioctl.h"
+#include "nvrm_object.xml.h"
+#include "util.h"
+
+enum dd_kind
+{
+	DD_MSG = 1,
+	DD_OPEN,
+	DD_DUP,
+	DD_WRITE_SYSCALL,
+	DD_MMAP,
+	DD_MUNMAP,
+	DD_MREMAP,
+	DD_MEMREAD,
+	DD_MEMWRITE,
+	DD_IOCTL_PRE,
+	DD_IOCTL_POST,
+	DD_NV_CREATE,
+	DD_NV_DESTROY,
+	DD_NV_CALL,
+	DD_NV_CALL_DATA,
+	DD_NV_MEMORY_DUMP,
+	DD_NV_GPU_MAP,
+	DD_NV_GPU_UNMAP,
+	DD_NV_MARK,
+	DD_PUSHBUF_DATA,
+};
+
+static const char * const dd_kind_names[] =
+{
+	[DD_MSG] = "msg",
+	[DD_OPEN] = "open",
+	[DD_DUP] = "dup",
+	[DD_WRITE_SYSCALL] = "write",
+	[DD_MMAP] = "mmap",
+	[DD_MUNMAP] = "munmap",
+	[DD_MREMAP] = "mremap",
+	[DD_MEMREAD] = "r",
+	[DD_MEMWRITE] = "w",
+	[DD_IOCTL_PRE] = "ioctl pre",
+	[DD_IOCTL_POST] = "ioctl post",
+	[DD_NV_CREATE] = "create object",
+	[DD_NV_DESTROY] = "destroy object",
+	[DD_NV_CALL] = "call method",
+	[DD_NV_CALL_DATA] = "call method data",
+	[DD_NV_MEMORY_DUMP] = "memory dump",
+	[DD_NV_GPU_MAP] = "gpu map",
+	[DD_NV_GPU_UNMAP] = "gpu unmap",
+	[DD_NV_MARK] = "mark",
+	[DD_PUSHBUF_DATA] = "pushbuf data",
+};
+
+enum dd_stream_class
+{
+	DD_STREAM_SYS,
+	DD_STREAM_MMAP,
+	DD_STREAM_OBJ,
+	DD_STREAM_PUSHBUF,
+	DD_STREAM_IOCTL,
+	DD_STREAM_MEM,
+};
+
+static const char * const dd_stream_names[] =
+{
+	[DD_STREAM_SYS] = "sys",
+	[DD_STREAM_MMAP] = "mmap",
+	[DD_STREAM_OBJ] = "obj",
+	[DD_STREAM_PUSHBUF] = "pushbuf",
+	[DD_STREAM_IOCTL] = "ioctl",
+	[DD_STREAM_MEM] = "mem",
+};
+
+#define DD_STREAM(cls, idx) (((uint32_t)(cls) << 24) | ((idx) & 0xffffff))
+#define DD_STREAM_CLASS(s) ((s) >> 24)
+#define DD_STREAM_IDX(s) ((s) & 0xffffff)
+#define DD_UNKNOWN 0xffffff
+
+/* values substituted for renumbered handles, argument pointers and gpu addresses */
+#define DD_HANDLE_TAG 0x4e560000u
+#define DD_PTR_TAG 0x4444500000000000ull
+#define DD_VA_TAG 0x4756000000000000ull
+
+/* queued records with the same key looked at for an identical one */
+#define DD_SCAN_MAX 256
+
+struct dd_rec
+{
+	uint8_t kind;
+	uint8_t _pad[3];
+	uint32_t stream;
+	uint32_t len;
+	uint32_t _pad2;
+	uint64_t key;
+	uint64_t a, b, c;
+};
+
+/*
+ * value -> ordinal map, open addressing.
+ */
+struct dd_map
+{
+	uint64_t *keys;
+	int *vals;
+	int size;
+	int used;
+};
+
+static uint32_t dd_map_hash(uint64_t key)
+{
+	return (key ^ (key >> 32)) * 0x9e3779b1u;
+}
+
+static int *dd_map_slot(struct dd_map *m, uint64_t key)
+{
+	uint32_t i = dd_map_hash(key);
+	for (i &= m->size - 1; m->vals[i] >= 0; i = (i + 1) & (m->size - 1))
+		if (m->keys[i] == key)
+			return &m->vals[i];
+	return NULL;
+}
+
+static int dd_map_get(struct dd_map *m, uint64_t key)
+{
+	int *v;
+	if (!m->size)
+		return -1;
+	v = dd_map_slot(m, key);
+	return v ? *v : -1;
+}
+
+static void dd_map_set(struct dd_map *m, uint64_t key, int val)
+{
+	int i;
+	if (2 * (m->used + 1) > m->size)
+	{
+		struct dd_map n;
+		n.size = m->size ? m->size * 2 : 64;
+		n.used = 0;
+		n.keys = malloc(n.size * sizeof *n.keys);
+		n.vals = malloc(n.size * sizeof *n.vals);
+		for (i = 0; i < n.size; ++i)
+			n.vals[i] = -1;
+		for (i = 0; i < m->size; ++i)
+			if (m->vals[i] >= 0)
+				dd_map_set(&n, m->keys[i], m->vals[i]);
+		free(m->keys);
+		free(m->vals);
+		*m = n;
+	}
+
+	int *v = dd_map_slot(m, key);
+	if (v)
+	{
+		*v = val;
+		return;
+	}
+	uint32_t h = dd_map_hash(key);
+	for (h &= m->size - 1; m->vals[h] >= 0; h = (h + 1) & (m->size - 1))
+		;
+	m->keys[h] = key;
+	m->vals[h] = val;
+	m->used++;
+}
+
+/*
+ * Child side: decode one trace and write normalized records to a pipe.
+ */
+
+struct dd_mapping
+{
+	uint64_t start;
+	uint64_t len;
+	uint32_t id;
+	int ord;
+	uint32_t handle;
+	int ib;
+	/* last 32-bit word written, for gpu addresses split in two words */
+	uint64_t last_off;
+	uint32_t last_word;
+	/* for IB entries written one word at a time */
+	uint64_t ib_lo_off;
+	int ib_ord;
+	uint32_t ib_hi;
+};
+
+/* gpu virtual address range, kept sorted and disjoint */
+struct dd_gpu_map
+{
+	uint64_t va;
+	uint64_t len;
+	uint32_t handle;
+	int ord;
+	int ib;
+};
+
+/* nvrm memory object handle behind an mmap offset */
+struct dd_host_map
+{
+	uint64_t foffset;
+	uint32_t handle;
+};
+
+static FILE *dd_out;
+static int dd_dump_reads;
+
+static struct dd_mapping *mappings;
+static int mappingsnum, mappingsmax;
+static int next_mapping_ord;
+
+static struct dd_gpu_map *gpu_maps;
+static int gpu_mapsnum, gpu_mapsmax;
+static int next_gpu_map_ord;
+
+static struct dd_host_map *host_maps;
+static int host_mapsnum, host_mapsmax;
+
+static struct dd_map fd_ords;
+static int next_fd_ord;
+
+static struct dd_map handle_ords;
+static int next_handle_ord;
+
+static struct dd_map ptr_ords;
+static int next_ptr_ord;
+
+static uint8_t dd_scratch[2 * MMT_BUF_SIZE];
+
+static void dd_emit(enum dd_kind kind, uint32_t stream, uint64_t key, uint64_t a,
+		uint64_t b, uint64_t c, const void *data, uint32_t len)
+{
+	struct dd_rec r;
+	memset(&r, 0, sizeof(r));
+	r.kind = kind;
+	r.stream = stream;
+	r.len = len;
+	r.key = key;
+	r.a = a;
+	r.b = b;
+	r.c = c;
+	if (fwrite(&r, sizeof(r), 1, dd_out) != 1 ||
+			(len && fwrite(data, 1, len, dd_out) != len))
+		exit(errno == EPIPE ? 0 : 1);
+}
+
+static int dd_fd(uint32_t fd)
+{
+	int ord = dd_map_get(&fd_ords, fd);
+	if (ord < 0)
+	{
+		ord = next_fd_ord++;
+		dd_map_set(&fd_ords, fd, ord);
+	}
+	return ord;
+}
+
+static uint32_t dd_handle(uint32_t handle)
+{
+	int ord = dd_map_get(&handle_ords, handle);
+	return ord < 0 ? handle : DD_HANDLE_TAG | ord;
+}
+
+static void dd_learn_handle(uint32_t handle)
+{
+	if (handle && dd_map_get(&handle_ords, handle) < 0)
+		dd_map_set(&handle_ords, handle, next_handle_ord++);
+}
+
+/* index of the first gpu mapping ending above va */
+static int dd_gpu_map_idx(uint64_t va)
+{
+	int lo = 0, hi = gpu_mapsnum;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (gpu_maps[mid].va + gpu_maps[mid].len <= va)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct dd_gpu_map *dd_find_va(uint64_t va)
+{
+	int i = dd_gpu_map_idx(va);
+	if (i < gpu_mapsnum && gpu_maps[i].va <= va)
+		return &gpu_maps[i];
+	return NULL;
+}
+
+static void dd_forget_va(uint64_t va, uint64_t len)
+{
+	int i = dd_gpu_map_idx(va), j = i;
+	while (j < gpu_mapsnum && gpu_maps[j].va < va + len)
+		j++;
+	memmove(&gpu_maps[i], &gpu_maps[j], (gpu_mapsnum - j) * sizeof(*gpu_maps));
+	gpu_mapsnum -= j - i;
+}
+
+static void dd_learn_va(uint64_t va, uint64_t len, uint32_t handle)
+{
+	struct dd_gpu_map *g = dd_find_va(va);
+	struct dd_gpu_map n = { va, len, handle, 0, 0 };
+	int i;
+	if (!va || !len || va + len < va || (g && g->va == va && g->len == len))
+		return;
+
+	/* whatever was mapped there before is gone */
+	dd_forget_va(va, len);
+	n.ord = next_gpu_map_ord++;
+	ADDARRAY(gpu_maps, n);
+	i = dd_gpu_map_idx(va);
+	memmove(&gpu_maps[i + 1], &gpu_maps[i], (gpu_mapsnum - 1 - i) * sizeof(*gpu_maps));
+	gpu_maps[i] = n;
+}
+
+/* gpu address as its mapping's ordinal and the offset into it, 40 bits wide */
+static uint64_t dd_va_short(const struct dd_gpu_map *g, uint64_t va)
+{
+	return (uint64_t)(g->ord & 0xffff) << 24 | ((va - g->va) & 0xffffff);
+}
+
+static uint64_t dd_va(const struct dd_gpu_map *g, uint64_t va)
+{
+	return DD_VA_TAG | (uint64_t)(g->ord & 0xffff) << 32 | ((va - g->va) & 0xffffffff);
+}
+
+/* Replace a 64-bit gpu address at data + offset, if it is one. */
+static void dd_normalize_va64(uint8_t *data, uint32_t offset, uint32_t len)
+{
+	struct dd_gpu_map *g;
+	uint64_t v;
+	if (offset + 8 > len)
+		return;
+	memcpy(&v, data + offset, 8);
+	if ((g = dd_find_va(v)))
+	{
+		v = dd_va(g, v);
+		memcpy(data + offset, &v, 8);
+	}
+}
+
+static void dd_mark_ib(uint32_t handle)
+{
+	int i;
+	for (i = 0; i < gpu_mapsnum; ++i)
+		if (gpu_maps[i].handle == handle)
+			gpu_maps[i].ib = 1;
+	for (i = 0; i < mappingsnum; ++i)
+		if (mappings[i].handle == handle)
+			mappings[i].ib = 1;
+}
+
+static int dd_is_ib_handle(uint32_t handle)
+{
+	int i;
+	for (i = 0; i < gpu_mapsnum; ++i)
+		if (gpu_maps[i].handle == handle && gpu_maps[i].ib)
+			return 1;
+	return 0;
+}
+
+/*
+ * Rewrite gpu addresses written through a cpu mapping: IB entries in IB
+ * rings, and elsewhere 64-bit addresses and the high/low word pairs that
+ * address methods take in pushbuffers.  Outside of IB rings only addresses
+ * aligned to 16 bytes are recognized, so method headers and other data
+ * rarely pass for one.
+ */
+static void dd_normalize_written_va(struct dd_mapping *m, uint64_t offset, uint8_t *data, uint32_t len)
+{
+	struct dd_gpu_map *g;
+	uint32_t i, w;
+	uint64_t v;
+
+	for (i = (4 - offset % 4) % 4; i + 4 <= len; i += 4)
+	{
+		uint64_t o = offset + i;
+		memcpy(&w, data + i, 4);
+
+		if (m->ib)
+		{
+			if (o % 8 == 0 && i + 8 <= len)
+			{
+				/* address in bits 0..39, length and flags above */
+				memcpy(&v, data + i, 8);
+				if ((g = dd_find_va(v & 0xffffffffffull)))
+				{
+					v = (v & ~0xffffffffffull) | dd_va_short(g, v & 0xffffffffffull);
+					memcpy(data + i, &v, 8);
+				}
+				i += 4;
+			}
+			else if (o % 8 == 0)
+			{
+				m->ib_lo_off = -1;
+				if ((g = dd_find_va((uint64_t)(m->ib_hi & 0xff) << 32 | w)))
+				{
+					w = dd_va_short(g, (uint64_t)(m->ib_hi & 0xff) << 32 | w);
+					memcpy(data + i, &w, 4);
+					m->ib_lo_off = o;
+					m->ib_ord = g->ord;
+				}
+			}
+			else
+			{
+				m->ib_hi = w;
+				if (m->ib_lo_off == o - 4)
+				{
+					w = (w & ~0xffu) | ((m->ib_ord >> 8) & 0xff);
+					memcpy(data + i, &w, 4);
+				}
+			}
+			continue;
+		}
+
+		if (o % 8 == 0 && i + 8 <= len)
+		{
+			memcpy(&v, data + i, 8);
+			if (!(v & 0xf) && (g = dd_find_va(v)))
+			{
+				v = dd_va(g, v);
+				memcpy(data + i, &v, 8);
+				m->last_off = -1;
+				i += 4;
+				continue;
+			}
+		}
+		if (m->last_off == o - 4 && !(w & 0xf) && (g = dd_find_va((uint64_t)m->last_word << 32 | w)))
+		{
+			uint32_t n = dd_va_short(g, (uint64_t)m->last_word << 32 | w);
+			memcpy(data + i, &n, 4);
+		}
+		m->last_off = o;
+		m->last_word = w;
+	}
+}
+
+static struct dd_mapping *dd_find_mapping_id(uint32_t id)
+{
+	int i;
+	for (i = mappingsnum - 1; i >= 0; --i)
+		if (mappings[i].id == id)
+			return &mappings[i];
+	return NULL;
+}
+
+static struct dd_mapping *dd_find_mapping_addr(uint64_t addr)
+{
+	int i;
+	for (i = mappingsnum - 1; i >= 0; --i)
+		if (addr >= mappings[i].start && addr < mappings[i].start + mappings[i].len)
+			return &mappings[i];
+	return NULL;
+}
+
+static void dd_add_mapping(uint64_t start, uint64_t len, uint32_t id, uint64_t offset,
+		uint32_t fd, uint32_t prot, uint32_t flags, uint64_t h1, uint64_t h2)
+{
+	struct dd_mapping m;
+	int i;
+	memset(&m, 0, sizeof(m));
+	m.start = start;
+	m.len = len;
+	m.id = id;
+	m.ord = next_mapping_ord++;
+	m.last_off = m.ib_lo_off = -1;
+	for (i = host_mapsnum - 1; i >= 0; --i)
+		if (host_maps[i].foffset == (offset & ~0xfffull))
+		{
+			m.handle = host_maps[i].handle;
+			m.ib = dd_is_ib_handle(m.handle);
+			break;
+		}
+	ADDARRAY(mappings, m);
+
+	uint64_t desc[3] = { fd == (uint32_t)-1 ? -1 : dd_fd(fd), dd_handle(h1), dd_handle(h2) };
+	dd_emit(DD_MMAP, DD_STREAM(DD_STREAM_MMAP, 0), m.ord, len, prot, flags, desc, sizeof(desc));
+}
+
+static void dd_learn_ptrs(struct mmt_memory_dump *args, int argc)
+{
+	int i;
+	for (i = 0; i < argc; ++i)
+		if (dd_map_get(&ptr_ords, args[i].addr) < 0)
+			dd_map_set(&ptr_ords, args[i].addr, next_ptr_ord++);
+}
+
+/* Replace pointers to dumped arguments with their ordinals. */
+static void dd_normalize(uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+	uint32_t i;
+	memcpy(dst, src, len);
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		uint64_t v;
+		int ord;
+		memcpy(&v, src + i, 8);
+		if (!v || (ord = dd_map_get(&ptr_ords, v)) < 0)
+			continue;
+		v = DD_PTR_TAG | ord;
+		memcpy(dst + i, &v, 8);
+	}
+}
+
+enum
+{
+	DD_HF_NEW = 1,	/* the ioctl creates this handle */
+	DD_HF_KEY = 2,	/* the object the ioctl is about, for pairing */
+};
+
+#define HF(ioctl, type, field, flags) { NVRM_IOCTL_##ioctl, offsetof(struct nvrm_ioctl_##type, field), flags }
+
+/* the fields of nvrm ioctls holding object handles, nothing else gets renumbered */
+static const struct
+{
+	uint32_t id;
+	uint32_t offset;
+	int flags;
+} nvrm_handle_fields[] =
+{
+	HF(CREATE_CTX, create_ctx, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_DEV_OBJ, create_dev_obj, cid, 0),
+	HF(CREATE_DEV_OBJ, create_dev_obj, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_VSPACE, create_vspace, cid, 0),
+	HF(CREATE_VSPACE, create_vspace, parent, 0),
+	HF(CREATE_VSPACE, create_vspace, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_VSPACE56, create_vspace56, cid, 0),
+	HF(CREATE_VSPACE56, create_vspace56, parent, 0),
+	HF(CREATE_VSPACE56, create_vspace56, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_SIMPLE, create_simple, cid, 0),
+	HF(CREATE_SIMPLE, create_simple, parent, 0),
+	HF(CREATE_SIMPLE, create_simple, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(DESTROY, destroy, cid, 0),
+	HF(DESTROY, destroy, parent, 0),
+	HF(DESTROY, destroy, handle, DD_HF_KEY),
+	HF(CALL, call, cid, 0),
+	HF(CALL, call, handle, DD_HF_KEY),
+	HF(CREATE, create, cid, 0),
+	HF(CREATE, create, parent, 0),
+	HF(CREATE, create, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_DRV_OBJ, create_drv_obj, cid, 0),
+	HF(CREATE_DRV_OBJ, create_drv_obj, parent, 0),
+	HF(CREATE_DRV_OBJ, create_drv_obj, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(GET_PARAM, get_param, cid, 0),
+	HF(GET_PARAM, get_param, handle, DD_HF_KEY),
+	HF(CREATE_UNK34, create_unk34, cid, 0),
+	HF(CREATE_UNK34, create_unk34, parent, 0),
+	HF(CREATE_UNK34, create_unk34, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_UNK34, create_unk34, cid2, 0),
+	HF(CREATE_UNK34, create_unk34, handle2, 0),
+	HF(QUERY, query, cid, 0),
+	HF(QUERY, query, handle, DD_HF_KEY),
+	HF(UNK38, unk38, cid, 0),
+	HF(UNK38, unk38, handle, DD_HF_KEY),
+	HF(SCHED_FIFO, sched_fifo, cid, 0),
+	HF(SCHED_FIFO, sched_fifo, dev, 0),
+	HF(SCHED_FIFO, sched_fifo, handle, DD_HF_KEY),
+	HF(DISP_UNK48, disp_unk48, cid, 0),
+	HF(DISP_UNK48, disp_unk48, handle, DD_HF_KEY),
+	HF(MEMORY, memory, cid, 0),
+	HF(MEMORY, memory, parent, 0),
+	HF(MEMORY, memory, vspace, 0),
+	HF(MEMORY, memory, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(MEMORY2, memory2, cid, 0),
+	HF(MEMORY2, memory2, parent, 0),
+	HF(MEMORY2, memory2, vspace, 0),
+	HF(MEMORY2, memory2, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(MEMORY3, memory3, cid, 0),
+	HF(MEMORY3, memory3, parent, 0),
+	HF(MEMORY3, memory3, vspace, 0),
+	HF(MEMORY3, memory3, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CONFIG, config, cid, 0),
+	HF(CONFIG, config, handle, DD_HF_KEY),
+	HF(HOST_MAP, host_map, cid, 0),
+	HF(HOST_MAP, host_map, subdev, 0),
+	HF(HOST_MAP, host_map, handle, DD_HF_KEY),
+	HF(HOST_MAP56, host_map56, cid, 0),
+	HF(HOST_MAP56, host_map56, subdev, 0),
+	HF(HOST_MAP56, host_map56, handle, DD_HF_KEY),
+	HF(HOST_UNMAP, host_unmap, cid, 0),
+	HF(HOST_UNMAP, host_unmap, subdev, 0),
+	HF(HOST_UNMAP, host_unmap, handle, DD_HF_KEY),
+	HF(CREATE_DMA, create_dma, cid, 0),
+	HF(CREATE_DMA, create_dma, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_DMA, create_dma, parent, 0),
+	HF(CREATE_DMA56, create_dma56, cid, 0),
+	HF(CREATE_DMA56, create_dma56, handle, DD_HF_NEW | DD_HF_KEY),
+	HF(CREATE_DMA56, create_dma56, parent, 0),
+	HF(VSPACE_MAP, vspace_map, cid, 0),
+	HF(VSPACE_MAP, vspace_map, dev, 0),
+	HF(VSPACE_MAP, vspace_map, vspace, 0),
+	HF(VSPACE_MAP, vspace_map, handle, DD_HF_KEY),
+	HF(VSPACE_UNMAP, vspace_unmap, cid, 0),
+	HF(VSPACE_UNMAP, vspace_unmap, dev, 0),
+	HF(VSPACE_UNMAP, vspace_unmap, vspace, 0),
+	HF(VSPACE_UNMAP, vspace_unmap, handle, DD_HF_KEY),
+	HF(BIND, bind, cid, 0),
+	HF(BIND, bind, target, 0),
+	HF(BIND, bind, handle, DD_HF_KEY),
+	HF(UNK5E, unk5e, cid, 0),
+	HF(UNK5E, unk5e, subdev, 0),
+	HF(UNK5E, unk5e, handle, DD_HF_KEY),
+};
+
+#undef HF
+
+static int dd_is_fifo_ib_class(uint32_t cls)
+{
+	switch (cls)
+	{
+		case NVRM_FIFO_IB_G80:
+		case NVRM_FIFO_IB_G82:
+		case NVRM_FIFO_IB_MCP89:
+		case NVRM_FIFO_IB_GF100:
+		case NVRM_FIFO_IB_GK104:
+		case NVRM_FIFO_IB_GK110:
+		case NVRM_FIFO_IB_UNKA2:
+		case NVRM_FIFO_IB_GM107:
+		case NVRM_FIFO_IB_GP102:
+		case NVRM_FIFO_IB_GV100:
+		case NVRM_FIFO_IB_TU102:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* nouveau's struct drm_nouveau_gem_info, demmt-diff doesn't need libdrm */
+struct dd_nouveau_gem_info
+{
+	uint32_t handle;
+	uint32_t domain;
+	uint64_t size;
+	uint64_t offset;
+	uint64_t map_handle;
+	uint32_t tile_mode;
+	uint32_t tile_flags;
+};
+
+struct dd_nouveau_gem_new
+{
+	struct dd_nouveau_gem_info info;
+	uint32_t channel_hint;
+	uint32_t align;
+};
+
+#define DD_NOUVEAU_GEM_NEW _IOWR('d', 0x80, struct dd_nouveau_gem_new)
+#define DD_NOUVEAU_GEM_INFO _IOWR('d', 0x84, struct dd_nouveau_gem_info)
+
+/*
+ * Learn handles, gpu mappings and IB rings from an nvrm ioctl, and renumber
+ * its handle and gpu address fields.  Pointers in data are already
+ * renumbered.  Returns the key handle, if any.
+ */
+static uint32_t dd_nvrm_ioctl(enum dd_kind kind, uint32_t id, uint8_t *data, uint32_t len,
+		struct mmt_memory_dump *args, int argc, uint8_t **argdata)
+{
+	uint32_t key = 0, h;
+	int post = kind == DD_IOCTL_POST;
+	int i;
+
+	if (id == NVRM_IOCTL_VSPACE_MAP && len >= sizeof(struct nvrm_ioctl_vspace_map))
+	{
+		struct nvrm_ioctl_vspace_map *s = (void *)data;
+		if (!post || s->status == NVRM_STATUS_SUCCESS)
+			dd_learn_va(s->addr, s->size, s->handle);
+		dd_normalize_va64(data, offsetof(struct nvrm_ioctl_vspace_map, addr), len);
+	}
+	else if (id == NVRM_IOCTL_VSPACE_UNMAP && len >= sizeof(struct nvrm_ioctl_vspace_unmap))
+	{
+		struct nvrm_ioctl_vspace_unmap *s = (void *)data;
+		uint64_t va = s->addr;
+		int done = post && s->status == NVRM_STATUS_SUCCESS;
+		struct dd_gpu_map *g = dd_find_va(va);
+		dd_normalize_va64(data, offsetof(struct nvrm_ioctl_vspace_unmap, addr), len);
+		if (done && g && g->va == va)
+			dd_forget_va(va, g->len);
+	}
+	else if (id == NVRM_IOCTL_HOST_MAP && len >= sizeof(struct nvrm_ioctl_host_map))
+	{
+		struct nvrm_ioctl_host_map *s = (void *)data;
+		if (post && s->status == NVRM_STATUS_SUCCESS)
+		{
+			struct dd_host_map hm = { s->foffset & ~0xfffull, s->handle };
+			ADDARRAY(host_maps, hm);
+		}
+	}
+	else if (id == NVRM_IOCTL_HOST_MAP56 && len >= sizeof(struct nvrm_ioctl_host_map56))
+	{
+		struct nvrm_ioctl_host_map56 *s = (void *)data;
+		if (post && s->status == NVRM_STATUS_SUCCESS)
+		{
+			struct dd_host_map hm = { s->foffset & ~0xfffull, s->handle };
+			ADDARRAY(host_maps, hm);
+		}
+	}
+	else if (id == NVRM_IOCTL_CREATE && len >= sizeof(struct nvrm_ioctl_create))
+	{
+		struct nvrm_ioctl_create *s = (void *)data;
+		if (dd_is_fifo_ib_class(s->cls))
+			for (i = 0; i < argc; ++i)
+				if (s->ptr == (DD_PTR_TAG | dd_map_get(&ptr_ords, args[i].addr)) &&
+						args[i].data->len >= sizeof(struct nvrm_create_fifo_ib))
+				{
+					struct nvrm_create_fifo_ib *fifo = (void *)argdata[i];
+					struct dd_gpu_map *g = dd_find_va(fifo->ib_addr);
+					if (g)
+						dd_mark_ib(g->handle);
+					dd_normalize_va64(argdata[i], offsetof(struct nvrm_create_fifo_ib, ib_addr), args[i].data->len);
+				}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(nvrm_handle_fields); ++i)
+		if (nvrm_handle_fields[i].id == id && nvrm_handle_fields[i].offset + 4 <= len)
+		{
+			memcpy(&h, data + nvrm_handle_fields[i].offset, 4);
+			if (nvrm_handle_fields[i].flags & DD_HF_NEW)
+				dd_learn_handle(h);
+			h = dd_handle(h);
+			memcpy(data + nvrm_handle_fields[i].offset, &h, 4);
+			if (nvrm_handle_fields[i].flags & DD_HF_KEY)
+				key = h;
+		}
+	return key;
+}
+
+static void dd_ioctl(enum dd_kind kind, uint32_t fd, uint32_t id, struct mmt_buf *data,
+		uint64_t ret, uint64_t err, struct mmt_memory_dump *args, int argc)
+{
+	int nvrm = ((id >> 8) & 0xff) == NVRM_IOCTL_MAGIC;
+	uint8_t *argdata[argc > 0 ? argc : 1];
+	uint32_t len, key = 0;
+	int i;
+
+	dd_learn_ptrs(args, argc);
+	dd_normalize(dd_scratch, data->data, data->len);
+	len = data->len;
+
+	for (i = 0; i < argc; ++i)
+	{
+		struct mmt_buf *b = args[i].data;
+		argdata[i] = NULL;
+		if (len + 4 + b->len > sizeof(dd_scratch))
+		{
+			argc = i;
+			break;
+		}
+		memcpy(dd_scratch + len, &b->len, 4);
+		len += 4;
+		argdata[i] = dd_scratch + len;
+		dd_normalize(dd_scratch + len, b->data, b->len);
+		len += b->len;
+	}
+
+	if (nvrm)
+		key = dd_nvrm_ioctl(kind, id, dd_scratch, data->len, args, argc, argdata);
+	else if ((id == DD_NOUVEAU_GEM_NEW || id == DD_NOUVEAU_GEM_INFO) &&
+			data->len >= sizeof(struct dd_nouveau_gem_info))
+	{
+		struct dd_nouveau_gem_info *info = (void *)dd_scratch;
+		if (kind == DD_IOCTL_POST && !ret)
+			dd_learn_va(info->offset, info->size, 0);
+		dd_normalize_va64(dd_scratch, offsetof(struct dd_nouveau_gem_info, offset), data->len);
+	}
+
+	dd_emit(kind, DD_STREAM(DD_STREAM_IOCTL, dd_fd(fd)), (uint64_t)key << 32 | id,
+			id, ret, err, dd_scratch, len);
+}
+
+static void dd_memaccess(enum dd_kind kind, struct dd_mapping *m, uint64_t offset,
+		const uint8_t *data, uint8_t len)
+{
+	uint32_t idx = m ? m->ord : DD_UNKNOWN;
+	if (kind == DD_MEMWRITE && m)
+	{
+		memcpy(dd_scratch, data, len);
+		dd_normalize_written_va(m, offset, dd_scratch, len);
+		data = dd_scratch;
+	}
+	dd_emit(kind, DD_STREAM(DD_STREAM_MEM, idx), offset, offset, len, 0, data, len);
+}
+
+static void dd_memread(struct mmt_read *r, void *state)
+{
+	if (dd_dump_reads)
+	{
+		struct dd_mapping *m = dd_find_mapping_id(r->id);
+		dd_memaccess(DD_MEMREAD, m, r->offset, r->data, r->len);
+	}
+}
+
+static void dd_memread2(struct mmt_read2 *r, void *state)
+{
+	if (dd_dump_reads)
+	{
+		struct dd_mapping *m = dd_find_mapping_addr(r->addr);
+		dd_memaccess(DD_MEMREAD, m, m ? r->addr - m->start : r->addr, r->data, r->len);
+	}
+}
+
+static void dd_memwrite(struct mmt_write *w, void *state)
+{
+	struct dd_mapping *m = dd_find_mapping_id(w->id);
+	dd_memaccess(DD_MEMWRITE, m, w->offset, w->data, w->len);
+}
+
+static void dd_memwrite2(struct mmt_write2 *w, void *state)
+{
+	struct dd_mapping *m = dd_find_mapping_addr(w->addr);
+	dd_memaccess(DD_MEMWRITE, m, m ? w->addr - m->start : w->addr, w->data, w->len);
+}
+
+static void dd_mmap(struct mmt_mmap *mm, void *state)
+{
+	dd_add_mapping(mm->start, mm->len, mm->id, mm->offset, -1, 0, 0, 0, 0);
+}
+
+static void dd_mmap2(struct mmt_mmap2 *mm, void *state)
+{
+	dd_add_mapping(mm->start, mm->len, mm->id, mm->offset, mm->fd, mm->prot, mm->flags, 0, 0);
+}
+
+static void dd_nv_mmap(struct mmt_nvidia_mmap *mm, void *state)
+{
+	dd_add_mapping(mm->start, mm->len, mm->id, mm->offset, -1, 0, 0, mm->data1, mm->data2);
+}
+
+static void dd_nv_mmap2(struct mmt_nvidia_mmap2 *mm, void *state)
+{
+	dd_add_mapping(mm->start, mm->len, mm->id, mm->offset, mm->fd, mm->prot, mm->flags, mm->data1, mm->data2);
+}
+
+static void dd_munmap(struct mmt_unmap *mm, void *state)
+{
+	struct dd_mapping *m = dd_find_mapping_id(mm->id);
+	uint32_t ord = m ? m->ord : DD_UNKNOWN;
+	dd_emit(DD_MUNMAP, DD_STREAM(DD_STREAM_MMAP, 0), ord, ord, mm->len, 0, NULL, 0);
+	if (m)
+		*m = mappings[--mappingsnum];
+}
+
+static void dd_mremap(struct mmt_mremap *mm, void *state)
+{
+	struct dd_mapping *m = dd_find_mapping_id(mm->id);
+	uint32_t ord = m ? m->ord : DD_UNKNOWN;
+	dd_emit(DD_MREMAP, DD_STREAM(DD_STREAM_MMAP, 0), ord, ord, mm->old_len, mm->len, NULL, 0);
+	if (m)
+	{
+		m->start = mm->start;
+		m->len = mm->len;
+	}
+}
+
+static void dd_open(struct mmt_open *o, void *state)
+{
+	int32_t ret = o->ret;
+	dd_emit(DD_OPEN, DD_STREAM(DD_STREAM_SYS, 0), 0, o->flags, o->mode,
+			ret >= 0 ? dd_fd(ret) : (uint64_t)ret, o->path.data, o->path.len);
+}
+
+static void dd_msg(uint8_t *data, unsigned int len, void *state)
+{
+	dd_emit(DD_MSG, DD_STREAM(DD_STREAM_SYS, 0), 0, 0, 0, 0, data, len);
+}
+
+static void dd_write_syscall(struct mmt_write_syscall *o, void *state)
+{
+	int fd = dd_fd(o->fd);
+	dd_emit(DD_WRITE_SYSCALL, DD_STREAM(DD_STREAM_SYS, 0), fd, fd, 0, 0, o->data.data, o->data.len);
+}
+
+static void dd_dup_syscall(struct mmt_dup_syscall *o, void *state)
+{
+	int old = dd_fd(o->oldfd);
+	dd_map_set(&fd_ords, o->newfd, next_fd_ord++);
+	dd_emit(DD_DUP, DD_STREAM(DD_STREAM_SYS, 0), old, old, dd_fd(o->newfd), 0, NULL, 0);
+}
+
+static void dd_ioctl_pre_v2(struct mmt_ioctl_pre_v2 *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	dd_ioctl(DD_IOCTL_PRE, ctl->fd, ctl->id, &ctl->data, 0, 0, args, argc);
+}
+
+static void dd_ioctl_post_v2(struct mmt_ioctl_post_v2 *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	dd_ioctl(DD_IOCTL_POST, ctl->fd, ctl->id, &ctl->data, ctl->ret, ctl->err, args, argc);
+}
+
+static void dd_ioctl_pre(struct mmt_ioctl_pre *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	dd_ioctl(DD_IOCTL_PRE, ctl->fd, ctl->id, &ctl->data, 0, 0, args, argc);
+}
+
+static void dd_ioctl_post(struct mmt_ioctl_post *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	dd_ioctl(DD_IOCTL_POST, ctl->fd, ctl->id, &ctl->data, 0, 0, args, argc);
+}
+
+static void dd_nv_create_object(struct mmt_nvidia_create_object *create, void *state)
+{
+	dd_learn_handle(create->obj2);
+	dd_emit(DD_NV_CREATE, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(create->obj2),
+			dd_handle(create->obj1), dd_handle(create->obj2), create->class,
+			create->name.data, create->name.len);
+}
+
+static void dd_nv_destroy_object(struct mmt_nvidia_destroy_object *destroy, void *state)
+{
+	dd_emit(DD_NV_DESTROY, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(destroy->obj2),
+			dd_handle(destroy->obj1), dd_handle(destroy->obj2), 0, NULL, 0);
+}
+
+static void dd_nv_memory_dump(struct mmt_memory_dump_prefix *d, struct mmt_buf *b, void *state)
+{
+	dd_normalize(dd_scratch, b->data, b->len);
+	dd_emit(DD_NV_MEMORY_DUMP, DD_STREAM(DD_STREAM_OBJ, 0), 0, 0, 0, 0, dd_scratch, b->len);
+}
+
+static void dd_nv_call_method(struct mmt_nvidia_call_method *m, void *state)
+{
+	dd_emit(DD_NV_CALL, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(m->data1),
+			dd_handle(m->data1), m->data2, 0, NULL, 0);
+}
+
+static void dd_nv_gpu_map(struct mmt_nvidia_gpu_map *map, void *state)
+{
+	dd_learn_va(map->gpu_start, map->len, 0);
+	dd_emit(DD_NV_GPU_MAP, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(map->data3), dd_handle(map->data1),
+			dd_handle(map->data2), dd_handle(map->data3), &map->len, 4);
+}
+
+static void dd_nv_gpu_map2(struct mmt_nvidia_gpu_map2 *map, void *state)
+{
+	dd_learn_va(map->gpu_start, map->len, 0);
+	dd_emit(DD_NV_GPU_MAP, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(map->data3), dd_handle(map->data1),
+			dd_handle(map->data2), dd_handle(map->data3), &map->len, 4);
+}
+
+static void dd_nv_gpu_unmap(struct mmt_nvidia_gpu_unmap *unmap, void *state)
+{
+	struct dd_gpu_map *g = dd_find_va(unmap->gpu_start);
+	if (g && g->va == unmap->gpu_start)
+		dd_forget_va(g->va, g->len);
+	dd_emit(DD_NV_GPU_UNMAP, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(unmap->data3), dd_handle(unmap->data1),
+			dd_handle(unmap->data2), dd_handle(unmap->data3), NULL, 0);
+}
+
+static void dd_nv_gpu_unmap2(struct mmt_nvidia_gpu_unmap2 *unmap, void *state)
+{
+	struct dd_gpu_map *g = dd_find_va(unmap->gpu_start);
+	if (g && g->va == unmap->gpu_start)
+		dd_forget_va(g->va, g->len);
+	dd_emit(DD_NV_GPU_UNMAP, DD_STREAM(DD_STREAM_OBJ, 0), dd_handle(unmap->data3), dd_handle(unmap->data1),
+			dd_handle(unmap->data2), dd_handle(unmap->data3), NULL, 0);
+}
+
+static void dd_nv_call_method_data(struct mmt_nvidia_call_method_data *call, void *state)
+{
+	dd_emit(DD_NV_CALL_DATA, DD_STREAM(DD_STREAM_OBJ, 0), 0, call->cnt, 0, 0,
+			call->data.data, call->data.len);
+}
+
+static void dd_nv_ioctl_4d(struct mmt_nvidia_ioctl_4d *ctl, void *state)
+{
+	dd_emit(DD_NV_MARK, DD_STREAM(DD_STREAM_SYS, 0), 0, '4', 0, 0, ctl->str.data, ctl->str.len);
+}
+
+static void dd_nv_mmiotrace_mark(struct mmt_nvidia_mmiotrace_mark *mark, void *state)
+{
+	dd_emit(DD_NV_MARK, DD_STREAM(DD_STREAM_SYS, 0), 0, 'k', 0, 0, mark->str.data, mark->str.len);
+}
+
+static void dd_nouveau_gem_pushbuf_data(struct mmt_nouveau_pushbuf_data *data, void *state)
+{
+	struct dd_mapping m;
+	memset(&m, 0, sizeof(m));
+	m.last_off = -1;
+	memcpy(dd_scratch, data->data.data, data->data.len);
+	dd_normalize_written_va(&m, 0, dd_scratch, data->data.len);
+	dd_emit(DD_PUSHBUF_DATA, DD_STREAM(DD_STREAM_PUSHBUF, 0), 0, 0, 0, 0,
+			dd_scratch, data->data.len);
+}
+
+static const struct mmt_nvidia_decode_funcs dd_funcs =
+{
+	{ dd_memread, dd_memwrite, dd_mmap, dd_mmap2, dd_munmap, dd_mremap,
+	  dd_open, dd_msg, dd_write_syscall, dd_dup_syscall, NULL,
+	  dd_ioctl_pre_v2, dd_ioctl_post_v2, dd_memread2, dd_memwrite2 },
+	dd_nv_create_object,
+	dd_nv_destroy_object,
+	dd_ioctl_pre,
+	dd_ioctl_post,
+	dd_nv_memory_dump,
+	dd_nv_call_method,
+	NULL,
+	NULL,
+	NULL,
+	dd_nv_gpu_map,
+	dd_nv_gpu_map2,
+	dd_nv_gpu_unmap,
+	dd_nv_gpu_unmap2,
+	dd_nv_mmap,
+	dd_nv_mmap2,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	dd_nv_call_method_data,
+	dd_nv_ioctl_4d,
+	dd_nv_mmiotrace_mark,
+	dd_nouveau_gem_pushbuf_data
+};
+
+static pid_t dd_spawn(const char *filename, FILE **in)
+{
+	int pipe_fds[2];
+	pid_t pid;
+
+	if (pipe(pipe_fds) < 0)
+	{
+		perror("pipe");
+		exit(2);
+	}
+
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		exit(2);
+	}
+
+	if (pid == 0)
+	{
+		close(pipe_fds[0]);
+		close(0);
+		if (open_input(filename) == NULL)
+		{
+			perror(filename);
+			exit(2);
+		}
+
+		dd_out = fdopen(pipe_fds[1], "w");
+		setvbuf(dd_out, NULL, _IOFBF, 1 << 20);
+		mmt_decode(&dd_funcs.base, NULL);
+		fflush(dd_out);
+		exit(0);
+	}
+
+	close(pipe_fds[1]);
+	*in = fdopen(pipe_fds[0], "r");
+	setvbuf(*in, NULL, _IOFBF, 1 << 20);
+	return pid;
+}
+
+/*
+ * Parent side: pair records per stream.
+ */
+
+struct dd_chain;
+
+struct dd_entry
+{
+	/* all queued records of one side, oldest first */
+	struct dd_entry *prev, *next;
+	/* queued records of one side with the same pairing key */
+	struct dd_entry *knext;
+	struct dd_chain *chain;
+	int stream;
+	uint64_t order;
+	uint64_t seq;
+	struct dd_rec rec;
+	uint8_t data[0];
+};
+
+/* records waiting for a partner, by stream, kind and key */
+struct dd_chain
+{
+	uint32_t stream;
+	uint32_t kind;
+	uint64_t key;
+	struct dd_entry *head[2], *tail[2];
+};
+
+struct dd_stream
+{
+	uint32_t id;
+	uint64_t seq[2];
+};
+
+static struct dd_stream *streams;
+static int streamsnum, streamsmax;
+static struct dd_map stream_idx;
+
+static struct dd_chain **chains;
+static uint32_t chainssize, chainsused;
+
+static struct dd_entry *head[2], *tail[2];
+static size_t queued[2];
+static uint64_t order[2];
+static size_t budget = 64 << 20;
+static int quiet;
+static int max_diffs;
+
+static uint64_t compared, differing, unpaired[2];
+
+static void dd_stream_name(uint32_t id, char *buf, size_t len)
+{
+	uint32_t cls = DD_STREAM_CLASS(id), idx = DD_STREAM_IDX(id);
+	if (cls == DD_STREAM_IOCTL || cls == DD_STREAM_MEM)
+	{
+		if (idx == DD_UNKNOWN)
+			snprintf(buf, len, "%s/?", dd_stream_names[cls]);
+		else
+			snprintf(buf, len, "%s/%u", dd_stream_names[cls], idx);
+	}
+	else
+		snprintf(buf, len, "%s", dd_stream_names[cls]);
+}
+
+static void dd_print_rec(char pfx, const struct dd_rec *r, const uint8_t *data, uint32_t word)
+{
+	uint32_t i;
+	printf("%c %s", pfx, dd_kind_names[r->kind]);
+
+	switch (r->kind)
+	{
+		case DD_MSG:
+		case DD_OPEN:
+		case DD_NV_MARK:
+			if (r->kind == DD_OPEN)
+				printf(" flags 0x%" PRIx64 ", mode 0x%" PRIx64 ", ret %" PRId64 ",", r->a, r->b, r->c);
+			printf(" \"");
+			for (i = 0; i < r->len && data[i]; ++i)
+				putchar(data[i] >= 0x20 && data[i] < 0x7f ? data[i] : '?');
+			printf("\"\n");
+			return;
+		case DD_IOCTL_PRE:
+		case DD_IOCTL_POST:
+			printf(" 0x%08" PRIx64, r->a);
+			if (r->b || r->c)
+				printf(", ret 0x%" PRIx64 ", err 0x%" PRIx64, r->b, r->c);
+			break;
+		case DD_MEMREAD:
+		case DD_MEMWRITE:
+			printf(" 0x%" PRIx64, r->a);
+			break;
+		default:
+			printf(" 0x%" PRIx64 " 0x%" PRIx64 " 0x%" PRIx64, r->a, r->b, r->c);
+			break;
+	}
+
+	printf(", %u bytes", r->len);
+	if (r->len >= 4)
+	{
+		uint32_t first = word != -1 && word > 2 ? word - 2 : 0;
+		uint32_t last = min(r->len / 4, first + 8);
+		printf(":%s", first ? " ..." : "");
+		for (i = first; i < last; ++i)
+			printf(i == word ? " [0x%08x]" : " 0x%08x", ((uint32_t *)data)[i]);
+		if (last < r->len / 4)
+			printf(" ...");
+	}
+	else
+		for (i = 0; i < r->len; ++i)
+			printf(" %02x", data[i]);
+	printf("\n");
+}
+
+static int dd_same(const struct dd_entry *a, const struct dd_entry *b, uint32_t *word)
+{
+	uint32_t i, len;
+	*word = 0;
+	if (a->rec.kind != b->rec.kind || a->rec.a != b->rec.a ||
+			a->rec.b != b->rec.b || a->rec.c != b->rec.c)
+		return 0;
+
+	len = min(a->rec.len, b->rec.len);
+	for (i = 0; i < len; ++i)
+		if (a->data[i] != b->data[i])
+		{
+			*word = i / 4;
+			return 0;
+		}
+
+	*word = len / 4;
+	return a->rec.len == b->rec.len;
+}
+
+static void dd_check_limit(void)
+{
+	if (max_diffs && differing + unpaired[0] + unpaired[1] >= max_diffs)
+	{
+		fflush(stdout);
+		fprintf(stderr, "demmt-diff: stopping after %d differences\n", max_diffs);
+		exit(1);
+	}
+}
+
+static void dd_report_pair(int stream, struct dd_entry *a, struct dd_entry *b)
+{
+	uint32_t word;
+	compared++;
+	if (dd_same(a, b, &word))
+		return;
+
+	differing++;
+	if (!quiet)
+	{
+		char name[32];
+		dd_stream_name(streams[stream].id, name, sizeof(name));
+		printf("@@ %s #%" PRIu64 " / #%" PRIu64 "\n", name, a->seq, b->seq);
+		dd_print_rec('-', &a->rec, a->data, word);
+		dd_print_rec('+', &b->rec, b->data, word);
+	}
+	dd_check_limit();
+}
+
+static void dd_report_unpaired(int side, int stream, struct dd_entry *e)
+{
+	unpaired[side]++;
+	if (!quiet)
+	{
+		char name[32];
+		dd_stream_name(streams[stream].id, name, sizeof(name));
+		printf("@@ %s #%" PRIu64 " only in %s trace\n", name, e->seq, side ? "second" : "first");
+		dd_print_rec(side ? '+' : '-', &e->rec, e->data, -1);
+	}
+	dd_check_limit();
+}
+
+static uint32_t dd_chain_hash(uint32_t stream, uint32_t kind, uint64_t key)
+{
+	return dd_map_hash(key * 0x9e3779b97f4a7c15ull ^ ((uint64_t)stream << 8 | kind));
+}
+
+static struct dd_chain **dd_chain_slot(uint32_t stream, uint32_t kind, uint64_t key)
+{
+	uint32_t i = dd_chain_hash(stream, kind, key) & (chainssize - 1);
+	for (; chains[i]; i = (i + 1) & (chainssize - 1))
+		if (chains[i]->stream == stream && chains[i]->kind == kind && chains[i]->key == key)
+			break;
+	return &chains[i];
+}
+
+static struct dd_chain *dd_chain_get(uint32_t stream, uint32_t kind, uint64_t key)
+{
+	struct dd_chain **slot;
+	if (2 * (chainsused + 1) > chainssize)
+	{
+		struct dd_chain **old = chains;
+		uint32_t i, oldsize = chainssize;
+		chainssize = chainssize ? chainssize * 2 : 1024;
+		chains = calloc(chainssize, sizeof(*chains));
+		for (i = 0; i < oldsize; ++i)
+			if (old[i])
+				*dd_chain_slot(old[i]->stream, old[i]->kind, old[i]->key) = old[i];
+		free(old);
+	}
+
+	slot = dd_chain_slot(stream, kind, key);
+	if (!*slot)
+	{
+		*slot = calloc(1, sizeof(**slot));
+		(*slot)->stream = stream;
+		(*slot)->kind = kind;
+		(*slot)->key = key;
+		chainsused++;
+	}
+	return *slot;
+}
+
+/* Free a chain with nothing queued, moving later entries of its cluster back. */
+static void dd_chain_put(struct dd_chain *c)
+{
+	uint32_t i, j, h;
+	if (c->head[0] || c->head[1])
+		return;
+
+	i = dd_chain_slot(c->stream, c->kind, c->key) - chains;
+	free(c);
+	chains[i] = NULL;
+	chainsused--;
+	for (j = (i + 1) & (chainssize - 1); chains[j]; j = (j + 1) & (chainssize - 1))
+	{
+		h = dd_chain_hash(chains[j]->stream, chains[j]->kind, chains[j]->key) & (chainssize - 1);
+		if (((j - h) & (chainssize - 1)) >= ((j - i) & (chainssize - 1)))
+		{
+			chains[i] = chains[j];
+			chains[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+static void dd_queue(int side, struct dd_entry *e)
+{
+	struct dd_chain *c = e->chain;
+	e->prev = tail[side];
+	e->next = NULL;
+	if (tail[side])
+		tail[side]->next = e;
+	else
+		head[side] = e;
+	tail[side] = e;
+
+	e->knext = NULL;
+	if (c->tail[side])
+		c->tail[side]->knext = e;
+	else
+		c->head[side] = e;
+	c->tail[side] = e;
+	queued[side] += sizeof(*e) + e->rec.len;
+}
+
+/* Take a queued record out, kprev being its predecessor on its chain. */
+static void dd_unqueue(int side, struct dd_entry *e, struct dd_entry *kprev)
+{
+	struct dd_chain *c = e->chain;
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		head[side] = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		tail[side] = e->prev;
+
+	if (kprev)
+		kprev->knext = e->knext;
+	else
+		c->head[side] = e->knext;
+	if (c->tail[side] == e)
+		c->tail[side] = kprev;
+	queued[side] -= sizeof(*e) + e->rec.len;
+}
+
+/*
+ * Drop the oldest queued record of one side.  It gets paired with the
+ * oldest record of the other side under the same key if there is one, and
+ * reported as unpaired otherwise.
+ */
+static int dd_drop_oldest(int side)
+{
+	struct dd_entry *e = head[side], *other;
+	struct dd_chain *c;
+	if (!e)
+		return 0;
+
+	c = e->chain;
+	dd_unqueue(side, e, NULL);
+	other = c->head[!side];
+	if (other)
+	{
+		dd_unqueue(!side, other, NULL);
+		if (side)
+			dd_report_pair(e->stream, other, e);
+		else
+			dd_report_pair(e->stream, e, other);
+		free(other);
+	}
+	else
+		dd_report_unpaired(side, e->stream, e);
+	free(e);
+	dd_chain_put(c);
+	return 1;
+}
+
+static int dd_read(FILE *in, int side)
+{
+	struct dd_rec r;
+	struct dd_entry *e, *other, *kprev = NULL;
+	uint32_t word;
+	int idx, n;
+
+	if (fread(&r, sizeof(r), 1, in) != 1)
+		return 0;
+
+	e = malloc(sizeof(*e) + r.len);
+	e->rec = r;
+	e->order = order[side]++;
+	if (r.len && fread(e->data, 1, r.len, in) != r.len)
+	{
+		fprintf(stderr, "demmt-diff: truncated record stream\n");
+		exit(2);
+	}
+
+	idx = dd_map_get(&stream_idx, r.stream);
+	if (idx < 0)
+	{
+		struct dd_stream s;
+		memset(&s, 0, sizeof(s));
+		s.id = r.stream;
+		ADDARRAY(streams, s);
+		idx = streamsnum - 1;
+		dd_map_set(&stream_idx, r.stream, idx);
+	}
+	e->stream = idx;
+	e->seq = streams[idx].seq[side]++;
+	e->chain = dd_chain_get(r.stream, r.kind, r.key);
+
+	/* an identical record waiting on the other side is the partner */
+	for (other = e->chain->head[!side], n = 0; other && n < DD_SCAN_MAX;
+			kprev = other, other = other->knext, ++n)
+		if (dd_same(other, e, &word))
+		{
+			dd_unqueue(!side, other, kprev);
+			compared++;
+			dd_chain_put(e->chain);
+			free(other);
+			free(e);
+			return 1;
+		}
+
+	dd_queue(side, e);
+	return 1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: demmt-diff [OPTION]... TRACE1 TRACE2\n"
+			"Semantic comparison of two MMT binary traces.\n"
+			"\n"
+			"  -r\t\tcompare memory reads too\n"
+			"  -m MB\t\tmemory budget for records waiting for a match (default 64)\n"
+			"  -n NUM\tstop after NUM differences\n"
+			"  -q\t\tonly print the summary\n"
+			"\n"
+			"Exit status is 0 if traces match, 1 if they differ, 2 on error.\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in[2];
+	pid_t pid[2];
+	int eof[2] = { 0, 0 };
+	int c, i, status, ret = 0;
+
+	while ((c = getopt(argc, argv, "rm:n:qh")) != -1)
+	{
+		switch (c)
+		{
+			case 'r':
+				dd_dump_reads = 1;
+				break;
+			case 'm':
+				budget = strtoull(optarg, NULL, 0) << 20;
+				break;
+			case 'n':
+				max_diffs = strtol(optarg, NULL, 0);
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (argc - optind != 2)
+		usage();
+
+	signal(SIGPIPE, SIG_IGN);
+	pid[0] = dd_spawn(argv[optind], &in[0]);
+	pid[1] = dd_spawn(argv[optind + 1], &in[1]);
+
+	while (!eof[0] || !eof[1])
+	{
+		int side;
+		if (eof[0])
+			side = 1;
+		else if (eof[1])
+			side = 0;
+		else
+			side = queued[0] > queued[1];
+
+		if (!dd_read(in[side], side))
+		{
+			eof[side] = 1;
+			continue;
+		}
+
+		while (queued[side] > budget && (eof[!side] || queued[!side] > budget))
+			if (!dd_drop_oldest(side))
+				break;
+	}
+
+	for (i = 0; i < 2; ++i)
+		while (dd_drop_oldest(i))
+			;
+
+	for (i = 0; i < 2; ++i)
+	{
+		fclose(in[i]);
+		if (waitpid(pid[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			fprintf(stderr, "demmt-diff: decoding of %s failed\n", argv[optind + i]);
+			ret = 2;
+		}
+	}
+
+	fflush(stdout);
+	fprintf(stderr, "%" PRIu64 " records paired, %" PRIu64 " differ, %" PRIu64
+			" only in first trace, %" PRIu64 " only in second trace\n",
+			compared, differing, unpaired[0], unpaired[1]);
+
+	if (ret)
+		return ret;
+	return differing || unpaired[0] || unpaired[1];
+}
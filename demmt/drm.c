@@ -30,10 +30,12 @@
 #include <string.h>
 
 #include "buffer.h"
+#include "chanq.h"
 #include "config.h"
 #include "decode_utils.h"
 #include "drm.h"
 #include "log.h"
+#include "memstat.h"
 #include "nvrm.h"
 #include "nvrm_object.xml.h"
 #include "pushbuf.h"
@@ -183,6 +185,8 @@ void demmt_nouveau_gem_pushbuf_data(struct mmt_nouveau_pushbuf_data *data, void
 {
 	// compat code, mmt does not generate mmt_nouveau_pushbuf_data message anymore
 
+	chanq_sync();
+
 	int minlen = sizeof(struct mmt_buf *);
 	if (data->data.len < minlen)
 	{
@@ -526,6 +530,7 @@ static void drm_nouveau_gem_new(uint32_t fd, uint32_t cid, uint32_t parent, stru
 	obj->length = info->size;
 	obj->data = realloc(obj->data, obj->length);
 	memset(obj->data, 0, obj->length);
+	memstat_add(MEMSTAT_GPU_OBJECTS, obj->length);
 
 	struct gpu_mapping *gmapping = calloc(sizeof(struct gpu_mapping), 1);
 	gmapping->fd = fd;
@@ -10,14 +10,17 @@
 extern int indent_logs;
 extern int mmt_sync_fd;
 
-#define fflush_stdout(fmt)         do { if (mmt_sync_fd != -1 && fmt[strlen(fmt) - 1] == '\n') fflush(stdout); } while (0)
-#define mmt_debug(fmt, ...)        do { if (MMT_DEBUG) { fprintf(stdout, "DBG: " fmt, __VA_ARGS__); fflush_stdout(fmt); } } while (0)
-#define mmt_debug_cont(fmt, ...)   do { if (MMT_DEBUG) { fprintf(stdout, fmt, __VA_ARGS__); fflush_stdout(fmt); } } while (0)
-#define mmt_printf(fmt, ...)       do { fprintf(stdout, fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
-#define mmt_log(fmt, ...)          do { if (indent_logs) fprintf(stdout, "%64s" fmt, " ", __VA_ARGS__); else fprintf(stdout, "LOG: " fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
-#define mmt_log_cont(fmt, ...)     do { fprintf(stdout, fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
-#define mmt_log_cont_nl()          do { fprintf(stdout, "\n"); fflush_stdout("\n"); } while (0)
-#define mmt_error(fmt, ...)        do { fprintf(stdout, "ERROR: " fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
+/* stream all decoded output goes to; per thread, see chanq.h */
+extern __thread FILE *mmt_out;
+
+#define fflush_stdout(fmt)         do { if (mmt_sync_fd != -1 && fmt[strlen(fmt) - 1] == '\n') fflush(mmt_out); } while (0)
+#define mmt_debug(fmt, ...)        do { if (MMT_DEBUG) { fprintf(mmt_out, "DBG: " fmt, __VA_ARGS__); fflush_stdout(fmt); } } while (0)
+#define mmt_debug_cont(fmt, ...)   do { if (MMT_DEBUG) { fprintf(mmt_out, fmt, __VA_ARGS__); fflush_stdout(fmt); } } while (0)
+#define mmt_printf(fmt, ...)       do { fprintf(mmt_out, fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
+#define mmt_log(fmt, ...)          do { if (indent_logs) fprintf(mmt_out, "%64s" fmt, " ", __VA_ARGS__); else fprintf(mmt_out, "LOG: " fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
+#define mmt_log_cont(fmt, ...)     do { fprintf(mmt_out, fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
+#define mmt_log_cont_nl()          do { fprintf(mmt_out, "\n"); fflush_stdout("\n"); } while (0)
+#define mmt_error(fmt, ...)        do { fprintf(mmt_out, "ERROR: " fmt, __VA_ARGS__); fflush_stdout(fmt); } while (0)
 
 #define _print_x64(pfx, strct, field)	mmt_log_cont("%s" #field ": 0x%016" PRIx64, pfx, (strct)->field)
 #define _print_x32(pfx, strct, field)	mmt_log_cont("%s" #field ": 0x%08"  PRIx32, pfx, (strct)->field)
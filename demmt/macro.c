@@ -462,7 +462,7 @@ static void register_method_call(struct macro_interpreter_state *istate, uint32_
 	struct obj *obj = istate->obj;
 
 	if (istate->mthd < OBJECT_SIZE)
-		obj->data[istate->mthd / 4] = res;
+		obj_set_method_value(obj, istate->mthd, res);
 	else
 		mmt_printf("method 0x%x >= 0x%x\n", istate->mthd, OBJECT_SIZE);
 
@@ -1116,7 +1116,7 @@ static void macro_sim(struct macro_interpreter_state *istate)
 				print_aligned(outs);
 
 			uint32_t mthd = (imm(c) & 0xfff) << 2;
-			uint32_t mthd_data =  obj->data[mthd / 4];
+			uint32_t mthd_data = obj_method_value(obj, mthd);
 			regs[reg1(c)] = mthd_data;
 
 			decode_method_raw(mthd, mthd_data, obj, dec_obj, dec_mthd, dec_val);
@@ -1139,7 +1139,7 @@ static void macro_sim(struct macro_interpreter_state *istate)
 			uint32_t val = regs[reg2(c)] + imm(c);
 
 			uint32_t mthd = (val & 0xfff) << 2;
-			uint32_t mthd_data =  obj->data[mthd / 4];
+			uint32_t mthd_data = obj_method_value(obj, mthd);
 			regs[reg1(c)] = mthd_data;
 
 			decode_method_raw(mthd, mthd_data, obj, dec_obj, dec_mthd, dec_val);
@@ -1323,7 +1323,7 @@ int decode_macro(struct pushbuf_decode_state *pstate, struct macro_state *macro)
 				{
 					struct varinfo *var = varinfo_new(isa_macro->vardata);
 
-					envydis(isa_macro, stdout, (void *)(macro->code + macro->last_code_pos / 4), 0,
+					envydis(isa_macro, mmt_out, (void *)(macro->code + macro->last_code_pos / 4), 0,
 							(macro->cur_code_pos - macro->last_code_pos) / 4,
 							var, 0, NULL, 0, colors);
 					varinfo_del(var);
@@ -1373,7 +1373,7 @@ int decode_macro(struct pushbuf_decode_state *pstate, struct macro_state *macro)
 			{
 				struct varinfo *var = varinfo_new(isa_macro->vardata);
 
-				envydis(isa_macro, stdout, (uint8_t *)macro->istate.code, 0,
+				envydis(isa_macro, mmt_out, (uint8_t *)macro->istate.code, 0,
 						macro->istate.words, var, 0, NULL, 0, colors);
 				varinfo_del(var);
 
@@ -35,11 +35,14 @@
 #include "mmt_bin_decode.h"
 #include "mmt_bin_decode_nvidia.h"
 #include "buffer.h"
+#include "chanq.h"
 #include "config.h"
 #include "demmt.h"
+#include "dis.h"
 #include "drm.h"
 #include "fglrx.h"
 #include "macro.h"
+#include "memstat.h"
 #include "nvrm.h"
 #include "object_state.h"
 #include "util.h"
@@ -58,6 +61,7 @@ struct rnndomain *gk104_cp_header_domain;
 
 const struct envy_colors *colors = NULL;
 int mmt_sync_fd = -1;
+__thread FILE *mmt_out;
 
 static void demmt_memread(struct mmt_read *w, void *state)
 {
@@ -101,6 +105,18 @@ static void demmt_memread(struct mmt_read *w, void *state)
 
 static void demmt_memwrite(struct mmt_write *w, void *state)
 {
+	if (chanq_enabled)
+	{
+		/*
+		 * Object decoders of queued submissions read gpu buffers as they
+		 * are now, only the IB ring and queued pushbuffer bytes are safe.
+		 */
+		struct cpu_mapping *mapping = get_cpu_mapping(w->id);
+		if (!mapping || !(mapping->ib.is || (mapping->object &&
+				chanq_queued(mapping->object, mapping->object_offset + w->offset, w->len))))
+			chanq_sync();
+	}
+
 	buffer_register_mmt_write(w);
 }
 
@@ -263,6 +279,8 @@ static void demmt_mmap2(struct mmt_mmap2 *mm, void *state)
 
 static void demmt_munmap(struct mmt_unmap *mm, void *state)
 {
+	chanq_sync();
+
 	if (get_cpu_mapping(mm->id) == NULL)
 	{
 		mmt_error("invalid buffer id: %d\n", mm->id);
@@ -278,6 +296,8 @@ static void demmt_munmap(struct mmt_unmap *mm, void *state)
 
 static void demmt_mremap(struct mmt_mremap *mm, void *state)
 {
+	chanq_sync();
+
 	if (get_cpu_mapping(mm->id) == NULL)
 	{
 		mmt_error("invalid buffer id: %d\n", mm->id);
@@ -317,6 +337,8 @@ enum mmt_fd_type demmt_get_fdtype(int fd)
 
 static void demmt_open(struct mmt_open *o, void *state)
 {
+	chanq_sync();
+
 	if (o->ret < MAX_FD)
 	{
 		struct open_file *f = &open_files[o->ret];
@@ -342,7 +364,7 @@ static void demmt_msg(uint8_t *data, unsigned int len, void *state)
 	if (dump_msg)
 	{
 		mmt_log("MSG: %s", "");
-		fwrite(data, 1, len, stdout);
+		fwrite(data, 1, len, mmt_out);
 		mmt_log_cont_nl();
 	}
 }
@@ -350,11 +372,13 @@ static void demmt_msg(uint8_t *data, unsigned int len, void *state)
 static void demmt_write_syscall(struct mmt_write_syscall *o, void *state)
 {
 	if (dump_sys_write)
-		fwrite(o->data.data, 1, o->data.len, stdout);
+		fwrite(o->data.data, 1, o->data.len, mmt_out);
 }
 
 static void demmt_dup_syscall(struct mmt_dup_syscall *o, void *state)
 {
+	chanq_sync();
+
 	if (o->newfd < MAX_FD && o->oldfd < MAX_FD)
 	{
 		open_files[o->newfd].path = open_files[o->oldfd].path;
@@ -367,6 +391,9 @@ static void demmt_dup_syscall(struct mmt_dup_syscall *o, void *state)
 
 static void demmt_sync(struct mmt_sync *o, void *state)
 {
+	chanq_sync();
+	memstat_check();
+
 	if (mmt_sync_fd == -1)
 		return;
 
@@ -412,6 +439,8 @@ static void __demmt_ioctl_pre(uint32_t fd, uint32_t id, struct mmt_buf *data, vo
 	decode_ioctl_id(id, &dir, &type, &nr, &size);
 	int print_raw = 1;
 
+	chanq_sync();
+
 	enum mmt_fd_type fdtype = demmt_get_fdtype(fd);
 
 	if (fdtype == FDUNK)
@@ -453,6 +482,8 @@ static void __demmt_ioctl_post(uint32_t fd, uint32_t id, struct mmt_buf *data,
 	decode_ioctl_id(id, &dir, &type, &nr, &size);
 	int print_raw = 0;
 
+	chanq_sync();
+
 	enum mmt_fd_type fdtype = demmt_get_fdtype(fd);
 
 	if (fdtype == FDDRM)
@@ -479,6 +510,8 @@ static void __demmt_ioctl_post(uint32_t fd, uint32_t id, struct mmt_buf *data,
 		ioctl_data_print(data);
 		mmt_log_cont_nl();
 	}
+
+	memstat_check();
 }
 
 void demmt_ioctl_pre(struct mmt_ioctl_pre *ctl, void *state, struct mmt_memory_dump *args, int argc)
@@ -543,8 +576,13 @@ uint64_t roundup_to_pagesize(uint64_t sz)
 
 int main(int argc, char *argv[])
 {
+	mmt_out = stdout;
+
 	char *filename = read_opts(argc, argv);
 
+	/* shaders and macros get disassembled over and over */
+	envydis_memo(1);
+
 	/* set up an rnn context */
 	rnn_init();
 	rnndb = rnn_newdb();
@@ -645,6 +683,10 @@ int main(int argc, char *argv[])
 		close(pipe_fds[1]);
 	}
 
+	/* threads have to be started before the sandbox is set up */
+	if (decode_jobs > 1 && mmt_sync_fd == -1)
+		chanq_init(decode_jobs);
+
 #ifdef LIBSECCOMP_AVAILABLE
 	if (seccomp_level)
 	{
@@ -707,6 +749,27 @@ int main(int argc, char *argv[])
 		if (rc != 0)
 			exit(1);
 
+		if (chanq_enabled)
+		{
+			/* apply the filter to decode threads too */
+			rc = seccomp_attr_set(ctx, SCMP_FLTATR_CTL_TSYNC, 1);
+			if (rc != 0)
+				exit(1);
+
+			rc = seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(futex), 0);
+			if (rc != 0)
+				exit(1);
+
+			/* malloc arenas of non-main threads */
+			rc = seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(mprotect), 0);
+			if (rc != 0)
+				exit(1);
+
+			rc = seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(madvise), 0);
+			if (rc != 0)
+				exit(1);
+		}
+
 		rc = seccomp_load(ctx);
 		if (rc != 0)
 		{
@@ -719,7 +782,10 @@ int main(int argc, char *argv[])
 #endif
 
 	mmt_decode(&demmt_funcs.base, NULL);
+	chanq_sync();
 	fflush(stdout);
+	if (memory_budget)
+		memstat_report();
 
 	fini_macrodis();
 	demmt_cleanup_isas();
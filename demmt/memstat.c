@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "memstat.h"
+#include "pushbuf.h"
+
+int64_t memstat_bytes[MEMSTAT_NR];
+
+static const char * const memstat_names[MEMSTAT_NR] =
+{
+	[MEMSTAT_CPU_MAPPINGS]  = "cpu mappings",
+	[MEMSTAT_GPU_OBJECTS]   = "gpu objects",
+	[MEMSTAT_REGIONS]       = "regions",
+	[MEMSTAT_METHOD_STATE]  = "method state",
+	[MEMSTAT_DECODE_CACHES] = "decode caches",
+};
+
+uint64_t memstat_total(void)
+{
+	int64_t total = 0;
+	int i;
+	for (i = 0; i < MEMSTAT_NR; ++i)
+		total += memstat_bytes[i];
+	return total > 0 ? total : 0;
+}
+
+void memstat_report(void)
+{
+	uint64_t total = memstat_total();
+	int i;
+
+	fflush(stdout);
+	fprintf(stderr, "demmt: memory:");
+	for (i = 0; i < MEMSTAT_NR; ++i)
+		fprintf(stderr, " %s %" PRId64 " KiB,", memstat_names[i], memstat_bytes[i] >> 10);
+	fprintf(stderr, " total %" PRIu64 " KiB", total >> 10);
+	if (memory_budget)
+		fprintf(stderr, " (budget %" PRIu64 " KiB%s)", memory_budget >> 10,
+				total > memory_budget ? ", exceeded" : "");
+	fprintf(stderr, "\n");
+}
+
+/*
+ * Called between messages, when no decoder holds pointers into evictable
+ * state. Drops the coldest method decode caches until usage is back under
+ * 7/8 of the budget and prints a report whenever usage moved by more than
+ * 1/8 of the budget since the previous one.
+ */
+void memstat_check(void)
+{
+	static uint64_t last_reported;
+	uint64_t total, slack;
+
+	if (!memory_budget)
+		return;
+
+	slack = memory_budget / 8;
+	total = memstat_total();
+	if (total > memory_budget)
+	{
+		pushbuf_evict_caches(total - memory_budget + slack);
+		total = memstat_total();
+	}
+
+	if (total > last_reported + slack || total + slack < last_reported)
+	{
+		memstat_report();
+		last_reported = total;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef DEMMT_MEMSTAT_H
+#define DEMMT_MEMSTAT_H
+
+#include <stdint.h>
+
+/*
+ * Per-subsystem accounting of memory held by the decoder state.
+ * Counters are updated wherever the corresponding buffers are allocated
+ * or freed and are checked against memory_budget (-M) at safe points.
+ */
+enum memstat_subsys
+{
+	MEMSTAT_CPU_MAPPINGS,	/* shadows of mappings not backed by gpu objects */
+	MEMSTAT_GPU_OBJECTS,	/* gpu object contents */
+	MEMSTAT_REGIONS,	/* written regions lists */
+	MEMSTAT_METHOD_STATE,	/* fifo states and per-object method values */
+	MEMSTAT_DECODE_CACHES,	/* rnndec method name caches */
+	MEMSTAT_NR
+};
+
+extern int64_t memstat_bytes[MEMSTAT_NR];
+
+static inline void memstat_add(enum memstat_subsys s, int64_t bytes)
+{
+	/* may be called from decode threads, see chanq.h */
+	__atomic_add_fetch(&memstat_bytes[s], bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t memstat_total(void);
+void memstat_report(void);
+void memstat_check(void);
+
+#endif
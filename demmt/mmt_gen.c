@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VA LINUX SYSTEMS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * mmt_gen writes a synthetic, deterministic MMT binary trace of a blob
+ * client: nvrm object setup, memory objects mapped to gpu and cpu, IB
+ * channels with 3D/2D/M2MF/compute objects, and a stream of pushbuffer
+ * submissions with macros and shaders. Used to benchmark demmt.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmt_bin_decode.h"
+#include "nvrm_create.h"
+#include "nvrm_ioctl.h"
+#include "nvrm_mthd.h"
+#include "nvrm_object.xml.h"
+
+#define FD_CTL 3
+#define FD_DEV 4
+
+#define H_CLIENT  0xc1d00001
+#define H_DEVICE  0xcaf00002
+#define H_SUBDEV  0xcaf00003
+#define H_FIFO    0xcaf00010	/* + channel * H_CHAN */
+#define H_OBJ     0xcaf00020	/* + channel * H_CHAN + subchannel */
+#define H_CHAN    0x100
+#define H_MEM     0xbeef0000	/* + buffer index */
+#define H_CHURN   0xdead0000	/* + churn counter */
+
+#define PB_SIZE   0x40000
+#define IB_SIZE   0x1000
+#define CODE_SIZE 0x10000
+#define DATA_SIZE 0x10000
+#define SHADER_STRIDE 0x800
+
+#define SUBC_3D 0
+#define SUBC_2D 1
+#define SUBC_M2MF 2
+#define SUBC_COMPUTE 3
+#define SUBC_CHURN 5
+
+struct gen_chip
+{
+	int chipset;
+	uint32_t fifo, cls[4];
+	uint32_t mthd_fifo_info;
+};
+
+static const struct gen_chip gen_chips[] =
+{
+	{ 0x50, NVRM_FIFO_IB_G80,   { 0x5097, 0x502d, 0x5039, 0x50c0 }, 0 },
+	{ 0xc0, NVRM_FIFO_IB_GF100, { 0x9097, 0x902d, 0x9039, 0x90c0 }, NVRM_MTHD_FIFO_IB_OBJECT_INFO },
+	{ 0xe4, NVRM_FIFO_IB_GK104, { 0xa097, 0x902d, 0xa040, 0xa0c0 }, NVRM_MTHD_FIFO_IB_OBJECT_INFO2 },
+};
+
+struct gen_buffer
+{
+	uint32_t handle;
+	uint32_t map_id;
+	uint64_t gpu_addr;
+	uint64_t cpu_addr;
+	uint64_t foffset;
+	uint32_t size;
+};
+
+struct gen_channel
+{
+	uint32_t fifo;
+	struct gen_buffer pb, ib, code;
+	uint32_t pb_pos, ib_pos;
+};
+
+static const struct gen_chip *chip;
+static FILE *out;
+static uint64_t msgs, methods_total;
+static uint32_t next_map_id = 1;
+static uint64_t next_gpu_addr = 0x20000000;
+static uint64_t next_cpu_addr = 0x7f0000000000;
+static uint64_t next_foffset = 0x10000000;
+static uint64_t next_ptr = 0x7ffd00000000;
+static uint64_t rnd_state = 0x2545f4914f6cdd1d;
+
+static uint32_t *cmds;
+static int cmdsnum, cmdsmax;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state >> 16;
+}
+
+static void emit(const void *data, size_t len)
+{
+	fwrite(data, 1, len, out);
+}
+
+static void eor(void)
+{
+	fputc(10, out);
+	msgs++;
+}
+
+static void gen_open(const char *path, uint32_t fd)
+{
+	struct mmt_open o = { { 'o' }, O_RDWR, 0, fd, { strlen(path) + 1 } };
+	emit(&o, sizeof(o));
+	emit(path, o.path.len);
+	eor();
+}
+
+static void gen_dump(uint64_t addr, const void *data, uint32_t len)
+{
+	struct mmt_memory_dump_v2_prefix d = { { 'y' }, addr };
+	emit(&d, sizeof(d));
+	emit(&len, 4);
+	emit(data, len);
+	eor();
+}
+
+/* ioctl pre + post, with optional argument memory dumped on both sides */
+static void gen_ioctl(uint32_t id, void *data, uint32_t len,
+		uint64_t arg_addr, const void *arg, uint32_t arg_len)
+{
+	struct mmt_ioctl_pre_v2 pre = { { 'i' }, FD_CTL, id, { len } };
+	struct mmt_ioctl_post_v2 post = { { 'j' }, FD_CTL, id, 0, 0, { len } };
+
+	emit(&pre, sizeof(pre));
+	emit(data, len);
+	eor();
+	if (arg)
+		gen_dump(arg_addr, arg, arg_len);
+
+	emit(&post, sizeof(post));
+	emit(data, len);
+	eor();
+	if (arg)
+		gen_dump(arg_addr, arg, arg_len);
+}
+
+static void gen_create(uint32_t parent, uint32_t handle, uint32_t cls,
+		const void *arg, uint32_t arg_len)
+{
+	struct nvrm_ioctl_create c = { H_CLIENT, parent, handle, cls, arg ? next_ptr : 0, NVRM_STATUS_SUCCESS, 0 };
+	gen_ioctl(NVRM_IOCTL_CREATE, &c, sizeof(c), next_ptr, arg, arg_len);
+	next_ptr += 0x100;
+}
+
+static void gen_call(uint32_t handle, uint32_t mthd, const void *arg, uint32_t arg_len)
+{
+	struct nvrm_ioctl_call c = { H_CLIENT, handle, mthd, 0, next_ptr, arg_len, NVRM_STATUS_SUCCESS };
+	gen_ioctl(NVRM_IOCTL_CALL, &c, sizeof(c), next_ptr, arg, arg_len);
+	next_ptr += 0x100;
+}
+
+static void gen_destroy(uint32_t parent, uint32_t handle)
+{
+	struct nvrm_ioctl_destroy d = { H_CLIENT, parent, handle, NVRM_STATUS_SUCCESS };
+	gen_ioctl(NVRM_IOCTL_DESTROY, &d, sizeof(d), 0, NULL, 0);
+}
+
+static void gen_write32(struct gen_buffer *b, uint32_t offset, uint32_t val)
+{
+	struct mmt_write w = { { 'w' }, b->map_id, offset, 4 };
+	emit(&w, sizeof(w));
+	emit(&val, 4);
+	eor();
+}
+
+/* memory object, mapped into the gpu address space and mmapped by the cpu */
+static void gen_buffer(struct gen_buffer *b, uint32_t handle, uint32_t size)
+{
+	struct nvrm_ioctl_memory m = { 0 };
+	struct nvrm_ioctl_vspace_map vm = { 0 };
+	struct nvrm_ioctl_host_map hm = { 0 };
+
+	b->handle = handle;
+	b->size = size;
+	b->gpu_addr = next_gpu_addr;
+	b->cpu_addr = next_cpu_addr;
+	b->foffset = next_foffset;
+	b->map_id = next_map_id++;
+	next_gpu_addr += (size + 0xfffff) & ~0xfffff;
+	next_cpu_addr += (size + 0xfffff) & ~0xfffff;
+	next_foffset += (size + 0xfffff) & ~0xfffff;
+
+	m.cid = H_CLIENT;
+	m.parent = H_DEVICE;
+	m.cls = NVRM_MEMORY_UNK0040;
+	m.handle = handle;
+	m.flags1 = NVRM_IOCTL_MEMORY_FLAGS1_USER_HANDLE;
+	m.size = size;
+	m.limit = size - 1;
+	gen_ioctl(NVRM_IOCTL_MEMORY, &m, sizeof(m), 0, NULL, 0);
+
+	vm.cid = H_CLIENT;
+	vm.dev = H_DEVICE;
+	vm.handle = handle;
+	vm.size = size;
+	vm.addr = b->gpu_addr;
+	gen_ioctl(NVRM_IOCTL_VSPACE_MAP, &vm, sizeof(vm), 0, NULL, 0);
+
+	hm.cid = H_CLIENT;
+	hm.subdev = H_SUBDEV;
+	hm.handle = handle;
+	hm.limit = size - 1;
+	hm.foffset = b->foffset;
+	gen_ioctl(NVRM_IOCTL_HOST_MAP, &hm, sizeof(hm), 0, NULL, 0);
+
+	struct mmt_mmap2 mm = { { 'M' }, b->foffset, 3, 1, FD_DEV, b->map_id, b->cpu_addr, size };
+	emit(&mm, sizeof(mm));
+	eor();
+}
+
+static void gen_buffer_free(struct gen_buffer *b)
+{
+	struct mmt_unmap u = { { 'u' }, b->foffset, b->map_id, b->cpu_addr, b->size, 0, 0 };
+	emit(&u, sizeof(u));
+	eor();
+	gen_destroy(H_DEVICE, b->handle);
+}
+
+static void cmd(uint32_t word)
+{
+	if (cmdsnum == cmdsmax)
+	{
+		cmdsmax = cmdsmax ? cmdsmax * 2 : 1024;
+		cmds = realloc(cmds, cmdsmax * sizeof(cmds[0]));
+	}
+	cmds[cmdsnum++] = word;
+}
+
+/* method header: incr/non-incr, in the g80 or gf100 pushbuffer format */
+static void mthd_hdr(int subc, uint32_t mthd, int size, int incr)
+{
+	methods_total += size;
+	if (chip->chipset >= 0xc0)
+		cmd((incr ? 1 << 29 : 3 << 29) | size << 16 | subc << 13 | mthd >> 2);
+	else
+		cmd((incr ? 0 : 1 << 30) | size << 18 | subc << 13 | mthd);
+}
+
+static void mthd1(int subc, uint32_t mthd, uint32_t data)
+{
+	mthd_hdr(subc, mthd, 1, 1);
+	cmd(data);
+}
+
+/* whether a run of up to 8 incrementing methods starting at mthd hits [start, end) */
+static int run_hits(uint32_t mthd, uint32_t start, uint32_t end)
+{
+	return mthd + 8 * 4 > start && mthd < end;
+}
+
+static uint32_t random_mthd(int subc)
+{
+	/* avoid binding, macro, shader start, texture binding and launch methods */
+	for (;;)
+	{
+		uint32_t mthd = 0x200 + (rnd() % (0x1400 / 4)) * 4;
+		if (subc == SUBC_3D && chip->chipset < 0xc0 && run_hits(mthd, 0x1400, 0x1480))
+			continue;
+		if (subc == SUBC_3D && chip->chipset >= 0xc0 && run_hits(mthd, 0x1600, 0x1610))
+			continue;
+		if (subc == SUBC_COMPUTE && run_hits(mthd, 0x2b0, 0x2c0))
+			continue;
+		return mthd;
+	}
+}
+
+static void random_methods(int subc, int cnt)
+{
+	while (cnt > 0)
+	{
+		int size = 1 + rnd() % 8, i;
+		int incr = rnd() % 4 != 0;
+		uint32_t mthd = random_mthd(subc);
+		if (size > cnt)
+			size = cnt;
+		mthd_hdr(subc, mthd, size, incr);
+		for (i = 0; i < size; ++i)
+			cmd(rnd());
+		cnt -= size;
+	}
+}
+
+/*
+ * macro i: "maddr 0x1000 | mthd >> 2; send $r1; exit; nop" - sends its
+ * first parameter to one 3D method
+ */
+static void upload_macros(int nmacros)
+{
+	int i;
+	for (i = 0; i < nmacros; ++i)
+	{
+		uint32_t target = random_mthd(SUBC_3D);
+		uint32_t pos = i * 3;
+
+		mthd1(SUBC_3D, 0x0114, pos); // MACRO_CODE_POS
+		mthd_hdr(SUBC_3D, 0x0118, 3, 0); // MACRO_CODE_DATA
+		cmd(0x00000021 | ((0x1000 | target >> 2) << 14));
+		cmd(0x000008c1);
+		cmd(0x00000011);
+		mthd1(SUBC_3D, 0x011c, i); // MACRO_ENTRY_POS
+		mthd1(SUBC_3D, 0x0120, pos); // MACRO_ENTRY_DATA
+	}
+}
+
+static void upload_shaders(struct gen_buffer *code, int nshaders)
+{
+	static const uint32_t gf100_code[] = { 0x04001de4, 0x28000000, 0x00001de4, 0x40000000 };
+	static const uint32_t gf100_exit[] = { 0x00001de7, 0x80000000 };
+	static const uint32_t g80_code[] = { 0x10000001, 0x0403c780 };
+	static const uint32_t g80_exit[] = { 0xf0000001, 0xe0000001 };
+	const uint32_t *body = chip->chipset >= 0xc0 ? gf100_code : g80_code;
+	const uint32_t *last = chip->chipset >= 0xc0 ? gf100_exit : g80_exit;
+	int bodylen = chip->chipset >= 0xc0 ? 4 : 2;
+	int i, j;
+
+	for (i = 0; i < nshaders; ++i)
+	{
+		uint32_t off = i * SHADER_STRIDE;
+		int len = 2 * (2 + rnd() % 32);
+
+		if (chip->chipset >= 0xc0)
+		{
+			/* shader program header, program type in bits 10..12 */
+			int program = (i & 1) ? 5 : 1;
+			gen_write32(code, off, 0x00020061 | program << 10);
+			off += 4;
+			for (j = 1; j < 20; ++j, off += 4)
+				gen_write32(code, off, j == 1 ? 0x00000000 : rnd() & 0xff);
+		}
+		for (j = 0; j < len; ++j, off += 4)
+			gen_write32(code, off, body[j % bodylen]);
+		gen_write32(code, off, last[0]);
+		gen_write32(code, off + 4, last[1]);
+	}
+}
+
+static void shader_methods(struct gen_buffer *code, int nshaders, int frame)
+{
+	int i = frame % nshaders;
+	uint32_t start = i * SHADER_STRIDE;
+
+	if (chip->chipset >= 0xc0)
+		mthd1(SUBC_3D, 0x2004 + ((i & 1) ? 5 : 1) * 0x40, start); // SP[].START_ID
+	else if (i & 1)
+		mthd1(SUBC_3D, 0x1414, start); // FP_START_ID
+	else
+		mthd1(SUBC_3D, 0x140c, start); // VP_START_ID
+}
+
+static void set_code_address(struct gen_buffer *code)
+{
+	if (chip->chipset >= 0xc0)
+	{
+		mthd_hdr(SUBC_3D, 0x1608, 2, 1); // CODE_ADDRESS
+		cmd(code->gpu_addr >> 32);
+		cmd(code->gpu_addr);
+	}
+	else
+	{
+		mthd_hdr(SUBC_3D, 0x0f7c, 2, 1); // VP_ADDRESS
+		cmd(code->gpu_addr >> 32);
+		cmd(code->gpu_addr);
+		mthd_hdr(SUBC_3D, 0x0fa4, 2, 1); // FP_ADDRESS
+		cmd(code->gpu_addr >> 32);
+		cmd(code->gpu_addr);
+	}
+}
+
+/* copy cmds to the pushbuffer and queue them with one IB entry */
+static void submit(struct gen_channel *ch)
+{
+	uint32_t len = cmdsnum * 4;
+	int i;
+
+	if (len > PB_SIZE)
+	{
+		fprintf(stderr, "mmt_gen: frame too large for pushbuffer\n");
+		exit(1);
+	}
+	if (ch->pb_pos + len > PB_SIZE)
+		ch->pb_pos = 0;
+
+	for (i = 0; i < cmdsnum; ++i)
+		gen_write32(&ch->pb, ch->pb_pos + i * 4, cmds[i]);
+
+	uint64_t addr = ch->pb.gpu_addr + ch->pb_pos;
+	gen_write32(&ch->ib, ch->ib_pos, addr);
+	gen_write32(&ch->ib, ch->ib_pos + 4, ((addr >> 32) & 0xff) | cmdsnum << 10);
+
+	ch->pb_pos += (len + 0xff) & ~0xff;
+	ch->ib_pos = (ch->ib_pos + 8) % IB_SIZE;
+	cmdsnum = 0;
+}
+
+static void gen_channel(struct gen_channel *ch, int idx)
+{
+	int i;
+
+	ch->fifo = H_FIFO + idx * H_CHAN;
+	gen_buffer(&ch->pb, H_MEM + 3 * idx, PB_SIZE);
+	gen_buffer(&ch->ib, H_MEM + 3 * idx + 1, IB_SIZE);
+	gen_buffer(&ch->code, H_MEM + 3 * idx + 2, CODE_SIZE);
+
+	struct nvrm_create_fifo_ib fifo = { 0 };
+	fifo.ib_addr = ch->ib.gpu_addr;
+	fifo.ib_entries = IB_SIZE / 8;
+	gen_create(H_DEVICE, ch->fifo, chip->fifo, &fifo, sizeof(fifo));
+
+	for (i = 0; i < 4; ++i)
+	{
+		uint32_t handle = H_OBJ + idx * H_CHAN + i;
+		gen_create(ch->fifo, handle, chip->cls[i], NULL, 0);
+		if (chip->mthd_fifo_info)
+		{
+			struct nvrm_mthd_fifo_ib_object_info oi = { handle, 0, chip->cls[i], NVRM_FIFO_ENG_GRAPH };
+			gen_call(ch->fifo, chip->mthd_fifo_info, &oi, sizeof(oi));
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mmt_gen [OPTION]... > trace.mmt\n"
+			"Writes a synthetic MMT binary trace of a blob application.\n"
+			"\n"
+			"  -g CHIPSET\tg80 (50), gf100 (c0) or gk104 (e4) classes (default: c0)\n"
+			"  -f NUM\tnumber of IB submissions per channel (default: 1000)\n"
+			"  -c NUM\tnumber of channels (default: 1)\n"
+			"  -m NUM\trandom methods per submission (default: 64)\n"
+			"  -b NUM\tdata buffers written by the cpu (default: 4)\n"
+			"  -w NUM\tdata buffer writes per submission (default: 32)\n"
+			"  -M NUM\tmacros, gf100+ only (default: 4)\n"
+			"  -S NUM\tshaders (default: 4)\n"
+			"  -x NUM\tevery NUM submissions create and destroy a buffer and\n"
+			"        \tan object (default: 0 - never)\n"
+			"  -s NUM\trandom seed\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int chipset = 0xc0, frames = 1000, methods = 64, nbuffers = 4;
+	int writes = 32, nmacros = 4, nshaders = 4, churn = 0, nchannels = 1;
+	int c, i, f, n;
+
+	while ((c = getopt(argc, argv, "g:f:c:m:b:w:M:S:x:s:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'g':
+				chipset = strtoul(optarg, NULL, 16);
+				break;
+			case 'f':
+				frames = atoi(optarg);
+				break;
+			case 'c':
+				nchannels = atoi(optarg);
+				break;
+			case 'm':
+				methods = atoi(optarg);
+				break;
+			case 'b':
+				nbuffers = atoi(optarg);
+				break;
+			case 'w':
+				writes = atoi(optarg);
+				break;
+			case 'M':
+				nmacros = atoi(optarg);
+				break;
+			case 'S':
+				nshaders = atoi(optarg);
+				break;
+			case 'x':
+				churn = atoi(optarg);
+				break;
+			case 's':
+				rnd_state += strtoull(optarg, NULL, 0) * 0x9e3779b97f4a7c15ULL;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	for (i = 0; i < (int)(sizeof(gen_chips) / sizeof(gen_chips[0])); ++i)
+		if (gen_chips[i].chipset == chipset)
+			chip = &gen_chips[i];
+	if (!chip || optind != argc || nchannels < 1 || nchannels > 16)
+		usage();
+	if (chipset < 0xc0)
+		nmacros = 0;
+	if (nbuffers < 1)
+		writes = 0;
+
+	if (isatty(1))
+	{
+		fprintf(stderr, "mmt_gen: refusing to write a binary trace to a terminal\n");
+		exit(1);
+	}
+	out = stdout;
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+	gen_open("/dev/nvidiactl", FD_CTL);
+	gen_open("/dev/nvidia0", FD_DEV);
+
+	uint32_t cid = H_CLIENT;
+	gen_create(0, 0, NVRM_CONTEXT_NEW, &cid, sizeof(cid));
+	gen_create(H_CLIENT, H_DEVICE, NVRM_DEVICE_0, NULL, 0);
+	gen_create(H_DEVICE, H_SUBDEV, NVRM_SUBDEVICE_0, NULL, 0);
+
+	struct nvrm_mthd_subdevice_get_chipset cs = { chipset & 0xf0, chipset & 0x0f, 0xa1 };
+	gen_call(H_SUBDEV, NVRM_MTHD_SUBDEVICE_GET_CHIPSET, &cs, sizeof(cs));
+
+	struct gen_channel *chans = calloc(nchannels, sizeof(*chans));
+	struct gen_buffer *data = calloc(nbuffers ? nbuffers : 1, sizeof(*data));
+	struct gen_buffer churnbuf;
+	for (n = 0; n < nchannels; ++n)
+		gen_channel(&chans[n], n);
+	for (i = 0; i < nbuffers; ++i)
+		gen_buffer(&data[i], H_MEM + 3 * nchannels + i, DATA_SIZE);
+
+	if (nshaders)
+		for (n = 0; n < nchannels; ++n)
+			upload_shaders(&chans[n].code, nshaders);
+
+	for (f = 0; f < frames; ++f)
+	{
+		int churning = churn && f % churn == churn - 1;
+		uint32_t churn_handle = H_CHURN + f / (churn ? churn : 1);
+
+		for (i = 0; i < writes; ++i)
+			gen_write32(&data[rnd() % nbuffers], (rnd() % (DATA_SIZE / 4)) * 4, rnd());
+
+		if (churning)
+		{
+			gen_buffer(&churnbuf, churn_handle | 0x8000, DATA_SIZE);
+			for (i = 0; i < 64; ++i)
+				gen_write32(&churnbuf, i * 4, rnd());
+			gen_create(H_FIFO, churn_handle, chip->cls[1], NULL, 0);
+		}
+
+		for (n = 0; n < nchannels; ++n)
+		{
+			struct gen_channel *ch = &chans[n];
+
+			if (f == 0)
+			{
+				for (i = 0; i < 4; ++i)
+					mthd1(i, 0, H_OBJ + n * H_CHAN + i);
+				upload_macros(nmacros);
+				if (nshaders)
+					set_code_address(&ch->code);
+			}
+
+			if (churning && n == 0)
+			{
+				mthd1(SUBC_CHURN, 0, churn_handle);
+				random_methods(SUBC_CHURN, 8);
+			}
+
+			/* most of the traffic goes to 3D, like in real applications */
+			random_methods(SUBC_3D, methods - methods / 4);
+			random_methods(SUBC_2D, methods / 12);
+			random_methods(SUBC_M2MF, methods / 12);
+			random_methods(SUBC_COMPUTE, methods / 4 - 2 * (methods / 12));
+			if (nmacros)
+			{
+				int m = rnd() % nmacros;
+				mthd_hdr(SUBC_3D, 0x3800 + m * 8, 1, 1);
+				cmd(rnd());
+			}
+			if (nshaders)
+				shader_methods(&ch->code, nshaders, f);
+
+			submit(ch);
+		}
+
+		if (churning)
+		{
+			gen_destroy(H_FIFO, churn_handle);
+			gen_buffer_free(&churnbuf);
+		}
+	}
+
+	fflush(out);
+	fprintf(stderr, "mmt_gen: %" PRIu64 " messages, %" PRIu64 " methods\n", msgs, methods_total);
+	free(chans);
+	free(data);
+	free(cmds);
+	return 0;
+}
@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * mmt_slice: cut a range out of an MMT binary trace.
+ *
+ * Messages are copied verbatim from the decoder buffer.  Before the start of
+ * the slice only context is kept (open/dup, mmaps, ioctls, nvidia object
+ * messages), and memory writes are folded into a shadow copy of every mapping,
+ * which is replayed as plain writes when the slice starts, so buffers have
+ * their contents when the slice is decoded on its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmt_bin_decode.h"
+#include "mmt_bin_decode_nvidia.h"
+#include "util.h"
+
+#define EOR 10
+
+#define SHADOW_PAGE_SHIFT 12
+#define SHADOW_PAGE_SIZE (1 << SHADOW_PAGE_SHIFT)
+
+struct shadow_page
+{
+	uint32_t index;
+	struct shadow_page *next;
+	uint8_t written[SHADOW_PAGE_SIZE / 8];
+	uint8_t data[SHADOW_PAGE_SIZE];
+};
+
+struct slice_mapping
+{
+	uint32_t id;
+	uint64_t start;
+	uint64_t len;
+	struct shadow_page *pages;
+	struct shadow_page *last_page;
+};
+
+static struct slice_mapping *mappings;
+static int mappingsnum, mappingsmax;
+
+static uint64_t msg_idx;
+static uint64_t start_idx, end_idx = UINT64_MAX;
+static const char *start_marker, *end_marker;
+static int started, carry_contents = 1, pushbuf_only;
+
+static uint32_t *fds;
+static int fdsnum, fdsmax;
+static uint32_t *buffers;
+static int buffersnum, buffersmax;
+
+static uint64_t kept, dropped;
+
+static void emit(const void *start, const void *end)
+{
+	size_t len = (const uint8_t *)end - (const uint8_t *)start;
+	if (fwrite(start, 1, len, stdout) != len)
+	{
+		perror("write");
+		exit(1);
+	}
+	kept++;
+}
+
+#define EMIT_SIZED(msg, size) emit((msg), (const uint8_t *)(msg) + (size))
+#define EMIT_FIXED(msg) EMIT_SIZED((msg), sizeof(*(msg)) + 1)
+#define EMIT_BUF(msg, buf) EMIT_SIZED((msg), sizeof(*(msg)) + (buf).len + 1)
+
+static const void *args_end(const void *end, struct mmt_memory_dump *args, int argc)
+{
+	if (argc)
+		end = args[argc - 1].data->data + args[argc - 1].data->len + 1;
+	return end;
+}
+
+static struct slice_mapping *find_mapping_id(uint32_t id)
+{
+	int i;
+	for (i = mappingsnum - 1; i >= 0; --i)
+		if (mappings[i].id == id)
+			return &mappings[i];
+	return NULL;
+}
+
+static struct slice_mapping *find_mapping_addr(uint64_t addr)
+{
+	int i;
+	for (i = mappingsnum - 1; i >= 0; --i)
+		if (addr >= mappings[i].start && addr < mappings[i].start + mappings[i].len)
+			return &mappings[i];
+	return NULL;
+}
+
+static void free_shadow(struct slice_mapping *m)
+{
+	struct shadow_page *p, *n;
+	for (p = m->pages; p; p = n)
+	{
+		n = p->next;
+		free(p);
+	}
+	m->pages = m->last_page = NULL;
+}
+
+static struct shadow_page *get_shadow_page(struct slice_mapping *m, uint32_t index)
+{
+	struct shadow_page **pp, *p;
+
+	if (m->last_page && m->last_page->index == index)
+		return m->last_page;
+
+	for (pp = &m->pages; *pp && (*pp)->index < index; pp = &(*pp)->next)
+		;
+	if (*pp && (*pp)->index == index)
+		return m->last_page = *pp;
+
+	p = calloc(1, sizeof(*p));
+	p->index = index;
+	p->next = *pp;
+	*pp = p;
+	return m->last_page = p;
+}
+
+static void shadow_write(struct slice_mapping *m, uint64_t offset, const uint8_t *data, uint32_t len)
+{
+	while (len)
+	{
+		struct shadow_page *p = get_shadow_page(m, offset >> SHADOW_PAGE_SHIFT);
+		uint32_t o = offset & (SHADOW_PAGE_SIZE - 1);
+		uint32_t chunk = min(len, SHADOW_PAGE_SIZE - o);
+		uint32_t i;
+		memcpy(p->data + o, data, chunk);
+		for (i = o; i < o + chunk; ++i)
+			p->written[i / 8] |= 1 << (i % 8);
+		offset += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+static void emit_shadow_write(uint32_t id, uint32_t offset, const uint8_t *data, uint8_t len)
+{
+	uint8_t buf[sizeof(struct mmt_write) + 32 + 1];
+	struct mmt_write *w = (void *)buf;
+	w->msg_type.type = 'w';
+	w->id = id;
+	w->offset = offset;
+	w->len = len;
+	memcpy(w->data, data, len);
+	w->data[len] = EOR;
+	EMIT_SIZED(w, sizeof(*w) + len + 1);
+}
+
+/* Replay shadowed buffer contents as writes of 32, 16, 8, 4 or 1 bytes. */
+static void flush_shadow(void)
+{
+	int i;
+	for (i = 0; i < mappingsnum; ++i)
+	{
+		struct slice_mapping *m = &mappings[i];
+		struct shadow_page *p;
+
+		for (p = m->pages; p; p = p->next)
+		{
+			uint32_t o = 0;
+			uint64_t base = (uint64_t)p->index << SHADOW_PAGE_SHIFT;
+			while (o < SHADOW_PAGE_SIZE)
+			{
+				uint32_t len = 0;
+				if (!(p->written[o / 8] & (1 << (o % 8))))
+				{
+					o++;
+					continue;
+				}
+
+				if (!(o & 3))
+					while (len < 32 && o + len < SHADOW_PAGE_SIZE &&
+							((p->written[(o + len) / 8] >> ((o + len) % 8)) & 0xf) == 0xf)
+						len += 4;
+				while (len & (len - 1))
+					len &= len - 1;
+				if (!len)
+					len = 1;
+
+				if (base + o + len <= m->len)
+					emit_shadow_write(m->id, base + o, p->data + o, len);
+				o += len;
+			}
+		}
+		free_shadow(m);
+	}
+}
+
+static int has_marker(const uint8_t *data, unsigned int len, const char *marker)
+{
+	size_t mlen = strlen(marker);
+	unsigned int i;
+	for (i = 0; i + mlen <= len; ++i)
+		if (memcmp(data + i, marker, mlen) == 0)
+			return 1;
+	return 0;
+}
+
+static void stop(void)
+{
+	fflush(stdout);
+	fprintf(stderr, "mmt_slice: kept %" PRIu64 " messages, dropped %" PRIu64 "\n", kept, dropped);
+	exit(0);
+}
+
+/* Called for every message; returns whether we are inside the slice. */
+static int in_slice(const uint8_t *text, unsigned int len)
+{
+	msg_idx++;
+
+	if (started)
+	{
+		if (msg_idx > end_idx || (end_marker && text && has_marker(text, len, end_marker)))
+			stop();
+		return 1;
+	}
+
+	if (msg_idx > start_idx && (!start_marker || (text && has_marker(text, len, start_marker))))
+	{
+		started = 1;
+		if (carry_contents)
+			flush_shadow();
+		if (msg_idx > end_idx)
+			stop();
+		return 1;
+	}
+
+	return 0;
+}
+
+static int fd_selected(uint32_t fd)
+{
+	int i;
+	if (!fdsnum)
+		return 1;
+	for (i = 0; i < fdsnum; ++i)
+		if (fds[i] == fd)
+			return 1;
+	return 0;
+}
+
+static int buffer_selected(uint32_t id)
+{
+	int i;
+	if (!buffersnum)
+		return 1;
+	for (i = 0; i < buffersnum; ++i)
+		if (buffers[i] == id)
+			return 1;
+	return 0;
+}
+
+static void slice_memread(struct mmt_read *r, void *state)
+{
+	if (in_slice(NULL, 0) && !pushbuf_only && buffer_selected(r->id))
+		EMIT_SIZED(r, sizeof(*r) + r->len + 1);
+	else
+		dropped++;
+}
+
+static void slice_memread2(struct mmt_read2 *r, void *state)
+{
+	struct slice_mapping *m = find_mapping_addr(r->addr);
+	if (in_slice(NULL, 0) && !pushbuf_only && m && buffer_selected(m->id))
+		EMIT_SIZED(r, sizeof(*r) + r->len + 1);
+	else
+		dropped++;
+}
+
+static void slice_memwrite(struct mmt_write *w, void *state)
+{
+	if (in_slice(NULL, 0))
+	{
+		if (buffer_selected(w->id))
+			EMIT_SIZED(w, sizeof(*w) + w->len + 1);
+		else
+			dropped++;
+		return;
+	}
+
+	struct slice_mapping *m = find_mapping_id(w->id);
+	if (carry_contents && m && buffer_selected(w->id))
+		shadow_write(m, w->offset, w->data, w->len);
+	dropped++;
+}
+
+static void slice_memwrite2(struct mmt_write2 *w, void *state)
+{
+	struct slice_mapping *m = find_mapping_addr(w->addr);
+	if (in_slice(NULL, 0))
+	{
+		if (m && buffer_selected(m->id))
+			EMIT_SIZED(w, sizeof(*w) + w->len + 1);
+		else
+			dropped++;
+		return;
+	}
+
+	if (carry_contents && m && buffer_selected(m->id))
+		shadow_write(m, w->addr - m->start, w->data, w->len);
+	dropped++;
+}
+
+static void add_mapping(uint32_t id, uint64_t start, uint64_t len)
+{
+	struct slice_mapping m = { id, start, len, NULL, NULL };
+	ADDARRAY(mappings, m);
+}
+
+static void slice_mmap(struct mmt_mmap *mm, void *state)
+{
+	in_slice(NULL, 0);
+	add_mapping(mm->id, mm->start, mm->len);
+	EMIT_FIXED(mm);
+}
+
+static void slice_mmap2(struct mmt_mmap2 *mm, void *state)
+{
+	in_slice(NULL, 0);
+	add_mapping(mm->id, mm->start, mm->len);
+	EMIT_FIXED(mm);
+}
+
+static void slice_nv_mmap(struct mmt_nvidia_mmap *mm, void *state)
+{
+	in_slice(NULL, 0);
+	add_mapping(mm->id, mm->start, mm->len);
+	EMIT_FIXED(mm);
+}
+
+static void slice_nv_mmap2(struct mmt_nvidia_mmap2 *mm, void *state)
+{
+	in_slice(NULL, 0);
+	add_mapping(mm->id, mm->start, mm->len);
+	EMIT_FIXED(mm);
+}
+
+static void slice_munmap(struct mmt_unmap *mm, void *state)
+{
+	struct slice_mapping *m = find_mapping_id(mm->id);
+	in_slice(NULL, 0);
+	if (m)
+	{
+		free_shadow(m);
+		*m = mappings[--mappingsnum];
+	}
+	EMIT_FIXED(mm);
+}
+
+static void slice_mremap(struct mmt_mremap *mm, void *state)
+{
+	struct slice_mapping *m = find_mapping_id(mm->id);
+	in_slice(NULL, 0);
+	if (m)
+	{
+		m->start = mm->start;
+		m->len = mm->len;
+	}
+	EMIT_FIXED(mm);
+}
+
+static void slice_open(struct mmt_open *o, void *state)
+{
+	in_slice(NULL, 0);
+	EMIT_BUF(o, o->path);
+}
+
+static void slice_msg(uint8_t *data, unsigned int len, void *state)
+{
+	if (in_slice(data, len))
+		EMIT_SIZED(data, len + 1);
+	else
+		dropped++;
+}
+
+static void slice_write_syscall(struct mmt_write_syscall *o, void *state)
+{
+	if (in_slice(o->data.data, o->data.len) && fd_selected(o->fd))
+		EMIT_BUF(o, o->data);
+	else
+		dropped++;
+}
+
+static void slice_dup_syscall(struct mmt_dup_syscall *o, void *state)
+{
+	in_slice(NULL, 0);
+	EMIT_FIXED(o);
+}
+
+static void slice_sync(struct mmt_sync *s, void *state)
+{
+	if (in_slice(NULL, 0))
+		EMIT_FIXED(s);
+	else
+		dropped++;
+}
+
+static void slice_ioctl(uint32_t fd, const void *ctl, const struct mmt_buf *data,
+		struct mmt_memory_dump *args, int argc)
+{
+	/* ioctls outside of the slice are context, inside they obey -f */
+	if (in_slice(NULL, 0) && !fd_selected(fd))
+	{
+		dropped++;
+		return;
+	}
+	emit(ctl, args_end(data->data + data->len + 1, args, argc));
+}
+
+static void slice_ioctl_pre_v2(struct mmt_ioctl_pre_v2 *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	slice_ioctl(ctl->fd, ctl, &ctl->data, args, argc);
+}
+
+static void slice_ioctl_post_v2(struct mmt_ioctl_post_v2 *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	slice_ioctl(ctl->fd, ctl, &ctl->data, args, argc);
+}
+
+static void slice_ioctl_pre(struct mmt_ioctl_pre *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	slice_ioctl(ctl->fd, ctl, &ctl->data, args, argc);
+}
+
+static void slice_ioctl_post(struct mmt_ioctl_post *ctl, void *state, struct mmt_memory_dump *args, int argc)
+{
+	slice_ioctl(ctl->fd, ctl, &ctl->data, args, argc);
+}
+
+static void slice_memory_dump(struct mmt_memory_dump_prefix *d, struct mmt_buf *b, void *state)
+{
+	in_slice(NULL, 0);
+	emit(d, b->data + b->len + 1);
+}
+
+#define SLICE_CONTEXT(name, type) \
+static void slice_##name(type *obj, void *state) \
+{ \
+	in_slice(NULL, 0); \
+	EMIT_FIXED(obj); \
+}
+
+SLICE_CONTEXT(destroy_object, struct mmt_nvidia_destroy_object)
+SLICE_CONTEXT(call_method, struct mmt_nvidia_call_method)
+SLICE_CONTEXT(create_mapped, struct mmt_nvidia_create_mapped_object)
+SLICE_CONTEXT(create_dma_object, struct mmt_nvidia_create_dma_object)
+SLICE_CONTEXT(alloc_map, struct mmt_nvidia_alloc_map)
+SLICE_CONTEXT(gpu_map, struct mmt_nvidia_gpu_map)
+SLICE_CONTEXT(gpu_map2, struct mmt_nvidia_gpu_map2)
+SLICE_CONTEXT(gpu_unmap, struct mmt_nvidia_gpu_unmap)
+SLICE_CONTEXT(gpu_unmap2, struct mmt_nvidia_gpu_unmap2)
+SLICE_CONTEXT(unmap, struct mmt_nvidia_unmap)
+SLICE_CONTEXT(bind, struct mmt_nvidia_bind)
+SLICE_CONTEXT(create_driver_object, struct mmt_nvidia_create_driver_object)
+SLICE_CONTEXT(create_device_object, struct mmt_nvidia_create_device_object)
+SLICE_CONTEXT(create_context_object, struct mmt_nvidia_create_context_object)
+
+static void slice_create_object(struct mmt_nvidia_create_object *create, void *state)
+{
+	in_slice(NULL, 0);
+	EMIT_BUF(create, create->name);
+}
+
+static void slice_call_method_data(struct mmt_nvidia_call_method_data *call, void *state)
+{
+	in_slice(NULL, 0);
+	EMIT_BUF(call, call->data);
+}
+
+static void slice_ioctl_4d(struct mmt_nvidia_ioctl_4d *ctl, void *state)
+{
+	in_slice(NULL, 0);
+	EMIT_BUF(ctl, ctl->str);
+}
+
+static void slice_mmiotrace_mark(struct mmt_nvidia_mmiotrace_mark *mark, void *state)
+{
+	if (in_slice(mark->str.data, mark->str.len))
+		EMIT_BUF(mark, mark->str);
+	else
+		dropped++;
+}
+
+static void slice_nouveau_gem_pushbuf_data(struct mmt_nouveau_pushbuf_data *data, void *state)
+{
+	if (in_slice(NULL, 0))
+		EMIT_BUF(data, data->data);
+	else
+		dropped++;
+}
+
+static const struct mmt_nvidia_decode_funcs slice_funcs =
+{
+	{ slice_memread, slice_memwrite, slice_mmap, slice_mmap2, slice_munmap,
+	  slice_mremap, slice_open, slice_msg, slice_write_syscall, slice_dup_syscall,
+	  slice_sync, slice_ioctl_pre_v2, slice_ioctl_post_v2, slice_memread2,
+	  slice_memwrite2 },
+	slice_create_object,
+	slice_destroy_object,
+	slice_ioctl_pre,
+	slice_ioctl_post,
+	slice_memory_dump,
+	slice_call_method,
+	slice_create_mapped,
+	slice_create_dma_object,
+	slice_alloc_map,
+	slice_gpu_map,
+	slice_gpu_map2,
+	slice_gpu_unmap,
+	slice_gpu_unmap2,
+	slice_nv_mmap,
+	slice_nv_mmap2,
+	slice_unmap,
+	slice_bind,
+	slice_create_driver_object,
+	slice_create_device_object,
+	slice_create_context_object,
+	slice_call_method_data,
+	slice_ioctl_4d,
+	slice_mmiotrace_mark,
+	slice_nouveau_gem_pushbuf_data
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mmt_slice [OPTION]... [TRACE] > SLICE\n"
+			"Write a reduced MMT binary trace that decodes on its own.\n"
+			"\n"
+			"  -s NUM\tstart at message NUM (counted from 0)\n"
+			"  -e NUM\tstop before message NUM\n"
+			"  -S TEXT\tstart at the first marker containing TEXT\n"
+			"  -E TEXT\tstop at the first marker containing TEXT\n"
+			"  -f FD\t\tkeep only ioctls and writes on FD (repeatable)\n"
+			"  -b ID\t\tkeep only accesses to mmap serial ID (repeatable)\n"
+			"  -p\t\tkeep only writes, drop memory reads\n"
+			"  -k\t\tdo not replay buffer contents written before the slice\n"
+			"\n"
+			"Markers are text messages and mmiotrace marks.\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	while ((c = getopt(argc, argv, "s:e:S:E:f:b:pkh")) != -1)
+	{
+		switch (c)
+		{
+			case 's':
+				start_idx = strtoull(optarg, NULL, 0);
+				break;
+			case 'e':
+				end_idx = strtoull(optarg, NULL, 0);
+				break;
+			case 'S':
+				start_marker = optarg;
+				break;
+			case 'E':
+				end_marker = optarg;
+				break;
+			case 'f':
+				ADDARRAY(fds, strtoul(optarg, NULL, 0));
+				break;
+			case 'b':
+				ADDARRAY(buffers, strtoul(optarg, NULL, 0));
+				break;
+			case 'p':
+				pushbuf_only = 1;
+				break;
+			case 'k':
+				carry_contents = 0;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (optind + 1 < argc)
+		usage();
+
+	if (isatty(1))
+	{
+		fprintf(stderr, "mmt_slice: refusing to write a binary trace to a terminal\n");
+		exit(1);
+	}
+
+	if (optind < argc)
+	{
+		close(0);
+		if (open_input(argv[optind]) == NULL)
+		{
+			perror("open");
+			exit(1);
+		}
+	}
+
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+	mmt_decode(&slice_funcs.base, NULL);
+	stop();
+	return 0;
+}
@@ -28,8 +28,11 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#include "chanq.h"
+#include "config.h"
 #include "demmt.h"
 #include "log.h"
+#include "memstat.h"
 #include "nvrm_create.h"
 #include "nvrm_decode.h"
 #include "nvrm_mthd.h"
@@ -303,6 +306,32 @@ static struct gpu_object *nvrm_add_object(uint32_t fd, uint32_t cid, uint32_t pa
 	return obj;
 }
 
+static void nvrm_free_gpu_object(struct gpu_object *obj)
+{
+	/*
+	 * The kernel frees the whole subtree. Without a memory budget children
+	 * are kept around (orphaned) to not change the output of old traces.
+	 */
+	if (memory_budget)
+	{
+		int i = 0;
+		while (i < obj->children_space)
+			if (obj->children_objects[i])
+				nvrm_free_gpu_object(obj->children_objects[i]);
+			else
+				i++;
+	}
+
+	if (is_fifo_ib_class(obj->class_) || is_fifo_dma_class(obj->class_))
+	{
+		struct gpu_object *dev = nvrm_get_device(obj);
+		if (dev && dev->class_data)
+			nvrm_dev(dev)->fifos--;
+	}
+
+	gpu_object_destroy(obj);
+}
+
 static void nvrm_destroy_gpu_object(uint32_t fd, uint32_t cid, uint32_t parent, uint32_t handle)
 {
 	struct gpu_object *obj = gpu_object_find(cid, handle);
@@ -336,14 +365,7 @@ static void nvrm_destroy_gpu_object(uint32_t fd, uint32_t cid, uint32_t parent,
 		dump_object_trees(obj);
 	}
 
-	if (is_fifo_ib_class(obj->class_) || is_fifo_dma_class(obj->class_))
-	{
-		struct gpu_object *dev = nvrm_get_device(obj);
-		if (dev && dev->class_data)
-			nvrm_dev(dev)->fifos--;
-	}
-
-	gpu_object_destroy(obj);
+	nvrm_free_gpu_object(obj);
 }
 
 static int cid_not_found = 0;
@@ -499,6 +521,7 @@ static void host_map(struct gpu_object *obj, uint32_t fd, uint64_t mmap_offset,
 	{
 		obj->data = realloc(obj->data, min_obj_len);
 		memset(obj->data + obj->length, 0, min_obj_len - obj->length);
+		memstat_add(MEMSTAT_GPU_OBJECTS, min_obj_len - obj->length);
 		obj->length = min_obj_len;
 	}
 	mapping->data = obj->data + object_offset;
@@ -658,6 +681,7 @@ static void handle_nvrm_ioctl_vspace_map(uint32_t fd, struct nvrm_ioctl_vspace_m
 	{
 		obj->data = realloc(obj->data, s->size);
 		memset(obj->data + obj->length, 0, s->size - obj->length);
+		memstat_add(MEMSTAT_GPU_OBJECTS, s->size - obj->length);
 		obj->length = s->size;
 	}
 	mapping->object = obj;
@@ -875,6 +899,8 @@ void demmt_memory_dump(struct mmt_memory_dump_prefix *d, struct mmt_buf *b, void
 
 void __demmt_mmap(uint64_t start, uint64_t len, uint32_t id, uint64_t offset, void *state)
 {
+	chanq_sync();
+
 	if (dump_sys_mmap)
 		mmt_log("mmap: address: 0x%" PRIx64 ", length: 0x%08" PRIx64 ", id: %d, offset: 0x%08" PRIx64 "",
 				start, len, id, offset);
@@ -890,6 +916,8 @@ void demmt_nv_mmap(struct mmt_nvidia_mmap *mm, void *state)
 void __demmt_mmap2(uint64_t start, uint64_t len, uint32_t id, uint64_t offset,
 		uint32_t fd, uint32_t prot, uint32_t flags, void *state)
 {
+	chanq_sync();
+
 	if (dump_sys_mmap)
 	{
 		mmt_log("mmap: address: 0x%" PRIx64 ", length: 0x%08" PRIx64 ", id: %d, offset: 0x%08" PRIx64 ", fd: %d",
@@ -87,9 +87,9 @@ const char *nvrm_status(uint32_t status)
 
 const char *nvrm_get_class_name(uint32_t cls)
 {
-	static struct rnnenum *rnndb_cls = NULL, *nvrm_cls = NULL;
-	static uint32_t last_cls = 0;
-	static const char *last_cls_name = NULL;
+	static __thread struct rnnenum *rnndb_cls = NULL, *nvrm_cls = NULL;
+	static __thread uint32_t last_cls = 0;
+	static __thread const char *last_cls_name = NULL;
 
 	if (!cls || !nvrm_describe_classes)
 		return NULL;
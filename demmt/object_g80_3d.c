@@ -71,7 +71,7 @@ static void __g80_3d_disassemble(uint8_t *data, struct region *reg,
 			mmt_debug_cont("%s\n", "");
 		}
 
-		envydis(isa_g80, stdout, data + reg->start, start_id,
+		envydis(isa_g80, mmt_out, data + reg->start, start_id,
 				reg->end - reg->start, var, 0, NULL, 0, colors);
 		break;
 	}
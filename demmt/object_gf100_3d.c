@@ -197,7 +197,7 @@ void gf100_3d_disassemble(uint8_t *data, struct region *reg,
 			mmt_debug_cont("%s\n", "");
 		}
 
-		envydis(isa, stdout, data + reg->start + 20 * 4, 0,
+		envydis(isa, mmt_out, data + reg->start + 20 * 4, 0,
 				reg->end - reg->start - 20 * 4, var, 0, NULL, 0, colors);
 
 		break;
@@ -148,7 +148,7 @@ void decode_gf100_compute_verbose(struct gpu_object *obj, struct pushbuf_decode_
 				if (reg->start != start_id + code_addr - m->address)
 					continue;
 
-				envydis(isa_gf100, stdout, code + reg->start, 0,
+				envydis(isa_gf100, mmt_out, code + reg->start, 0,
 						reg->end - reg->start, var, 0, NULL, 0, colors);
 				break;
 			}
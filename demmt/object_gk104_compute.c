@@ -188,7 +188,7 @@ void decode_gk104_compute_verbose(struct gpu_object *obj, struct pushbuf_decode_
 					if (reg->start != start_id + code_addr - m->address)
 						continue;
 
-					envydis(isa, stdout, code + reg->start, 0,
+					envydis(isa, mmt_out, code + reg->start, 0,
 							reg->end - reg->start, var, 0, NULL, 0, colors);
 					break;
 				}
@@ -290,8 +290,8 @@ static void anb_set_low(struct addr_n_buf *s, uint32_t data, const char *usage,
 
 struct gpu_object_decoder obj_decoders[] =
 {
-	{ 0x502d, decode_g80_2d_init,        decode_g80_2d_terse,        decode_g80_2d_verbose },
-	{ 0x5039, decode_g80_m2mf_init,      decode_g80_m2mf_terse,      decode_g80_m2mf_verbose },
+	{ 0x502d, decode_g80_2d_init,        decode_g80_2d_terse,        decode_g80_2d_verbose, 1 },
+	{ 0x5039, decode_g80_m2mf_init,      decode_g80_m2mf_terse,      decode_g80_m2mf_verbose, 1 },
 	{ 0x5097, decode_g80_3d_init,        decode_g80_3d_terse,        decode_g80_3d_verbose },
 	{ 0x8297, decode_g80_3d_init,        decode_g80_3d_terse,        decode_g80_3d_verbose },
 	{ 0x8397, decode_g80_3d_init,        decode_g80_3d_terse,        decode_g80_3d_verbose },
@@ -300,33 +300,33 @@ struct gpu_object_decoder obj_decoders[] =
 	{ 0x50c0, decode_g80_compute_init,   decode_g80_compute_terse,   decode_g80_compute_verbose },
 	{ 0x85c0, decode_g80_compute_init,   decode_g80_compute_terse,   decode_g80_compute_verbose },
 	{ 0x902d, decode_gf100_2d_init,      decode_gf100_2d_terse,      NULL },
-	{ 0x9039, decode_gf100_m2mf_init,    decode_gf100_m2mf_terse,    decode_gf100_m2mf_verbose },
+	{ 0x9039, decode_gf100_m2mf_init,    decode_gf100_m2mf_terse,    decode_gf100_m2mf_verbose, 1 },
 	{ 0x9097, decode_gf100_3d_init,      decode_gf100_3d_terse,      decode_gf100_3d_verbose },
 	{ 0x9197, decode_gf100_3d_init,      decode_gf100_3d_terse,      decode_gf100_3d_verbose },
 	{ 0x9297, decode_gf100_3d_init,      decode_gf100_3d_terse,      decode_gf100_3d_verbose },
-	{ 0x90c0, decode_gf100_compute_init, decode_gf100_compute_terse, decode_gf100_compute_verbose },
-	{ 0x91c0, decode_gf100_compute_init, decode_gf100_compute_terse, decode_gf100_compute_verbose },
-	{ 0xa040, decode_gk104_p2mf_init,    decode_gk104_p2mf_terse,    decode_gk104_p2mf_verbose },
-	{ 0xa140, decode_gk104_p2mf_init,    decode_gk104_p2mf_terse,    decode_gk104_p2mf_verbose },
-	{ 0xa097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xa197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xa297, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xb097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xb197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xc097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
-	{ 0xc197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose },
+	{ 0x90c0, decode_gf100_compute_init, decode_gf100_compute_terse, decode_gf100_compute_verbose, 1 },
+	{ 0x91c0, decode_gf100_compute_init, decode_gf100_compute_terse, decode_gf100_compute_verbose, 1 },
+	{ 0xa040, decode_gk104_p2mf_init,    decode_gk104_p2mf_terse,    decode_gk104_p2mf_verbose, 1 },
+	{ 0xa140, decode_gk104_p2mf_init,    decode_gk104_p2mf_terse,    decode_gk104_p2mf_verbose, 1 },
+	{ 0xa097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xa197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xa297, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xb097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xb197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xc097, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
+	{ 0xc197, decode_gk104_3d_init,      decode_gk104_3d_terse,      decode_gk104_3d_verbose, 1 },
 	{ 0xa0b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
 	{ 0xb0b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
 	{ 0xc0b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
 	{ 0xc1b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
 	{ 0xc3b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
 	{ 0xc5b5, decode_gk104_copy_init,    decode_gk104_copy_terse,    NULL },
-	{ 0xa0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
-	{ 0xa1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
-	{ 0xb0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
-	{ 0xb1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
-	{ 0xc0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
-	{ 0xc1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose },
+	{ 0xa0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
+	{ 0xa1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
+	{ 0xb0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
+	{ 0xb1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
+	{ 0xc0c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
+	{ 0xc1c0, decode_gk104_compute_init, decode_gk104_compute_terse, decode_gk104_compute_verbose, 1 },
 	{ 0, NULL, NULL, NULL }
 };
 
@@ -15,6 +15,9 @@ struct gpu_object_decoder
 	// do whatever you like to do
 	void (*decode_verbose)(struct gpu_object *, struct pushbuf_decode_state *);
 
+	// writes to gpu buffers (uploads, copies), see chanq_submit
+	int uploads;
+
 	// internal
 	int disabled;
 };
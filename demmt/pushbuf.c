@@ -29,9 +29,11 @@
 #include <string.h>
 
 #include "buffer.h"
+#include "chanq.h"
 #include "config.h"
 #include "demmt.h"
 #include "log.h"
+#include "memstat.h"
 #include "nvrm.h"
 #include "nvrm_decode.h"
 #include "nvrm_object.xml.h"
@@ -40,34 +42,114 @@
 #include "rnndec.h"
 #include "util.h"
 
+static uint64_t cache_tick;
+
+static int cache_entry_size(struct cache_entry *c)
+{
+	return sizeof(*c) + sizeof(*c->info) + strlen(c->info->name) + 1;
+}
+
+static uint64_t obj_free_cache(struct obj *obj)
+{
+	uint64_t freed = 0;
+	int j;
+	if (!obj->cache)
+		return 0;
+	for (j = 0; j < ADDR_CACHE_SIZE; ++j)
+	{
+		struct cache_entry *c = obj->cache[j], *tmp;
+		while (c)
+		{
+			freed += cache_entry_size(c);
+			rnndec_free_decaddrinfo(c->info);
+			tmp = c;
+			c = c->next;
+			free(tmp);
+		}
+	}
+	free(obj->cache);
+	obj->cache = NULL;
+	freed += ADDR_CACHE_SIZE * sizeof(obj->cache[0]);
+	memstat_add(MEMSTAT_DECODE_CACHES, -(int64_t)freed);
+	return freed;
+}
+
+#define OBJECT_PAGES (OBJECT_SIZE / OBJECT_PAGE_SIZE)
+
+uint32_t obj_method_value(struct obj *obj, uint32_t mthd)
+{
+	uint32_t *page;
+	if (!obj->data || !(page = obj->data[mthd / OBJECT_PAGE_SIZE]))
+		return 0;
+	return page[mthd % OBJECT_PAGE_SIZE / 4];
+}
+
+/*
+ * Most objects use a small part of their method space, so method values are
+ * kept in pages allocated when a nonzero value is first stored.
+ */
+void obj_set_method_value(struct obj *obj, uint32_t mthd, uint32_t value)
+{
+	uint32_t **page;
+
+	if (!obj->data)
+	{
+		if (!value)
+			return;
+		obj->data = calloc(OBJECT_PAGES, sizeof(obj->data[0]));
+		memstat_add(MEMSTAT_METHOD_STATE, OBJECT_PAGES * sizeof(obj->data[0]));
+	}
+
+	page = &obj->data[mthd / OBJECT_PAGE_SIZE];
+	if (!*page)
+	{
+		if (!value)
+			return;
+		*page = calloc(OBJECT_PAGE_SIZE, 1);
+		memstat_add(MEMSTAT_METHOD_STATE, OBJECT_PAGE_SIZE);
+	}
+	(*page)[mthd % OBJECT_PAGE_SIZE / 4] = value;
+}
+
+static void obj_free_data(struct obj *obj)
+{
+	int i;
+	if (!obj->data)
+		return;
+	for (i = 0; i < OBJECT_PAGES; ++i)
+		if (obj->data[i])
+		{
+			free(obj->data[i]);
+			memstat_add(MEMSTAT_METHOD_STATE, -OBJECT_PAGE_SIZE);
+		}
+	free(obj->data);
+	obj->data = NULL;
+	memstat_add(MEMSTAT_METHOD_STATE, -(int64_t)(OBJECT_PAGES * sizeof(obj->data[0])));
+}
+
+static void obj_destroy(struct obj *obj)
+{
+	obj_free_cache(obj);
+	rnndec_freecontext(obj->ctx);
+	obj_free_data(obj);
+	memset(obj, 0, sizeof(*obj));
+}
+
 static void fifo_state_destroy(struct gpu_object *fifo)
 {
 	struct fifo_state *state = get_fifo_state(fifo);
 
-	int i, j;
+	int i;
 	for (i = 0; i < MAX_OBJECTS; i++)
 	{
 		struct obj *obj = &state->objects[i];
 		if (!obj->handle)
 			continue;
-		for (j = 0; j < ADDR_CACHE_SIZE; ++j)
-		{
-			struct cache_entry *c = obj->cache[j], *tmp;
-			while (c)
-			{
-				rnndec_free_decaddrinfo(c->info);
-				tmp = c;
-				c = c->next;
-				free(tmp);
-			}
-		}
-
-		rnndec_freecontext(obj->ctx);
-		free(obj->data);
-		memset(obj, 0, sizeof(*obj));
+		obj_destroy(obj);
 	}
 
 	free(state);
+	memstat_add(MEMSTAT_METHOD_STATE, -(int64_t)sizeof(*state));
 }
 
 struct fifo_state *get_fifo_state(struct gpu_object *fifo)
@@ -76,10 +158,114 @@ struct fifo_state *get_fifo_state(struct gpu_object *fifo)
 	{
 		fifo->class_data = calloc(1, sizeof(struct fifo_state));
 		fifo->class_data_destroy = fifo_state_destroy;
+		memstat_add(MEMSTAT_METHOD_STATE, sizeof(struct fifo_state));
 	}
 	return fifo->class_data;
 }
 
+static struct fifo_state *find_fifo_state(struct gpu_object *fifo)
+{
+	if (fifo && fifo->class_data && fifo->class_data_destroy == fifo_state_destroy)
+		return fifo->class_data;
+	return NULL;
+}
+
+/*
+ * Releases method state of objects living in the fifo of destroyed gpu_obj.
+ * Objects still bound to a subchannel keep their handle and class, so headers
+ * of later methods on that subchannel (like the SET_OBJECT rebinding it) are
+ * annotated the same way as without a memory budget. Their slot is freed when
+ * the subchannel is rebound.
+ */
+void pushbuf_drop_object(struct gpu_object *gpu_obj)
+{
+	struct gpu_object *fifo = nvrm_get_parent_fifo(gpu_obj);
+	struct fifo_state *state;
+	int i, j;
+
+	if (fifo == gpu_obj || !(state = find_fifo_state(fifo)))
+		return;
+
+	for (i = 0; i < MAX_OBJECTS; i++)
+	{
+		struct obj *obj = &state->objects[i];
+		if (!obj->handle || obj->gpu_object != gpu_obj)
+			continue;
+		for (j = 0; j < 8; ++j)
+			if (state->subchans[j] == obj)
+				break;
+		if (j == 8)
+		{
+			obj_destroy(obj);
+			continue;
+		}
+
+		obj_free_cache(obj);
+		obj_free_data(obj);
+		obj->decoder = NULL;
+		obj->gpu_object = NULL;
+	}
+}
+
+/* binds obj to a subchannel, freeing the previous object if it was dropped */
+static void set_subchan(struct pushbuf_decode_state *pstate, struct obj *obj)
+{
+	struct obj **subchans = get_subchans(pstate);
+	struct obj *prev = subchans[pstate->subchan];
+	int j;
+
+	subchans[pstate->subchan] = obj;
+	if (!prev || prev->gpu_object || prev == obj)
+		return;
+
+	for (j = 0; j < 8; ++j)
+		if (subchans[j] == prev)
+			return;
+	obj_destroy(prev);
+}
+
+static int obj_lru_cmp(const void *a, const void *b)
+{
+	const struct obj *o1 = *(const struct obj **)a, *o2 = *(const struct obj **)b;
+	if (o1->last_used != o2->last_used)
+		return o1->last_used < o2->last_used ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Frees method decode caches of the least recently used objects until at
+ * least "bytes" were released. Caches are rebuilt on demand, so this does
+ * not change the output.
+ */
+uint64_t pushbuf_evict_caches(uint64_t bytes)
+{
+	struct obj **objs = NULL;
+	int objsnum = 0, objsmax = 0;
+	struct gpu_object *fifo;
+	uint64_t freed = 0;
+	int i;
+
+	for (fifo = gpu_objects; fifo != NULL; fifo = fifo->next)
+	{
+		struct fifo_state *state = find_fifo_state(fifo);
+		if (!state)
+			continue;
+		for (i = 0; i < MAX_OBJECTS; i++)
+			if (state->objects[i].handle && state->objects[i].last_used)
+				ADDARRAY(objs, &state->objects[i]);
+	}
+
+	qsort(objs, objsnum, sizeof(objs[0]), obj_lru_cmp);
+	for (i = 0; i < objsnum && freed < bytes; i++)
+	{
+		freed += obj_free_cache(objs[i]);
+		objs[i]->last_used = 0;
+	}
+
+	free(objs);
+	return freed;
+}
+
 struct obj **get_subchans(struct pushbuf_decode_state *pstate)
 {
 	return get_fifo_state(pstate->fifo)->subchans;
@@ -167,22 +353,33 @@ void pushbuf_add_object_name(uint32_t handle, uint32_t name, struct gpu_object *
 	mmt_error("pushbuf_add_object_name(0x%08x, 0x%08x): no object\n", handle, name);
 }
 
-static struct obj *get_object(uint32_t handle, struct gpu_object *gpu_obj)
+static struct obj *find_object(uint32_t handle, struct obj *objs)
 {
-	struct obj *objs = get_all_objects(gpu_obj);
 	int i;
-	if (handle == 0)
-		return NULL;
 
+	/* objects dropped by pushbuf_drop_object have no gpu_object */
 	for (i = 0; i < MAX_OBJECTS; i++)
-		if (objs[i].handle == handle)
+		if (objs[i].handle == handle && objs[i].gpu_object)
 			return &objs[i];
 
 	for (i = 0; i < MAX_OBJECTS; i++)
-		if (objs[i].name == handle)
+		if (objs[i].name == handle && objs[i].gpu_object)
 			return &objs[i];
 
-	if (nvrm_get_chipset(gpu_obj) >= 0xc0)
+	return NULL;
+}
+
+static struct obj *get_object(uint32_t handle, struct gpu_object *gpu_obj)
+{
+	struct obj *objs = get_all_objects(gpu_obj);
+	struct obj *obj;
+	if (handle == 0)
+		return NULL;
+
+	/* objects of one fifo are shared by channels decoded in parallel */
+	chanq_lock();
+	obj = find_object(handle, objs);
+	if (!obj && nvrm_get_chipset(gpu_obj) >= 0xc0)
 	{
 		if (demmt_get_fdtype(gpu_obj->fd) == FDDRM)
 		{
@@ -196,11 +393,29 @@ static struct obj *get_object(uint32_t handle, struct gpu_object *gpu_obj)
 			struct gpu_object *gpu_obj2 = gpu_object_add(gpu_obj->fd, gpu_obj->cid, gpu_obj->handle, handle, handle & 0xffff);
 			pushbuf_add_object(handle, handle & 0xffff, gpu_obj2);
 		}
-
-		return get_object(handle, gpu_obj);
+		obj = find_object(handle, objs);
 	}
+	chanq_unlock();
 
-	return NULL;
+	return obj;
+}
+
+/*
+ * Whether any object of the fifo has a decoder that writes to gpu buffers.
+ * Submissions of such fifos must not be decoded out of trace order.
+ */
+int pushbuf_fifo_uploads(struct gpu_object *fifo)
+{
+	struct fifo_state *state = find_fifo_state(fifo);
+	int i;
+
+	if (!state)
+		return 0;
+	for (i = 0; i < MAX_OBJECTS; i++)
+		if (state->objects[i].handle && state->objects[i].decoder &&
+				state->objects[i].decoder->uploads)
+			return 1;
+	return 0;
 }
 
 static void decode_header(struct pushbuf_decode_state *state, char *output)
@@ -244,7 +459,13 @@ void decode_method_raw(int mthd, uint32_t data, struct obj *obj, char *dec_obj,
 		char *tmp;
 		struct rnndecaddrinfo *ai;
 		int bucket = (mthd * (mthd + 3)) % ADDR_CACHE_SIZE;
-		struct cache_entry *entry = obj->cache[bucket];
+		struct cache_entry *entry;
+		if (!obj->cache)
+		{
+			obj->cache = calloc(ADDR_CACHE_SIZE, sizeof(obj->cache[0]));
+			memstat_add(MEMSTAT_DECODE_CACHES, ADDR_CACHE_SIZE * sizeof(obj->cache[0]));
+		}
+		entry = obj->cache[bucket];
 		while (entry && entry->mthd != mthd)
 			entry = entry->next;
 		if (entry)
@@ -256,7 +477,9 @@ void decode_method_raw(int mthd, uint32_t data, struct obj *obj, char *dec_obj,
 			entry->info = ai = rnndec_decodeaddr(obj->ctx, domain, mthd, 1);
 			entry->next = obj->cache[bucket];
 			obj->cache[bucket] = entry;
+			memstat_add(MEMSTAT_DECODE_CACHES, cache_entry_size(entry));
 		}
+		obj->last_used = __atomic_add_fetch(&cache_tick, 1, __ATOMIC_RELAXED);
 
 		strcpy(dec_mthd,  ai->name);
 		if (dec_val)
@@ -282,7 +505,7 @@ void decode_method_raw(int mthd, uint32_t data, struct obj *obj, char *dec_obj,
 static void decode_method(struct pushbuf_decode_state *state, char *output)
 {
 	struct obj *obj = current_subchan_object(state);
-	static char dec_obj[1000], dec_mthd[1000], dec_val[1000];
+	char dec_obj[1000], dec_mthd[1000], dec_val[1000];
 	if (!decode_pb)
 	{
 		output[0] = 0;
@@ -520,7 +743,7 @@ uint64_t pushbuf_decode(struct pushbuf_decode_state *state, uint32_t data, char
 			}
 
 			if (handle)
-				subchans[state->subchan] = get_object(handle, state->fifo);
+				set_subchan(state, get_object(handle, state->fifo));
 		}
 		if (subchans[state->subchan] == NULL && state->addr != 0)
 			mmt_log("subchannel %d does not have bound object and first command does not bind it\n", state->subchan);
@@ -534,13 +757,13 @@ uint64_t pushbuf_decode(struct pushbuf_decode_state *state, uint32_t data, char
 		if (state->addr == 0)
 		{
 			if (subchans[state->subchan] == NULL)
-				subchans[state->subchan] = get_object(data, state->fifo);
+				set_subchan(state, get_object(data, state->fifo));
 			else
 			{
-				if (data != subchans[state->subchan]->handle)
+				if (data != subchans[state->subchan]->handle || !subchans[state->subchan]->gpu_object)
 				{
 					if (safe)
-						subchans[state->subchan] = get_object(data, state->fifo);
+						set_subchan(state, get_object(data, state->fifo));
 					else
 						mmt_log("subchannel %d is already taken\n", state->subchan);
 				}
@@ -561,7 +784,7 @@ uint64_t pushbuf_decode(struct pushbuf_decode_state *state, uint32_t data, char
 	return 0;
 }
 
-static uint64_t __pushbuf_print(struct pushbuf_decode_state *pstate, uint32_t *cur, uint32_t *end, uint64_t gpu_address, int commands)
+uint64_t __pushbuf_print(struct pushbuf_decode_state *pstate, uint32_t *cur, uint32_t *end, uint64_t gpu_address, int commands)
 {
 	char cmdoutput[1024];
 	uint64_t nextaddr;
@@ -583,18 +806,19 @@ static uint64_t __pushbuf_print(struct pushbuf_decode_state *pstate, uint32_t *c
 
 		if (obj)
 		{
-			if (obj->data == NULL)
-				obj->data = calloc(OBJECT_SIZE, sizeof(obj->data[0]));
-
 			if (pstate->mthd_data_available)
 			{
 				if (pstate->mthd < OBJECT_SIZE)
-					obj->data[pstate->mthd / 4] = pstate->mthd_data;
+					obj_set_method_value(obj, pstate->mthd, pstate->mthd_data);
 				else
 					mmt_log("not enough space for object data 0x%x\n", pstate->mthd);
 
 				if (obj->decoder && obj->decoder->decode_terse)
+				{
+					chanq_lock();
 					obj->decoder->decode_terse(obj->gpu_object, pstate);
+					chanq_unlock();
+				}
 			}
 		}
 
@@ -602,7 +826,11 @@ static uint64_t __pushbuf_print(struct pushbuf_decode_state *pstate, uint32_t *c
 			mmt_printf("%s\n", "");
 
 		if (pstate->mthd_data_available && obj && obj->decoder && obj->decoder->decode_verbose)
+		{
+			chanq_lock();
 			obj->decoder->decode_verbose(obj->gpu_object, pstate);
+			chanq_unlock();
+		}
 
 		cur++;
 	}
@@ -627,7 +855,10 @@ static void ib_flush(struct ib_decode_state *state)
 		uint64_t cur = state->address - m->address;
 		uint64_t end = cur + state->size * 4;
 
-		__pushbuf_print(&state->pstate, (uint32_t *)&data[cur], (uint32_t *)&data[end], state->address, state->size);
+		if (chanq_enabled)
+			chanq_submit(&state->pstate, m->object, m->object_offset + cur, state->size, state->address);
+		else
+			__pushbuf_print(&state->pstate, (uint32_t *)&data[cur], (uint32_t *)&data[end], state->address, state->size);
 
 		state->gpu_mapping = NULL;
 	}
@@ -13,6 +13,8 @@ struct cache_entry
 };
 
 #define OBJECT_SIZE (0x8000 * 4)
+/* method values are allocated in pages of this many bytes when first set */
+#define OBJECT_PAGE_SIZE 0x400
 
 struct obj
 {
@@ -22,9 +24,10 @@ struct obj
 	char *desc;
 	struct rnndeccontext *ctx;
 	const struct gpu_object_decoder *decoder;
-	struct cache_entry *cache[ADDR_CACHE_SIZE];
-	uint32_t *data;
+	struct cache_entry **cache; // ADDR_CACHE_SIZE buckets, allocated on demand
+	uint32_t **data; // OBJECT_SIZE / OBJECT_PAGE_SIZE pages, see obj_method_value
 	struct gpu_object *gpu_object;
+	uint64_t last_used; // decode_method_raw tick, for cache eviction
 };
 
 #define MAX_OBJECTS 256
@@ -91,6 +94,7 @@ void pushbuf_add_object_name(uint32_t handle, uint32_t fifo_name, struct gpu_obj
 
 uint64_t pushbuf_decode(struct pushbuf_decode_state *state, uint32_t data, char *output, int safe);
 
+uint64_t __pushbuf_print(struct pushbuf_decode_state *pstate, uint32_t *cur, uint32_t *end, uint64_t gpu_address, int commands);
 uint64_t pushbuf_print(struct pushbuf_decode_state *pstate, struct gpu_mapping *gpu_mapping, uint64_t gpu_address, int commands);
 
 void ib_decode(struct ib_decode_state *state, uint32_t data, char *output);
@@ -102,6 +106,13 @@ void user_decode_end(struct user_decode_state *state);
 void decode_method_raw(int mthd, uint32_t data, struct obj *obj, char *dec_obj,
 		char *dec_mthd, char *dec_val);
 
+uint32_t obj_method_value(struct obj *obj, uint32_t mthd);
+void obj_set_method_value(struct obj *obj, uint32_t mthd, uint32_t value);
+
+void pushbuf_drop_object(struct gpu_object *gpu_obj);
+uint64_t pushbuf_evict_caches(uint64_t bytes);
+int pushbuf_fifo_uploads(struct gpu_object *fifo);
+
 struct obj **get_subchans(struct pushbuf_decode_state *pstate);
 struct obj *current_subchan_object(struct pushbuf_decode_state *pstate);
 
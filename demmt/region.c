@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include "region.h"
 #include "log.h"
+#include "memstat.h"
 
 void dump_regions(struct regions *regions)
 {
@@ -92,6 +93,7 @@ static void drop_region(struct region *reg, struct regions *parent)
 	struct region *next = reg->next;
 	mmt_debug("dropping entry <0x%08x, 0x%08x>\n", reg->start, reg->end);
 	free(reg);
+	memstat_add(MEMSTAT_REGIONS, -(int64_t)sizeof(*reg));
 	if (prev)
 		prev->next = next;
 	else
@@ -189,6 +191,7 @@ void free_regions(struct regions *regions)
 	{
 		next = cur->next;
 		free(cur);
+		memstat_add(MEMSTAT_REGIONS, -(int64_t)sizeof(*cur));
 		cur = next;
 	}
 
@@ -203,6 +206,7 @@ static void __regions_add_range(struct regions *regions, uint32_t start, uint32_
 	if (cur == NULL)
 	{
 		regions->head = cur = malloc(sizeof(struct region));
+		memstat_add(MEMSTAT_REGIONS, sizeof(struct region));
 		cur->start = start;
 		cur->end = start + len;
 		cur->prev = NULL;
@@ -225,6 +229,7 @@ static void __regions_add_range(struct regions *regions, uint32_t start, uint32_
 		mmt_debug("adding last entry <0x%08x, 0x%08x> after <0x%08x, 0x%08x>\n",
 				start, start + len, last_reg->start, last_reg->end);
 		cur = malloc(sizeof(struct region));
+		memstat_add(MEMSTAT_REGIONS, sizeof(struct region));
 		cur->start = start;
 		cur->end = start + len;
 		cur->prev = last_reg;
@@ -274,6 +279,7 @@ static void __regions_add_range(struct regions *regions, uint32_t start, uint32_
 		mmt_debug("adding new entry <0x%08x, 0x%08x> before <0x%08x, 0x%08x>\n",
 				start, start + len, cur->start, cur->end);
 		struct region *tmp = malloc(sizeof(struct region));
+		memstat_add(MEMSTAT_REGIONS, sizeof(struct region));
 		tmp->start = start;
 		tmp->end = start + len;
 		tmp->prev = cur->prev;
@@ -25,23 +25,29 @@
 #include "easm.h"
 #include <stdlib.h>
 
-void easm_cfold_sinsn(struct easm_sinsn *sinsn) {
+static int cfold_expr(struct easm_expr *expr, int del);
+
+static void cfold_sinsn(struct easm_sinsn *sinsn, int del) {
 	int i, j;
 	for (i = 0; i < sinsn->operandsnum; i++)
 		for (j = 0; j < sinsn->operands[i]->exprsnum; j++)
-			easm_cfold_expr(sinsn->operands[i]->exprs[j]);
+			cfold_expr(sinsn->operands[i]->exprs[j], del);
 }
 
-int easm_cfold_expr(struct easm_expr *expr) {
+void easm_cfold_sinsn(struct easm_sinsn *sinsn) {
+	cfold_sinsn(sinsn, 1);
+}
+
+static int cfold_expr(struct easm_expr *expr, int del) {
 	if (expr->type == EASM_EXPR_NUM)
 		return 1;
 	int e1f = 1, e2f = 1;
 	if (expr->e1)
-		e1f = easm_cfold_expr(expr->e1);
+		e1f = cfold_expr(expr->e1, del);
 	if (expr->e2)
-		e2f = easm_cfold_expr(expr->e2);
+		e2f = cfold_expr(expr->e2, del);
 	if (expr->sinsn)
-		easm_cfold_sinsn(expr->sinsn);
+		cfold_sinsn(expr->sinsn, del);
 	if (!e1f || !e2f || expr->type < EASM_EXPR_LOR || expr->type > EASM_EXPR_LNOT)
 		return 0;
 	uint64_t val;
@@ -107,8 +113,10 @@ int easm_cfold_expr(struct easm_expr *expr) {
 		default:
 			abort();
 	}
-	easm_del_expr(expr->e1);
-	easm_del_expr(expr->e2);
+	if (del) {
+		easm_del_expr(expr->e1);
+		easm_del_expr(expr->e2);
+	}
 	expr->e1 = 0;
 	expr->e2 = 0;
 	expr->num = val;
@@ -116,6 +124,14 @@ int easm_cfold_expr(struct easm_expr *expr) {
 	return 1;
 }
 
+int easm_cfold_expr(struct easm_expr *expr) {
+	return cfold_expr(expr, 1);
+}
+
+int easm_cfold_expr_nofree(struct easm_expr *expr) {
+	return cfold_expr(expr, 0);
+}
+
 void easm_cfold_insn(struct easm_insn *insn) {
 	int i, j;
 	for (i = 0; i < insn->subinsnsnum; i++) {
@@ -34,6 +34,20 @@ struct iasctx {
 	int atomsmax;
 };
 
+/*
+ * Match lists are built and torn down for every table entry tried, and
+ * most of them hold a single match, so they start small, and are merged
+ * and concatenated in place where possible.
+ */
+
+static void addmatch(struct matches *res, const struct match *m) {
+	if (res->mnum >= res->mmax) {
+		res->mmax = res->mmax ? res->mmax * 2 : 1;
+		res->m = realloc(res->m, res->mmax * sizeof *res->m);
+	}
+	res->m[res->mnum++] = *m;
+}
+
 struct matches *emptymatches() {
 	struct matches *res = calloc(sizeof *res, 1);
 	return res;
@@ -42,22 +56,30 @@ struct matches *emptymatches() {
 struct matches *alwaysmatches(int lpos) {
 	struct matches *res = calloc(sizeof *res, 1);
 	struct match m = { .lpos = lpos };
-	ADDARRAY(res->m, m);
+	addmatch(res, &m);
 	return res;
 }
 
 struct matches *catmatches(struct matches *a, struct matches *b) {
-	int i;
-	for (i = 0; i < b->mnum; i++)
-		ADDARRAY(a->m, b->m[i]);
+	if (!a->mnum) {
+		free(a->m);
+		free(a);
+		return b;
+	}
+	if (a->mnum + b->mnum > a->mmax) {
+		a->mmax = a->mmax * 2 > a->mnum + b->mnum ? a->mmax * 2 : a->mnum + b->mnum;
+		a->m = realloc(a->m, a->mmax * sizeof *a->m);
+	}
+	memcpy(a->m + a->mnum, b->m, b->mnum * sizeof *b->m);
+	a->mnum += b->mnum;
 	free(b->m);
 	free(b);
 	return a;
 }
 
 struct matches *mergematches(struct match a, struct matches *b) {
-	struct matches *res = emptymatches();
 	int i, j;
+	int n = 0;
 	for (i = 0; i < b->mnum; i++) {
 		for (j = 0; j < MAXOPLEN; j++) {
 			ull cmask = a.m[j] & b->m[i].m[j];
@@ -65,24 +87,23 @@ struct matches *mergematches(struct match a, struct matches *b) {
 				break;
 		}
 		if (j == MAXOPLEN) {
-			struct match nm = b->m[i];
-			if (!nm.oplen)
-				nm.oplen = a.oplen;
+			struct match *nm = &b->m[n++];
+			if (nm != &b->m[i])
+				*nm = b->m[i];
+			if (!nm->oplen)
+				nm->oplen = a.oplen;
 			for (j = 0; j < MAXOPLEN; j++) {
-				nm.a[j] |= a.a[j];
-				nm.m[j] |= a.m[j];
+				nm->a[j] |= a.a[j];
+				nm->m[j] |= a.m[j];
 			}
-			int j;
-			assert (a.nrelocs + nm.nrelocs <= 8);
+			assert (a.nrelocs + nm->nrelocs <= 8);
 			for (j = 0; j < a.nrelocs; j++)
-				nm.relocs[nm.nrelocs + j] = a.relocs[j];
-			nm.nrelocs += a.nrelocs;
-			ADDARRAY(res->m, nm);
+				nm->relocs[nm->nrelocs + j] = a.relocs[j];
+			nm->nrelocs += a.nrelocs;
 		}
 	}
-	free(b->m);
-	free(b);
-	return res;
+	b->mnum = n;
+	return b;
 }
 
 static inline ull bf_(int s, int l, ull *a, ull *m) {
@@ -235,7 +256,7 @@ static int setbf (struct match *res, const struct bitfield *bf, ull num) {
 struct matches *tabdesc (struct iasctx *ctx, struct match m, const struct atom *atoms) {
 	if (!atoms->fun_as) {
 		struct matches *res = emptymatches();
-		ADDARRAY(res->m, m);
+		addmatch(res, &m);
 		return res;
 	}
 	struct matches *ms = atoms->fun_as(ctx, atoms->arg, m.lpos);
@@ -585,7 +606,7 @@ struct matches *atommem_a APROTO {
 			return 0;
 	}
 	struct matches *rres = emptymatches();
-	ADDARRAY(rres->m, res);
+	addmatch(rres, &res);
 	return rres;
 }
 
@@ -647,7 +668,7 @@ struct matches *atomvec_a APROTO {
 		       return 0;	
 	}
 	struct matches *rres = emptymatches();
-	ADDARRAY(rres->m, res);
+	addmatch(rres, &res);
 	return rres;
 }
 
@@ -666,7 +687,7 @@ struct matches *atombf_a APROTO {
 	if (!setbf(&res, &bf[1], b))
 		return 0;
 	struct matches *rres = emptymatches();
-	ADDARRAY(rres->m, res);
+	addmatch(rres, &res);
 	return rres;
 }
 
@@ -737,16 +758,23 @@ void convert_insn(struct iasctx *ctx, struct easm_insn *insn) {
 }
 
 struct matches *do_as(const struct disisa *isa, struct varinfo *varinfo, struct easm_insn *insn) {
-	struct matches *res = calloc(sizeof *res, 1);
 	struct iasctx c = { isa, varinfo };
 	struct iasctx *ctx = &c;
 	convert_insn(ctx, insn);
 	const struct insn *root = isa->trootas ? isa->trootas : isa->troot;
-	struct matches *m = atomtab_a(ctx, root, 0);
-	int i;
-	for (i = 0; i < m->mnum; i++)
-		if (m->m[i].lpos == ctx->atomsnum) {
-			ADDARRAY(res->m, m->m[i]);
-		}
+	struct matches *res = atomtab_a(ctx, root, 0);
+	int i, n = 0;
+	for (i = 0; i < res->mnum; i++)
+		if (res->m[i].lpos == ctx->atomsnum)
+			res->m[n++] = res->m[i];
+	res->mnum = n;
+	/* these stay around until the end */
+	if (n && n < res->mmax) {
+		res->m = realloc(res->m, n * sizeof *res->m);
+		res->mmax = n;
+	}
+	for (i = 0; i < ctx->atomsnum; i++)
+		free(ctx->atoms[i]);
+	free(ctx->atoms);
 	return res;
 }
@@ -24,9 +24,162 @@
 
 #include "dis-intern.h"
 #include "easm.h"
+#include <stdarg.h>
 #include <stdlib.h>
+#include <pthread.h>
+
+/*
+ * Arena
+ *
+ * Everything decoded for a single instruction (litems, expressions, the
+ * resulting easm_insn and its strings) is allocated from a bump arena owned
+ * by the decoctx, and the whole lot is thrown away at once by resetting the
+ * arena once the instruction has been printed. Blocks are kept around for
+ * reuse, so after the first few instructions decoding doesn't touch malloc
+ * at all. Instruction and modifier names point straight into the tables.
+ *
+ * Users of envydis_list get an arena of their own, which holds the listing.
+ */
+
+#define DIS_ARENA_BLOCK 0x4000
+/* limit on memory used to keep decoded instructions around in label mode */
+#define DIS_DRES_MAX (64 << 20)
+
+struct dis_arena_block {
+	struct dis_arena_block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct dis_arena {
+	struct dis_arena_block *first;
+	struct dis_arena_block *cur;
+	size_t size;
+};
+
+static void *dis_alloc(struct dis_arena *arena, size_t size) {
+	struct dis_arena_block *blk = arena->cur;
+	size = (size + 15) & ~(size_t)15;
+	while (blk && blk->used + size > blk->size) {
+		if (!blk->next)
+			break;
+		blk = blk->next;
+		blk->used = 0;
+	}
+	if (!blk || blk->used + size > blk->size) {
+		size_t bsize = size > DIS_ARENA_BLOCK ? size : DIS_ARENA_BLOCK;
+		struct dis_arena_block *nblk = malloc(sizeof *nblk + bsize);
+		nblk->size = bsize;
+		nblk->used = 0;
+		arena->size += bsize;
+		if (blk) {
+			nblk->next = blk->next;
+			blk->next = nblk;
+		} else {
+			nblk->next = arena->first;
+			arena->first = nblk;
+		}
+		blk = nblk;
+	}
+	arena->cur = blk;
+	void *res = blk->data + blk->used;
+	blk->used += size;
+	memset(res, 0, size);
+	return res;
+}
+
+static void dis_arena_reset(struct dis_arena *arena) {
+	arena->cur = arena->first;
+	if (arena->cur)
+		arena->cur->used = 0;
+}
+
+static void dis_arena_fini(struct dis_arena *arena) {
+	struct dis_arena_block *blk = arena->first;
+	while (blk) {
+		struct dis_arena_block *next = blk->next;
+		free(blk);
+		blk = next;
+	}
+	arena->first = arena->cur = 0;
+	arena->size = 0;
+}
+
+struct dis_arena *dis_arena_new(void) {
+	return calloc(sizeof(struct dis_arena), 1);
+}
+
+void dis_arena_del(struct dis_arena *arena) {
+	dis_arena_fini(arena);
+	free(arena);
+}
+
+static char *dis_aprintf(struct dis_arena *arena, const char *format, ...) {
+	va_list va;
+	char buf[64];
+	va_start(va, format);
+	int len = vsnprintf(buf, sizeof buf, format, va);
+	va_end(va);
+	char *res = dis_alloc(arena, len + 1);
+	if (len < sizeof buf) {
+		memcpy(res, buf, len + 1);
+	} else {
+		va_start(va, format);
+		vsnprintf(res, len + 1, format, va);
+		va_end(va);
+	}
+	return res;
+}
+
+/* like ADDARRAY, but for arrays living in the arena */
+#define DIS_ADDARRAY(arena, a, e) \
+	do { \
+	if ((a ## num) >= (a ## max)) { \
+		int nmax = (a ## max) ? (a ## max) * 2 : 4; \
+		void *na = dis_alloc((arena), nmax * sizeof *(a)); \
+		if (a ## num) \
+			memcpy(na, (a), (a ## num) * sizeof *(a)); \
+		(a) = na; \
+		(a ## max) = nmax; \
+	} \
+	(a)[(a ## num)++] = (e); \
+	} while(0)
+
+static struct easm_expr *dis_expr(struct dis_arena *arena, enum easm_expr_type type) {
+	struct easm_expr *res = dis_alloc(arena, sizeof *res);
+	res->type = type;
+	return res;
+}
+
+static struct easm_expr *dis_expr_bin(struct dis_arena *arena, enum easm_expr_type type, struct easm_expr *e1, struct easm_expr *e2) {
+	struct easm_expr *res = dis_expr(arena, type);
+	res->e1 = e1;
+	res->e2 = e2;
+	return res;
+}
+
+static struct easm_expr *dis_expr_un(struct dis_arena *arena, enum easm_expr_type type, struct easm_expr *e1) {
+	struct easm_expr *res = dis_expr(arena, type);
+	res->e1 = e1;
+	return res;
+}
+
+static struct easm_expr *dis_expr_num(struct dis_arena *arena, enum easm_expr_type type, uint64_t num) {
+	struct easm_expr *res = dis_expr(arena, type);
+	res->num = num;
+	return res;
+}
+
+static struct easm_expr *dis_expr_str(struct dis_arena *arena, enum easm_expr_type type, const char *str) {
+	struct easm_expr *res = dis_expr(arena, type);
+	res->str = (char *)str;
+	return res;
+}
 
 struct disctx {
+	struct dis_arena *arena;
+	struct dis_arena *tmp;	/* for litems, which are dead once the insn is parsed */
 	const struct disisa *isa;
 	struct varinfo *varinfo;
 	int oplen;
@@ -34,6 +187,8 @@ struct disctx {
 	int atomsnum;
 	int atomsmax;
 	int endmark;
+	struct dtree *dtree; /* compiled table for the next atomtab_d, if known */
+	ull *deps; /* if set, collects opcode bits looked at by table scans */
 };
 
 static inline ull bf_(int s, int l, ull *a, ull *m) {
@@ -83,7 +238,7 @@ ull getbf(const struct bitfield *bf, ull *a, ull *m) {
 	return res;
 }
 
-struct easm_expr *getrbf(const struct rbitfield *bf, ull *a, ull *m) {
+struct easm_expr *getrbf(struct disctx *ctx, const struct rbitfield *bf, ull *a, ull *m) {
 	ull res = 0;
 	int pos = bf->shr;
 	int i;
@@ -107,40 +262,302 @@ struct easm_expr *getrbf(const struct rbitfield *bf, ull *a, ull *m) {
 			break;
 	}
 	if (bf->pcrel) {
-		struct easm_expr *expr = easm_expr_simple(EASM_EXPR_POS);
+		struct easm_expr *expr = dis_expr(ctx->arena, EASM_EXPR_POS);
 		if (bf->pospreadd)
-			expr = easm_expr_bin(EASM_EXPR_ADD, expr, easm_expr_num(EASM_EXPR_NUM, bf->pospreadd));
+			expr = dis_expr_bin(ctx->arena, EASM_EXPR_ADD, expr, dis_expr_num(ctx->arena, EASM_EXPR_NUM, bf->pospreadd));
 		if (bf->shr)
-			expr = easm_expr_bin(EASM_EXPR_AND, expr, easm_expr_num(EASM_EXPR_NUM, -(1ull << bf->shr)));
-		expr = easm_expr_bin(EASM_EXPR_ADD, expr, easm_expr_num(EASM_EXPR_NUM, res));
+			expr = dis_expr_bin(ctx->arena, EASM_EXPR_AND, expr, dis_expr_num(ctx->arena, EASM_EXPR_NUM, -(1ull << bf->shr)));
+		expr = dis_expr_bin(ctx->arena, EASM_EXPR_ADD, expr, dis_expr_num(ctx->arena, EASM_EXPR_NUM, res));
 		if (bf->addend)
-			expr = easm_expr_bin(EASM_EXPR_ADD, expr, easm_expr_num(EASM_EXPR_NUM, bf->addend));
+			expr = dis_expr_bin(ctx->arena, EASM_EXPR_ADD, expr, dis_expr_num(ctx->arena, EASM_EXPR_NUM, bf->addend));
 		return expr;
 	} else {
 		res += bf->addend;
-		return easm_expr_num(EASM_EXPR_NUM, res);
+		return dis_expr_num(ctx->arena, EASM_EXPR_NUM, res);
 	}
 }
 
 #define GETBF(bf) getbf(bf, a, m)
-#define GETRBF(bf) getrbf(bf, a, m)
+#define GETRBF(bf) getrbf(ctx, bf, a, m)
 
-static inline struct litem *makeli(struct easm_expr *e) {
-	struct litem *li = calloc(sizeof *li, 1);
+static inline struct litem *makeli(struct disctx *ctx, struct easm_expr *e) {
+	struct litem *li = dis_alloc(ctx->tmp, sizeof *li);
 	li->type = LITEM_EXPR;
 	li->expr = e;
 	return li;
 }
 
-void atomtab_d DPROTO {
-	const struct insn *tab = v;
+/*
+ * Decision trees
+ *
+ * Scanning big tables linearly for every decoded field is slow, so the first
+ * time a table is used with a given variant, it's compiled into a decision
+ * tree testing small bitfields of the first opcode word.
+ *
+ * A tree node corresponds to a set of opcodes with some bits already known.
+ * The first entry that can still match these opcodes is looked up: if all of
+ * its mask bits are known, it's the entry linear scan would pick, and the node
+ * becomes a leaf. Otherwise, the node switches on up to DTREE_BITS contiguous
+ * unknown bits of its mask, and all children continue the search from that
+ * entry. This only ever touches entries that linear scan could reach, so
+ * tables relying on covering all possible values instead of a terminator
+ * are fine too.
+ *
+ * Children are stored in a flat array, leaves as -1 - entry index, inner
+ * nodes as indices into the nodes array. Trees that grow beyond
+ * DTREE_MAX_KIDS children are dropped, and the table keeps being scanned
+ * linearly. So are trees for tables where the scan never goes past
+ * DTREE_MIN_ENTRIES entries, as walking them wouldn't be any faster.
+ *
+ * To avoid looking up trees by table pointer all the time, every tree also
+ * remembers the trees of the sub-tables used by its entries, and atomtab_d
+ * passes them down through disctx. Once filled in, these links never change,
+ * so they're read without taking the lock.
+ */
+
+#define DTREE_BITS 4
+#define DTREE_MAX_KIDS 0x40000
+#define DTREE_MIN_ENTRIES 8
+
+struct dtnode {
+	int shift;
+	int bits;
+	int kids;
+};
+
+struct dtree {
+	const struct insn *tab;
+	uint32_t fmask;
+	int mode;
+	int linear;
+	int maxent;
+	int root;
+	/* per entry, trees of the sub-tables its atoms descend into */
+	struct dtree ***subs;
+	/* per entry, opcode bits looked at by linear scan until reaching it */
+	ull *deps;
+	/* opcode lengths in memo cache entries for this root table, in bytes */
+	uint32_t memolens;
+	struct dtnode *nodes;
+	int nodesnum;
+	int nodesmax;
+	int *kids;
+	int kidsnum;
+	int kidsmax;
+};
+
+/* shared by all threads, lookups and insertions go under dtree_lock */
+static struct dtree **dtrees;
+static int dtreesnum;
+static int dtreesmax;
+static pthread_mutex_t dtree_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int dtree_build(struct dtree *dt, struct varinfo *varinfo, ull kmask, ull kval, int start) {
+	const struct insn *tab = dt->tab;
+	int i, j;
+	for (i = start; ; i++) {
+		if (!var_ok(tab[i].fmask, tab[i].ptype, varinfo))
+			continue;
+		/* can never match */
+		if (tab[i].val & ~tab[i].mask)
+			continue;
+		/* conflicts with already known bits */
+		if ((tab[i].val ^ kval) & tab[i].mask & kmask)
+			continue;
+		break;
+	}
+	if (i > dt->maxent)
+		dt->maxent = i;
+	ull unk = tab[i].mask & ~kmask;
+	if (!unk || dt->linear)
+		return -1 - i;
+	int shift = 63 - __builtin_clzll(unk);
+	int bits = 1;
+	while (bits < DTREE_BITS && shift && unk >> (shift - 1) & 1)
+		shift--, bits++;
+	if (dt->kidsnum + (1 << bits) > DTREE_MAX_KIDS) {
+		dt->linear = 1;
+		return -1 - i;
+	}
+	int res = dt->nodesnum;
+	struct dtnode node = { shift, bits, dt->kidsnum };
+	ADDARRAY(dt->nodes, node);
+	for (j = 0; j < 1 << bits; j++) {
+		int kid = 0;
+		ADDARRAY(dt->kids, kid);
+	}
+	ull fmask = ((1ull << bits) - 1) << shift;
+	for (j = 0; j < 1 << bits; j++) {
+		int kid = dtree_build(dt, varinfo, kmask | fmask, kval | (ull)j << shift, i);
+		dt->kids[node.kids + j] = kid;
+	}
+	return res;
+}
+
+static inline uint32_t dtree_fmask(struct varinfo *varinfo) {
+	return varinfo->data->featuresnum ? varinfo->fmask[0] : 0;
+}
+
+static inline int dtree_mode(struct varinfo *varinfo) {
+	return varinfo->data->modesetsnum ? varinfo->modes[0] : -1;
+}
+
+static struct dtree *dtree_get_locked(const struct insn *tab, struct varinfo *varinfo) {
+	uint32_t fmask = dtree_fmask(varinfo);
+	int mode = dtree_mode(varinfo);
 	int i;
-	while ((a[0]&tab->mask) != tab->val || !var_ok(tab->fmask, tab->ptype, ctx->varinfo))
+	/* open addressing, size is always a power of two */
+	if (dtreesmax) {
+		for (i = ((uintptr_t)tab >> 3) & (dtreesmax - 1); dtrees[i]; i = (i + 1) & (dtreesmax - 1))
+			if (dtrees[i]->tab == tab && dtrees[i]->fmask == fmask && dtrees[i]->mode == mode)
+				return dtrees[i];
+	}
+	if ((dtreesnum + 1) * 2 > dtreesmax) {
+		int nmax = dtreesmax ? dtreesmax * 2 : 0x100;
+		struct dtree **ntrees = calloc(sizeof *ntrees, nmax);
+		int j;
+		for (j = 0; j < dtreesmax; j++)
+			if (dtrees[j]) {
+				for (i = ((uintptr_t)dtrees[j]->tab >> 3) & (nmax - 1); ntrees[i]; i = (i + 1) & (nmax - 1));
+				ntrees[i] = dtrees[j];
+			}
+		free(dtrees);
+		dtrees = ntrees;
+		dtreesmax = nmax;
+	}
+	struct dtree *dt = calloc(sizeof *dt, 1);
+	dt->tab = tab;
+	dt->fmask = fmask;
+	dt->mode = mode;
+	dt->root = dtree_build(dt, varinfo, 0, 0, 0);
+	dt->subs = calloc(sizeof *dt->subs, dt->maxent + 1);
+	dt->deps = calloc(sizeof *dt->deps, dt->maxent + 1);
+	for (i = 0; i <= dt->maxent; i++) {
+		dt->deps[i] = i ? dt->deps[i - 1] : 0;
+		if (var_ok(tab[i].fmask, tab[i].ptype, varinfo) && !(tab[i].val & ~tab[i].mask))
+			dt->deps[i] |= tab[i].mask;
+	}
+	/* not worth it for short tables */
+	if (dt->maxent < DTREE_MIN_ENTRIES)
+		dt->linear = 1;
+	if (dt->linear) {
+		free(dt->nodes);
+		free(dt->kids);
+		dt->nodes = 0;
+		dt->kids = 0;
+	}
+	for (i = ((uintptr_t)tab >> 3) & (dtreesmax - 1); dtrees[i]; i = (i + 1) & (dtreesmax - 1));
+	dtrees[i] = dt;
+	dtreesnum++;
+	return dt;
+}
+
+static void dis_flush_memo(void);
+
+static struct dtree *dtree_get(const struct insn *tab, struct varinfo *varinfo) {
+	pthread_mutex_lock(&dtree_lock);
+	struct dtree *res = dtree_get_locked(tab, varinfo);
+	pthread_mutex_unlock(&dtree_lock);
+	return res;
+}
+
+/* looks up tree for sub-table used by atom i of entry e, remembering it */
+static struct dtree *dtree_get_sub(struct dtree *dt, int e, int i, struct varinfo *varinfo) {
+	const struct insn *tab = dt->tab + e;
+	pthread_mutex_lock(&dtree_lock);
+	struct dtree **subs = dt->subs[e];
+	if (!subs) {
+		subs = calloc(sizeof *subs, ARRAY_SIZE(tab->atoms));
+		__atomic_store_n(&dt->subs[e], subs, __ATOMIC_RELEASE);
+	}
+	struct dtree *res = subs[i];
+	if (!res) {
+		res = dtree_get_locked(tab->atoms[i].arg, varinfo);
+		__atomic_store_n(&subs[i], res, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&dtree_lock);
+	return res;
+}
+
+void dis_flush_dtrees(void) {
+	int i;
+	pthread_mutex_lock(&dtree_lock);
+	for (i = 0; i < dtreesmax; i++)
+		if (dtrees[i]) {
+			int j;
+			for (j = 0; j <= dtrees[i]->maxent; j++)
+				free(dtrees[i]->subs[j]);
+			free(dtrees[i]->subs);
+			free(dtrees[i]->deps);
+			free(dtrees[i]->nodes);
+			free(dtrees[i]->kids);
+			free(dtrees[i]);
+		}
+	free(dtrees);
+	dtrees = 0;
+	dtreesnum = dtreesmax = 0;
+	/* the memo cache is keyed by trees */
+	dis_flush_memo();
+	pthread_mutex_unlock(&dtree_lock);
+}
+
+const struct insn *dis_tab_scan(const struct insn *tab, ull a, struct varinfo *varinfo) {
+	while ((a&tab->mask) != tab->val || !var_ok(tab->fmask, tab->ptype, varinfo))
 		tab++;
+	return tab;
+}
+
+/* bits of the opcode that decide whether entry e is the one picked */
+static ull dtree_deps(struct dtree *dt, int e, struct varinfo *varinfo) {
+	if (e <= dt->maxent)
+		return dt->deps[e];
+	/* a linear table that got too big to compile, scanned further than the compiler got */
+	ull res = dt->deps[dt->maxent];
+	int i;
+	for (i = dt->maxent + 1; i <= e; i++)
+		if (var_ok(dt->tab[i].fmask, dt->tab[i].ptype, varinfo) && !(dt->tab[i].val & ~dt->tab[i].mask))
+			res |= dt->tab[i].mask;
+	return res;
+}
+
+static inline int dtree_match(struct dtree *dt, ull a, struct varinfo *varinfo) {
+	int x = dt->root;
+	if (dt->linear)
+		return dis_tab_scan(dt->tab, a, varinfo) - dt->tab;
+	while (x >= 0) {
+		const struct dtnode *node = &dt->nodes[x];
+		x = dt->kids[node->kids + (a >> node->shift & ((1 << node->bits) - 1))];
+	}
+	return -1 - x;
+}
+
+const struct insn *dis_tab_match(const struct insn *tab, ull a, struct varinfo *varinfo) {
+	return tab + dtree_match(dtree_get(tab, varinfo), a, varinfo);
+}
+
+void atomtab_d DPROTO {
+	struct dtree *dt = ctx->dtree;
+	if (!dt || dt->tab != v)
+		dt = dtree_get(v, ctx->varinfo);
+	int e = dtree_match(dt, a[0], ctx->varinfo);
+	const struct insn *tab = dt->tab + e;
+	struct dtree **subs = e <= dt->maxent ? __atomic_load_n(&dt->subs[e], __ATOMIC_ACQUIRE) : 0;
+	int i;
 	m[0] |= tab->mask;
+	if (ctx->deps)
+		*ctx->deps |= dtree_deps(dt, e, ctx->varinfo);
 	for (i = 0; i < ARRAY_SIZE(tab->atoms); i++)
-		if (tab->atoms[i].fun_dis)
+		if (tab->atoms[i].fun_dis) {
+			if (tab->atoms[i].fun_dis == atomtab_d) {
+				struct dtree *sub = subs ? __atomic_load_n(&subs[i], __ATOMIC_ACQUIRE) : 0;
+				if (!sub && e > dt->maxent)
+					sub = dtree_get(tab->atoms[i].arg, ctx->varinfo);
+				else if (!sub)
+					sub = dtree_get_sub(dt, e, i, ctx->varinfo);
+				ctx->dtree = sub;
+			}
 			tab->atoms[i].fun_dis (ctx, a, m, tab->atoms[i].arg);
+		}
 }
 
 void atomopl_d DPROTO {
@@ -152,61 +569,61 @@ void atomendmark_d DPROTO {
 }
 
 void atomsestart_d DPROTO {
-	struct litem *li = calloc(sizeof *li, 1);
+	struct litem *li = dis_alloc(ctx->tmp, sizeof *li);
 	li->type = LITEM_SESTART;
-	ADDARRAY(ctx->atoms, li);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, li);
 }
 
 void atomseend_d DPROTO {
-	struct litem *li = calloc(sizeof *li, 1);
+	struct litem *li = dis_alloc(ctx->tmp, sizeof *li);
 	li->type = LITEM_SEEND;
-	ADDARRAY(ctx->atoms, li);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, li);
 }
 
 void atomname_d DPROTO {
-	struct litem *li = calloc(sizeof *li, 1);
+	struct litem *li = dis_alloc(ctx->tmp, sizeof *li);
 	li->type = LITEM_NAME;
-	li->str = strdup(v);
-	ADDARRAY(ctx->atoms, li);
+	li->str = (char *)v;
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, li);
 }
 
 void atomcmd_d DPROTO {
-	struct litem *li = makeli(easm_expr_str(EASM_EXPR_LABEL, strdup(v)));
-	ADDARRAY(ctx->atoms, li);
+	struct litem *li = makeli(ctx, dis_expr_str(ctx->arena, EASM_EXPR_LABEL, v));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, li);
 }
 
 void atomunk_d DPROTO {
-	struct litem *li = calloc(sizeof *li, 1);
+	struct litem *li = dis_alloc(ctx->tmp, sizeof *li);
 	li->type = LITEM_NAME;
-	li->str = strdup(v);
+	li->str = (char *)v;
 	li->isunk = 1;
-	ADDARRAY(ctx->atoms, li);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, li);
 }
 
 void atomimm_d DPROTO {
 	const struct bitfield *bf = v;
-	struct easm_expr *expr = easm_expr_num(EASM_EXPR_NUM, GETBF(bf));
-	ADDARRAY(ctx->atoms, makeli(expr));
+	struct easm_expr *expr = dis_expr_num(ctx->arena, EASM_EXPR_NUM, GETBF(bf));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atomrimm_d DPROTO {
 	const struct rbitfield *bf = v;
 	struct easm_expr *expr = GETRBF(bf);
-	ADDARRAY(ctx->atoms, makeli(expr));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atomctarg_d DPROTO {
 	const struct rbitfield *bf = v;
 	struct easm_expr *expr = GETRBF(bf);
 	expr->special = EASM_SPEC_CTARG;
-	ADDARRAY(ctx->atoms, makeli(expr));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atombtarg_d DPROTO {
 	const struct rbitfield *bf = v;
 	struct easm_expr *expr = GETRBF(bf);
 	expr->special = EASM_SPEC_BTARG;
-	ADDARRAY(ctx->atoms, makeli(expr));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atomign_d DPROTO {
@@ -228,15 +645,15 @@ static struct easm_expr *printreg (struct disctx *ctx, ull *a, ull *m, const str
 			if (num == reg->specials[i].num) {
 				switch (reg->specials[i].mode) {
 					case SR_NAMED:
-						expr = easm_expr_str(EASM_EXPR_REG, strdup(reg->specials[i].name));
+						expr = dis_expr_str(ctx->arena, EASM_EXPR_REG, reg->specials[i].name);
 						expr->special = EASM_SPEC_REGSP;
 						return expr;
 					case SR_ZERO:
 						return 0;
 					case SR_ONE:
-						return easm_expr_num(EASM_EXPR_NUM, 1);
+						return dis_expr_num(ctx->arena, EASM_EXPR_NUM, 1);
 					case SR_DISCARD:
-						return easm_expr_simple(EASM_EXPR_DISCARD);
+						return dis_expr(ctx->arena, EASM_EXPR_DISCARD);
 				}
 			}
 		}
@@ -253,10 +670,10 @@ static struct easm_expr *printreg (struct disctx *ctx, ull *a, ull *m, const str
 	}
 	char *str;
 	if (reg->bf)
-		str = aprintf("%s%lld%s", reg->name, num, suf);
+		str = dis_aprintf(ctx->arena, "%s%lld%s", reg->name, num, suf);
 	else
-		str = aprintf("%s%s", reg->name, suf);
-	expr = easm_expr_str(EASM_EXPR_REG, str);
+		str = dis_aprintf(ctx->arena, "%s%s", reg->name, suf);
+	expr = dis_expr_str(ctx->arena, EASM_EXPR_REG, str);
 	if (reg->cool)
 		expr->special = EASM_SPEC_REGSP;
 	if (reg->always_special)
@@ -267,13 +684,13 @@ static struct easm_expr *printreg (struct disctx *ctx, ull *a, ull *m, const str
 void atomreg_d DPROTO {
 	const struct reg *reg = v;
 	struct easm_expr *expr = printreg(ctx, a, m, reg);
-	if (!expr) expr = easm_expr_num(EASM_EXPR_NUM, 0);
-	ADDARRAY(ctx->atoms, makeli(expr));
+	if (!expr) expr = dis_expr_num(ctx->arena, EASM_EXPR_NUM, 0);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atomdiscard_d DPROTO {
-	struct easm_expr *expr = easm_expr_simple(EASM_EXPR_DISCARD);
-	ADDARRAY(ctx->atoms, makeli(expr));
+	struct easm_expr *expr = dis_expr(ctx->arena, EASM_EXPR_DISCARD);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atommem_d DPROTO {
@@ -290,7 +707,7 @@ void atommem_d DPROTO {
 			pexpr = imm;
 		} else {
 			if (expr) {
-				expr = easm_expr_bin(EASM_EXPR_ADD, expr, imm);
+				expr = dis_expr_bin(ctx->arena, EASM_EXPR_ADD, expr, imm);
 			} else {
 				expr = imm;
 			}
@@ -301,34 +718,34 @@ void atommem_d DPROTO {
 		if (sexpr) {
 			if (mem->reg2shr) {
 				uint64_t num = 1ull << mem->reg2shr;
-				struct easm_expr *ssexpr = easm_expr_num(EASM_EXPR_NUM, num);
-				sexpr = easm_expr_bin(EASM_EXPR_MUL, sexpr, ssexpr);
+				struct easm_expr *ssexpr = dis_expr_num(ctx->arena, EASM_EXPR_NUM, num);
+				sexpr = dis_expr_bin(ctx->arena, EASM_EXPR_MUL, sexpr, ssexpr);
 			}
 			if (expr)
-				expr = easm_expr_bin(EASM_EXPR_ADD, expr, sexpr);
+				expr = dis_expr_bin(ctx->arena, EASM_EXPR_ADD, expr, sexpr);
 			else
 				expr = sexpr;
 		}
 	}
-	if (!expr) expr = easm_expr_num(EASM_EXPR_NUM, 0);
+	if (!expr) expr = dis_expr_num(ctx->arena, EASM_EXPR_NUM, 0);
 	if (mem->name) {
 		struct easm_expr *nex;
 		if (pexpr)
-			nex = easm_expr_bin(type, expr, pexpr);
+			nex = dis_expr_bin(ctx->arena, type, expr, pexpr);
 		else
-			nex = easm_expr_un(type, expr);
+			nex = dis_expr_un(ctx->arena, type, expr);
 		if (mem->idx)
-			nex->str = aprintf("%s%lld", mem->name, GETBF(mem->idx));
+			nex->str = dis_aprintf(ctx->arena, "%s%lld", mem->name, GETBF(mem->idx));
 		else
-			nex->str = strdup(mem->name);
-		nex->mods = calloc(sizeof *nex->mods, 1);
+			nex->str = (char *)mem->name;
+		nex->mods = dis_alloc(ctx->arena, sizeof *nex->mods);
 		expr = nex;
 	} else if (type != EASM_EXPR_MEM) {
 		abort();
 	}
 	if (mem->literal && expr->type == EASM_EXPR_MEM)
 		expr->special = EASM_SPEC_LITERAL;
-	ADDARRAY(ctx->atoms, makeli(expr));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atomvec_d DPROTO {
@@ -343,31 +760,31 @@ void atomvec_d DPROTO {
 	for (i = 0; i < cnt; i++) {
 		struct easm_expr *sexpr;
 		if (mask & 1ull<<i) {
-			char *name = aprintf("%s%lld", vec->name,  base + k++);
-			sexpr = easm_expr_str(EASM_EXPR_REG, name);
+			char *name = dis_aprintf(ctx->arena, "%s%lld", vec->name,  base + k++);
+			sexpr = dis_expr_str(ctx->arena, EASM_EXPR_REG, name);
 			if (vec->cool)
 				sexpr->special = EASM_SPEC_REGSP;
 		} else {
-			sexpr = easm_expr_simple(EASM_EXPR_DISCARD);
+			sexpr = dis_expr(ctx->arena, EASM_EXPR_DISCARD);
 		}
 		if (expr)
-			expr = easm_expr_bin(EASM_EXPR_VEC, expr, sexpr);
+			expr = dis_expr_bin(ctx->arena, EASM_EXPR_VEC, expr, sexpr);
 		else
 			expr = sexpr;
 	}
 	if (!expr)
-		expr = easm_expr_simple(EASM_EXPR_ZVEC);
-	ADDARRAY(ctx->atoms, makeli(expr));
+		expr = dis_expr(ctx->arena, EASM_EXPR_ZVEC);
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 void atombf_d DPROTO {
 	const struct bitfield *bf = v;
 	uint64_t num1 = GETBF(&bf[0]);
 	uint64_t num2 = num1 + GETBF(&bf[1]);
-	struct easm_expr *expr = easm_expr_bin(EASM_EXPR_VEC,
-			easm_expr_num(EASM_EXPR_NUM, num1),
-			easm_expr_num(EASM_EXPR_NUM, num2));
-	ADDARRAY(ctx->atoms, makeli(expr));
+	struct easm_expr *expr = dis_expr_bin(ctx->arena, EASM_EXPR_VEC,
+			dis_expr_num(ctx->arena, EASM_EXPR_NUM, num1),
+			dis_expr_num(ctx->arena, EASM_EXPR_NUM, num2));
+	DIS_ADDARRAY(ctx->tmp, ctx->atoms, makeli(ctx, expr));
 }
 
 struct dis_op_chunk {
@@ -376,14 +793,7 @@ struct dis_op_chunk {
 };
 
 struct dis_res {
-	enum dis_status {
-		DIS_STATUS_OK = 0,
-		DIS_STATUS_EOF = 0x1,		/* EOF in the middle of an opcode */
-		DIS_STATUS_UNK_FORM = 0x2,	/* failed to determine instruction format - opcode length uncertain */
-		DIS_STATUS_UNK_INSN = 0x4,	/* failed to determine instruction name - unknown opcode or due to one of the above errors */
-		DIS_STATUS_UNK_OPERAND = 0x8,	/* failed to determine instruction operands */
-		DIS_STATUS_UNUSED_BITS = 0x10,	/* instruction decoded, but unused bitfields have non-default values */
-	} status;
+	enum dis_status status;
 	uint32_t oplen;
 	struct dis_op_chunk *chunks;
 	int chunksnum;
@@ -396,13 +806,6 @@ struct dis_res {
 //	uint32_t *umask;
 };
 
-static void dis_del_res(struct dis_res *dres)
-{
-	easm_del_insn(dres->insn);
-
-	free(dres);
-}
-
 static struct easm_sinsn *dis_parse_sinsn(struct disctx *ctx, enum dis_status *status, int *spos);
 
 static struct easm_expr *dis_parse_expr(struct disctx *ctx, enum dis_status *status, int *spos) {
@@ -412,36 +815,37 @@ static struct easm_expr *dis_parse_expr(struct disctx *ctx, enum dis_status *sta
 		return ctx->atoms[(*spos)++]->expr;
 	if (ctx->atoms[(*spos)++]->type != LITEM_SESTART)
 		abort();
-	struct easm_expr *res = easm_expr_sinsn(dis_parse_sinsn(ctx, status, spos));
+	struct easm_expr *res = dis_expr(ctx->arena, EASM_EXPR_SINSN);
+	res->sinsn = dis_parse_sinsn(ctx, status, spos);
 	if (ctx->atoms[(*spos)++]->type != LITEM_SEEND)
 		abort();
 	return res;
 }
 
 static struct easm_sinsn *dis_parse_sinsn(struct disctx *ctx, enum dis_status *status, int *spos) {
-	struct easm_sinsn *res = calloc(sizeof *res, 1);
+	struct easm_sinsn *res = dis_alloc(ctx->arena, sizeof *res);
 	res->str = ctx->atoms[*spos]->str;
 	res->isunk = ctx->atoms[*spos]->isunk;
 	if (res->isunk)
 		*status |= DIS_STATUS_UNK_INSN;
 	if (ctx->atoms[(*spos)++]->type != LITEM_NAME)
 		abort();
-	struct easm_mods *mods = calloc (sizeof *mods, 1);
+	struct easm_mods *mods = dis_alloc(ctx->arena, sizeof *mods);
 	while (*spos < ctx->atomsnum && ctx->atoms[*spos]->type != LITEM_SEEND) {
 		if (ctx->atoms[*spos]->type == LITEM_NAME) {
-			struct easm_mod *mod = calloc(sizeof *mod, 1);
+			struct easm_mod *mod = dis_alloc(ctx->arena, sizeof *mod);
 			mod->str = ctx->atoms[*spos]->str;
 			mod->isunk = ctx->atoms[*spos]->isunk;
 			if (mod->isunk)
 				*status |= DIS_STATUS_UNK_OPERAND;
-			ADDARRAY(mods->mods, mod);
+			DIS_ADDARRAY(ctx->arena, mods->mods, mod);
 			(*spos)++;
 		} else {
-			struct easm_operand *op = calloc (sizeof *op, 1);
+			struct easm_operand *op = dis_alloc(ctx->arena, sizeof *op);
 			op->mods = mods;
-			mods = calloc (sizeof *mods, 1);
-			ADDARRAY(op->exprs, dis_parse_expr(ctx, status, spos));
-			ADDARRAY(res->operands, op);
+			mods = dis_alloc(ctx->arena, sizeof *mods);
+			DIS_ADDARRAY(ctx->arena, op->exprs, dis_parse_expr(ctx, status, spos));
+			DIS_ADDARRAY(ctx->arena, res->operands, op);
 		}
 	}
 	res->mods = mods;
@@ -449,22 +853,294 @@ static struct easm_sinsn *dis_parse_sinsn(struct disctx *ctx, enum dis_status *s
 }
 
 static struct easm_subinsn *dis_parse_subinsn(struct disctx *ctx, enum dis_status *status, int *spos) {
-	struct easm_subinsn *res = calloc(sizeof *res, 1);
+	struct easm_subinsn *res = dis_alloc(ctx->arena, sizeof *res);
 	while (ctx->atoms[*spos]->type != LITEM_NAME)
-		ADDARRAY(res->prefs, dis_parse_expr(ctx, status, spos));
+		DIS_ADDARRAY(ctx->arena, res->prefs, dis_parse_expr(ctx, status, spos));
 	res->sinsn = dis_parse_sinsn(ctx, status, spos);
 	return res;
 }
 
 static struct easm_insn *dis_parse_insn(struct disctx *ctx, enum dis_status *status) {
 	int spos = 0;
-	struct easm_insn *res = calloc(sizeof *res, 1);
-	ADDARRAY(res->subinsns, dis_parse_subinsn(ctx, status, &spos));
+	struct easm_insn *res = dis_alloc(ctx->arena, sizeof *res);
+	DIS_ADDARRAY(ctx->arena, res->subinsns, dis_parse_subinsn(ctx, status, &spos));
 	if (spos != ctx->atomsnum)
 		abort();
 	return res;
 }
 
+/*
+ * Memo cache
+ *
+ * Shader dumps and firmware are full of identical instructions, and demmt
+ * disassembles the same programs over and over, so decoded instructions can
+ * optionally be remembered and handed out again by do_dis.
+ *
+ * Decoding depends on nothing but the opcode bits it looks at: ones read
+ * through bitfields, which end up in the m mask, and ones compared by table
+ * scans up to the picked entries, collected through disctx deps. A cache
+ * entry is thus good for any opcode matching it on these bits. Entries are
+ * hashed by root table tree and by the opcode bytes up to their length, and
+ * lookups try every length seen so far for the given root table. Opcodes
+ * differing from an entry only in unused bits within its length thus miss
+ * it, which costs a duplicate entry, but never a wrong result.
+ *
+ * Everything depending on the position, like branch targets and labels, is
+ * only resolved later by dis_dopp, which works on a copy. The cached
+ * instructions are never modified, so copies share their strings and
+ * modifiers.
+ */
+
+/* limit on memory used by the memo cache */
+#define DIS_MEMO_MAX (32 << 20)
+
+struct dis_memo {
+	struct dis_memo *next;
+	struct dtree *root;
+	int len;		/* in bytes */
+	ull key[MAXOPLEN];	/* opcode, truncated to len */
+	ull deps[MAXOPLEN];	/* bits the decoding depends on */
+	ull a[MAXOPLEN];	/* opcode, masked to deps */
+	ull m[MAXOPLEN];
+	int oplen;
+	int endmark;
+	int status;
+	struct easm_insn *insn;
+};
+
+static int memo_enabled;
+static long long memo_lookups;
+static long long memo_hits;
+/* lookups and insertions go under memo_lock, entries never change once in */
+static struct dis_memo **memo;
+static int memonum;
+static int memomax;
+static struct dis_arena memo_arena;
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *dis_copy_str(struct dis_arena *arena, const char *str) {
+	if (!str)
+		return 0;
+	size_t len = strlen(str);
+	char *res = dis_alloc(arena, len + 1);
+	memcpy(res, str, len + 1);
+	return res;
+}
+
+static struct easm_mods *dis_copy_mods(struct dis_arena *arena, const struct easm_mods *mods) {
+	if (!mods)
+		return 0;
+	struct easm_mods *res = dis_alloc(arena, sizeof *res);
+	int i;
+	*res = *mods;
+	res->mods = dis_alloc(arena, mods->modsnum * sizeof *res->mods);
+	res->modsmax = mods->modsnum;
+	for (i = 0; i < mods->modsnum; i++) {
+		res->mods[i] = dis_alloc(arena, sizeof *res->mods[i]);
+		*res->mods[i] = *mods->mods[i];
+		res->mods[i]->str = dis_copy_str(arena, mods->mods[i]->str);
+	}
+	return res;
+}
+
+/*
+ * Copies the parts of an instruction dis_dopp modifies. With full set,
+ * copies everything else as well, for keeping it after the decoctx arena
+ * is reset.
+ */
+
+static struct easm_sinsn *dis_copy_sinsn(struct dis_arena *arena, const struct easm_sinsn *sinsn, int full);
+
+static struct easm_expr *dis_copy_expr(struct dis_arena *arena, const struct easm_expr *expr, int full) {
+	if (!expr)
+		return 0;
+	struct easm_expr *res = dis_alloc(arena, sizeof *res);
+	int i;
+	*res = *expr;
+	res->e1 = dis_copy_expr(arena, expr->e1, full);
+	res->e2 = dis_copy_expr(arena, expr->e2, full);
+	res->sinsn = expr->sinsn ? dis_copy_sinsn(arena, expr->sinsn, full) : 0;
+	if (full) {
+		res->str = dis_copy_str(arena, expr->str);
+		res->mods = dis_copy_mods(arena, expr->mods);
+		if (expr->astr.str) {
+			res->astr.str = dis_alloc(arena, expr->astr.len + 1);
+			memcpy(res->astr.str, expr->astr.str, expr->astr.len + 1);
+		}
+		if (expr->swizzlesnum) {
+			res->swizzles = dis_alloc(arena, expr->swizzlesnum * sizeof *res->swizzles);
+			res->swizzlesmax = expr->swizzlesnum;
+			for (i = 0; i < expr->swizzlesnum; i++) {
+				res->swizzles[i] = expr->swizzles[i];
+				res->swizzles[i].str = dis_copy_str(arena, expr->swizzles[i].str);
+			}
+		}
+	}
+	return res;
+}
+
+static struct easm_sinsn *dis_copy_sinsn(struct dis_arena *arena, const struct easm_sinsn *sinsn, int full) {
+	struct easm_sinsn *res = dis_alloc(arena, sizeof *res);
+	int i, j;
+	*res = *sinsn;
+	if (full) {
+		res->str = dis_copy_str(arena, sinsn->str);
+		res->mods = dis_copy_mods(arena, sinsn->mods);
+	}
+	res->operands = dis_alloc(arena, sinsn->operandsnum * sizeof *res->operands);
+	res->operandsmax = sinsn->operandsnum;
+	for (i = 0; i < sinsn->operandsnum; i++) {
+		const struct easm_operand *op = sinsn->operands[i];
+		struct easm_operand *nop = dis_alloc(arena, sizeof *nop);
+		*nop = *op;
+		if (full)
+			nop->mods = dis_copy_mods(arena, op->mods);
+		nop->exprs = dis_alloc(arena, op->exprsnum * sizeof *nop->exprs);
+		nop->exprsmax = op->exprsnum;
+		for (j = 0; j < op->exprsnum; j++)
+			nop->exprs[j] = dis_copy_expr(arena, op->exprs[j], full);
+		res->operands[i] = nop;
+	}
+	return res;
+}
+
+static struct easm_insn *dis_copy_insn(struct dis_arena *arena, const struct easm_insn *insn, int full) {
+	struct easm_insn *res = dis_alloc(arena, sizeof *res);
+	int i, j;
+	*res = *insn;
+	res->subinsns = dis_alloc(arena, insn->subinsnsnum * sizeof *res->subinsns);
+	res->subinsnsmax = insn->subinsnsnum;
+	for (i = 0; i < insn->subinsnsnum; i++) {
+		const struct easm_subinsn *sub = insn->subinsns[i];
+		struct easm_subinsn *nsub = dis_alloc(arena, sizeof *nsub);
+		*nsub = *sub;
+		nsub->prefs = dis_alloc(arena, sub->prefsnum * sizeof *nsub->prefs);
+		nsub->prefsmax = sub->prefsnum;
+		for (j = 0; j < sub->prefsnum; j++)
+			nsub->prefs[j] = dis_copy_expr(arena, sub->prefs[j], full);
+		nsub->sinsn = dis_copy_sinsn(arena, sub->sinsn, full);
+		res->subinsns[i] = nsub;
+	}
+	return res;
+}
+
+static inline ull memo_trunc(ull a, int len) {
+	if (len >= 8)
+		return a;
+	if (len <= 0)
+		return 0;
+	return a & ((1ull << len * 8) - 1);
+}
+
+static uint32_t memo_hash(struct dtree *root, int len, const ull *a) {
+	ull res = (uintptr_t)root ^ len;
+	int i;
+	for (i = 0; i < MAXOPLEN; i++)
+		res = (res ^ memo_trunc(a[i], len - i * 8)) * 0x9e3779b97f4a7c15ull;
+	return res >> 32;
+}
+
+static struct dis_memo *memo_lookup(struct dtree *root, const ull *a) {
+	uint32_t lens = __atomic_load_n(&root->memolens, __ATOMIC_RELAXED);
+	struct dis_memo *res = 0;
+	int i;
+	__atomic_fetch_add(&memo_lookups, 1, __ATOMIC_RELAXED);
+	if (!lens)
+		return 0;
+	pthread_mutex_lock(&memo_lock);
+	while (lens && !res) {
+		int len = __builtin_ctz(lens) + 1;
+		lens &= lens - 1;
+		if (!memomax)
+			break;
+		for (res = memo[memo_hash(root, len, a) & (memomax - 1)]; res; res = res->next) {
+			if (res->root != root || res->len != len)
+				continue;
+			for (i = 0; i < MAXOPLEN; i++)
+				if ((a[i] & res->deps[i]) != res->a[i])
+					break;
+			if (i == MAXOPLEN)
+				break;
+		}
+	}
+	pthread_mutex_unlock(&memo_lock);
+	if (res)
+		__atomic_fetch_add(&memo_hits, 1, __ATOMIC_RELAXED);
+	return res;
+}
+
+static void memo_insert(struct dtree *root, int stride, const struct dis_res *dres, ull deps) {
+	int len = dres->oplen * stride;
+	int i;
+	if (len < 1 || len > MAXOPLEN * 8)
+		return;
+	pthread_mutex_lock(&memo_lock);
+	if (memo_arena.size >= DIS_MEMO_MAX) {
+		pthread_mutex_unlock(&memo_lock);
+		return;
+	}
+	if ((memonum + 1) > memomax) {
+		int nmax = memomax ? memomax * 2 : 0x1000;
+		struct dis_memo **nmemo = calloc(sizeof *nmemo, nmax);
+		for (i = 0; i < memomax; i++) {
+			struct dis_memo *e = memo[i];
+			while (e) {
+				struct dis_memo *next = e->next;
+				uint32_t h = memo_hash(e->root, e->len, e->key) & (nmax - 1);
+				e->next = nmemo[h];
+				nmemo[h] = e;
+				e = next;
+			}
+		}
+		free(memo);
+		memo = nmemo;
+		memomax = nmax;
+	}
+	struct dis_memo *e = dis_alloc(&memo_arena, sizeof *e);
+	e->root = root;
+	e->len = len;
+	for (i = 0; i < MAXOPLEN; i++) {
+		e->key[i] = memo_trunc(dres->a[i], len - i * 8);
+		e->deps[i] = dres->m[i] | (i ? 0 : deps);
+		e->a[i] = dres->a[i] & e->deps[i];
+		e->m[i] = dres->m[i];
+	}
+	e->oplen = dres->oplen;
+	e->endmark = dres->endmark;
+	e->status = dres->status;
+	e->insn = dis_copy_insn(&memo_arena, dres->insn, 1);
+	uint32_t h = memo_hash(root, len, e->key) & (memomax - 1);
+	e->next = memo[h];
+	memo[h] = e;
+	memonum++;
+	__atomic_fetch_or(&root->memolens, 1u << (len - 1), __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&memo_lock);
+}
+
+static void dis_flush_memo(void) {
+	pthread_mutex_lock(&memo_lock);
+	free(memo);
+	memo = 0;
+	memonum = memomax = 0;
+	dis_arena_fini(&memo_arena);
+	pthread_mutex_unlock(&memo_lock);
+}
+
+void envydis_memo(int enable) {
+	memo_enabled = enable;
+}
+
+void envydis_memo_stats(long long *lookups, long long *hits) {
+	*lookups = __atomic_load_n(&memo_lookups, __ATOMIC_RELAXED);
+	*hits = __atomic_load_n(&memo_hits, __ATOMIC_RELAXED);
+}
+
+struct markev {
+	uint32_t pos;	/* position of the instruction */
+	uint32_t ptr;	/* position being marked */
+	int m;
+};
+
 struct decoctx {
 	const struct disisa *isa;
 	struct varinfo *varinfo;
@@ -476,37 +1152,86 @@ struct decoctx {
 	struct label *labels;
 	int labelsnum;
 	int labelsmax;
+	struct dis_arena arena;
+	struct dis_arena tmp;
+	/* label mode only: results of control flow discovery, per position */
+	struct dis_res **dres;
+	struct dis_arena dres_arena;
+	uint8_t *decoded;
+	uint32_t *todo;
+	int todonum;
+	int todomax;
+	/* trees of the root tables */
+	struct dtree *dtroot;
+	struct dtree *dtsched;
+	/* what mark() does, see envydis_par */
+	enum {
+		MARK_SET,
+		MARK_RECORD,
+		MARK_IGNORE,
+	} markmode;
+	uint32_t markpos;
+	struct markev *markevs;
+	int markevsnum;
+	int markevsmax;
 };
 
 struct dis_res *do_dis(struct decoctx *deco, uint32_t cur) {
 	struct disctx c = { 0 };
 	struct disctx *ctx = &c;
-	struct dis_res *res = calloc(sizeof *res, 1);
+	struct dis_res *res = dis_alloc(&deco->arena, sizeof *res);
 	int i;
 	int stride = ed_getcstride(deco->isa, deco->varinfo);
 	for (i = 0; i < MAXOPLEN*8 && cur + i/stride < deco->codesz; i++) {
 		res->a[i/8] |= (ull)deco->code[cur*stride + i] << (i&7)*8;
 	}
+	ctx->arena = &deco->arena;
+	ctx->tmp = &deco->tmp;
 	ctx->isa = deco->isa;
 	ctx->varinfo = deco->varinfo;
-	if (deco->isa->tsched && (cur % deco->isa->schedpos) == 0)
-		atomtab_d (ctx, res->a, res->m, deco->isa->tsched);
-	else
-		atomtab_d (ctx, res->a, res->m, deco->isa->troot);
-	res->oplen = ctx->oplen;
+	const struct insn *roottab;
+	struct dtree *root;
+	if (deco->isa->tsched && (cur % deco->isa->schedpos) == 0) {
+		if (!deco->dtsched)
+			deco->dtsched = dtree_get(deco->isa->tsched, deco->varinfo);
+		roottab = deco->isa->tsched;
+		root = deco->dtsched;
+	} else {
+		if (!deco->dtroot)
+			deco->dtroot = dtree_get(deco->isa->troot, deco->varinfo);
+		roottab = deco->isa->troot;
+		root = deco->dtroot;
+	}
+	struct dis_memo *hit = 0;
+	ull deps = 0;
+	if (memo_enabled) {
+		hit = memo_lookup(root, res->a);
+		ctx->deps = &deps;
+	}
+	if (hit) {
+		for (i = 0; i < MAXOPLEN; i++)
+			res->m[i] = hit->m[i];
+		res->oplen = hit->oplen;
+		res->endmark = hit->endmark;
+		res->status = hit->status;
+		res->insn = dis_copy_insn(&deco->arena, hit->insn, 0);
+	} else {
+		ctx->dtree = root;
+		atomtab_d (ctx, res->a, res->m, roottab);
+		res->oplen = ctx->oplen;
+		res->endmark = ctx->endmark;
+		/* XXX unused status */
+		res->insn = dis_parse_insn(ctx, &res->status);
+		dis_arena_reset(&deco->tmp);
+		if (memo_enabled)
+			memo_insert(root, stride, res, deps);
+	}
 	if (res->oplen + cur > deco->codesz)
 		res->status |= DIS_STATUS_EOF;
 	if (res->oplen == 0) {
 		res->status |= DIS_STATUS_UNK_FORM;
 		res->oplen = ctx->isa->opunit;
 	}
-	res->endmark = ctx->endmark;
-	/* XXX unused status */
-	res->insn = dis_parse_insn(ctx, &res->status);
-
-	for (i = 0; i < ctx->atomsnum; ++i)
-		free(ctx->atoms[i]);
-	free(ctx->atoms);
 
 	return res;
 }
@@ -514,7 +1239,20 @@ struct dis_res *do_dis(struct decoctx *deco, uint32_t cur) {
 static void mark(struct decoctx *ctx, uint32_t ptr, int m) {
 	if (ptr < ctx->codebase || ptr >= ctx->codebase + ctx->codesz)
 		return;
-	ctx->marks[ptr - ctx->codebase] |= m;
+	if (ctx->markmode == MARK_IGNORE)
+		return;
+	if (ctx->markmode == MARK_RECORD) {
+		struct markev ev = { ctx->markpos, ptr - ctx->codebase, m };
+		ADDARRAY(ctx->markevs, ev);
+		return;
+	}
+	int *pm = &ctx->marks[ptr - ctx->codebase];
+	*pm |= m;
+	/* new branch or call target, queue it for control flow discovery */
+	if (ctx->dres && (*pm & 3) && !(*pm & 8)) {
+		*pm |= 8;
+		ADDARRAY(ctx->todo, ptr - ctx->codebase);
+	}
 }
 
 static int is_nr_mark(struct decoctx *ctx, uint32_t ptr) {
@@ -527,7 +1265,7 @@ char *deco_label(struct decoctx *ctx, uint64_t val) {
 	int i;
 	for (i = 0; i < ctx->labelsnum; i++)
 		if (ctx->labels[i].val == val && ctx->labels[i].name)
-			return strdup(ctx->labels[i].name);
+			return (char *)ctx->labels[i].name;
 	return 0;
 }
 
@@ -541,7 +1279,7 @@ static void dis_pp_expr(struct decoctx *deco, struct dis_res *dres, struct easm_
 	if (expr->sinsn)
 		dis_pp_sinsn(deco, dres, expr->sinsn, pos);
 	easm_substpos_expr(expr, pos);
-	if (easm_cfold_expr(expr)) {
+	if (easm_cfold_expr_nofree(expr)) {
 		if (expr->special == EASM_SPEC_CTARG) {
 			mark(deco, expr->num, 2);
 			expr->alabel = deco_label(deco, expr->num);
@@ -553,21 +1291,15 @@ static void dis_pp_expr(struct decoctx *deco, struct dis_res *dres, struct easm_
 		}
 		if (expr->num & 1ull << 63 && !expr->special) {
 			expr->type = EASM_EXPR_NEG;
-			expr->e1 = easm_expr_num(EASM_EXPR_NUM, -expr->num);
+			expr->e1 = dis_expr_num(&deco->arena, EASM_EXPR_NUM, -expr->num);
 			expr->num = 0;
 		}
 	}
 	if (expr->type == EASM_EXPR_ADD && expr->e1->type == EASM_EXPR_NUM && expr->e1->num == 0) {
-		struct easm_expr *oe2 = expr->e2;
-		free(expr->e1);
-		*expr = *oe2;
-		free(oe2);
+		*expr = *expr->e2;
 	}
 	if ((expr->type == EASM_EXPR_ADD || expr->type == EASM_EXPR_SUB) && expr->e2->type == EASM_EXPR_NUM && expr->e2->num == 0) {
-		struct easm_expr *oe1 = expr->e1;
-		free(expr->e2);
-		*expr = *oe1;
-		free(oe1);
+		*expr = *expr->e1;
 	}
 	if (expr->type == EASM_EXPR_ADD && expr->e2->type == EASM_EXPR_NUM && expr->e2->num & 1ull << 63) {
 		expr->e2->num = -expr->e2->num;
@@ -619,150 +1351,137 @@ void dis_dopp(struct decoctx *deco, struct dis_res *dres, uint64_t pos) {
 }
 
 /*
- * Disassembler driver
+ * Listing
  *
- * You pass a block of memory to this function, disassembly goes out to given
- * FILE*.
+ * Printing goes through dis_items, the same ones envydis_list hands out:
+ * walk_range figures out what gets printed where, and envydis_print_item
+ * does the formatting. A sink either prints the items right away or
+ * collects them into a listing.
  */
 
-void envydis (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, int quiet, struct label *labels, int labelsnum, const struct envy_colors *cols)
-{
-	struct decoctx c = { 0 };
-	struct decoctx *ctx = &c;
-	int cur = 0, i, j;
-	ctx->code = code;
-	ctx->codesz = num;
-	ctx->marks = calloc(num, sizeof *ctx->marks);
-	ctx->names = calloc(num, sizeof *ctx->names);
-	ctx->codebase = start;
-	ctx->varinfo = varinfo;
-	ctx->isa = isa;
-	ctx->labels = labels;
-	ctx->labelsnum = labelsnum;
-	int stride = ed_getcstride(ctx->isa, ctx->varinfo);
-	int cbsz = ed_getcbsz(ctx->isa, ctx->varinfo);
-	if (labels) {
-		for (i = 0; i < labelsnum; i++) {
-			mark(ctx, labels[i].val, labels[i].type);
-			if (labels[i].val >= ctx->codebase && labels[i].val < ctx->codebase + ctx->codesz) {
-				if (labels[i].name)
-					ctx->names[labels[i].val - ctx->codebase] = labels[i].name;
-			}
-			if (labels[i].size) {
-				for (j = 0; j < labels[i].size; j+=4)
-					mark(ctx, labels[i].val + j, labels[i].type);
-			}
-		}
-		int done;
-		do {
-			done = 1;
-			cur = 0;
-			int active = 0;
-			while (cur < num) {
-				if (!active && (ctx->marks[cur] & 3) && !(ctx->marks[cur] & 8)) {
-					done = 0;
-					active = 1;
-					ctx->marks[cur] |= 8;
-				}
-				if (active) {
-					struct dis_res *dres = do_dis(ctx, cur);
-					dis_dopp(ctx, dres, cur + start);
-					if (dres->oplen && !dres->endmark && !(ctx->marks[cur] & 4))
-						cur += dres->oplen;
-					else
-						active = 0;
-					dis_del_res(dres);
-				} else {
-					cur++;
-				}
-			}
-		} while (!done);
+struct dis_sink {
+	FILE *out;
+	int quiet;
+	const struct envy_colors *cols;
+	/* what envydis_print_item needs */
+	struct dis_listing hdr;
+	/* if set, items are collected here instead of printing them */
+	struct dis_listing *list;
+	struct dis_arena *arena;
+};
+
+static void dis_sink_init(struct dis_sink *sink, struct decoctx *ctx) {
+	sink->hdr.isa = ctx->isa;
+	sink->hdr.varinfo = ctx->varinfo;
+	sink->hdr.code = ctx->code;
+	sink->hdr.start = ctx->codebase;
+	sink->hdr.num = ctx->codesz;
+	if (sink->list)
+		*sink->list = sink->hdr;
+}
+
+static void emit(struct dis_sink *sink, const struct dis_item *item) {
+	if (sink->list) {
+		struct dis_listing *list = sink->list;
+		DIS_ADDARRAY(sink->arena, list->items, *item);
+		if (item->insn)
+			list->items[list->itemsnum - 1].insn = dis_copy_insn(sink->arena, item->insn, 1);
 	} else {
-		while (cur < num) {
-			struct dis_res *dres = do_dis(ctx, cur);
-			dis_dopp(ctx, dres, cur + start);
-			if (dres->oplen)
-				cur += dres->oplen;
-			else
-				cur++;
-			dis_del_res(dres);
-		}
+		envydis_print_item(sink->out, &sink->hdr, item, sink->quiet, sink->cols);
 	}
-	cur = 0;
-	int active = 0;
+}
+
+static void emit_skip(struct dis_sink *sink, struct decoctx *ctx, int cur, int *skip, int *nonzero) {
+	if (!*skip)
+		return;
+	struct dis_item item = { DIS_ITEM_SKIP };
+	item.pos = cur - *skip + ctx->codebase;
+	item.len = *skip;
+	item.nonzero = *nonzero;
+	emit(sink, &item);
+	*skip = 0;
+	*nonzero = 0;
+}
+
+/* finds branch or call target of a post-processed instruction */
+static int dis_find_target(struct easm_expr *expr, uint64_t *target) {
+	int i, j;
+	if (!expr)
+		return 0;
+	if (expr->type == EASM_EXPR_NUM && (expr->special == EASM_SPEC_BTARG || expr->special == EASM_SPEC_CTARG)) {
+		*target = expr->num;
+		return expr->special == EASM_SPEC_CTARG ? 2 : 1;
+	}
+	int res = dis_find_target(expr->e1, target);
+	if (!res)
+		res = dis_find_target(expr->e2, target);
+	if (!res && expr->sinsn)
+		for (i = 0; i < expr->sinsn->operandsnum && !res; i++)
+			for (j = 0; j < expr->sinsn->operands[i]->exprsnum && !res; j++)
+				res = dis_find_target(expr->sinsn->operands[i]->exprs[j], target);
+	return res;
+}
+
+static int dis_find_insn_target(struct easm_insn *insn, uint64_t *target) {
+	int i, j, k;
+	for (i = 0; i < insn->subinsnsnum; i++) {
+		struct easm_subinsn *sub = insn->subinsns[i];
+		for (j = 0; j < sub->sinsn->operandsnum; j++)
+			for (k = 0; k < sub->sinsn->operands[j]->exprsnum; k++) {
+				int res = dis_find_target(sub->sinsn->operands[j]->exprs[k], target);
+				if (res)
+					return res;
+			}
+	}
+	return 0;
+}
+
+/*
+ * Walks everything from position cur up to end, which has to be where
+ * walking some earlier position left off. marks are the position marks
+ * as they were when walking each position.
+ */
+
+static void walk_range(struct decoctx *ctx, struct dis_sink *sink, const int *marks, int cur, int end, int active) {
+	uint8_t *code = ctx->code;
+	int num = ctx->codesz;
+	uint32_t start = ctx->codebase;
+	struct label *labels = ctx->labels;
+	int stride = ed_getcstride(ctx->isa, ctx->varinfo);
+	int cbsz = ed_getcbsz(ctx->isa, ctx->varinfo);
 	int skip = 0, nonzero = 0;
-	while (cur < num) {
-		int mark = ctx->marks[cur];
+	int i;
+	while (cur < end) {
+		int mark = marks[cur];
+		struct dis_item item = { 0 };
+		item.pos = cur + start;
+		item.marks = mark & ~8;
+		item.label = ctx->names[cur];
 		if (ctx->names[cur]) {
-			if (skip) {
-				if (nonzero)
-					fprintf(out, "%s[%x bytes skipped]\n", cols->err, skip);
-				else
-					fprintf(out, "%s[%x zero bytes skipped]\n", cols->reset, skip);
-				skip = 0;
-				nonzero = 0;
-			}
-			if (mark & 0x1b0)
-				fprintf (out, "%s%s:\n", cols->reset, ctx->names[cur]);
-			else if (mark & 2)
-				fprintf (out, "\n%s%s:\n", cols->ctarg, ctx->names[cur]);
-			else if (mark & 1)
-				fprintf (out, "%s%s:\n", cols->btarg, ctx->names[cur]);
-			else
-				fprintf (out, "%s%s:\n", cols->reset, ctx->names[cur]);
+			emit_skip(sink, ctx, cur, &skip, &nonzero);
+			item.type = DIS_ITEM_LABEL;
+			emit(sink, &item);
 		}
 		if (mark & 0x1b0 && !active) {
-			if (skip) {
-				if (nonzero)
-					fprintf(out, "%s[%x bytes skipped]\n", cols->err, skip);
-				else
-					fprintf(out, "%s[%x zero bytes skipped]\n", cols->reset, skip);
-				skip = 0;
-				nonzero = 0;
-			}
+			emit_skip(sink, ctx, cur, &skip, &nonzero);
 			if (cbsz != 8)
 				abort();
-			fprintf (out, "%s%08x:%s", cols->mem, cur + start, cols->reset);
+			item.type = DIS_ITEM_DATA;
 			if (mark & 0x80) {
-				uint8_t val = code[cur];
-				fprintf (out, " %s%02x\n", cols->num, val);
-				cur += 1;
+				item.len = 1;
 			} else if (mark & 0x100) {
-				uint16_t val = 0;
-				for (i = 0; i < 2 && cur + i < num; i++) {
-					val |= code[cur + i] << i*8;
-				}
-				fprintf (out, " %s%04x\n", cols->num, val);
-				cur += 2;
+				item.len = 2;
 			} else if (mark & 0x10) {
-				uint32_t val = 0;
-				for (i = 0; i < 4 && cur + i < num; i++) {
-					val |= code[cur + i] << i*8;
-				}
-				fprintf (out, " %s%08x\n", cols->num, val);
-				cur += 4;
+				item.len = 4;
 			} else {
-				fprintf (out, " %s\"", cols->num);
-				while (code[cur]) {
-					switch (code[cur]) {
-						case '\n':
-							fprintf (out, "\\n");
-							break;
-						case '\\':
-							fprintf (out, "\\\\");
-							break;
-						case '\"':
-							fprintf (out, "\\\"");
-							break;
-						default:
-							fprintf (out, "%c", code[cur]);
-							break;
-					}
-					cur++;
-				}
-				cur++;
-				fprintf (out, "\"\n");
+				item.type = DIS_ITEM_STRING;
+				item.len = strlen((char *)code + cur) + 1;
 			}
+			if (item.type == DIS_ITEM_DATA)
+				for (i = 0; i < item.len && cur + i < num; i++)
+					item.val |= code[cur + i] << i*8;
+			emit(sink, &item);
+			cur += item.len;
 			continue;
 		}
 		if (!active && mark & 7)
@@ -775,106 +1494,535 @@ void envydis (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start
 			skip++;
 			continue;
 		}
-		if (skip) {
-			if (nonzero)
-				fprintf(out, "%s[%x bytes skipped]\n", cols->err, skip);
-			else
-				fprintf(out, "%s[%x zero bytes skipped]\n", cols->reset, skip);
-			skip = 0;
-			nonzero = 0;
+		emit_skip(sink, ctx, cur, &skip, &nonzero);
+		struct dis_res *dres = ctx->dres ? ctx->dres[cur] : 0;
+		if (!dres) {
+			dres = do_dis(ctx, cur);
+			dis_dopp(ctx, dres, cur + start);
 		}
-		struct dis_res *dres = do_dis(ctx, cur);
-		dis_dopp(ctx, dres, cur + start);
 
 		if (dres->endmark || mark & 4)
 			active = 0;
 
-		if (mark & 2 && !ctx->names[cur])
-			fprintf (out, "\n");
-		switch (mark & 3) {
-			case 0:
-				if (!quiet)
-					fprintf (out, "%s%08x:%s", cols->reset, cur + start, cols->reset);
-				break;
-			case 1:
-				fprintf (out, "%s%08x:%s", cols->btarg, cur + start, cols->reset);
-				break;
-			case 2:
-				fprintf (out, "%s%08x:%s", cols->ctarg, cur + start, cols->reset);
-				break;
-			case 3:
-				fprintf (out, "%s%08x:%s", cols->bctarg, cur + start, cols->reset);
-				break;
+		item.type = DIS_ITEM_INSN;
+		item.len = dres->oplen;
+		item.insn = dres->insn;
+		item.status = dres->status;
+		item.endmark = dres->endmark;
+		for (i = 0; i < MAXOPLEN; i++)
+			item.unkbits[i] = dres->a[i];
+		for (i = dres->oplen; i < MAXOPLEN * 8; i++)
+			item.unkbits[i/8] &= ~(0xffull << (i & 7) * 8);
+		for (i = 0; i < MAXOPLEN; i++)
+			item.unkbits[i] &= ~dres->m[i];
+		item.targtype = dis_find_insn_target(dres->insn, &item.target);
+		emit(sink, &item);
+		cur += dres->oplen;
+
+		dis_arena_reset(&ctx->arena);
+	}
+}
+
+void envydis_print_item(FILE *out, const struct dis_listing *list, const struct dis_item *item, int quiet, const struct envy_colors *cols) {
+	const struct disisa *isa = list->isa;
+	const uint8_t *code = list->code;
+	int num = list->num;
+	int stride = ed_getcstride(list->isa, list->varinfo);
+	int cur = item->pos - list->start;
+	int mark = item->marks;
+	int i, j;
+	switch (item->type) {
+		case DIS_ITEM_SKIP:
+			if (item->nonzero)
+				fprintf(out, "%s[%x bytes skipped]\n", cols->err, item->len);
+			else
+				fprintf(out, "%s[%x zero bytes skipped]\n", cols->reset, item->len);
+			return;
+		case DIS_ITEM_LABEL:
+			if (mark & 0x1b0)
+				fprintf (out, "%s%s:\n", cols->reset, item->label);
+			else if (mark & 2)
+				fprintf (out, "\n%s%s:\n", cols->ctarg, item->label);
+			else if (mark & 1)
+				fprintf (out, "%s%s:\n", cols->btarg, item->label);
+			else
+				fprintf (out, "%s%s:\n", cols->reset, item->label);
+			return;
+		case DIS_ITEM_DATA:
+			fprintf (out, "%s%08x:%s", cols->mem, cur + list->start, cols->reset);
+			if (item->len == 1)
+				fprintf (out, " %s%02x\n", cols->num, item->val);
+			else if (item->len == 2)
+				fprintf (out, " %s%04x\n", cols->num, item->val);
+			else
+				fprintf (out, " %s%08x\n", cols->num, item->val);
+			return;
+		case DIS_ITEM_STRING:
+			fprintf (out, "%s%08x:%s", cols->mem, cur + list->start, cols->reset);
+			fprintf (out, " %s\"", cols->num);
+			for (i = 0; i < item->len - 1; i++) {
+				switch (code[cur + i]) {
+					case '\n':
+						fprintf (out, "\\n");
+						break;
+					case '\\':
+						fprintf (out, "\\\\");
+						break;
+					case '\"':
+						fprintf (out, "\\\"");
+						break;
+					default:
+						fprintf (out, "%c", code[cur + i]);
+						break;
+				}
+			}
+			fprintf (out, "\"\n");
+			return;
+		case DIS_ITEM_INSN:
+			break;
+	}
+
+	if (mark & 2 && !item->label)
+		fprintf (out, "\n");
+	switch (mark & 3) {
+		case 0:
+			if (!quiet)
+				fprintf (out, "%s%08x:%s", cols->reset, cur + list->start, cols->reset);
+			break;
+		case 1:
+			fprintf (out, "%s%08x:%s", cols->btarg, cur + list->start, cols->reset);
+			break;
+		case 2:
+			fprintf (out, "%s%08x:%s", cols->ctarg, cur + list->start, cols->reset);
+			break;
+		case 3:
+			fprintf (out, "%s%08x:%s", cols->bctarg, cur + list->start, cols->reset);
+			break;
+	}
+
+	if (!quiet) {
+		for (i = 0; i < isa->maxoplen; i += isa->opunit) {
+			fprintf (out, " ");
+			for (j = isa->opunit*stride - 1; j >= 0; j--)
+				if (i+j/stride && i+j/stride >= item->len) {
+					fprintf (out, "  ");
+				} else if (cur+i+j/stride >= num) {
+					fprintf (out, "%s??", cols->err);
+				} else {
+					fprintf (out, "%s%02x", cols->reset, code[(cur + i)*stride + j]);
+				}
 		}
+		fprintf (out, "  ");
 
-		if (!quiet) {
-			for (i = 0; i < isa->maxoplen; i += isa->opunit) {
+		if (mark & 2)
+			fprintf (out, "%sC", cols->ctarg);
+		else
+			fprintf (out, " ");
+		if (mark & 1)
+			fprintf (out, "%sB", cols->btarg);
+		else
+			fprintf (out, " ");
+		fprintf(out, " ");
+	} else if (quiet == 1) {
+		if (mark)
+			fprintf (out, "\n");
+	}
+
+	easm_print_insn(out, cols, item->insn);
+
+	if (item->status & DIS_STATUS_UNK_FORM) {
+		fprintf (out, " %s[unknown op length]%s", cols->err, cols->reset);
+	} else {
+		int fl = 0;
+		for (i = 0; i < MAXOPLEN; i++) {
+			if (item->unkbits[i])
+				fl = 1;
+		}
+		if (fl) {
+			fprintf (out, " %s[unknown:", cols->err);
+			for (i = 0; i < item->len || i == 0; i += isa->opunit) {
 				fprintf (out, " ");
 				for (j = isa->opunit*stride - 1; j >= 0; j--)
-					if (i+j/stride && i+j/stride >= dres->oplen) {
-						fprintf (out, "  ");
-					} else if (cur+i+j/stride >= num) {
-						fprintf (out, "%s??", cols->err);
-					} else {
-						fprintf (out, "%s%02x", cols->reset, code[(cur + i)*stride + j]);
-					}
+					if (cur+i+j >= num)
+						fprintf (out, "??");
+					else
+						fprintf (out, "%02llx", (ull)(item->unkbits[(i+j)/8] >> ((i + j)&7) * 8) & 0xff);
 			}
-			fprintf (out, "  ");
+			fprintf (out, "]");
+		}
+	}
+	if (item->status & DIS_STATUS_EOF) {
+		fprintf (out, " %s[incomplete]%s", cols->err, cols->reset);
+	}
+	if (item->status & DIS_STATUS_UNK_INSN) {
+		fprintf (out, " %s[unknown instruction]%s", cols->err, cols->reset);
+	}
+	if (item->status & DIS_STATUS_UNK_OPERAND) {
+		fprintf (out, " %s[unknown operand]%s", cols->err, cols->reset);
+	}
+	fprintf (out, "%s\n", cols->reset);
+}
 
-			if (mark & 2)
-				fprintf (out, "%sC", cols->ctarg);
-			else
-				fprintf (out, " ");
-			if (mark & 1)
-				fprintf (out, "%sB", cols->btarg);
-			else
-				fprintf (out, " ");
-			fprintf(out, " ");
-		} else if (quiet == 1) {
-			if (mark)
-				fprintf (out, "\n");
+void envydis_print_listing(FILE *out, const struct dis_listing *list, int quiet, const struct envy_colors *cols) {
+	int i;
+	for (i = 0; i < list->itemsnum; i++)
+		envydis_print_item(out, list, &list->items[i], quiet, cols);
+}
+
+/*
+ * Parallel disassembly
+ *
+ * Without labels, disassembly is two linear passes over the code: one
+ * decoding everything to find branch targets, and one printing. With more
+ * than one job, the code is split into chunks, and most of the work is done
+ * on a bunch of threads:
+ *
+ *  1. Every chunk is decoded from its start as if an instruction began
+ *     there, recording instruction lengths and the marks each instruction
+ *     would set, without setting them yet.
+ *  2. The chunks are walked in order, starting from where the previous one
+ *     really ended. For variable length ISAs that may be in the middle of an
+ *     instruction found in step 1, in which case instructions are decoded
+ *     again until the walk lands on an instruction start found in step 1,
+ *     after which it's in sync. Marks recorded for instructions on the walk
+ *     are applied.
+ *  3. The printing pass is simulated, using the lengths from above, to find
+ *     its state at chunk boundaries. Positions it needs that weren't decoded
+ *     on the walk (eg. ones following a data word) are decoded here, setting
+ *     their marks just like printing would, and marks are saved as they are
+ *     when each position gets printed.
+ *  4. Chunks are printed to memory buffers in parallel, then written out in
+ *     order.
+ *
+ * The output is identical to the serial one.
+ */
+
+#define PAR_CHUNKS_PER_JOB 8
+#define PAR_MIN_CHUNK 0x400
+
+#define PAR_ENDMARK 1
+#define PAR_REAL 2
+
+struct par_chunk {
+	/* steps 1 and 2 */
+	int start;
+	int end;
+	struct markev *markevs;
+	int markevsnum;
+	/* step 4 */
+	int pstart;
+	int pend;
+	int pactive;
+	char *buf;
+	size_t len;
+};
+
+struct par {
+	struct decoctx *ctx;
+	int quiet;
+	const struct envy_colors *cols;
+	int jobs;
+	struct par_chunk *chunks;
+	int chunksnum;
+	int next;
+	int last;
+	void (*fun)(struct par *par, struct par_chunk *chunk);
+	uint8_t *oplens;
+	uint8_t *flags;
+	int *pmarks;
+};
+
+static void par_subctx(struct decoctx *sub, struct decoctx *ctx, int markmode) {
+	memset(sub, 0, sizeof *sub);
+	sub->isa = ctx->isa;
+	sub->varinfo = ctx->varinfo;
+	sub->code = ctx->code;
+	sub->marks = ctx->marks;
+	sub->names = ctx->names;
+	sub->codebase = ctx->codebase;
+	sub->codesz = ctx->codesz;
+	sub->labels = ctx->labels;
+	sub->labelsnum = ctx->labelsnum;
+	sub->markmode = markmode;
+}
+
+static void par_decode_one(struct par *par, struct decoctx *ctx, int cur) {
+	struct dis_res *dres = do_dis(ctx, cur);
+	ctx->markpos = cur;
+	dis_dopp(ctx, dres, cur + ctx->codebase);
+	par->oplens[cur] = dres->oplen;
+	if (dres->endmark)
+		par->flags[cur] |= PAR_ENDMARK;
+	dis_arena_reset(&ctx->arena);
+}
+
+static void par_decode(struct par *par, struct par_chunk *chunk) {
+	struct decoctx c;
+	int cur;
+	par_subctx(&c, par->ctx, MARK_RECORD);
+	for (cur = chunk->start; cur < chunk->end; cur += par->oplens[cur])
+		par_decode_one(par, &c, cur);
+	chunk->markevs = c.markevs;
+	chunk->markevsnum = c.markevsnum;
+	dis_arena_fini(&c.arena);
+	dis_arena_fini(&c.tmp);
+}
+
+static void par_print(struct par *par, struct par_chunk *chunk) {
+	struct decoctx c;
+	par_subctx(&c, par->ctx, MARK_IGNORE);
+	FILE *out = open_memstream(&chunk->buf, &chunk->len);
+	struct dis_sink sink = { out, par->quiet, par->cols };
+	dis_sink_init(&sink, &c);
+	walk_range(&c, &sink, par->pmarks, chunk->pstart, chunk->pend, chunk->pactive);
+	fclose(out);
+	dis_arena_fini(&c.arena);
+	dis_arena_fini(&c.tmp);
+}
+
+static void *par_worker(void *arg) {
+	struct par *par = arg;
+	int i;
+	while ((i = __atomic_fetch_add(&par->next, 1, __ATOMIC_RELAXED)) < par->last)
+		par->fun(par, &par->chunks[i]);
+	return 0;
+}
+
+/* runs fun on chunks first..last-1 */
+static void par_run(struct par *par, void (*fun)(struct par *par, struct par_chunk *chunk), int first, int last) {
+	pthread_t threads[par->jobs];
+	int started[par->jobs];
+	int i;
+	par->fun = fun;
+	par->next = first;
+	par->last = last;
+	for (i = 1; i < par->jobs; i++)
+		started[i] = !pthread_create(&threads[i], 0, par_worker, par);
+	par_worker(par);
+	for (i = 1; i < par->jobs; i++)
+		if (started[i])
+			pthread_join(threads[i], 0);
+}
+
+static void envydis_par(struct decoctx *ctx, struct dis_sink *sink, int jobs) {
+	struct par p = { ctx, sink->quiet, sink->cols, jobs };
+	struct par *par = &p;
+	int num = ctx->codesz;
+	int i, k;
+	int align = ctx->isa->opunit;
+	if (ctx->isa->tsched && ctx->isa->schedpos > align)
+		align = ctx->isa->schedpos;
+	par->chunksnum = jobs * PAR_CHUNKS_PER_JOB;
+	if (par->chunksnum > num / PAR_MIN_CHUNK)
+		par->chunksnum = num / PAR_MIN_CHUNK;
+	par->chunks = calloc(par->chunksnum, sizeof *par->chunks);
+	for (k = 0; k < par->chunksnum; k++) {
+		par->chunks[k].start = (long long)num * k / par->chunksnum / align * align;
+		if (k)
+			par->chunks[k - 1].end = par->chunks[k].start;
+	}
+	par->chunks[par->chunksnum - 1].end = num;
+	par->oplens = calloc(num, 1);
+	par->flags = calloc(num, 1);
+	par->pmarks = calloc(num, sizeof *par->pmarks);
+
+	/* step 1 */
+	par_run(par, par_decode, 0, par->chunksnum);
+
+	/* step 2 */
+	int cur = 0;
+	for (k = 0; k < par->chunksnum; k++) {
+		struct par_chunk *chunk = &par->chunks[k];
+		for (; cur < chunk->end; cur += par->oplens[cur]) {
+			if (!par->oplens[cur])
+				par_decode_one(par, ctx, cur);
+			par->flags[cur] |= PAR_REAL;
 		}
+		for (i = 0; i < chunk->markevsnum; i++)
+			if (par->flags[chunk->markevs[i].pos] & PAR_REAL)
+				ctx->marks[chunk->markevs[i].ptr] |= chunk->markevs[i].m;
+		free(chunk->markevs);
+	}
 
-		easm_print_insn(out, cols, dres->insn);
+	/* step 3, keep in sync with walk_range */
+	int active = 0;
+	cur = 0;
+	k = 0;
+	while (cur < num) {
+		for (; k < par->chunksnum && cur >= par->chunks[k].start; k++) {
+			par->chunks[k].pstart = cur;
+			par->chunks[k].pactive = active;
+		}
+		int mark = ctx->marks[cur];
+		par->pmarks[cur] = mark;
+		if (mark & 0x1b0 && !active) {
+			if (mark & 0x80) {
+				cur += 1;
+			} else if (mark & 0x100) {
+				cur += 2;
+			} else if (mark & 0x10) {
+				cur += 4;
+			} else {
+				while (ctx->code[cur])
+					cur++;
+				cur++;
+			}
+			continue;
+		}
+		if (!active && mark & 7)
+			active = 1;
+		if (!(par->flags[cur] & PAR_REAL)) {
+			par->flags[cur] &= ~PAR_ENDMARK;
+			par_decode_one(par, ctx, cur);
+			par->flags[cur] |= PAR_REAL;
+		}
+		if (par->flags[cur] & PAR_ENDMARK || mark & 4)
+			active = 0;
+		cur += par->oplens[cur];
+	}
+	for (; k < par->chunksnum; k++) {
+		par->chunks[k].pstart = cur;
+		par->chunks[k].pactive = active;
+	}
+	for (k = 0; k < par->chunksnum; k++)
+		par->chunks[k].pend = k + 1 < par->chunksnum ? par->chunks[k + 1].pstart : num;
 
-		if (dres->status & DIS_STATUS_UNK_FORM) {
-			fprintf (out, " %s[unknown op length]%s", cols->err, cols->reset);
-		} else {
-			int fl = 0;
-			for (i = dres->oplen; i < MAXOPLEN * 8; i++)
-				dres->a[i/8] &= ~(0xffull << (i & 7) * 8);
-			for (i = 0; i < MAXOPLEN; i++) {
-				dres->a[i] &= ~dres->m[i];
-				if (dres->a[i])
-					fl = 1;
+	/* step 4, a few chunks at a time to keep memory use down */
+	for (i = 0; i < par->chunksnum; i += jobs) {
+		int last = i + jobs < par->chunksnum ? i + jobs : par->chunksnum;
+		par_run(par, par_print, i, last);
+		for (k = i; k < last; k++) {
+			fwrite(par->chunks[k].buf, 1, par->chunks[k].len, sink->out);
+			free(par->chunks[k].buf);
+		}
+	}
+
+	free(par->chunks);
+	free(par->oplens);
+	free(par->flags);
+	free(par->pmarks);
+}
+
+/*
+ * Disassembler driver
+ *
+ * You pass a block of memory to this function, disassembly goes out to given
+ * FILE*, or into a listing for envydis_list.
+ */
+
+static void dis_run (const struct disisa *isa, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, struct label *labels, int labelsnum, int jobs, struct dis_sink *sink)
+{
+	struct decoctx c = { 0 };
+	struct decoctx *ctx = &c;
+	int cur = 0, i, j;
+	ctx->code = code;
+	ctx->codesz = num;
+	ctx->marks = calloc(num, sizeof *ctx->marks);
+	ctx->names = calloc(num, sizeof *ctx->names);
+	ctx->codebase = start;
+	ctx->varinfo = varinfo;
+	ctx->isa = isa;
+	ctx->labels = labels;
+	ctx->labelsnum = labelsnum;
+	dis_sink_init(sink, ctx);
+	/* see envydis_par */
+	int par = !labels && !sink->list && jobs > 1 && num >= 2 * PAR_MIN_CHUNK;
+	if (labels) {
+		/*
+		 * Control flow discovery: every position newly marked as
+		 * a branch or call target, be it by a label or by an already
+		 * decoded instruction, is put on a worklist. Code is then
+		 * followed from each of them until the end of the block, or
+		 * until reaching an instruction that has already been decoded,
+		 * since everything after it has been followed already. Thus
+		 * each instruction is decoded once, and the results are kept
+		 * for printing.
+		 */
+		ctx->dres = calloc(num, sizeof *ctx->dres);
+		ctx->decoded = calloc(num, 1);
+		for (i = 0; i < labelsnum; i++) {
+			mark(ctx, labels[i].val, labels[i].type);
+			if (labels[i].val >= ctx->codebase && labels[i].val < ctx->codebase + ctx->codesz) {
+				if (labels[i].name)
+					ctx->names[labels[i].val - ctx->codebase] = labels[i].name;
 			}
-			if (fl) {
-				fprintf (out, " %s[unknown:", cols->err);
-				for (i = 0; i < dres->oplen || i == 0; i += isa->opunit) {
-					fprintf (out, " ");
-					for (j = isa->opunit*stride - 1; j >= 0; j--)
-						if (cur+i+j >= num)
-							fprintf (out, "??");
-						else
-							fprintf (out, "%02llx", (dres->a[(i+j)/8] >> ((i + j)&7) * 8) & 0xff);
-				}
-				fprintf (out, "]");
+			if (labels[i].size) {
+				for (j = 0; j < labels[i].size; j+=4)
+					mark(ctx, labels[i].val + j, labels[i].type);
 			}
 		}
-		if (dres->status & DIS_STATUS_EOF) {
-			fprintf (out, " %s[incomplete]%s", cols->err, cols->reset);
+		int cachefull = 0;
+		while (ctx->todonum) {
+			cur = ctx->todo[--ctx->todonum];
+			while (cur < num && !ctx->decoded[cur]) {
+				struct dis_res *dres = do_dis(ctx, cur);
+				dis_dopp(ctx, dres, cur + start);
+				ctx->decoded[cur] = 1;
+				int stop = dres->endmark || ctx->marks[cur] & 4;
+				int oplen = dres->oplen;
+				if (cachefull) {
+					dis_arena_reset(&ctx->arena);
+				} else {
+					ctx->dres[cur] = dres;
+					/* too much, the rest gets decoded again for printing */
+					if (ctx->arena.size >= DIS_DRES_MAX) {
+						ctx->dres_arena = ctx->arena;
+						memset(&ctx->arena, 0, sizeof ctx->arena);
+						cachefull = 1;
+					}
+				}
+				if (stop)
+					break;
+				cur += oplen;
+			}
 		}
-		if (dres->status & DIS_STATUS_UNK_INSN) {
-			fprintf (out, " %s[unknown instruction]%s", cols->err, cols->reset);
+		/* keep the results, use the main arena for anything else */
+		if (!cachefull) {
+			ctx->dres_arena = ctx->arena;
+			memset(&ctx->arena, 0, sizeof ctx->arena);
 		}
-		if (dres->status & DIS_STATUS_UNK_OPERAND) {
-			fprintf (out, " %s[unknown operand]%s", cols->err, cols->reset);
+	} else if (!par) {
+		while (cur < num) {
+			struct dis_res *dres = do_dis(ctx, cur);
+			dis_dopp(ctx, dres, cur + start);
+			if (dres->oplen)
+				cur += dres->oplen;
+			else
+				cur++;
+			dis_arena_reset(&ctx->arena);
 		}
-		fprintf (out, "%s\n", cols->reset);
-		cur += dres->oplen;
-
-		dis_del_res(dres);
 	}
+	if (par)
+		envydis_par(ctx, sink, jobs);
+	else
+		walk_range(ctx, sink, ctx->marks, 0, num, 0);
 	free(ctx->marks);
 	free(ctx->names);
+	free(ctx->dres);
+	free(ctx->decoded);
+	free(ctx->todo);
+	dis_arena_fini(&ctx->arena);
+	dis_arena_fini(&ctx->tmp);
+	dis_arena_fini(&ctx->dres_arena);
+}
+
+void envydis (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, int quiet, struct label *labels, int labelsnum, const struct envy_colors *cols)
+{
+	envydis_jobs(isa, out, code, start, num, varinfo, quiet, labels, labelsnum, cols, 1);
+}
+
+void envydis_jobs (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, int quiet, struct label *labels, int labelsnum, const struct envy_colors *cols, int jobs)
+{
+	struct dis_sink sink = { out, quiet, cols };
+	dis_run(isa, code, start, num, varinfo, labels, labelsnum, jobs, &sink);
+}
+
+struct dis_listing *envydis_list (const struct disisa *isa, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, struct label *labels, int labelsnum, struct dis_arena *arena)
+{
+	struct dis_listing *list = dis_alloc(arena, sizeof *list);
+	struct dis_sink sink = { 0 };
+	sink.list = list;
+	sink.arena = arena;
+	dis_run(isa, code, start, num, varinfo, labels, labelsnum, 1, &sink);
+	return list;
 }
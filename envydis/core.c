@@ -80,6 +80,7 @@ void ed_freeisa(const struct disisa *isa) {
 	if (!isa->prepdone)
 		return;
 	vardata_del(isa->vardata);
+	dis_flush_dtrees();
 	((struct disisa *)isa)->prepdone = 0;
 }
 
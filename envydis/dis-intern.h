@@ -38,7 +38,8 @@
  *  - a sequence of 0 to 8 operations to perform if this entry is matched.
  *
  * Each table is scanned linearly until a matching entry is found, then all
- * ops in this entry are executed. Length of a table is not checked, so they
+ * ops in this entry are executed. The disassembler actually walks a decision
+ * tree compiled from the table, but the first matching entry always wins. Length of a table is not checked, so they
  * need either a terminator showing '???' for unknown stuff, or match all
  * possible values.
  *
@@ -80,8 +81,6 @@
 
 typedef unsigned long long ull;
 
-#define MAXOPLEN (128/64)
-
 struct iasctx;
 struct disctx;
 struct disisa;
@@ -222,6 +221,15 @@ struct litem {
 struct matches *atomtab_a APROTO;
 void atomtab_d DPROTO;
 
+/*
+ * Finds the first entry of a table matching given opcode word and variant.
+ * dis_tab_match uses a decision tree compiled on first use, dis_tab_scan is
+ * the plain linear scan it replaces. dis_flush_dtrees frees compiled trees.
+ */
+const struct insn *dis_tab_match(const struct insn *tab, ull a, struct varinfo *varinfo);
+const struct insn *dis_tab_scan(const struct insn *tab, ull a, struct varinfo *varinfo);
+void dis_flush_dtrees(void);
+
 #define OP1B atomopl_a, atomopl_d, op1blen
 #define OP2B atomopl_a, atomopl_d, op2blen
 #define OP3B atomopl_a, atomopl_d, op3blen
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
 
 /*
  * Options:
@@ -39,6 +40,7 @@
  *  -F <feature>  Enable optional ISA feature. Most of these are auto-selected by
  *                -V, but can also be specified manually
  *  -S <stride>   Override stride length for ISA and variant
+ *  -j <num>      Match instructions in <num> threads
  *
  *  -o <filename> Output to filename
  *
@@ -63,6 +65,7 @@ struct asctx {
 	int sectionsnum;
 	int sectionsmax;
 	struct matches *im;
+	int jobs;
 };
 
 enum envyas_ofmt {
@@ -244,241 +247,597 @@ int find_label(struct asctx *ctx, struct section *sect, int ofs, int start_at) {
 	return -1;
 }
 
+/*
+ * Matching instructions against the ISA tables is the slow part, and the
+ * result depends on nothing but the instruction itself. So results are
+ * remembered by instruction text, and every distinct instruction is only
+ * matched once. Reloc expressions get copied for every line using them,
+ * since calc expands local labels in place. Lines are matched on a few
+ * threads, sharing the memo.
+ */
+
+struct asmemo {
+	struct symtab *symtab;
+	struct matches *res;
+	int resnum;
+	int resmax;
+	pthread_mutex_t lock;
+};
+
+struct asproc {
+	struct asctx *ctx;
+	struct easm_file *file;
+	struct asmemo memo;
+	int next;
+};
+
+static struct easm_expr *copy_expr(const struct easm_expr *expr) {
+	if (!expr)
+		return 0;
+	struct easm_expr *res = malloc(sizeof *res);
+	*res = *expr;
+	res->e1 = copy_expr(expr->e1);
+	res->e2 = copy_expr(expr->e2);
+	if (expr->str)
+		res->str = strdup(expr->str);
+	if (expr->astr.str) {
+		res->astr.str = malloc(expr->astr.len + 1);
+		memcpy(res->astr.str, expr->astr.str, expr->astr.len + 1);
+	}
+	/* reloc expressions never carry these, don't share them with the parsed file */
+	res->sinsn = 0;
+	res->swizzles = 0;
+	res->swizzlesnum = res->swizzlesmax = 0;
+	res->mods = 0;
+	res->alabel = 0;
+	return res;
+}
+
+static struct matches copy_matches(const struct matches *m) {
+	struct matches res = { 0 };
+	int i, j;
+	res.m = malloc(m->mnum * sizeof *res.m);
+	res.mnum = res.mmax = m->mnum;
+	for (i = 0; i < m->mnum; i++) {
+		res.m[i] = m->m[i];
+		for (j = 0; j < res.m[i].nrelocs; j++)
+			res.m[i].relocs[j].expr = copy_expr(m->m[i].relocs[j].expr);
+	}
+	return res;
+}
+
+static void process_line(struct asproc *proc, int i) {
+	struct asctx *ctx = proc->ctx;
+	struct asmemo *memo = &proc->memo;
+	struct easm_insn *insn = proc->file->lines[i]->insn;
+	char *key;
+	size_t keylen;
+	int idx;
+	FILE *f = open_memstream(&key, &keylen);
+	easm_print_insn(f, &envy_null_colors, insn);
+	fclose(f);
+	pthread_mutex_lock(&memo->lock);
+	if (symtab_get(memo->symtab, key, 0, &idx) != -1) {
+		struct matches res = memo->res[idx];
+		pthread_mutex_unlock(&memo->lock);
+		ctx->im[i] = copy_matches(&res);
+		free(key);
+		return;
+	}
+	pthread_mutex_unlock(&memo->lock);
+	struct matches *res = do_as(ctx->isa, ctx->varinfo, insn);
+	ctx->im[i] = *res;
+	free(res);
+	struct matches copy = copy_matches(&ctx->im[i]);
+	pthread_mutex_lock(&memo->lock);
+	/* someone else could have got there first */
+	if (symtab_put(memo->symtab, key, 0, memo->resnum) != -1) {
+		ADDARRAY(memo->res, copy);
+		copy.m = 0;
+	}
+	pthread_mutex_unlock(&memo->lock);
+	if (copy.m) {
+		for (idx = 0; idx < copy.mnum; idx++)
+			for (i = 0; i < copy.m[idx].nrelocs; i++)
+				easm_del_expr(copy.m[idx].relocs[i].expr);
+		free(copy.m);
+	}
+	free(key);
+}
+
+static void *process_worker(void *arg) {
+	struct asproc *proc = arg;
+	int i;
+	while ((i = __atomic_fetch_add(&proc->next, 1, __ATOMIC_RELAXED)) < proc->file->linesnum)
+		if (proc->file->lines[i]->type == EASM_LINE_INSN)
+			process_line(proc, i);
+	return 0;
+}
+
 int envyas_process(struct asctx *ctx, struct easm_file *file) {
+	struct asproc proc = { ctx, file };
+	int jobs = ctx->jobs > 1 ? ctx->jobs : 1;
+	pthread_t threads[jobs];
+	int started[jobs];
 	int i;
 	ctx->im = calloc(sizeof *ctx->im, file->linesnum);
+	proc.memo.symtab = symtab_new();
+	pthread_mutex_init(&proc.memo.lock, 0);
+	for (i = 1; i < jobs; i++)
+		started[i] = !pthread_create(&threads[i], 0, process_worker, &proc);
+	process_worker(&proc);
+	for (i = 1; i < jobs; i++)
+		if (started[i])
+			pthread_join(threads[i], 0);
+	pthread_mutex_destroy(&proc.memo.lock);
+	symtab_del(proc.memo.symtab);
+	for (i = 0; i < proc.memo.resnum; i++) {
+		int j, k;
+		for (j = 0; j < proc.memo.res[i].mnum; j++)
+			for (k = 0; k < proc.memo.res[i].m[j].nrelocs; k++)
+				easm_del_expr(proc.memo.res[i].m[j].relocs[k].expr);
+		free(proc.memo.res[i].m);
+	}
+	free(proc.memo.res);
 	for (i = 0; i < file->linesnum; i++) {
-		if (file->lines[i]->type == EASM_LINE_INSN) {
-			ctx->im[i] = *do_as(ctx->isa, ctx->varinfo, file->lines[i]->insn);
-			if (!ctx->im[i].mnum) {
-				fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "No match\n"));
-				return 1;
-			}
+		if (file->lines[i]->type == EASM_LINE_INSN && !ctx->im[i].mnum) {
+			fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "No match\n"));
+			return 1;
 		}
 	}
 	return 0;
 }
 
-int envyas_layout(struct asctx *ctx, struct easm_file *file) {
+/*
+ * Instructions with several encodings start out with the first one, and move
+ * on to the next one when a relocation doesn't fit. This moves the labels
+ * after the instruction, which may break relocations elsewhere, so it's
+ * repeated until nothing changes.
+ *
+ * Sections, labels and local label names are only set up once. After that,
+ * positions are recomputed starting at the first line that changed length,
+ * and an instruction is only resolved again when its position or encoding
+ * changed, or when a label it refers to moved.
+ */
+
+enum aslkind {
+	ASL_INSN,
+	ASL_LABEL,
+	ASL_SECTION,
+	ASL_ALIGN,
+	ASL_SIZE,
+	ASL_SKIP,
+	ASL_EQU,
+	ASL_DATA,
+};
+
+struct asline {
+	enum aslkind kind;
+	int sect;
+	int start;	/* position in section before the line */
+	int label;	/* ASL_LABEL, ASL_EQU: index in labels */
+	ull num;	/* ASL_ALIGN, ASL_SIZE, ASL_SKIP: the argument; ASL_DATA: size */
+	/* ASL_INSN: result of the last resolve */
+	const struct match *m;
+	int pos;	/* only matters for pc-relative relocations */
+	int ok;
+	int dirty;
+	ull val[MAXOPLEN];
+};
+
+struct asdeps {
+	int *lines;
+	int linesnum;
+	int linesmax;
+};
+
+struct aslayout {
+	struct asline *lines;
+	struct asdeps *deps;	/* instructions using each label */
+	int first;		/* first line that changed length */
+};
+
+static int layout_init(struct asctx *ctx, struct easm_file *file, struct aslayout *lay, int stride) {
 	int i, j;
-	int allok = 1;
-	int stride = ed_getcstride(ctx->isa, ctx->varinfo);
-	ctx->symtab = symtab_new();
-	do {
-		symtab_del(ctx->symtab);
-		ctx->symtab = symtab_new();
-		allok = 1;
-		ctx->labelsnum = 0;
-		ctx->cur_global_label = NULL;
-		for (i = 0; i < ctx->sectionsnum; i++)
-			free(ctx->sections[i].code);
-		ctx->sectionsnum = 0;
-		int cursect = 0;
-		struct section def = { "default" };
-		def.first_label = -1;
-		ADDARRAY(ctx->sections, def);
-		for (i = 0; i < file->linesnum; i++) {
-			struct easm_directive *direct = file->lines[i]->directive;
-			switch (file->lines[i]->type) {
-				case EASM_LINE_INSN:
-					if (ctx->isa->i_need_g80as_hack) {
-						if (ctx->im[i].m[0].oplen == 8 && (ctx->sections[cursect].pos & 7))
-							ctx->sections[cursect].pos &= ~7ull, ctx->sections[cursect].pos += 8;
+	int cursect = 0;
+	struct section def = { "default" };
+	def.first_label = -1;
+	ADDARRAY(ctx->sections, def);
+	for (i = 0; i < file->linesnum; i++) {
+		struct easm_directive *direct = file->lines[i]->directive;
+		struct asline *line = &lay->lines[i];
+		line->start = ctx->sections[cursect].pos;
+		switch (file->lines[i]->type) {
+			case EASM_LINE_INSN:
+				line->kind = ASL_INSN;
+				if (ctx->isa->i_need_g80as_hack) {
+					if (ctx->im[i].m[0].oplen == 8 && (ctx->sections[cursect].pos & 7))
+						ctx->sections[cursect].pos &= ~7ull, ctx->sections[cursect].pos += 8;
+				}
+				ctx->sections[cursect].pos += ctx->im[i].m[0].oplen * stride;
+				break;
+			case EASM_LINE_LABEL:
+				if (file->lines[i]->lname[0] == '_' && file->lines[i]->lname[1] != '_') {
+					char *full_label = expand_local_label(file->lines[i]->lname, ctx->cur_global_label);
+					free(file->lines[i]->lname);
+					file->lines[i]->lname = full_label;
+				}
+				else
+					ctx->cur_global_label = file->lines[i]->lname;
+
+				if (symtab_put(ctx->symtab, file->lines[i]->lname, 0, ctx->labelsnum) == -1) {
+					fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "Label %s redeclared!\n"), file->lines[i]->lname);
+					return 1;
+				}
+				struct label l = { file->lines[i]->lname, ctx->sections[cursect].pos / stride + ctx->sections[cursect].base };
+				if (ctx->sections[cursect].first_label < 0)
+					ctx->sections[cursect].first_label = ctx->labelsnum;
+				ctx->sections[cursect].last_label = ctx->labelsnum;
+				line->kind = ASL_LABEL;
+				line->label = ctx->labelsnum;
+				ADDARRAY(ctx->labels, l);
+				break;
+			case EASM_LINE_DIRECTIVE:
+				if (!strcmp(direct->str, "section")) {
+					if (direct->paramsnum > 2) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .section\n"));
+						return 1;
 					}
-					ctx->sections[cursect].pos += ctx->im[i].m[0].oplen * stride;
-					break;
-				case EASM_LINE_LABEL:
-					if (file->lines[i]->lname[0] == '_' && file->lines[i]->lname[1] != '_') {
-						char *full_label = expand_local_label(file->lines[i]->lname, ctx->cur_global_label);
-						free(file->lines[i]->lname);
-						file->lines[i]->lname = full_label;
+					if (direct->params[0]->type != EASM_EXPR_LABEL || (direct->paramsnum == 2 && direct->params[1]->type != EASM_EXPR_NUM)) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .section\n"));
+						return 1;
 					}
-					else
-						ctx->cur_global_label = file->lines[i]->lname;
-
-					if (symtab_put(ctx->symtab, file->lines[i]->lname, 0, ctx->labelsnum) == -1) {
-						fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "Label %s redeclared!\n"), file->lines[i]->lname);
+					for (j = 0; j < ctx->sectionsnum; j++)
+						if (!strcmp(ctx->sections[j].name, direct->params[0]->str))
+							break;
+					if (j == ctx->sectionsnum) {
+						struct section s = { direct->params[0]->str };
+						s.first_label = -1;
+						if (direct->paramsnum == 2)
+							s.base = direct->params[1]->num;
+						ADDARRAY(ctx->sections, s);
+					}
+					cursect = j;
+					line->kind = ASL_SECTION;
+					line->start = ctx->sections[cursect].pos;
+				} else if (!strcmp(direct->str, "align")) {
+					if (direct->paramsnum > 1) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .align\n"));
 						return 1;
 					}
-					struct label l = { file->lines[i]->lname, ctx->sections[cursect].pos / stride + ctx->sections[cursect].base };
-					if (ctx->sections[cursect].first_label < 0)
-						ctx->sections[cursect].first_label = ctx->labelsnum;
-					ctx->sections[cursect].last_label = ctx->labelsnum;
-					ADDARRAY(ctx->labels, l);
-					break;
-				case EASM_LINE_DIRECTIVE:
-					if (!strcmp(direct->str, "section")) {
-						if (direct->paramsnum > 2) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .section\n"));
-							return 1;
-						}
-						if (direct->params[0]->type != EASM_EXPR_LABEL || (direct->paramsnum == 2 && direct->params[1]->type != EASM_EXPR_NUM)) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .section\n"));
-							return 1;
-						}
-						for (j = 0; j < ctx->sectionsnum; j++)
-							if (!strcmp(ctx->sections[j].name, direct->params[0]->str))
-								break;
-						if (j == ctx->sectionsnum) {
-							struct section s = { direct->params[0]->str };
-							s.first_label = -1;
-							if (direct->paramsnum == 2)
-								s.base = direct->params[1]->num;
-							ADDARRAY(ctx->sections, s);
-						}
-						cursect = j;
-					} else if (!strcmp(direct->str, "align")) {
-						if (direct->paramsnum > 1) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .align\n"));
-							return 1;
-						}
-						if (direct->params[0]->type != EASM_EXPR_NUM) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .align\n"));
-							return 1;
-						}
-						ull num = direct->params[0]->num;
-						ctx->sections[cursect].pos += num - 1;
-						ctx->sections[cursect].pos /= num;
-						ctx->sections[cursect].pos *= num;
-					} else if (!strcmp(direct->str, "size")) {
-						if (direct->paramsnum > 1) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .size\n"));
-							return 1;
-						}
-						if (direct->params[0]->type != EASM_EXPR_NUM) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .size\n"));
-							return 1;
-						}
-						ull num = direct->params[0]->num;
-						if (ctx->sections[cursect].pos > num) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Section '%s' exceeds .size by %llu bytes\n"), ctx->sections[cursect].name, ctx->sections[cursect].pos - num);
-							return 1;
-						}
-						ctx->sections[cursect].pos = num;
-					} else if (!strcmp(direct->str, "skip")) {
-						if (direct->paramsnum > 1) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .skip\n"));
-							return 1;
-						}
-						if (direct->params[0]->type != EASM_EXPR_NUM) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .skip\n"));
-							return 1;
-						}
-						ull num = direct->params[0]->num;
-						ctx->sections[cursect].pos += num;
-					} else if (!strcmp(direct->str, "equ")) {
-						if (direct->paramsnum != 2
-							|| direct->params[0]->type != EASM_EXPR_LABEL
-							|| !easm_isimm(direct->params[1])) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .equ\n"));
-							return 1;
-						}
-						if (direct->params[0]->str[0] == '_' && direct->params[0]->str[1] != '_') {
-							char *full_label = expand_local_label(direct->params[0]->str, ctx->cur_global_label);
-							free((void*)direct->params[0]->str);
-							direct->params[0]->str = full_label;
-						}
-						ull num = calc(direct->params[1], ctx);
-						if (symtab_put(ctx->symtab, direct->params[0]->str, 0, ctx->labelsnum) == -1) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Label %s redeclared!\n"), direct->params[0]->str);
-							return 1;
-						}
-						struct label l = { direct->params[0]->str, num , /* Distinguish .equ labels from regular labels */ 1 };
-						ADDARRAY(ctx->labels, l);
-					} else if (!donum(&ctx->sections[cursect], direct, ctx, 0)) {
-						fprintf (stderr, LOC_FORMAT(direct->loc, "Unknown directive .%s\n"), direct->str);
+					if (direct->params[0]->type != EASM_EXPR_NUM) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .align\n"));
 						return 1;
 					}
-					break;
-			}
+					ull num = direct->params[0]->num;
+					ctx->sections[cursect].pos += num - 1;
+					ctx->sections[cursect].pos /= num;
+					ctx->sections[cursect].pos *= num;
+					line->kind = ASL_ALIGN;
+					line->num = num;
+				} else if (!strcmp(direct->str, "size")) {
+					if (direct->paramsnum > 1) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .size\n"));
+						return 1;
+					}
+					if (direct->params[0]->type != EASM_EXPR_NUM) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .size\n"));
+						return 1;
+					}
+					ull num = direct->params[0]->num;
+					if (ctx->sections[cursect].pos > num) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Section '%s' exceeds .size by %llu bytes\n"), ctx->sections[cursect].name, ctx->sections[cursect].pos - num);
+						return 1;
+					}
+					ctx->sections[cursect].pos = num;
+					line->kind = ASL_SIZE;
+					line->num = num;
+				} else if (!strcmp(direct->str, "skip")) {
+					if (direct->paramsnum > 1) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Too many arguments for .skip\n"));
+						return 1;
+					}
+					if (direct->params[0]->type != EASM_EXPR_NUM) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .skip\n"));
+						return 1;
+					}
+					ull num = direct->params[0]->num;
+					ctx->sections[cursect].pos += num;
+					line->kind = ASL_SKIP;
+					line->num = num;
+				} else if (!strcmp(direct->str, "equ")) {
+					if (direct->paramsnum != 2
+						|| direct->params[0]->type != EASM_EXPR_LABEL
+						|| !easm_isimm(direct->params[1])) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Wrong arguments for .equ\n"));
+						return 1;
+					}
+					if (direct->params[0]->str[0] == '_' && direct->params[0]->str[1] != '_') {
+						char *full_label = expand_local_label(direct->params[0]->str, ctx->cur_global_label);
+						free((void*)direct->params[0]->str);
+						direct->params[0]->str = full_label;
+					}
+					ull num = calc(direct->params[1], ctx);
+					if (symtab_put(ctx->symtab, direct->params[0]->str, 0, ctx->labelsnum) == -1) {
+						fprintf (stderr, LOC_FORMAT(direct->loc, "Label %s redeclared!\n"), direct->params[0]->str);
+						return 1;
+					}
+					struct label l = { direct->params[0]->str, num , /* Distinguish .equ labels from regular labels */ 1 };
+					line->kind = ASL_EQU;
+					line->label = ctx->labelsnum;
+					ADDARRAY(ctx->labels, l);
+				} else if (donum(&ctx->sections[cursect], direct, ctx, 0)) {
+					line->kind = ASL_DATA;
+					line->num = ctx->sections[cursect].pos - line->start;
+				} else {
+					fprintf (stderr, LOC_FORMAT(direct->loc, "Unknown directive .%s\n"), direct->str);
+					return 1;
+				}
+				break;
 		}
-		cursect = 0;
-		ctx->cur_global_label = NULL;
-		for (j = 0; j < ctx->sectionsnum; j++)
-			ctx->sections[j].pos = 0;
-		ull val[MAXOPLEN];
-		for (i = 0; i < file->linesnum; i++) {
-			struct easm_directive *direct = file->lines[i]->directive;
-			switch (file->lines[i]->type) {
-				case EASM_LINE_INSN:
-					if (!resolve(ctx, val, ctx->im[i].m[0], ctx->sections[cursect].pos / stride + ctx->sections[cursect].base)) {
-						ctx->sections[cursect].pos += ctx->im[i].m[0].oplen * stride;
-						ctx->im[i].m++;
-						ctx->im[i].mnum--;
-						if (!ctx->im[i].mnum) {
-							fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "Relocation failed\n"));
-							return 1;
-						}
-						allok = 0;
-					} else {
-						if (ctx->isa->i_need_g80as_hack) {
-							if (ctx->im[i].m[0].oplen == 8 && (ctx->sections[cursect].pos & 7)) {
-								j = i - 1;
-								while (j != -1ull && file->lines[j]->type == EASM_LINE_LABEL)
-									j--;
-								assert (j != -1ull && file->lines[j]->type == EASM_LINE_INSN);
-								if (ctx->im[j].m[0].oplen == 4) {
-									ctx->im[j].m++;
-									ctx->im[j].mnum--;
-								}
-								allok = 0;
-								ctx->sections[cursect].pos &= ~7ull, ctx->sections[cursect].pos += 8;
-							}
-						}
-						extend(&ctx->sections[cursect], ctx->im[i].m[0].oplen * stride);
-						for (j = 0; j < ctx->im[i].m[0].oplen * stride; j++)
-							ctx->sections[cursect].code[ctx->sections[cursect].pos++] = val[j>>3] >> (8*(j&7));
+		line->sect = cursect;
+	}
+	ctx->cur_global_label = NULL;
+	return 0;
+}
+
+/* expands local labels the way calc would, and notes labels used by the line */
+static void layout_note(struct asctx *ctx, struct aslayout *lay, struct easm_expr *expr, int i) {
+	int res;
+	if (!expr)
+		return;
+	if (expr->type == EASM_EXPR_LABEL) {
+		if (expr->str[0] == '_' && expr->str[1] != '_') {
+			char *full_label = expand_local_label(expr->str, ctx->cur_global_label);
+			free(expr->str);
+			expr->str = full_label;
+		}
+		if (symtab_get(ctx->symtab, expr->str, 0, &res) != -1) {
+			struct asdeps *deps = &lay->deps[res];
+			if (!deps->linesnum || deps->lines[deps->linesnum - 1] != i)
+				ADDARRAY(deps->lines, i);
+		}
+	}
+	layout_note(ctx, lay, expr->e1, i);
+	layout_note(ctx, lay, expr->e2, i);
+}
+
+static void layout_deps(struct asctx *ctx, struct easm_file *file, struct aslayout *lay) {
+	int i, j, k;
+	lay->deps = calloc(ctx->labelsnum, sizeof *lay->deps);
+	for (i = 0; i < file->linesnum; i++) {
+		if (file->lines[i]->type == EASM_LINE_LABEL) {
+			if (file->lines[i]->lname[0] != '_')
+				ctx->cur_global_label = file->lines[i]->lname;
+		} else if (file->lines[i]->type == EASM_LINE_INSN) {
+			for (j = 0; j < ctx->im[i].mnum; j++)
+				for (k = 0; k < ctx->im[i].m[j].nrelocs; k++)
+					layout_note(ctx, lay, ctx->im[i].m[j].relocs[k].expr, i);
+		}
+	}
+	ctx->cur_global_label = NULL;
+}
+
+static void layout_set_label(struct asctx *ctx, struct aslayout *lay, int idx, ull val) {
+	int i;
+	if (ctx->labels[idx].val == val)
+		return;
+	ctx->labels[idx].val = val;
+	for (i = 0; i < lay->deps[idx].linesnum; i++)
+		lay->lines[lay->deps[idx].lines[i]].dirty = 1;
+}
+
+/* moves everything after the first changed line */
+static int layout_update(struct asctx *ctx, struct easm_file *file, struct aslayout *lay, int stride) {
+	int *pos = calloc(ctx->sectionsnum, sizeof *pos);
+	char *seen = calloc(ctx->sectionsnum, 1);
+	int i;
+	for (i = lay->first; i < file->linesnum; i++) {
+		struct asline *line = &lay->lines[i];
+		struct section *s = &ctx->sections[line->sect];
+		int *p = &pos[line->sect];
+		/* nothing before the first changed line moved */
+		if (!seen[line->sect])
+			*p = line->start, seen[line->sect] = 1;
+		line->start = *p;
+		switch (line->kind) {
+			case ASL_INSN:
+				if (ctx->isa->i_need_g80as_hack) {
+					if (ctx->im[i].m[0].oplen == 8 && (*p & 7))
+						*p &= ~7, *p += 8;
+				}
+				*p += ctx->im[i].m[0].oplen * stride;
+				break;
+			case ASL_LABEL:
+				layout_set_label(ctx, lay, line->label, *p / stride + s->base);
+				break;
+			case ASL_EQU:
+				layout_set_label(ctx, lay, line->label, calc(file->lines[i]->directive->params[1], ctx));
+				break;
+			case ASL_ALIGN:
+				*p += line->num - 1;
+				*p /= line->num;
+				*p *= line->num;
+				break;
+			case ASL_SIZE:
+				if (*p > line->num) {
+					fprintf (stderr, LOC_FORMAT(file->lines[i]->directive->loc, "Section '%s' exceeds .size by %llu bytes\n"), s->name, *p - line->num);
+					free(pos);
+					free(seen);
+					return 1;
+				}
+				*p = line->num;
+				break;
+			case ASL_SKIP:
+			case ASL_DATA:
+				*p += line->num;
+				break;
+			case ASL_SECTION:
+				break;
+		}
+	}
+	free(pos);
+	free(seen);
+	return 0;
+}
+
+static int match_pcrel(const struct match *m) {
+	int i;
+	for (i = 0; i < m->nrelocs; i++)
+		if (m->relocs[i].bf->pcrel)
+			return 1;
+	return 0;
+}
+
+/* tries the current encodings, moves on to the next one where they don't fit */
+static int layout_resolve(struct asctx *ctx, struct easm_file *file, struct aslayout *lay, int stride, int *allok) {
+	int *pos = calloc(ctx->sectionsnum, sizeof *pos);
+	int i, j;
+	for (i = 0; i < file->linesnum; i++) {
+		struct asline *line = &lay->lines[i];
+		int *p = &pos[line->sect];
+		switch (line->kind) {
+			case ASL_INSN: {
+				int at = *p / stride + ctx->sections[line->sect].base;
+				if (line->dirty || line->m != ctx->im[i].m || (line->pos != at && match_pcrel(&ctx->im[i].m[0]))) {
+					line->ok = resolve(ctx, line->val, ctx->im[i].m[0], at);
+					line->m = ctx->im[i].m;
+					line->dirty = 0;
+				}
+				line->pos = at;
+				if (!line->ok) {
+					*p += ctx->im[i].m[0].oplen * stride;
+					ctx->im[i].m++;
+					ctx->im[i].mnum--;
+					if (!ctx->im[i].mnum) {
+						fprintf (stderr, LOC_FORMAT(file->lines[i]->loc, "Relocation failed\n"));
+						free(pos);
+						return 1;
 					}
-					break;
-				case EASM_LINE_LABEL:
-					if (file->lines[i]->lname[0] != '_')
-						ctx->cur_global_label = file->lines[i]->lname;
-					break;
-				case EASM_LINE_DIRECTIVE:
-					if (!strcmp(direct->str, "section")) {
-						for (j = 0; j < ctx->sectionsnum; j++)
-							if (!strcmp(ctx->sections[j].name, direct->params[0]->str))
-								break;
-						cursect = j;
-					} else if (!strcmp(direct->str, "align")) {
-						ull num = direct->params[0]->num;
-						ull oldpos = ctx->sections[cursect].pos;
-						ctx->sections[cursect].pos += num - 1;
-						ctx->sections[cursect].pos /= num;
-						ctx->sections[cursect].pos *= num;
-						extend(&ctx->sections[cursect], 0);
-						for (j = oldpos; j < ctx->sections[cursect].pos; j++)
-							ctx->sections[cursect].code[j] = 0;
-					} else if (!strcmp(direct->str, "size")) {
-						ull num = direct->params[0]->num;
-						ull oldpos = ctx->sections[cursect].pos;
-						if (ctx->sections[cursect].pos > num) {
-							fprintf (stderr, LOC_FORMAT(direct->loc, "Section '%s' exceeds .size by %llu bytes\n"), ctx->sections[cursect].name, ctx->sections[cursect].pos - num);
-							return 1;
+					if (lay->first > i)
+						lay->first = i;
+					*allok = 0;
+				} else {
+					if (ctx->isa->i_need_g80as_hack) {
+						if (ctx->im[i].m[0].oplen == 8 && (*p & 7)) {
+							j = i - 1;
+							while (j >= 0 && file->lines[j]->type == EASM_LINE_LABEL)
+								j--;
+							assert (j >= 0 && file->lines[j]->type == EASM_LINE_INSN);
+							if (ctx->im[j].m[0].oplen == 4) {
+								ctx->im[j].m++;
+								ctx->im[j].mnum--;
+								if (lay->first > j)
+									lay->first = j;
+							}
+							*allok = 0;
+							*p &= ~7, *p += 8;
 						}
-						ctx->sections[cursect].pos = num;
-						extend(&ctx->sections[cursect], 0);
-						for (j = oldpos; j < ctx->sections[cursect].pos; j++)
-							ctx->sections[cursect].code[j] = 0;
-					} else if (!strcmp(direct->str, "skip")) {
-						ull num = direct->params[0]->num;
-						ull oldpos = ctx->sections[cursect].pos;
-						ctx->sections[cursect].pos += num;
-						extend(&ctx->sections[cursect], 0);
-						for (j = oldpos; j < ctx->sections[cursect].pos; j++)
-							ctx->sections[cursect].code[j] = 0;
-					} else if (!strcmp(direct->str, "equ")) {
-						/* nothing to be done */
-					} else if (!donum(&ctx->sections[cursect], direct, ctx, 1)) {
-						fprintf (stderr, LOC_FORMAT(direct->loc, "Unknown directive .%s\n"), direct->str);
-						return 1;
 					}
+					*p += ctx->im[i].m[0].oplen * stride;
+				}
+				break;
 			}
+			case ASL_ALIGN:
+				*p += line->num - 1;
+				*p /= line->num;
+				*p *= line->num;
+				break;
+			case ASL_SIZE:
+				if (*p > line->num) {
+					fprintf (stderr, LOC_FORMAT(file->lines[i]->directive->loc, "Section '%s' exceeds .size by %llu bytes\n"), ctx->sections[line->sect].name, *p - line->num);
+					free(pos);
+					return 1;
+				}
+				*p = line->num;
+				break;
+			case ASL_SKIP:
+			case ASL_DATA:
+				*p += line->num;
+				break;
+			default:
+				break;
 		}
-	} while (!allok);
+	}
+	free(pos);
 	return 0;
 }
 
+/* writes out the code once everything fits */
+static void layout_emit(struct asctx *ctx, struct easm_file *file, struct aslayout *lay, int stride) {
+	int i, j;
+	for (i = 0; i < file->linesnum; i++) {
+		struct asline *line = &lay->lines[i];
+		struct section *s = &ctx->sections[line->sect];
+		int oldpos = s->pos;
+		switch (line->kind) {
+			case ASL_INSN:
+				extend(s, ctx->im[i].m[0].oplen * stride);
+				for (j = 0; j < ctx->im[i].m[0].oplen * stride; j++)
+					s->code[s->pos++] = line->val[j>>3] >> (8*(j&7));
+				break;
+			case ASL_LABEL:
+				if (file->lines[i]->lname[0] != '_')
+					ctx->cur_global_label = file->lines[i]->lname;
+				break;
+			case ASL_ALIGN:
+				s->pos += line->num - 1;
+				s->pos /= line->num;
+				s->pos *= line->num;
+				break;
+			case ASL_SIZE:
+				s->pos = line->num;
+				break;
+			case ASL_SKIP:
+				s->pos += line->num;
+				break;
+			case ASL_DATA:
+				donum(s, file->lines[i]->directive, ctx, 1);
+				break;
+			default:
+				break;
+		}
+		if (line->kind == ASL_ALIGN || line->kind == ASL_SIZE || line->kind == ASL_SKIP) {
+			extend(s, 0);
+			for (j = oldpos; j < s->pos; j++)
+				s->code[j] = 0;
+		}
+	}
+}
+
+int envyas_layout(struct asctx *ctx, struct easm_file *file) {
+	struct aslayout lay = { 0 };
+	int stride = ed_getcstride(ctx->isa, ctx->varinfo);
+	int allok;
+	int res = 1;
+	int i;
+	ctx->symtab = symtab_new();
+	lay.lines = calloc(file->linesnum, sizeof *lay.lines);
+	if (layout_init(ctx, file, &lay, stride))
+		goto out;
+	layout_deps(ctx, file, &lay);
+	lay.first = file->linesnum;
+	do {
+		if (layout_update(ctx, file, &lay, stride))
+			goto out;
+		lay.first = file->linesnum;
+		allok = 1;
+		if (layout_resolve(ctx, file, &lay, stride, &allok))
+			goto out;
+	} while (!allok);
+	for (i = 0; i < ctx->sectionsnum; i++)
+		ctx->sections[i].pos = 0;
+	layout_emit(ctx, file, &lay, stride);
+	res = 0;
+out:
+	if (lay.deps)
+		for (i = 0; i < ctx->labelsnum; i++)
+			free(lay.deps[i].lines);
+	free(lay.deps);
+	free(lay.lines);
+	return res;
+}
+
 int envyas_output(struct asctx *ctx, enum envyas_ofmt ofmt, const char *outname, int stride) {
 	FILE *outfile = stdout;
 	int i, j, k;
@@ -589,7 +948,7 @@ int main(int argc, char **argv) {
 	const char **featnames = 0;
 	int featnamesnum = 0;
 	int featnamesmax = 0;
-	while ((c = getopt (argc, argv, "am:V:O:F:o:wWiS:")) != -1)
+	while ((c = getopt (argc, argv, "am:V:O:F:o:wWiS:j:")) != -1)
 		switch (c) {
 			case 'a':
 				if (ofmt == OFMT_HEX64)
@@ -636,6 +995,9 @@ int main(int argc, char **argv) {
 			case 'S':
 				sscanf(optarg, "%x", &stride);
 				break;
+			case 'j':
+				ctx->jobs = strtol(optarg, 0, 0);
+				break;
 		}
 	FILE *ifile = stdin;
 	const char *filename = "stdin";
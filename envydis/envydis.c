@@ -29,6 +29,8 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
  * Options:
@@ -50,6 +52,8 @@
                  mode only)
  *  -M <mapfile> Load map file
  *  -u <value>   Set map file label value
+ *  -j <num>     Disassemble in <num> threads (without labels only)
+ *  -c           Cache decoded instructions, print cache hit rate to stderr
  *
  *  -n           Disable color escape sequences in output
  *  -q           Disable printing address + opcodes
@@ -57,13 +61,99 @@
  * Refer to docs/envydis/index.rst for ISA details
  */
 
+/*
+ * Reads the whole input. Regular files are mapped rather than read. Either
+ * way there is a zero page after the end, since the disassembler may look
+ * a few bytes past the end of code.
+ */
+static uint8_t *read_input(FILE *infile, size_t *plen) {
+	struct stat st;
+	int fd = fileno(infile);
+	size_t page = sysconf(_SC_PAGESIZE);
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size) {
+		size_t len = st.st_size;
+		size_t maplen = (len + page - 1) / page * page;
+		void *res = mmap(0, maplen + page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (res != MAP_FAILED) {
+			if (mmap(res, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+				*plen = len;
+				return res;
+			}
+			munmap(res, maplen + page);
+		}
+	}
+	size_t len = 0, max = 0x10000;
+	uint8_t *res = malloc(max);
+	size_t n;
+	while ((n = fread(res + len, 1, max - len, infile))) {
+		len += n;
+		if (len == max)
+			max *= 2, res = realloc(res, max);
+	}
+	res = realloc(res, len + page);
+	memset(res + len, 0, page);
+	*plen = len;
+	return res;
+}
+
+/*
+ * Parses hex input the way repeated fscanf("%llx") and fscanf(" ,") would,
+ * stopping once <need> bytes are there, if that's nonzero.
+ */
+static uint8_t *parse_hex(const uint8_t *text, size_t len, int wsz, int need, int *pnum) {
+	static signed char hexval[256];
+	const uint8_t *p = text, *end = text + len;
+	int num = 0;
+	int maxnum = 16;
+	uint8_t *code = malloc (maxnum);
+	int i;
+	if (!hexval[0]) {
+		memset(hexval, -1, sizeof hexval);
+		for (i = 0; i < 10; i++)
+			hexval['0' + i] = i;
+		for (i = 0; i < 6; i++)
+			hexval['a' + i] = hexval['A' + i] = 10 + i;
+	}
+	while (!need || num < need) {
+		int neg = 0, ovf = 0;
+		unsigned long long t = 0;
+		while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+			p++;
+		if (p < end && (*p == '+' || *p == '-'))
+			neg = *p++ == '-';
+		if (end - p >= 3 && p[0] == '0' && (p[1] | 0x20) == 'x' && hexval[p[2]] >= 0)
+			p += 2;
+		if (p == end || hexval[*p] < 0)
+			break;
+		for (; p < end && hexval[*p] >= 0; p++) {
+			ovf |= t >> 60;
+			t = t << 4 | hexval[*p];
+		}
+		if (ovf)
+			t = -1ull;
+		else if (neg)
+			t = -t;
+		if (num + wsz - 1 >= maxnum) maxnum *= 2, code = realloc (code, maxnum);
+		for (i = 0; i < wsz; i++) {
+			code[num++] = t & 0xff;
+			t >>= 8;
+		}
+		while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+			p++;
+		if (p < end && *p == ',')
+			p++;
+	}
+	*pnum = num;
+	return code;
+}
+
 int main(int argc, char **argv) {
 	FILE *infile = stdin;
 	const struct disisa *isa = 0;
 	struct label *labels = 0;
 	int labelsnum = 0;
 	int labelsmax = 0;
-	int w = 0, bin = 0, quiet = 0;
+	int w = 0, bin = 0, quiet = 0, jobs = 1, memo = 0;
 	const char **varnames = 0;
 	int varnamesnum = 0;
 	int varnamesmax = 0;
@@ -85,7 +175,7 @@ int main(int argc, char **argv) {
 	}
 	int c;
 	unsigned base = 0, skip = 0, limit = 0;
-	while ((c = getopt (argc, argv, "b:d:l:m:V:O:F:wWinqu:M:S:")) != -1)
+	while ((c = getopt (argc, argv, "b:d:l:m:V:O:F:wWinqu:M:S:j:c")) != -1)
 		switch (c) {
 			case 'b':
 				sscanf(optarg, "%x", &base);
@@ -111,6 +201,13 @@ int main(int argc, char **argv) {
 			case 'q':
 				quiet = 1;
 				break;
+			case 'j':
+				jobs = strtol(optarg, 0, 0);
+				break;
+			case 'c':
+				memo = 1;
+				envydis_memo(1);
+				break;
 			case 'n':
 				cols = &envy_null_colors;
 				break;
@@ -243,27 +340,36 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "Byte size too large for non-binary input!\n");
 		return 1;
 	}
+	int stride = ed_getcstride(isa, var);
+	/* bytes of code needed for -d and -l, or 0 for everything */
+	int need = limit ? skip + limit * stride : 0;
 	int num = 0;
-	int maxnum = 16;
-	uint8_t *code = malloc (maxnum);
-	unsigned long long t;
+	uint8_t *code;
+	size_t inlen;
+	uint8_t *input = read_input(infile, &inlen);
 	if (bin) {
+		int ccb = CEILDIV(cbsz, 8);
 		if (!wsz)
-			wsz = CEILDIV(cbsz, 8);
-		if (wsz < CEILDIV(cbsz, 8)) {
+			wsz = ccb;
+		if (wsz < ccb) {
 			fprintf(stderr, "Stride too small!\n");
 			return 1;
 		}
-		int pos = 0;
-		int c;
-		while ((c = getc(infile)) != EOF) {
-			if (pos < CEILDIV(cbsz, 8)) {
-				if (num >= maxnum) maxnum *= 2, code = realloc (code, maxnum);
-				code[num++] = c;
+		if (wsz == ccb) {
+			code = input;
+			num = inlen;
+		} else {
+			/* keep the first ccb bytes of every wsz */
+			size_t pos;
+			if (!need || need > (int)inlen)
+				need = inlen;
+			code = malloc (need + 16);
+			for (pos = 0; pos < inlen && num < need; pos += wsz) {
+				int n = inlen - pos < ccb ? inlen - pos : ccb;
+				memcpy(code + num, input + pos, n);
+				num += n;
 			}
-			pos++;
-			if (pos == wsz)
-				pos = 0;
+			memset(code + num, 0, 16);
 		}
 	} else {
 		if (wsz) {
@@ -275,21 +381,19 @@ int main(int argc, char **argv) {
 			wsz = 4;
 		if (cbsz == 8 && w == 2)
 			wsz = 8;
-		while (!feof(infile) && fscanf (infile, "%llx", &t) == 1) {
-			if (num + wsz - 1 >= maxnum) maxnum *= 2, code = realloc (code, maxnum);
-			for (i = 0; i < wsz; i++) {
-				code[num++] = t & 0xff;
-				t >>= 8;
-			}
-			fscanf (infile, " ,");
-		}
+		code = parse_hex(input, inlen, wsz, need, &num);
 	}
 	if (num <= skip)
 		return 0;
 	int cnt = num - skip;
-	cnt /= ed_getcstride(isa, var);
+	cnt /= stride;
 	if (limit && limit < cnt)
 		cnt = limit;
-	envydis (isa, stdout, code+skip, base, cnt, var, quiet, labels, labelsnum, cols);
+	envydis_jobs (isa, stdout, code+skip, base, cnt, var, quiet, labels, labelsnum, cols, jobs);
+	if (memo) {
+		long long lookups, hits;
+		envydis_memo_stats(&lookups, &hits);
+		fprintf(stderr, "memo cache: %lld lookups, %lld hits (%.1f%%)\n", lookups, hits, lookups ? hits * 100.0 / lookups : 0.0);
+	}
 	return 0;
 }
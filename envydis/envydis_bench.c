@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * envydis-bench measures disassembly throughput for every ISA, on two
+ * deterministic code streams: random bytes, and instructions picked out of
+ * random bytes that decode cleanly. For each, it reports instructions per
+ * second and allocations per instruction, both for building a listing and
+ * for printing it. The clean stream is also put through envyas, if given,
+ * and timed. Results are printed as JSON.
+ *
+ * Every ISA is measured in its own process, so that one crashing doesn't
+ * take the others down; a crash is reported as an error of that ISA only.
+ * ISAs known to crash on random code are skipped unless named explicitly.
+ */
+
+#include "bench.h"
+#include "dis.h"
+#include "easm.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct bench_isa {
+	const char *name;
+	const char *variant;
+	const char *broken;
+};
+
+static const struct bench_isa isas[] = {
+	{ "g80", "gt215" },
+	{ "gf100", "gk104" },
+	{ "gk110", 0, "aborts on random code" },
+	{ "gm107", "sm52" },
+	{ "ctx", "g80" },
+	{ "falcon", "fuc5" },
+	{ "hwsq", "g80" },
+	{ "xtensa", 0 },
+	{ "vuc", "vp3" },
+	{ "macro", 0 },
+	{ "vp1", 0 },
+	{ "vcomp", 0 },
+};
+
+static int bytes = 1 << 16;
+static int reps = 3;
+static const char *dir = ".";
+static const char *envyas;
+
+static int count_insns(const struct dis_listing *list) {
+	int i, res = 0;
+	for (i = 0; i < list->itemsnum; i++)
+		if (list->items[i].type == DIS_ITEM_INSN)
+			res++;
+	return res;
+}
+
+/* instructions from random bytes that decode without any complaints */
+static uint8_t *make_clean(const struct disisa *isa, struct varinfo *var, int stride, int *pnum) {
+	uint8_t *res = malloc(bytes);
+	uint8_t *rbuf = malloc(bytes);
+	int num = 0;
+	int tries, i, j;
+	for (tries = 0; tries < 64 && num < bytes; tries++) {
+		for (i = 0; i < bytes; i++)
+			rbuf[i] = bench_rnd();
+		struct dis_arena *arena = dis_arena_new();
+		struct dis_listing *list = envydis_list(isa, rbuf, 0, bytes / stride, var, 0, 0, arena);
+		for (i = 0; i < list->itemsnum && num < bytes; i++) {
+			struct dis_item *item = &list->items[i];
+			if (item->type != DIS_ITEM_INSN || item->status != DIS_STATUS_OK)
+				continue;
+			for (j = 0; j < MAXOPLEN; j++)
+				if (item->unkbits[j])
+					break;
+			if (j < MAXOPLEN)
+				continue;
+			int len = item->len * stride;
+			if (num + len > bytes)
+				break;
+			memcpy(res + num, rbuf + item->pos * stride, len);
+			num += len;
+		}
+		dis_arena_del(arena);
+	}
+	free(rbuf);
+	*pnum = num;
+	return res;
+}
+
+static void report(const char *name, double secs, int insns, long long nallocs) {
+	printf("\"%s\": { \"secs\": %.6f, \"insns_per_sec\": %.0f, ", name, secs, insns / secs);
+	if (bench_have_allocs)
+		printf("\"allocs_per_insn\": %.4f }", insns ? (double)nallocs / insns : 0.0);
+	else
+		printf("\"allocs_per_insn\": null }");
+}
+
+/*
+ * assembles the listing back with envyas. Most ISAs don't round trip
+ * exactly, so only the time and exit status are reported.
+ */
+static void roundtrip(const struct bench_isa *bi, const struct dis_listing *list) {
+	char src[4096], out[4096];
+	double start;
+	int status, i;
+	snprintf(src, sizeof src, "%s/bench-%s.s", dir, bi->name);
+	snprintf(out, sizeof out, "%s/bench-%s.bin", dir, bi->name);
+	FILE *f = fopen(src, "w");
+	if (!f) {
+		perror(src);
+		exit(2);
+	}
+	for (i = 0; i < list->itemsnum; i++) {
+		if (list->items[i].type != DIS_ITEM_INSN)
+			continue;
+		easm_print_insn(f, &envy_null_colors, list->items[i].insn);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	start = bench_now();
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(2);
+	}
+	if (!pid) {
+		int fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0)
+			dup2(fd, 2);
+		if (bi->variant)
+			execl(envyas, envyas, "-m", bi->name, "-V", bi->variant, "-i", "-o", out, src, (char *)0);
+		else
+			execl(envyas, envyas, "-m", bi->name, "-i", "-o", out, src, (char *)0);
+		_exit(127);
+	}
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR) {
+			perror("waitpid");
+			exit(2);
+		}
+	double secs = bench_now() - start;
+	status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	printf(", \"roundtrip\": { \"secs\": %.6f, \"status\": %d }", secs, status);
+}
+
+static void bench_stream(const struct bench_isa *bi, const struct disisa *isa, struct varinfo *var, const char *name, uint8_t *code, int num) {
+	int stride = ed_getcstride(isa, var);
+	double best = 0;
+	long long nallocs = 0;
+	int insns, i;
+	FILE *null = fopen("/dev/null", "w");
+	/* first run builds tables, don't count it */
+	struct dis_arena *arena = dis_arena_new();
+	insns = count_insns(envydis_list(isa, code, 0, num / stride, var, 0, 0, arena));
+	dis_arena_del(arena);
+	printf("{ \"stream\": \"%s\", \"bytes\": %d, \"insns\": %d, ", name, num, insns);
+	for (i = 0; i < reps; i++) {
+		long long a = bench_allocs;
+		double start = bench_now();
+		arena = dis_arena_new();
+		envydis_list(isa, code, 0, num / stride, var, 0, 0, arena);
+		dis_arena_del(arena);
+		double secs = bench_now() - start;
+		if (!i || secs < best)
+			best = secs;
+		nallocs = bench_allocs - a;
+	}
+	report("list", best, insns, nallocs);
+	printf(", ");
+	for (i = 0; i < reps; i++) {
+		long long a = bench_allocs;
+		double start = bench_now();
+		envydis(isa, null, code, 0, num / stride, var, 0, 0, 0, &envy_null_colors);
+		fflush(null);
+		double secs = bench_now() - start;
+		if (!i || secs < best)
+			best = secs;
+		nallocs = bench_allocs - a;
+	}
+	report("print", best, insns, nallocs);
+	if (envyas && !strcmp(name, "clean")) {
+		arena = dis_arena_new();
+		roundtrip(bi, envydis_list(isa, code, 0, num / stride, var, 0, 0, arena));
+		dis_arena_del(arena);
+	}
+	printf(" }");
+	fclose(null);
+}
+
+static int bench_isa(const struct bench_isa *bi) {
+	const struct disisa *isa = ed_getisa(bi->name);
+	if (!isa) {
+		fprintf(stderr, "envydis-bench: unknown ISA %s\n", bi->name);
+		return 1;
+	}
+	struct varinfo *var = varinfo_new(isa->vardata);
+	if (!var || (bi->variant && varinfo_set_variant(var, bi->variant)))
+		return 1;
+	int stride = ed_getcstride(isa, var);
+	uint8_t *code = malloc(bytes);
+	int num, i;
+	for (i = 0; i < bytes; i++)
+		code[i] = bench_rnd();
+	bench_stream(bi, isa, var, "random", code, bytes / stride * stride);
+	free(code);
+	code = make_clean(isa, var, stride, &num);
+	if (num) {
+		printf(", ");
+		bench_stream(bi, isa, var, "clean", code, num);
+	}
+	free(code);
+	varinfo_del(var);
+	ed_freeisa(isa);
+	return 0;
+}
+
+/*
+ * runs bench_isa in a child, copies its output if it didn't fail. Only a
+ * failure to set the ISA up counts as failure of the whole run.
+ */
+static int run_isa(const struct bench_isa *bi, uint64_t seed) {
+	int fds[2];
+	int status;
+	char *buf = 0;
+	int bufnum = 0, bufmax = 0;
+	ssize_t n;
+	fflush(stdout);
+	if (pipe(fds)) {
+		perror("pipe");
+		exit(2);
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(2);
+	}
+	if (!pid) {
+		close(fds[0]);
+		dup2(fds[1], 1);
+		bench_rstate = seed;
+		int res = bench_isa(bi);
+		fflush(stdout);
+		_exit(res);
+	}
+	close(fds[1]);
+	printf("\t\t{ \"isa\": \"%s\", \"variant\": ", bi->name);
+	if (bi->variant)
+		printf("\"%s\"", bi->variant);
+	else
+		printf("null");
+	printf(", \"streams\": [ ");
+	do {
+		if (bufnum == bufmax) {
+			bufmax = bufmax ? bufmax * 2 : 4096;
+			buf = realloc(buf, bufmax);
+		}
+		n = read(fds[0], buf + bufnum, bufmax - bufnum);
+		if (n < 0 && errno != EINTR) {
+			perror("read");
+			exit(2);
+		}
+		if (n > 0)
+			bufnum += n;
+	} while (n);
+	close(fds[0]);
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR) {
+			perror("waitpid");
+			exit(2);
+		}
+	if (WIFEXITED(status) && !WEXITSTATUS(status))
+		fwrite(buf, 1, bufnum, stdout);
+	free(buf);
+	printf(" ]");
+	if (WIFSIGNALED(status))
+		printf(", \"error\": \"killed by signal %d\"", WTERMSIG(status));
+	else if (WEXITSTATUS(status))
+		printf(", \"error\": \"exit status %d\"", WEXITSTATUS(status));
+	printf(" }");
+	return WIFEXITED(status) && WEXITSTATUS(status);
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: envydis-bench [-s BYTES] [-r REPS] [-S SEED] [-d DIR] [-a ENVYAS] [ISA...]\n"
+			"Reports disassembler throughput for every ISA as JSON.\n"
+			"\n"
+			"  -s BYTES\tsize of code streams (default: 65536)\n"
+			"  -r REPS\tmeasure each stream this many times, report the best (default: 3)\n"
+			"  -S SEED\tseed for generated code\n"
+			"  -d DIR\tdirectory for envyas round trip files (default: .)\n"
+			"  -a ENVYAS\tround trip clean streams through this envyas\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	uint64_t seed = 0x9e3779b97f4a7c15ull;
+	int c, i, j;
+	int failed = 0, first = 1;
+	while ((c = getopt(argc, argv, "s:r:S:d:a:h")) != -1)
+		switch (c) {
+			case 's':
+				bytes = strtol(optarg, 0, 0);
+				break;
+			case 'r':
+				reps = strtol(optarg, 0, 0);
+				break;
+			case 'S':
+				seed = strtoull(optarg, 0, 0) | 1;
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			case 'a':
+				envyas = optarg;
+				break;
+			default:
+				usage();
+		}
+	if (bytes < 64 || reps < 1)
+		usage();
+	printf("{\n\t\"bytes\": %d,\n\t\"reps\": %d,\n\t\"seed\": %llu,\n\t\"isas\": [\n", bytes, reps, (unsigned long long)seed);
+	for (i = 0; i < ARRAY_SIZE(isas); i++) {
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (!strcmp(argv[j], isas[i].name))
+					break;
+			if (j == argc)
+				continue;
+		}
+		if (!first)
+			printf(",\n");
+		first = 0;
+		if (isas[i].broken && optind == argc)
+			printf("\t\t{ \"isa\": \"%s\", \"skipped\": \"%s\" }", isas[i].name, isas[i].broken);
+		else
+			failed |= run_isa(&isas[i], seed);
+	}
+	printf("\n\t]\n}\n");
+	return failed;
+}
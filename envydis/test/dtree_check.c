@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that decision tree table lookup picks the same entries as linear
+ * scan, for every ISA, variant and mode, over random opcodes.
+ *
+ * Opcodes are a mix of fully random words, random words with a few bits
+ * flipped, and words forced to match entries preceding the one just found,
+ * so that entries guarded by many bits are reached as well.
+ */
+
+#include "dis-intern.h"
+#include <stdlib.h>
+
+static const char *const isanames[] = {
+	"g80", "gf100", "gk110", "gm107", "ctx", "falcon", "hwsq", "xtensa",
+	"vuc", "macro", "vp1", "vcomp",
+};
+
+static uint64_t rstate = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate;
+}
+
+static int fails;
+static long long lookups;
+
+/* walks the tables an opcode descends into, returns next opcode to try */
+static ull walk(const struct insn *tab, ull a, struct varinfo *varinfo, const char *name) {
+	const struct insn *ref = dis_tab_scan(tab, a, varinfo);
+	const struct insn *res = dis_tab_match(tab, a, varinfo);
+	ull next = a;
+	int i;
+	lookups++;
+	if (ref != res) {
+		if (fails++ < 16)
+			fprintf(stderr, "%s: table %p opcode %016llx: tree picked entry %d, scan picked entry %d\n",
+					name, (void *)tab, a, (int)(res - tab), (int)(ref - tab));
+		return rnd();
+	}
+	if (ref != tab) {
+		/* everything before ref is reachable, aim at one of these */
+		const struct insn *e = tab + rnd() % (ref - tab);
+		next = (rnd() & ~e->mask) | (e->val & e->mask);
+	}
+	for (i = 0; i < ARRAY_SIZE(ref->atoms); i++)
+		if (ref->atoms[i].fun_dis == atomtab_d && rnd() % 2)
+			next = walk(ref->atoms[i].arg, a, varinfo, name);
+	return next;
+}
+
+static void check(const struct disisa *isa, struct varinfo *varinfo, const char *name, int num) {
+	ull a = rnd();
+	int i;
+	for (i = 0; i < num; i++) {
+		ull next = walk(isa->troot, a, varinfo, name);
+		if (isa->tsched)
+			walk(isa->tsched, a, varinfo, name);
+		switch (rnd() % 4) {
+			case 0:
+				a = rnd();
+				break;
+			case 1:
+				a ^= 1ull << (rnd() % 64);
+				break;
+			default:
+				a = next;
+				break;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	int num = 20000;
+	int i, j, k;
+	if (argc > 1)
+		num = strtol(argv[1], 0, 0);
+	if (argc > 2)
+		rstate = strtoull(argv[2], 0, 0) | 1;
+	for (i = 0; i < ARRAY_SIZE(isanames); i++) {
+		const struct disisa *isa = ed_getisa(isanames[i]);
+		struct vardata *data = isa->vardata;
+		int nvar = 0;
+		for (j = -1; j < data->variantsnum; j++) {
+			for (k = -1; k < data->modesnum; k++) {
+				struct varinfo *varinfo = varinfo_new(data);
+				char name[256];
+				if (j != -1)
+					varinfo_set_variant(varinfo, data->variants[j].name);
+				if (k != -1)
+					varinfo->modes[data->modes[k].modeset] = k;
+				snprintf(name, sizeof name, "%s/%s/%s", isanames[i],
+						j == -1 ? "-" : data->variants[j].name,
+						k == -1 ? "-" : data->modes[k].name);
+				check(isa, varinfo, name, num);
+				varinfo_del(varinfo);
+				nvar++;
+			}
+		}
+		printf("%s: %d variant/mode combinations checked\n", isanames[i], nvar);
+		ed_freeisa(isa);
+	}
+	printf("%lld lookups, %d mismatches\n", lookups, fails);
+	return fails != 0;
+}
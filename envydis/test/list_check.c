@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that printing a listing from envydis_list gives the same output as
+ * envydis, with and without labels, and that branch targets recorded in the
+ * listing are marked as such.
+ */
+
+#include "dis.h"
+#include "easm.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const isanames[] = {
+	"g80", "gf100", "gm107", "ctx", "falcon", "hwsq", "xtensa", "macro",
+	"vp1", "vcomp",
+};
+
+static uint64_t rstate = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate;
+}
+
+static int fails;
+
+static void check(const struct disisa *isa, uint8_t *code, int num, struct label *labels, int labelsnum, const char *name) {
+	struct varinfo *varinfo = varinfo_new(isa->vardata);
+	char *ref, *res;
+	size_t reflen, reslen;
+	int i, j;
+	FILE *out = open_memstream(&ref, &reflen);
+	envydis(isa, out, code, 0, num, varinfo, 0, labels, labelsnum, &envy_null_colors);
+	fclose(out);
+	struct dis_arena *arena = dis_arena_new();
+	struct dis_listing *list = envydis_list(isa, code, 0, num, varinfo, labels, labelsnum, arena);
+	out = open_memstream(&res, &reslen);
+	envydis_print_listing(out, list, 0, &envy_null_colors);
+	fclose(out);
+	if (reflen != reslen || memcmp(ref, res, reflen)) {
+		fprintf(stderr, "%s: printed listing differs from envydis output\n", name);
+		fails++;
+	}
+	for (i = 0; i < list->itemsnum; i++) {
+		struct dis_item *item = &list->items[i];
+		if (item->type != DIS_ITEM_INSN || !item->targtype)
+			continue;
+		for (j = 0; j < list->itemsnum; j++)
+			if (list->items[j].pos == item->target && list->items[j].type == DIS_ITEM_INSN)
+				break;
+		if (j < list->itemsnum && !(list->items[j].marks & item->targtype)) {
+			fprintf(stderr, "%s: target %llx of insn at %llx not marked\n", name,
+					(unsigned long long)item->target, (unsigned long long)item->pos);
+			fails++;
+			break;
+		}
+	}
+	dis_arena_del(arena);
+	free(ref);
+	free(res);
+	varinfo_del(varinfo);
+}
+
+int main(int argc, char **argv) {
+	int size = 0x2000;
+	uint8_t *code = malloc(size);
+	int i, j;
+	for (i = 0; i < ARRAY_SIZE(isanames); i++) {
+		const struct disisa *isa = ed_getisa(isanames[i]);
+		struct varinfo *varinfo = varinfo_new(isa->vardata);
+		int num = size / ed_getcstride(isa, varinfo);
+		int cbsz = ed_getcbsz(isa, varinfo);
+		char name[64];
+		varinfo_del(varinfo);
+		for (j = 0; j < size; j++)
+			code[j] = rnd();
+		snprintf(name, sizeof name, "%s/raw", isanames[i]);
+		check(isa, code, num, 0, 0, name);
+		struct label labels[] = {
+			{ "main", 0, 2 },
+			{ "loop", 0x100, 1 },
+			{ "data", 0x1000, 0x10, 0x10 },
+			{ "byte", 0x1100, 0x80 },
+			{ "str", 0x1200, 0x20 },
+		};
+		code[0x1208] = 0;
+		snprintf(name, sizeof name, "%s/labels", isanames[i]);
+		/* data labels only work for byte-sized code units */
+		check(isa, code, num, labels, cbsz == 8 ? ARRAY_SIZE(labels) : 2, name);
+		printf("%s: checked\n", isanames[i]);
+		ed_freeisa(isa);
+	}
+	free(code);
+	return fails != 0;
+}
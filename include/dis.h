@@ -53,6 +53,60 @@ struct label {
 	unsigned size;
 };
 
+#define MAXOPLEN (128/64)
+
+enum dis_status {
+	DIS_STATUS_OK = 0,
+	DIS_STATUS_EOF = 0x1,		/* EOF in the middle of an opcode */
+	DIS_STATUS_UNK_FORM = 0x2,	/* failed to determine instruction format - opcode length uncertain */
+	DIS_STATUS_UNK_INSN = 0x4,	/* failed to determine instruction name - unknown opcode or due to one of the above errors */
+	DIS_STATUS_UNK_OPERAND = 0x8,	/* failed to determine instruction operands */
+	DIS_STATUS_UNUSED_BITS = 0x10,	/* instruction decoded, but unused bitfields have non-default values */
+};
+
+/*
+ * A disassembly listing, as returned by envydis_list: the things envydis
+ * would print, in order, without formatting them. Everything in it lives in
+ * the arena passed to envydis_list, and stays valid until it's destroyed.
+ */
+
+struct easm_insn;
+struct dis_arena;
+
+struct dis_item {
+	enum dis_item_type {
+		DIS_ITEM_INSN,
+		DIS_ITEM_LABEL,		/* label name, comes before the item at its position */
+		DIS_ITEM_DATA,		/* data word marked by a label */
+		DIS_ITEM_STRING,	/* zero-terminated string marked by a label */
+		DIS_ITEM_SKIP,		/* code not reachable from the labels */
+	} type;
+	uint64_t pos;		/* address */
+	int len;		/* in code units, for strings including the terminator */
+	int marks;		/* label types of this position, as in struct label */
+	const char *label;	/* label name at this position, if any */
+	uint32_t val;		/* DIS_ITEM_DATA: the value */
+	int nonzero;		/* DIS_ITEM_SKIP: not all skipped bytes were zero */
+	/* DIS_ITEM_INSN */
+	struct easm_insn *insn;	/* subinsns[i]->sinsn->str is the mnemonic, operands are easm_exprs */
+	enum dis_status status;
+	uint64_t unkbits[MAXOPLEN];	/* opcode bits not used by any instruction field */
+	int targtype;		/* 1 if insn branches to target, 2 if it calls it */
+	uint64_t target;
+	int endmark;		/* control flow doesn't continue past insn */
+};
+
+struct dis_listing {
+	const struct disisa *isa;
+	struct varinfo *varinfo;
+	const uint8_t *code;
+	uint32_t start;
+	int num;
+	struct dis_item *items;
+	int itemsnum;
+	int itemsmax;
+};
+
 const struct disisa *ed_getisa(const char *name);
 void ed_freeisa(const struct disisa *isa);
 
@@ -63,5 +117,18 @@ static inline int ed_getcstride(const struct disisa *isa, struct varinfo *varinf
 }
 
 void envydis (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, int quiet, struct label *labels, int labelsnum, const struct envy_colors *cols);
+/* same, but spreads the work over the given number of threads when possible */
+void envydis_jobs (const struct disisa *isa, FILE *out, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, int quiet, struct label *labels, int labelsnum, const struct envy_colors *cols, int jobs);
+
+struct dis_arena *dis_arena_new(void);
+void dis_arena_del(struct dis_arena *arena);
+struct dis_listing *envydis_list (const struct disisa *isa, uint8_t *code, uint32_t start, int num, struct varinfo *varinfo, struct label *labels, int labelsnum, struct dis_arena *arena);
+/* prints an item of the listing the way envydis does */
+void envydis_print_item(FILE *out, const struct dis_listing *list, const struct dis_item *item, int quiet, const struct envy_colors *cols);
+void envydis_print_listing(FILE *out, const struct dis_listing *list, int quiet, const struct envy_colors *cols);
+
+/* enables cache of decoded instructions, shared by all envydis calls until ed_freeisa */
+void envydis_memo(int enable);
+void envydis_memo_stats(long long *lookups, long long *hits);
 
 #endif
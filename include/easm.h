@@ -200,6 +200,8 @@ int easm_isimm(struct easm_expr *expr);
 
 /* does const-folding of expression, returns 1 if folded to a simple EASM_EXPR_NUM, 0 otherwise */
 int easm_cfold_expr(struct easm_expr *expr);
+/* same, but doesn't free folded subexpressions, for callers managing expression memory themselves */
+int easm_cfold_expr_nofree(struct easm_expr *expr);
 void easm_substpos_expr(struct easm_expr *expr, uint64_t val);
 
 void easm_cfold_insn(struct easm_insn *insn);
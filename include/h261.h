@@ -62,6 +62,9 @@ struct h261_gob {
 
 int h261_picparm(struct bitstream *str, struct h261_picparm *picparm);
 int h261_gob(struct bitstream *str, struct h261_gob *gob);
+
+/* all VLC tables of the module, NULL-terminated */
+extern const struct vs_vlc_val *const h261_vlc_tables[];
 void h261_del_picparm(struct h261_picparm *picparm);
 void h261_del_gob(struct h261_gob *gob);
 void h261_print_picparm(struct h261_picparm *picparm);
@@ -199,6 +199,29 @@ struct h262_macroblock {
 	int32_t block[12][64];
 };
 
+/* what struct h262_stats charges bits to */
+enum h262_stats_se {
+	H262_STATS_MB_ADDR_INC,
+	H262_STATS_MB_MODES,	/* macroblock_type, *_motion_type and dct_type */
+	H262_STATS_QUANTISER_SCALE_CODE,
+	H262_STATS_MOTION_VECTORS,
+	H262_STATS_CODED_BLOCK_PATTERN,
+	H262_STATS_DCT_DC,	/* dct_dc_size and dct_dc_differential */
+	H262_STATS_DCT_COEFFS,	/* the rest of a block, end of block included */
+	H262_STATS_SE_NUM,
+};
+
+/* counters updated by h262_slice when slice->stats is set */
+struct h262_stats {
+	uint64_t se_bits[H262_STATS_SE_NUM];
+	uint64_t se_num[H262_STATS_SE_NUM];
+	/* coded blocks by their number of nonzero coefficients */
+	uint64_t total_coeff[65];
+	/* h262_slice's own: what is being read, and since where */
+	enum h262_stats_se cur_se;
+	int64_t cur_pos;
+};
+
 struct h262_slice {
 	uint32_t slice_vertical_position;
 	uint32_t quantiser_scale_code;
@@ -207,6 +230,8 @@ struct h262_slice {
 	uint32_t first_mb_in_slice;
 	uint32_t last_mb_in_slice;
 	struct h262_macroblock *mbs;
+	/* counters to update, or NULL */
+	struct h262_stats *stats;
 };
 
 void h262_del_seqparm(struct h262_seqparm *seqparm);
@@ -226,10 +251,14 @@ int h262_gop(struct bitstream *str, struct h262_gop *gop);
 
 int h262_slice(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_slice *slice);
 
-void h262_print_seqparm(struct h262_seqparm *seqparm);
-void h262_print_picparm(struct h262_picparm *picparm);
-void h262_print_gop(struct h262_gop *gop);
-void h262_print_slice(struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_slice *slice);
+/* all VLC tables of the module, NULL-terminated */
+extern const struct vs_vlc_val *const h262_vlc_tables[];
+
+void h262_print_seqparm(FILE *out, struct h262_seqparm *seqparm);
+void h262_print_picparm(FILE *out, struct h262_picparm *picparm);
+void h262_print_gop(FILE *out, struct h262_gop *gop);
+void h262_print_slice(FILE *out, struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_slice *slice);
+const char *h262_stats_se_name(enum h262_stats_se se);
 
 #endif
 
@@ -421,8 +421,6 @@ struct h264_macroblock {
 	uint32_t coded_block_pattern;
 	uint32_t transform_size_8x8_flag;
 	int32_t mb_qp_delta;
-	uint32_t pcm_sample_luma[256];
-	uint32_t pcm_sample_chroma[512];
 	uint32_t prev_intra4x4_pred_mode_flag[16];
 	uint32_t rem_intra4x4_pred_mode[16];
 	uint32_t prev_intra8x8_pred_mode_flag[4];
@@ -431,12 +429,9 @@ struct h264_macroblock {
 	uint32_t sub_mb_type[4];
 	uint32_t ref_idx[2][4];
 	int32_t mvd[2][16][2];
-	int32_t block_luma_dc[3][16]; /* [0 luma, 1 cb, 2 cr][coeff] */
-	int32_t block_luma_ac[3][16][15]; /* [0 luma, 1 cb, 2 cr][blkIdx][coeff] */
-	int32_t block_luma_4x4[3][16][16]; /* [0 luma, 1 cb, 2 cr][blkIdx][coeff] */
-	int32_t block_luma_8x8[3][4][64]; /* [0 luma, 1 cb, 2 cr][blkIdx][coeff] */
-	int32_t block_chroma_dc[2][8]; /* [0 cb, 1 cr][coeff] */
-	int32_t block_chroma_ac[2][8][15]; /* [0 cb, 1 cr][blkIdx][coeff] */
+	/* residual blocks and PCM samples live in slice->coeffs, see h264_mb_get_block */
+	int coeffs_start;
+	int coeffs_end;
 	int total_coeff[3][16]; /* [0 luma, 1 cb, 2 cr][blkIdx] */
 	int coded_block_flag[3][17]; /* [0 luma, 1 cb, 2 cr][blkIdx], with blkIdx == 16 being DC */
 };
@@ -501,6 +496,53 @@ struct h264_nal_svc_header {
 	uint32_t output_flag;
 };
 
+/* what struct h264_stats charges bits to */
+enum h264_stats_se {
+	H264_STATS_MB_SKIP,	/* mb_skip_flag or mb_skip_run */
+	H264_STATS_MB_FIELD_DECODING_FLAG,
+	H264_STATS_MB_TYPE,
+	H264_STATS_PCM_SAMPLES,	/* with the alignment before them */
+	H264_STATS_TRANSFORM_SIZE_8X8_FLAG,
+	H264_STATS_INTRA_PRED_MODE,	/* prev_intra*_pred_mode_flag and rem_intra*_pred_mode */
+	H264_STATS_INTRA_CHROMA_PRED_MODE,
+	H264_STATS_SUB_MB_TYPE,
+	H264_STATS_REF_IDX,
+	H264_STATS_MVD,
+	H264_STATS_CODED_BLOCK_PATTERN,
+	H264_STATS_MB_QP_DELTA,
+	H264_STATS_COEFF_TOKEN,	/* CAVLC only */
+	H264_STATS_TOTAL_ZEROS,	/* CAVLC only */
+	H264_STATS_RUN_BEFORE,	/* CAVLC only */
+	H264_STATS_CODED_BLOCK_FLAG,	/* CABAC only */
+	H264_STATS_SIGNIFICANCE_MAP,	/* CABAC only: significant_coeff_flag and last_significant_coeff_flag */
+	H264_STATS_COEFF_LEVEL,	/* levels and their signs */
+	H264_STATS_END_OF_SLICE_FLAG,	/* CABAC only */
+	H264_STATS_SE_NUM,
+};
+
+/* H264_CABAC_CTXIDX_NUM, which is private to the CABAC code */
+#define H264_STATS_CTXIDX_NUM 1031
+
+/* counters updated by h264_slice_data when slice->stats is set */
+struct h264_stats {
+	/*
+	 * In 1/65536 bits.  A CABAC bin is charged what it takes off codIRange,
+	 * ie. -log2 of the probability it was coded with, so that the sums come
+	 * out right even though bins and bits do not line up.
+	 */
+	uint64_t se_bits[H264_STATS_SE_NUM];
+	uint64_t se_num[H264_STATS_SE_NUM];
+	/* CABAC bins decoded in each context */
+	uint64_t ctx_bins[H264_STATS_CTXIDX_NUM];
+	uint64_t bypass_bins;
+	uint64_t terminate_bins;
+	/* coded residual blocks by their number of nonzero coefficients; CAVLC codes an 8x8 block as four 4x4 ones */
+	uint64_t total_coeff[65];
+	/* h264_slice_data's own: what is being read, and since where */
+	enum h264_stats_se cur_se;
+	uint64_t cur_pos;
+};
+
 struct h264_slice {
 	uint32_t nal_ref_idc;
 	uint32_t nal_unit_type;
@@ -554,6 +596,57 @@ struct h264_slice {
 	/* macroblocks */
 	int *sgmap;
 	struct h264_macroblock *mbs;
+	/* nonzero coefficients of all macroblocks, see h264_mb_set_block */
+	int32_t *coeffs;
+	int coeffsnum;
+	int coeffsmax;
+	/* counters to update while decoding slice data, or NULL */
+	struct h264_stats *stats;
+};
+
+/* storage reused by consecutive slices, see h264_slice_buf_attach */
+struct h264_slice_buf {
+	struct h264_macroblock *mbs;
+	uint32_t mbsmax;
+	int32_t *coeffs;
+	int coeffsmax;
+};
+
+/* what h264_recon_slice keeps of a macroblock for its neighbours */
+struct h264_recon_mb {
+	int slice;	/* numbered within the picture, -1 if not reconstructed yet */
+	int pred;
+	/* Intra4x4PredMode by luma4x4BlkIdx, or Intra8x8PredMode repeated over its four */
+	uint8_t modes[16];
+};
+
+/* a frame being reconstructed, see h264_recon.c */
+struct h264_picture {
+	uint32_t chroma_format_idc;
+	uint32_t bit_depth_luma;
+	uint32_t bit_depth_chroma;
+	int width[3];
+	int height[3];
+	uint16_t *planes[3];
+	/* fields drawn since the frame was last written: 1 top, 2 bottom */
+	int fields;
+	/* slices reconstructed in the current picture so far */
+	int slices;
+	/* of the current picture, one set per colour plane if coded separately */
+	struct h264_recon_mb *mbs;
+	uint32_t mbsnum;
+	uint32_t mbsmax;
+};
+
+enum h264_coeff_block {
+	H264_COEFF_LUMA_DC,	/* [0 luma, 1 cb, 2 cr][0], 16 coeffs */
+	H264_COEFF_LUMA_AC,	/* [0 luma, 1 cb, 2 cr][blkIdx], 15 coeffs */
+	H264_COEFF_LUMA_4X4,	/* [0 luma, 1 cb, 2 cr][blkIdx], 16 coeffs */
+	H264_COEFF_LUMA_8X8,	/* [0 luma, 1 cb, 2 cr][blkIdx], 64 coeffs */
+	H264_COEFF_CHROMA_DC,	/* [0 cb, 1 cr][0], 8 coeffs */
+	H264_COEFF_CHROMA_AC,	/* [0 cb, 1 cr][blkIdx], 15 coeffs */
+	H264_COEFF_PCM_LUMA,	/* [0][0], 256 samples */
+	H264_COEFF_PCM_CHROMA,	/* [0][0], 512 samples */
 };
 
 enum h264_mb_pos {
@@ -612,6 +705,18 @@ const struct h264_macroblock *h264_inter_filter(struct h264_slice *slice, const
 
 uint32_t h264_next_mb_addr(struct h264_slice *slice, uint32_t mbaddr);
 
+int h264_coeff_block_size(enum h264_coeff_block kind);
+/* fills all h264_coeff_block_size(kind) entries of block, zeros for blocks never stored */
+void h264_mb_get_block(const struct h264_slice *slice, const struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, int32_t *block);
+/* replaces the stored block; only its nonzero entries take up space */
+void h264_mb_set_block(struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, const int32_t *block);
+/* like h264_mb_set_block, for a block known not to be stored yet */
+void h264_mb_add_block(struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, const int32_t *block);
+
+void h264_slice_buf_attach(struct h264_slice_buf *buf, struct h264_slice *slice);
+void h264_slice_buf_detach(struct h264_slice_buf *buf, struct h264_slice *slice);
+void h264_slice_buf_free(struct h264_slice_buf *buf);
+
 int h264_mb_skip_flag(struct bitstream *str, struct h264_cabac_context *cabac, uint32_t *binVal);
 int h264_mb_field_decoding_flag(struct bitstream *str, struct h264_cabac_context *cabac, uint32_t *binVal);
 int h264_mb_type(struct bitstream *str, struct h264_cabac_context *cabac, uint32_t slice_type, uint32_t *val);
@@ -634,6 +739,9 @@ int h264_level(struct bitstream *str, int suffixLength, int onebias, int32_t *va
 int h264_total_zeros(struct bitstream *str, int mode, int tzVlcIndex, uint32_t *val);
 int h264_run_before(struct bitstream *str, int zerosLeft, uint32_t *val);
 
+/* all VLC tables of the module, NULL-terminated */
+extern const struct vs_vlc_val *const h264_vlc_tables[];
+
 void h264_del_seqparm(struct h264_seqparm *seqparm);
 void h264_del_picparm(struct h264_picparm *picparm);
 void h264_del_slice(struct h264_slice *slice);
@@ -648,10 +756,29 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice);
 int h264_pred_weight_table(struct bitstream *str, struct h264_slice *slice, struct h264_pred_weight_table *table);
 int h264_residual(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, int start, int end);
 
-void h264_print_seqparm(struct h264_seqparm *seqparm);
-void h264_print_seqparm_ext(struct h264_seqparm *seqparm);
-void h264_print_picparm(struct h264_picparm *picparm);
-void h264_print_slice_header(struct h264_slice *slice);
-void h264_print_slice_data(struct h264_slice *slice);
+/* writes out the frame first if the picture slice starts would draw over it */
+int h264_picture_start(struct h264_picture *pic, const struct h264_slice *slice, FILE *out);
+/* slice must have its data decoded, and be part of the picture last started */
+int h264_recon_slice(struct h264_picture *pic, struct h264_slice *slice);
+/* as raw planar YUV, 16-bit little endian samples if either bit depth is over 8 */
+int h264_picture_write(struct h264_picture *pic, FILE *out);
+void h264_picture_free(struct h264_picture *pic);
+
+/* 8.5.12.2 and 8.5.13.2 in place on raster order blocks, best version for the CPU */
+void h264_idct4x4(int32_t *blk);
+void h264_idct8x8(int32_t *blk);
+/* the plain C versions, which the others have to match */
+void h264_idct4x4_c(int32_t *blk);
+void h264_idct8x8_c(int32_t *blk);
+
+void h264_print_seqparm(FILE *out, struct h264_seqparm *seqparm);
+void h264_print_seqparm_ext(FILE *out, struct h264_seqparm *seqparm);
+void h264_print_picparm(FILE *out, struct h264_picparm *picparm);
+void h264_print_slice_header(FILE *out, struct h264_slice *slice);
+void h264_print_slice_data(FILE *out, struct h264_slice *slice);
+const char *h264_slice_type_name(uint32_t slice_type);
+const char *h264_mb_type_name(uint32_t mb_type);
+const char *h264_sub_mb_type_name(uint32_t sub_mb_type);
+const char *h264_stats_se_name(enum h264_stats_se se);
 
 #endif
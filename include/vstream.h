@@ -26,6 +26,7 @@
 #define VSTREAM_H
 
 #include <inttypes.h>
+#include <stdio.h>
 
 struct bitstream {
 	enum vs_dir {
@@ -48,6 +49,10 @@ struct bitstream {
 		VS_VC1,
 	} type;
 	int hasbyte;
+	/* decode only: the current NAL with escapes stripped, see bitstream.c */
+	struct vs_rbsp *rbsp;
+	/* decode only: where the bytes come from if not all in memory, see vs_new_decode_fd */
+	struct vs_input *input;
 };
 
 enum vs_align_byte_mode {
@@ -67,6 +72,8 @@ int vs_se(struct bitstream *str, int32_t *val);
 int vs_u(struct bitstream *str, uint32_t *val, int size);
 int vs_mark(struct bitstream *str, uint32_t val, int size);
 int vs_vlc(struct bitstream *str, uint32_t *val, const struct vs_vlc_val *tab);
+/* the entry vs_vlc would encode val with, or NULL */
+const struct vs_vlc_val *vs_vlc_find(const struct vs_vlc_val *tab, uint32_t val);
 int vs_start(struct bitstream *str, uint32_t *val);
 int vs_align_byte(struct bitstream *str, enum vs_align_byte_mode mode);
 int vs_end(struct bitstream *str);
@@ -74,9 +81,48 @@ int vs_has_more_data(struct bitstream *str);
 int vs_infer(struct bitstream *str, uint32_t *val, uint32_t ival);
 int vs_infers(struct bitstream *str, int32_t *val, int32_t ival);
 int vs_search_start(struct bitstream *str);
+/* offset of the first 00 00 01 at or after pos, -1 if none */
+int vs_find_start(const uint8_t *bytes, int bytesnum, int pos);
+/* offsets of all 00 00 01 followed by at least one byte, in a malloced array */
+int *vs_find_starts(const uint8_t *bytes, int bytesnum, int *pnum);
+/* decode only: offset of the 00 00 01 the next vs_start would read without complaint, -1 if it would complain */
+int vs_next_start(struct bitstream *str);
+/* decode only: reads up to size bits, fewer at the end of the NAL; returns how many, -1 on error */
+int vs_prefetch(struct bitstream *str, uint32_t *val, int size);
+/* decode only, not for H.261/H.263: puts back the last size bits read since the last start code or alignment */
+void vs_unread(struct bitstream *str, int size);
+/* bits read or written so far, escapes not counted; only differences within one unit mean anything */
+int64_t vs_tell(struct bitstream *str);
 
 struct bitstream *vs_new_encode(enum vs_type type);
 struct bitstream *vs_new_decode(enum vs_type type, uint8_t *bytes, int bytesnum);
+/* decodes from fd: regular files are mapped, anything else is read as vs_refill asks for it */
+struct bitstream *vs_new_decode_fd(enum vs_type type, int fd);
+/* decode only, before each start code: drops what was read, makes sure the next unit is all in bytes; 1 on read error */
+int vs_refill(struct bitstream *str);
+/* decode only: reads all the rest of the input into bytes; 1 on error */
+int vs_read_all(struct bitstream *str);
 void vs_destroy(struct bitstream *str);
 
+/*
+ * One step of a decoder main loop: reads a start code and the unit after it,
+ * prints it to out.  Returns 0 to go on, 1 at the end of the stream, -1 on
+ * a fatal error.  ctx is everything a step reads from earlier units; it must
+ * be flat, as vs_run_steps copies it around with memcpy.
+ */
+struct vs_step_ops {
+	int ctxsize;
+	int scratchsize;
+	int (*step)(struct bitstream *str, void *ctx, void *scratch, FILE *out);
+	/* whether a step starting with this start code leaves ctx alone apart from predict */
+	int (*parallel)(const void *ctx, uint32_t start_code);
+	/* applies what such a step does to ctx, may be NULL */
+	void (*predict)(void *ctx, uint32_t start_code);
+	/* frees whatever step left in scratch, may be NULL */
+	void (*scratch_fini)(void *scratch);
+};
+
+/* runs steps until one returns nonzero, on jobs threads if jobs > 1; out gets the output in stream order */
+int vs_run_steps(struct bitstream *str, const struct vs_step_ops *ops, void *ctx, int jobs, FILE *out);
+
 #endif
@@ -26,110 +26,378 @@
 #include "util.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#include <immintrin.h>
+#endif
 
-int vs_byte(struct bitstream *str) {
-	if (str->dir == VS_ENCODE) {
-		switch (str->type) {
-			case VS_H262:
-				if (str->curbyte < 2 && str->zero_bytes >= 2) {
-					fprintf(stderr, "00 00 0%d emitted!\n", str->curbyte);
-					return 1;
-				}
+/*
+ * On the decode side, bits are not pulled through the escape logic one at
+ * a time.  Instead, the first read after a start code scans ahead to the
+ * point where the byte-wise reader would have stopped (the next start code,
+ * a forbidden 00 00 0x sequence, or the end of the buffer), stripping the
+ * 00 00 03 escapes on the way.  Bits are then served from a 64-bit cache
+ * refilled from that escape-free buffer, and what stopped the scan is
+ * reported once the parser actually reads past it.
+ *
+ * bitpos and hasbyte are kept up to date after every read; bytepos, curbyte
+ * and zero_bytes are only brought in sync by the byte-level operations
+ * (vs_start, vs_search_start, vs_align_byte, vs_has_more_data).
+ */
+
+struct vs_rbsp {
+	int valid;
+	const uint8_t *data;
+	int num;
+	/* bytepos and zero_bytes corresponding to data[0] */
+	int start;
+	int zero_bytes;
+	/* offsets in data of bytes that were preceded by an escape */
+	int *escapes;
+	int escapesnum;
+	int escapesmax;
+	uint8_t *buf;
+	int bufmax;
+	/* read position in bits, and the next 64 bits from there */
+	int64_t pos;
+	uint64_t cache;
+	int cachebits;
+	/* why the scan stopped, and where the byte-wise reader would be then */
+	enum {
+		VS_RBSP_END,
+		VS_RBSP_ZERO,
+		VS_RBSP_ESCAPE,
+	} err;
+	int errbyte;
+	int stop;
+	int stopzero;
+};
+
+static void vs_rbsp_fill(struct bitstream *str) {
+	struct vs_rbsp *r = str->rbsp;
+	const uint8_t *b = str->bytes;
+	int n = str->bytesnum;
+	int i = str->bytepos;
+	int z = str->zero_bytes;
+	if (!r)
+		r = str->rbsp = calloc(sizeof *r, 1);
+	r->valid = 1;
+	r->start = i;
+	r->zero_bytes = z;
+	r->escapesnum = 0;
+	r->pos = 0;
+	r->cachebits = 0;
+	r->err = VS_RBSP_END;
+	r->stop = n;
+	if (str->type == VS_H261 || str->type == VS_H263) {
+		/* start codes not byte-oriented in these */
+		r->data = b + i;
+		r->num = n - i;
+		r->stopzero = z;
+		return;
+	}
+	while (i < n) {
+		if (z < 2) {
+			/* nothing can happen until two zero bytes in a row */
+			const uint8_t *q = memchr(b + i, 0, n - i);
+			if (!q) {
+				i = n;
+				z = 0;
 				break;
-			case VS_H264:
-				if (str->curbyte < 4 && str->zero_bytes == 2) {
-					/* escape */
-					ADDARRAY(str->bytes, 3);
-					str->zero_bytes = 0;
-				}
+			}
+			if (q != b + i)
+				z = 0;
+			z++;
+			i = q - b + 1;
+			continue;
+		}
+		if (b[i] < (str->type == VS_H262 ? 2 : 3)) {
+			r->err = VS_RBSP_ZERO;
+			r->errbyte = b[i];
+			r->stop = i + 1;
+			break;
+		}
+		if (b[i] == 3 && str->type == VS_H264) {
+			if (i + 1 >= n)
 				break;
-			case VS_H261:
-			case VS_H263:
-				/* start codes not byte-oriented in these */
+			if (b[i + 1] > 3) {
+				r->err = VS_RBSP_ESCAPE;
+				r->errbyte = b[i + 1];
+				r->stop = i + 2;
+				z = 0;
 				break;
-			default:
-				abort();
+			}
+			int off = i - r->start - r->escapesnum;
+			ADDARRAY(r->escapes, off);
+			z = !b[i + 1];
+			i += 2;
+			continue;
 		}
-		ADDARRAY(str->bytes, str->curbyte);
-		if (!str->curbyte)
-			str->zero_bytes++;
-		else
-			str->zero_bytes = 0;
-		str->curbyte = 0;
+		z = 0;
+		i++;
+	}
+	r->stopzero = z;
+	r->num = i - r->start - r->escapesnum;
+	if (!r->escapesnum) {
+		r->data = b + r->start;
 	} else {
-		if (str->bytepos >= str->bytesnum) {
-			fprintf(stderr, "End of bitstream in a NAL!\n");
-			return 1;
+		int j, src = r->start, dst = 0;
+		if (r->bufmax < r->num) {
+			r->bufmax = r->num;
+			r->buf = realloc(r->buf, r->bufmax);
 		}
-		str->curbyte = str->bytes[str->bytepos++];
-		switch (str->type) {
-			case VS_H262:
-				if (str->curbyte < 2 && str->zero_bytes >= 2) {
-					fprintf(stderr, "00 00 0%d read in a NAL!\n", str->curbyte);
-					return 1;
-				}
-				break;
-			case VS_H264:
-				if (str->zero_bytes == 2) {
-					switch (str->curbyte) {
-						case 0:
-						case 1:
-						case 2:
-							fprintf(stderr, "00 00 0%d read in a NAL!\n", str->curbyte);
-							return 1;
-						case 3:
-							if (str->bytepos >= str->bytesnum) {
-								fprintf(stderr, "End of bitstream in a NAL!\n");
-								return 1;
-							}
-							str->zero_bytes = 0;
-							str->curbyte = str->bytes[str->bytepos++];
-							if (str->curbyte > 3) {
-								fprintf(stderr, "Invalid escape sequence: 00 00 03 %02x!\n", str->curbyte);
-								return 1;
-							}
-							break;
-					}
-				}
-				break;
-			case VS_H261:
-			case VS_H263:
-				/* start codes not byte-oriented in these */
-				break;
-			default:
-				abort();
+		for (j = 0; j <= r->escapesnum; j++) {
+			int end = (j == r->escapesnum ? r->num : r->escapes[j]);
+			memcpy(r->buf + dst, b + src, end - dst);
+			src += end - dst + 1;
+			dst = end;
 		}
-		if (!str->curbyte)
-			str->zero_bytes++;
+		r->data = r->buf;
+	}
+}
+
+static int vs_rbsp_fail(struct bitstream *str) {
+	struct vs_rbsp *r = str->rbsp;
+	switch (r->err) {
+		case VS_RBSP_END:
+			fprintf(stderr, "End of bitstream in a NAL!\n");
+			break;
+		case VS_RBSP_ZERO:
+			fprintf(stderr, "00 00 0%d read in a NAL!\n", r->errbyte);
+			break;
+		case VS_RBSP_ESCAPE:
+			fprintf(stderr, "Invalid escape sequence: 00 00 03 %02x!\n", r->errbyte);
+			break;
+	}
+	str->bytepos = r->stop;
+	str->zero_bytes = r->stopzero;
+	str->hasbyte = 0;
+	str->bitpos = 7;
+	r->valid = 0;
+	return 1;
+}
+
+/* number of escapes before data[off] */
+static int vs_rbsp_escapes(struct vs_rbsp *r, int off) {
+	int lo = 0, hi = r->escapesnum;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (r->escapes[mid] < off)
+			lo = mid + 1;
 		else
-			str->zero_bytes = 0;
+			hi = mid;
+	}
+	return lo;
+}
+
+/* zero_bytes as the byte-wise reader would have it after reading data[off] */
+static int vs_rbsp_zero_bytes(struct vs_rbsp *r, int off) {
+	int z = 0;
+	for (; off >= 0; off--) {
+		if (r->data[off])
+			return z;
+		z++;
+		if (vs_rbsp_escapes(r, off + 1) != vs_rbsp_escapes(r, off))
+			return z;
+	}
+	return z + r->zero_bytes;
+}
+
+/* brings the byte-level fields up to date with the rbsp read position */
+static void vs_sync(struct bitstream *str) {
+	struct vs_rbsp *r = str->rbsp;
+	if (str->dir != VS_DECODE || !r || !r->valid)
+		return;
+	int off = r->pos >> 3;
+	int esc = vs_rbsp_escapes(r, off);
+	int bytewise = (str->type != VS_H261 && str->type != VS_H263);
+	str->bitpos = 7 - (r->pos & 7);
+	if (r->pos & 7) {
+		if (esc < r->escapesnum && r->escapes[esc] == off)
+			esc++;
 		str->hasbyte = 1;
+		str->curbyte = r->data[off];
+		str->bytepos = r->start + off + esc + 1;
+		if (bytewise)
+			str->zero_bytes = vs_rbsp_zero_bytes(r, off);
+	} else {
+		str->hasbyte = 0;
+		if (off)
+			str->curbyte = r->data[off - 1];
+		str->bytepos = r->start + off + esc;
+		if (bytewise)
+			str->zero_bytes = vs_rbsp_zero_bytes(r, off - 1);
 	}
+}
+
+static uint64_t vs_rbsp_load(struct vs_rbsp *r, int64_t pos) {
+	const uint8_t *p = r->data + (pos >> 3);
+	int left = r->num - (pos >> 3);
+	uint64_t w = 0;
+	int i;
+	if (left >= 8) {
+		w = (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48
+			| (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32
+			| (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16
+			| (uint64_t)p[6] << 8 | (uint64_t)p[7];
+	} else {
+		for (i = 0; i < 8; i++)
+			w = w << 8 | (i < left ? p[i] : 0);
+	}
+	return w << (pos & 7);
+}
+
+/* the longest run of zero bits allowed outside of start codes */
+static int vs_zlimit(struct bitstream *str) {
+	switch (str->type) {
+		case VS_H261:
+			return 15;
+		case VS_H263:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+/* reads 1 to 32 bits; zlimit, if nonzero, is the longest allowed run of zero bits */
+static int vs_read(struct bitstream *str, uint32_t *val, int size, int zlimit) {
+	struct vs_rbsp *r = str->rbsp;
+	uint32_t res;
+	if (!r || !r->valid) {
+		vs_rbsp_fill(str);
+		r = str->rbsp;
+	}
+	if (r->pos + size > (int64_t)r->num * 8)
+		return vs_rbsp_fail(str);
+	if (r->cachebits < size) {
+		r->cache = vs_rbsp_load(r, r->pos);
+		r->cachebits = 64 - (r->pos & 7);
+	}
+	res = r->cache >> (64 - size);
+	if (str->type == VS_H261 || str->type == VS_H263) {
+		if (zlimit && str->zero_bits + size >= zlimit) {
+			int i;
+			int z = str->zero_bits;
+			for (i = 0; i < size; i++) {
+				if (res >> (size - 1 - i) & 1)
+					z = 0;
+				else if (++z >= zlimit)
+					break;
+			}
+			if (i < size) {
+				int used = i + 1;
+				res &= ~0u << (size - used);
+				r->cache <<= used;
+				r->cachebits -= used;
+				r->pos += used;
+				str->zero_bits = z;
+				str->bitpos = 7 - (r->pos & 7);
+				str->hasbyte = (r->pos & 7) != 0;
+				*val = res;
+				fprintf(stderr, "Too many zero bits in a row\n");
+				return 1;
+			}
+		}
+		if (res)
+			str->zero_bits = __builtin_ctz(res);
+		else
+			str->zero_bits += size;
+	}
+	r->cache <<= size;
+	r->cachebits -= size;
+	r->pos += size;
+	str->bitpos = 7 - (r->pos & 7);
+	str->hasbyte = (r->pos & 7) != 0;
+	*val = res;
+	return 0;
+}
+
+/* the next 32 bits without consuming them, zero past the end; returns how many are real */
+static int vs_peek(struct bitstream *str, uint32_t *val) {
+	struct vs_rbsp *r = str->rbsp;
+	int64_t left;
+	if (!r || !r->valid) {
+		vs_rbsp_fill(str);
+		r = str->rbsp;
+	}
+	if (r->cachebits < 32) {
+		r->cache = vs_rbsp_load(r, r->pos);
+		r->cachebits = 64 - (r->pos & 7);
+	}
+	*val = r->cache >> 32;
+	left = (int64_t)r->num * 8 - r->pos;
+	return left > 32 ? 32 : left;
+}
+
+int vs_prefetch(struct bitstream *str, uint32_t *val, int size) {
+	uint32_t tmp;
+	int avail = vs_peek(str, &tmp);
+	if (size > avail)
+		size = avail;
+	*val = 0;
+	if (size <= 0)
+		return 0;
+	if (vs_read(str, val, size, vs_zlimit(str)))
+		return -1;
+	return size;
+}
+
+void vs_unread(struct bitstream *str, int size) {
+	struct vs_rbsp *r = str->rbsp;
+	if (!size)
+		return;
+	r->pos -= size;
+	r->cachebits = 0;
+	str->bitpos = 7 - (r->pos & 7);
+	str->hasbyte = (r->pos & 7) != 0;
+}
+
+int vs_byte(struct bitstream *str) {
+	switch (str->type) {
+		case VS_H262:
+			if (str->curbyte < 2 && str->zero_bytes >= 2) {
+				fprintf(stderr, "00 00 0%d emitted!\n", str->curbyte);
+				return 1;
+			}
+			break;
+		case VS_H264:
+			if (str->curbyte < 4 && str->zero_bytes == 2) {
+				/* escape */
+				ADDARRAY(str->bytes, 3);
+				str->zero_bytes = 0;
+			}
+			break;
+		case VS_H261:
+		case VS_H263:
+			/* start codes not byte-oriented in these */
+			break;
+		default:
+			abort();
+	}
+	ADDARRAY(str->bytes, str->curbyte);
+	if (!str->curbyte)
+		str->zero_bytes++;
+	else
+		str->zero_bytes = 0;
+	str->curbyte = 0;
 	str->bitpos = 7;
 	return 0;
 }
 
 int vs_bit(struct bitstream *str, uint32_t *val) {
-	if (str->dir == VS_ENCODE) {
-		str->curbyte |= *val << str->bitpos;
-		if (!str->bitpos) {
-			if (vs_byte(str))
-				return 1;
-		} else {
-			str->bitpos--;
-		}
+	if (str->dir == VS_DECODE)
+		return vs_read(str, val, 1, 0);
+	str->curbyte |= *val << str->bitpos;
+	if (!str->bitpos) {
+		if (vs_byte(str))
+			return 1;
 	} else {
-		if (!str->hasbyte) {
-			if (vs_byte(str))
-				return 1;
-		}
-		*val = str->curbyte >> str->bitpos & 1;
-		if (!str->bitpos) {
-			str->hasbyte = 0;
-			str->bitpos = 7;
-		} else {
-			str->bitpos--;
-		}
+		str->bitpos--;
 	}
 	if (!*val) {
 		str->zero_bits++;
@@ -142,27 +410,25 @@ int vs_bit(struct bitstream *str, uint32_t *val) {
 int vs_u(struct bitstream *str, uint32_t *val, int size) {
 	int i;
 	uint32_t bit;
-	if (str->dir == VS_DECODE)
+	int zlimit = vs_zlimit(str);
+	if (str->dir == VS_DECODE) {
 		*val = 0;
+		while (size > 32) {
+			/* only the low 32 bits of wider fields are kept */
+			int skip = (size - 32 > 32 ? 32 : size - 32);
+			if (vs_read(str, &bit, skip, zlimit)) return 1;
+			size -= skip;
+		}
+		if (size <= 0)
+			return 0;
+		return vs_read(str, val, size, zlimit);
+	}
 	for (i = 0; i < size; i++) {
 		bit = *val >> (size - 1 - i) & 1;
 		if (vs_bit(str, &bit)) return 1;
-		*val |= bit << (size - 1 - i);
-		switch (str->type) {
-			case VS_H261:
-				if (str->zero_bits >= 15) {
-					fprintf(stderr, "Too many zero bits in a row\n");
-					return 1;
-				}
-				break;
-			case VS_H263:
-				if (str->zero_bits >= 16) {
-					fprintf(stderr, "Too many zero bits in a row\n");
-					return 1;
-				}
-				break;
-			default:
-				break;
+		if (zlimit && str->zero_bits >= zlimit) {
+			fprintf(stderr, "Too many zero bits in a row\n");
+			return 1;
 		}
 	}
 	return 0;
@@ -190,6 +456,19 @@ int vs_ue(struct bitstream *str, uint32_t *val) {
 			return 1;
 		return 0;
 	} else {
+		uint32_t w;
+		int avail = vs_peek(str, &w);
+		if (w) {
+			/* the whole code is in the next 32 bits, take it at once */
+			lzb = __builtin_clz(w);
+			if (lzb < 16 && 2 * lzb + 1 <= avail) {
+				if (vs_read(str, &tmp, 2 * lzb + 1, vs_zlimit(str)))
+					return 1;
+				*val = tmp - 1;
+				return 0;
+			}
+			lzb = 0;
+		}
 		do {
 			if (vs_u(str, &tmp, 1))
 				return 1;
@@ -232,26 +511,240 @@ int vs_se(struct bitstream *str, int32_t *val) {
 	}
 }
 
+/*
+ * VLC tables are compiled on first use into lookup tables, kept in a small
+ * hash keyed by the table address.  Decoding peeks 32 bits and walks one
+ * level per VS_VLC_BITS bits of the code, so short codes resolve with
+ * a single probe and the longest ones with two; encoding hashes the value
+ * to the first entry having it, which is what the linear search picked.
+ *
+ * Tables that are not prefix-free, or have codes over 32 bits, stay with
+ * the linear search.  So do invalid codes and codes running past the end
+ * of the NAL, so that errors come out exactly as before.
+ */
+
+#define VS_VLC_BITS 8
+#define VS_VLC_MAX_TABLES 256
+
+struct vs_vlc_node {
+	/* leaf: code length and entry index; subtable: len 0, its bits and first node; invalid: all 0 */
+	uint8_t len;
+	uint8_t bits;
+	int idx;
+};
+
+struct vs_vlc_table {
+	const struct vs_vlc_val *tab;
+	int linear;
+	int bits;
+	struct vs_vlc_node *nodes;
+	int nodesnum;
+	int nodesmax;
+	/* value -> entry index, open addressing, -1 is empty */
+	int *hash;
+	uint32_t hashmask;
+};
+
+/* looked up without locking, new tables are published with a CAS */
+static struct vs_vlc_table *vs_vlc_tables[VS_VLC_MAX_TABLES];
+
+static inline uint32_t vs_vlc_hash(uint32_t val) {
+	return val * 0x9e3779b1u >> 16;
+}
+
+/* builds the lookup level for codes sharing their first plen bits, returns its first node or -1 */
+static int vs_vlc_build(struct vs_vlc_table *t, const uint32_t *codes, const int *ents, int entsnum, int plen, int *pbits) {
+	const struct vs_vlc_val *tab = t->tab;
+	int maxlen = 0, bits, base, res, i, j;
+	int *sub;
+	for (i = 0; i < entsnum; i++)
+		if (tab[ents[i]].blen > maxlen)
+			maxlen = tab[ents[i]].blen;
+	bits = maxlen - plen;
+	if (bits > VS_VLC_BITS)
+		bits = VS_VLC_BITS;
+	*pbits = bits;
+	base = t->nodesnum;
+	for (i = 0; i < 1 << bits; i++) {
+		struct vs_vlc_node node = { 0 };
+		ADDARRAY(t->nodes, node);
+	}
+	for (i = 0; i < entsnum; i++) {
+		int e = ents[i];
+		int left = tab[e].blen - plen;
+		if (left > bits)
+			continue;
+		int first = (codes[e] << plen) >> (32 - bits);
+		for (j = first; j < first + (1 << (bits - left)); j++) {
+			if (t->nodes[base + j].len)
+				return -1;
+			t->nodes[base + j].len = tab[e].blen;
+			t->nodes[base + j].idx = e;
+		}
+	}
+	if (maxlen - plen <= bits)
+		return base;
+	sub = malloc(sizeof *sub * entsnum);
+	res = base;
+	for (j = 0; j < 1 << bits && res >= 0; j++) {
+		int subnum = 0, subbits;
+		for (i = 0; i < entsnum; i++)
+			if (tab[ents[i]].blen - plen > bits && (codes[ents[i]] << plen) >> (32 - bits) == (uint32_t)j)
+				sub[subnum++] = ents[i];
+		if (!subnum)
+			continue;
+		/* a shorter code is a prefix of this one */
+		if (t->nodes[base + j].len) {
+			res = -1;
+			break;
+		}
+		int sbase = vs_vlc_build(t, codes, sub, subnum, plen + bits, &subbits);
+		if (sbase < 0) {
+			res = -1;
+			break;
+		}
+		t->nodes[base + j].bits = subbits;
+		t->nodes[base + j].idx = sbase;
+	}
+	free(sub);
+	return res;
+}
+
+static struct vs_vlc_table *vs_vlc_compile(const struct vs_vlc_val *tab) {
+	struct vs_vlc_table *t = calloc(sizeof *t, 1);
+	int num, i, hsize;
+	t->tab = tab;
+	for (num = 0; tab[num].blen; num++)
+		if (tab[num].blen > 32 || tab[num].blen < 0)
+			t->linear = 1;
+	hsize = 16;
+	while (hsize < num * 2)
+		hsize *= 2;
+	t->hash = malloc(sizeof *t->hash * hsize);
+	t->hashmask = hsize - 1;
+	for (i = 0; i < hsize; i++)
+		t->hash[i] = -1;
+	for (i = 0; i < num; i++) {
+		uint32_t h;
+		for (h = vs_vlc_hash(tab[i].val) & t->hashmask; t->hash[h] != -1; h = (h + 1) & t->hashmask)
+			if (tab[t->hash[h]].val == tab[i].val)
+				break;
+		if (t->hash[h] == -1)
+			t->hash[h] = i;
+	}
+	if (!t->linear && num) {
+		uint32_t *codes = calloc(sizeof *codes, num);
+		int *ents = malloc(sizeof *ents * num);
+		for (i = 0; i < num; i++) {
+			int j;
+			for (j = 0; j < tab[i].blen; j++)
+				codes[i] |= (uint32_t)(tab[i].bits[j] & 1) << (31 - j);
+			ents[i] = i;
+		}
+		if (vs_vlc_build(t, codes, ents, num, 0, &t->bits) < 0)
+			t->linear = 1;
+		free(codes);
+		free(ents);
+	} else {
+		t->linear = 1;
+	}
+	if (t->linear) {
+		free(t->nodes);
+		t->nodes = 0;
+		t->nodesnum = t->nodesmax = 0;
+	}
+	return t;
+}
+
+static void vs_vlc_free(struct vs_vlc_table *t) {
+	free(t->nodes);
+	free(t->hash);
+	free(t);
+}
+
+static const struct vs_vlc_table *vs_vlc_get(const struct vs_vlc_val *tab) {
+	uint32_t start = vs_vlc_hash((uintptr_t)tab >> 3) % VS_VLC_MAX_TABLES;
+	uint32_t i = start;
+	struct vs_vlc_table *t, *nt = 0;
+	do {
+		t = __atomic_load_n(&vs_vlc_tables[i], __ATOMIC_ACQUIRE);
+		if (!t) {
+			if (!nt)
+				nt = vs_vlc_compile(tab);
+			if (__atomic_compare_exchange_n(&vs_vlc_tables[i], &t, nt, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				return nt;
+			/* lost the race, t is now whatever got there first */
+		}
+		if (t->tab == tab) {
+			if (nt)
+				vs_vlc_free(nt);
+			return t;
+		}
+		i = (i + 1) % VS_VLC_MAX_TABLES;
+	} while (i != start);
+	/* out of slots, nt is not published and would leak on every call */
+	if (nt)
+		vs_vlc_free(nt);
+	return 0;
+}
+
+const struct vs_vlc_val *vs_vlc_find(const struct vs_vlc_val *tab, uint32_t val) {
+	const struct vs_vlc_table *t = vs_vlc_get(tab);
+	int i;
+	if (t) {
+		uint32_t h;
+		for (h = vs_vlc_hash(val) & t->hashmask; t->hash[h] != -1; h = (h + 1) & t->hashmask)
+			if (tab[t->hash[h]].val == val)
+				return &tab[t->hash[h]];
+		return 0;
+	}
+	for (i = 0; tab[i].blen; i++)
+		if (tab[i].val == val)
+			return &tab[i];
+	return 0;
+}
+
 int vs_vlc(struct bitstream *str, uint32_t *val, const struct vs_vlc_val *tab) {
 	if (str->dir == VS_ENCODE) {
-		int i, j;
-		for (i = 0; tab[i].blen; i++) {
-			if (*val == tab[i].val) {
-				uint32_t bit;
-				for (j = 0; j < tab[i].blen; j++) {
-					bit = tab[i].bits[j];
-					if (vs_u(str, &bit, 1))
-						return 1;
-				}
-				return 0;
-			}
+		const struct vs_vlc_val *e = vs_vlc_find(tab, *val);
+		uint32_t bit;
+		int j;
+		if (!e) {
+			fprintf(stderr, "No VLC code for a value\n");
+			return 1;
 		}
-		fprintf(stderr, "No VLC code for a value\n");
-		return 1;
+		for (j = 0; j < e->blen; j++) {
+			bit = e->bits[j];
+			if (vs_u(str, &bit, 1))
+				return 1;
+		}
+		return 0;
 	} else {
+		const struct vs_vlc_table *t = vs_vlc_get(tab);
 		int i, j;
 		uint32_t bit[32];
 		int n = 0;
+		if (t && !t->linear) {
+			uint32_t w, tmp;
+			int avail = vs_peek(str, &w);
+			int base = 0, bits = t->bits, used = 0;
+			while (1) {
+				const struct vs_vlc_node *node = &t->nodes[base + ((w << used) >> (32 - bits))];
+				if (node->len) {
+					if (node->len > avail)
+						break;
+					if (vs_read(str, &tmp, node->len, vs_zlimit(str)))
+						return 1;
+					*val = tab[node->idx].val;
+					return 0;
+				}
+				if (!node->bits)
+					break;
+				used += bits;
+				bits = node->bits;
+				base = node->idx;
+			}
+		}
 		for (i = 0; tab[i].blen; i++) {
 			for (j = 0; j < tab[i].blen; j++) {
 				if (j == n) {
@@ -300,6 +793,9 @@ int vs_start(struct bitstream *str, uint32_t *val) {
 			ADDARRAY(str->bytes, 1);
 			ADDARRAY(str->bytes, *val);
 		} else {
+			vs_sync(str);
+			if (str->rbsp)
+				str->rbsp->valid = 0;
 			str->zero_bytes--;
 			do {
 				str->zero_bytes++;
@@ -329,16 +825,122 @@ int vs_start(struct bitstream *str, uint32_t *val) {
 	return 0;
 }
 
+/*
+ * A start code begins at i when bytes[i] and bytes[i + 1] are 0 and
+ * bytes[i + 2] is 1, so comparing three overlapping loads against 0, 0 and
+ * 1 gives the mask of start codes in a 16 or 32 byte block.  AVX2 is picked
+ * at run time.  Block tails, and machines without SSE2, look at
+ * bytes[i + 2] first, which skips 3 bytes whenever it isn't 0 or 1.
+ *
+ * These all return the first i in [pos, end) a start code begins at, or end
+ * if there is none; end + 2 must not be past the buffer.
+ */
+
+static int vs_scan_start_c(const uint8_t *bytes, int pos, int end) {
+	int i = pos;
+	while (i < end) {
+		if (bytes[i + 2] > 1)
+			i += 3;
+		else if (!bytes[i + 2])
+			i++;
+		else if (!bytes[i] && !bytes[i + 1])
+			return i;
+		else
+			i += 3;
+	}
+	return end;
+}
+
+#ifdef __SSE2__
+static int vs_scan_start_sse2(const uint8_t *bytes, int pos, int end) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	int i;
+	for (i = pos; i + 16 <= end; i += 16) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(bytes + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(bytes + i + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(bytes + i + 2));
+		__m128i m = _mm_and_si128(_mm_cmpeq_epi8(b2, one), _mm_cmpeq_epi8(_mm_or_si128(b0, b1), zero));
+		int mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return vs_scan_start_c(bytes, i, end);
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VS_HAVE_AVX2
+__attribute__((target("avx2")))
+static int vs_scan_start_avx2(const uint8_t *bytes, int pos, int end) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	int i;
+	for (i = pos; i + 32 <= end; i += 32) {
+		__m256i b0 = _mm256_loadu_si256((const __m256i *)(bytes + i));
+		__m256i b1 = _mm256_loadu_si256((const __m256i *)(bytes + i + 1));
+		__m256i b2 = _mm256_loadu_si256((const __m256i *)(bytes + i + 2));
+		__m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(b2, one), _mm256_cmpeq_epi8(_mm256_or_si256(b0, b1), zero));
+		uint32_t mask = _mm256_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return vs_scan_start_c(bytes, i, end);
+}
+#endif
+
+static int vs_scan_start(const uint8_t *bytes, int pos, int end) {
+#ifdef VS_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return vs_scan_start_avx2(bytes, pos, end);
+#endif
+#ifdef __SSE2__
+	return vs_scan_start_sse2(bytes, pos, end);
+#else
+	return vs_scan_start_c(bytes, pos, end);
+#endif
+}
+
+int vs_find_start(const uint8_t *bytes, int bytesnum, int pos) {
+	int i;
+	if (pos < 0)
+		pos = 0;
+	if (pos >= bytesnum - 2)
+		return -1;
+	i = vs_scan_start(bytes, pos, bytesnum - 2);
+	return i == bytesnum - 2 ? -1 : i;
+}
+
+int *vs_find_starts(const uint8_t *bytes, int bytesnum, int *pnum) {
+	int *starts = 0;
+	int startsnum = 0;
+	int startsmax = 0;
+	int i = 0;
+	/* leave out a start code without the byte after it */
+	while ((i = vs_find_start(bytes, bytesnum - 1, i)) != -1) {
+		ADDARRAY(starts, i);
+		i += 3;
+	}
+	*pnum = startsnum;
+	return starts;
+}
+
+static int vs_input_fill(struct bitstream *str, int starts);
+
 int vs_search_start(struct bitstream *str) {
 	if (str->dir != VS_DECODE) {
 		fprintf (stderr, "vs_search_start called in encode mode!\n");
 		return -1;
 	}
+	/* a unit that failed may have eaten into the start code after it, so this can't count on vs_refill */
+	if (vs_input_fill(str, 1))
+		return -1;
 	if (str->type == VS_H261 || str->type == VS_H263) {
 		int nzbit = (str->type == VS_H261 ? 15 : 16);
 		uint32_t bit = 0;
 
 		while (1) {
+			vs_sync(str);
 			if (!str->hasbyte && str->bytepos >= str->bytesnum)
 				return 0;
 			if (str->zero_bits >= nzbit)
@@ -346,9 +948,14 @@ int vs_search_start(struct bitstream *str) {
 			if (vs_bit(str, &bit)) return 0;
 		}
 	} else {
+		int i;
+		vs_sync(str);
+		if (str->rbsp)
+			str->rbsp->valid = 0;
 		str->hasbyte = 0;
 		str->bitpos = 7;
-		while (1) {
+		/* the first two bytes may complete zeros counted before bytepos */
+		for (i = 0; i < 2; i++) {
 			if (str->bytepos >= str->bytesnum)
 				return 0;
 			if (str->zero_bytes == 2 && str->bytes[str->bytepos] == 1)
@@ -361,9 +968,43 @@ int vs_search_start(struct bitstream *str) {
 			}
 			str->bytepos++;
 		}
+		/* after that, it's all in the bytes */
+		i = vs_find_start(str->bytes, str->bytesnum, str->bytepos - 2);
+		if (i == -1) {
+			int n = str->bytesnum;
+			str->bytepos = n;
+			str->zero_bytes = str->bytes[n - 1] ? 0 : str->bytes[n - 2] ? 1 : 2;
+			return 0;
+		}
+		str->bytepos = i + 2;
+		str->zero_bytes = 2;
+		return 1;
 	}
 }
 
+int vs_next_start(struct bitstream *str) {
+	int i, z;
+	if (str->dir != VS_DECODE || str->type == VS_H261 || str->type == VS_H263)
+		return -1;
+	vs_sync(str);
+	if (str->bitpos != 7)
+		return -1;
+	/* the same walk as vs_start, without complaining */
+	for (i = str->bytepos, z = str->zero_bytes; i < str->bytesnum && !str->bytes[i]; i++, z++);
+	if (i + 1 >= str->bytesnum || str->bytes[i] != 1 || z < 2)
+		return -1;
+	return i - 2;
+}
+
+int64_t vs_tell(struct bitstream *str) {
+	struct vs_rbsp *r = str->rbsp;
+	if (str->dir == VS_ENCODE)
+		return (int64_t)str->bytesnum * 8 + 7 - str->bitpos;
+	if (r && r->valid)
+		return (int64_t)r->start * 8 + r->pos;
+	return (int64_t)str->bytepos * 8 + (str->hasbyte ? 7 - str->bitpos : 0);
+}
+
 int vs_align_byte(struct bitstream *str, enum vs_align_byte_mode mode) {
 	uint32_t pad;
 	switch (mode) {
@@ -397,6 +1038,7 @@ int vs_align_byte(struct bitstream *str, enum vs_align_byte_mode mode) {
 		}
 		str->hasbyte = 0;
 		str->bitpos = 7;
+		vs_sync(str);
 	}
 	return 0;
 }
@@ -427,6 +1069,7 @@ int vs_has_more_data(struct bitstream *str) {
 	}
 	int byte;
 	int offs = 0;
+	vs_sync(str);
 	switch (str->type) {
 		case VS_H264:
 			if (!str->hasbyte) {
@@ -483,6 +1126,168 @@ struct bitstream *vs_new_decode(enum vs_type type, uint8_t *bytes, int bytesnum)
 	return res;
 }
 
+/*
+ * Streamed input.  A regular file is mapped whole, and the pages already
+ * decoded are given back as decoding goes on.  Anything else is read
+ * a chunk at a time into bytes: vs_refill drops the bytes before bytepos
+ * (the zeros counted so far are in zero_bytes), and reads until bytes holds
+ * the start code after the next one, and a few bytes past it.  A unit
+ * doesn't read past the start code that ends it, except for the one byte
+ * an error there may take, and vs_search_start reads on by itself.  So
+ * units decode as they would with the whole stream in memory, and memory
+ * stays bounded by the largest unit.
+ */
+
+#define VS_INPUT_CHUNK 0x10000
+
+struct vs_input {
+	int fd;
+	int mapped;
+	size_t mapsize;
+	/* mapped: bytes before this were given back */
+	int dropped;
+	int eof;
+};
+
+struct bitstream *vs_new_decode_fd(enum vs_type type, int fd) {
+	struct bitstream *res = vs_new_decode(type, 0, 0);
+	struct vs_input *in = res->input = calloc(sizeof *in, 1);
+	struct stat st;
+	in->fd = fd;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size && st.st_size <= INT_MAX) {
+		void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			res->bytes = map;
+			res->bytesnum = res->bytesmax = st.st_size;
+			in->mapped = 1;
+			in->mapsize = st.st_size;
+			in->eof = 1;
+		}
+	}
+	return res;
+}
+
+static int vs_input_read(struct bitstream *str) {
+	struct vs_input *in = str->input;
+	ssize_t n;
+	if (str->bytesmax - str->bytesnum < VS_INPUT_CHUNK) {
+		if (str->bytesmax > INT_MAX / 2 - VS_INPUT_CHUNK) {
+			fprintf(stderr, "Unit too large\n");
+			return 1;
+		}
+		str->bytesmax = str->bytesmax * 2 + VS_INPUT_CHUNK;
+		str->bytes = realloc(str->bytes, str->bytesmax);
+	}
+	do {
+		n = read(in->fd, str->bytes + str->bytesnum, str->bytesmax - str->bytesnum);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		perror("read");
+		in->eof = 1;
+		return 1;
+	}
+	if (!n)
+		in->eof = 1;
+	str->bytesnum += n;
+	return 0;
+}
+
+/* H.261/H.263: the byte with the 1 ending the first run of nzbit zero bits from pos, -1 if none */
+static int vs_find_start_bits(const uint8_t *bytes, int bytesnum, int pos, int nzbit) {
+	int run = 0, i;
+	for (i = pos; i < bytesnum; i++) {
+		if (!bytes[i]) {
+			run += 8;
+			continue;
+		}
+		if (run + __builtin_clz(bytes[i]) - 24 >= nzbit)
+			return i;
+		run = __builtin_ctz(bytes[i]);
+	}
+	return -1;
+}
+
+/* drops what was read, and reads until bytes holds starts more start codes and a few bytes past them, or all there is */
+static int vs_input_fill(struct bitstream *str, int starts) {
+	struct vs_input *in = str->input;
+	int bitwise = (str->type == VS_H261 || str->type == VS_H263);
+	int nzbit = (str->type == VS_H261 ? 15 : 16);
+	int found = 0, scan = 0, keep;
+	if (!in || in->mapped)
+		return 0;
+	vs_sync(str);
+	/* the rbsp points into bytes, and they're about to move */
+	if (str->rbsp)
+		str->rbsp->valid = 0;
+	/* H.261 and H.263 start codes need not be byte-aligned, keep a byte partly read */
+	keep = bitwise && str->hasbyte;
+	if (str->bytepos - keep) {
+		memmove(str->bytes, str->bytes + str->bytepos - keep, str->bytesnum - str->bytepos + keep);
+		str->bytesnum -= str->bytepos - keep;
+		str->bytepos = keep;
+	}
+	while (!in->eof) {
+		int lim = str->bytesnum - 8;
+		while (found < starts) {
+			int i;
+			if (bitwise)
+				i = vs_find_start_bits(str->bytes, lim, scan, nzbit);
+			else
+				i = vs_find_start(str->bytes, lim, scan);
+			if (i == -1)
+				break;
+			found++;
+			scan = i + (bitwise ? 1 : 3);
+		}
+		if (found == starts)
+			break;
+		/* go on where the bytes ran out; H.261 units are small, just look again */
+		if (!bitwise && scan < lim - 2)
+			scan = lim - 2;
+		if (vs_input_read(str))
+			return 1;
+	}
+	if (keep) {
+		/* and pick up in the middle of it */
+		int bits = 7 - str->bitpos;
+		str->bytepos = 0;
+		vs_rbsp_fill(str);
+		str->rbsp->pos = bits;
+		vs_sync(str);
+	}
+	return 0;
+}
+
+int vs_refill(struct bitstream *str) {
+	struct vs_input *in = str->input;
+	if (!in)
+		return 0;
+	if (in->mapped) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		int end;
+		vs_sync(str);
+		end = str->bytepos / page * page;
+		if (end > in->dropped) {
+			madvise(str->bytes + in->dropped, end - in->dropped, MADV_DONTNEED);
+			in->dropped = end;
+		}
+		return 0;
+	}
+	/* the one vs_start reads, and the one ending its unit */
+	return vs_input_fill(str, 2);
+}
+
+int vs_read_all(struct bitstream *str) {
+	struct vs_input *in = str->input;
+	if (!in)
+		return 0;
+	while (!in->eof)
+		if (vs_input_read(str))
+			return 1;
+	return 0;
+}
+
 int vs_mark(struct bitstream *str, uint32_t val, int size) {
 	uint32_t tmp = val;
 	if (vs_u(str, &tmp, size)) return 1;
@@ -518,6 +1323,15 @@ int vs_infers(struct bitstream *str, int32_t *val, int32_t ival) {
 }
 
 void vs_destroy(struct bitstream *str) {
-	free(str->bytes);
+	if (str->rbsp) {
+		free(str->rbsp->escapes);
+		free(str->rbsp->buf);
+		free(str->rbsp);
+	}
+	if (str->input && str->input->mapped)
+		munmap(str->bytes, str->input->mapsize);
+	else
+		free(str->bytes);
+	free(str->input);
 	free(str);
 }
@@ -29,18 +29,13 @@
 #include <stdlib.h>
 
 int main() {
-	uint8_t *bytes = 0;
-	int bytesnum = 0;
-	int bytesmax = 0;
-	int c;
 	int res;
-	while ((c = getchar()) != EOF) {
-		ADDARRAY(bytes, c);
-	}
-	struct bitstream *str = vs_new_decode(VS_H261, bytes, bytesnum);
+	struct bitstream *str = vs_new_decode_fd(VS_H261, 0);
 	struct h261_picparm *picparm = calloc(sizeof *picparm, 1);
 	while (1) {
 		uint32_t start_code;
+		if (vs_refill(str))
+			return 1;
 		if (vs_start(str, &start_code)) goto err;
 		printf("Start code: %02x\n", start_code);
 		if (start_code == 0) {
@@ -27,121 +27,338 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
 
-int main() {
-	uint8_t *bytes = 0;
-	int bytesnum = 0;
-	int bytesmax = 0;
-	int c;
-	int res;
-	while ((c = getchar()) != EOF) {
-		ADDARRAY(bytes, c);
+/* what -s counts for the pictures of one picture_coding_type */
+struct deh262_counts {
+	uint64_t pictures;
+	uint64_t slices;
+	uint64_t mbs;
+	uint64_t slice_bits;
+	/* by quant | forward << 1 | backward << 2 | pattern << 3 | intra << 4, skipped last */
+	uint64_t mb_type[33];
+	uint64_t quantiser_scale_code[32];
+	uint64_t coded_block_pattern[4096];
+	struct h262_stats se;
+};
+
+struct deh262_stats {
+	/* the current picture, and everything so far by picture_coding_type */
+	struct deh262_counts pic;
+	struct deh262_counts total[8];
+	uint32_t pic_type;
+	int pics;
+	int inpic;
+};
+
+struct deh262_ctx {
+	struct h262_seqparm seqparm;
+	struct h262_picparm picparm;
+	struct h262_gop gop;
+	/* with -s, shared by all steps, which then have to run in order */
+	struct deh262_stats *stats;
+};
+
+static const char *const pic_type_names[8] = { "0", "I", "P", "B", "D", "5", "6", "7" };
+
+static const char *mb_type_name(uint32_t idx) {
+	static const char *const flags[5] = { "quant", "forward", "backward", "pattern", "intra" };
+	static char names[33][48];
+	int i;
+	if (idx == 32)
+		return "skipped";
+	if (!names[idx][0]) {
+		for (i = 0; i < 5; i++)
+			if (idx & 1 << i) {
+				if (names[idx][0])
+					strcat(names[idx], "+");
+				strcat(names[idx], flags[i]);
+			}
+		if (!names[idx][0])
+			strcpy(names[idx], "none");
+	}
+	return names[idx];
+}
+
+static void add_hist(uint64_t *dst, const uint64_t *src, int num) {
+	int i;
+	for (i = 0; i < num; i++)
+		dst[i] += src[i];
+}
+
+static void add_counts(struct deh262_counts *dst, const struct deh262_counts *src) {
+	dst->pictures += src->pictures;
+	dst->slices += src->slices;
+	dst->mbs += src->mbs;
+	dst->slice_bits += src->slice_bits;
+	add_hist(dst->mb_type, src->mb_type, 33);
+	add_hist(dst->quantiser_scale_code, src->quantiser_scale_code, 32);
+	add_hist(dst->coded_block_pattern, src->coded_block_pattern, 4096);
+	add_hist(dst->se.se_bits, src->se.se_bits, H262_STATS_SE_NUM);
+	add_hist(dst->se.se_num, src->se.se_num, H262_STATS_SE_NUM);
+	add_hist(dst->se.total_coeff, src->se.total_coeff, 65);
+}
+
+/* the nonzero entries of hist, as a JSON object keyed by name or by index */
+static void print_hist(FILE *out, const char *name, const uint64_t *hist, int num, const char *(*names)(uint32_t)) {
+	int i, first = 1;
+	fprintf(out, ", \"%s\": {", name);
+	for (i = 0; i < num; i++) {
+		if (!hist[i])
+			continue;
+		if (names)
+			fprintf(out, "%s\"%s\": %" PRIu64, first ? "" : ", ", names(i), hist[i]);
+		else
+			fprintf(out, "%s\"%d\": %" PRIu64, first ? "" : ", ", i, hist[i]);
+		first = 0;
+	}
+	fprintf(out, "}");
+}
+
+static void print_counts(FILE *out, const struct deh262_counts *counts) {
+	int i, first = 1;
+	fprintf(out, "\"slices\": %" PRIu64 ", \"mbs\": %" PRIu64 ", \"slice_bits\": %" PRIu64, counts->slices, counts->mbs, counts->slice_bits);
+	print_hist(out, "mb_type", counts->mb_type, 33, mb_type_name);
+	print_hist(out, "quantiser_scale_code", counts->quantiser_scale_code, 32, 0);
+	print_hist(out, "coded_block_pattern", counts->coded_block_pattern, 4096, 0);
+	print_hist(out, "total_coeff", counts->se.total_coeff, 65, 0);
+	fprintf(out, ", \"syntax_elements\": {");
+	for (i = 0; i < H262_STATS_SE_NUM; i++) {
+		if (!counts->se.se_num[i])
+			continue;
+		fprintf(out, "%s\"%s\": {\"num\": %" PRIu64 ", \"bits\": %" PRIu64 "}", first ? "" : ", ", h262_stats_se_name(i), counts->se.se_num[i], counts->se.se_bits[i]);
+		first = 0;
 	}
-	struct bitstream *str = vs_new_decode(VS_H262, bytes, bytesnum);
-	struct h262_seqparm *seqparm = calloc(sizeof *seqparm, 1);
-	struct h262_picparm *picparm = calloc(sizeof *picparm, 1);
-	struct h262_gop *gop = calloc(sizeof *gop, 1);
+	fprintf(out, "}");
+}
+
+static void end_picture(struct deh262_stats *stats, FILE *out) {
+	if (!stats->inpic)
+		return;
+	fprintf(out, "{\"type\": \"picture\", \"picture\": %d, \"picture_coding_type\": \"%s\", ", stats->pics++, pic_type_names[stats->pic_type]);
+	print_counts(out, &stats->pic);
+	fprintf(out, "}\n");
+	stats->pic.pictures = 1;
+	add_counts(&stats->total[stats->pic_type], &stats->pic);
+	memset(&stats->pic, 0, sizeof stats->pic);
+	stats->inpic = 0;
+}
+
+static void count_slice(struct deh262_counts *counts, struct h262_picparm *picparm, struct h262_slice *slice) {
+	uint32_t i;
+	counts->slices++;
+	if (slice->first_mb_in_slice == -1 || slice->first_mb_in_slice > slice->last_mb_in_slice || slice->last_mb_in_slice >= picparm->pic_size_in_mbs)
+		return;
+	for (i = slice->first_mb_in_slice; i <= slice->last_mb_in_slice; i++) {
+		struct h262_macroblock *mb = &slice->mbs[i];
+		counts->mbs++;
+		if (mb->macroblock_skipped) {
+			counts->mb_type[32]++;
+			continue;
+		}
+		counts->mb_type[mb->macroblock_quant
+			| mb->macroblock_motion_forward << 1
+			| mb->macroblock_motion_backward << 2
+			| mb->macroblock_pattern << 3
+			| mb->macroblock_intra << 4]++;
+		if (mb->macroblock_quant)
+			counts->quantiser_scale_code[mb->quantiser_scale_code & 31]++;
+		if (mb->macroblock_pattern)
+			counts->coded_block_pattern[mb->coded_block_pattern & 4095]++;
+	}
+}
+
+static int deh262_step(struct bitstream *str, void *pctx, void *scratch, FILE *out) {
+	struct deh262_ctx *ctx = pctx;
+	struct deh262_stats *stats = ctx->stats;
 	struct h262_slice *slice;
-	while (1) {
-		uint32_t start_code;
-		uint32_t ext_start_code;
-		if (vs_start(str, &start_code)) goto err;
-		printf("Start code: %02x\n", start_code);
-		switch (start_code) {
-			case H262_START_CODE_SEQPARM:
-				if (h262_seqparm(str, seqparm))
-					goto err;
-				if (vs_end(str))
-					goto err;
-				h262_print_seqparm(seqparm);
-				break;
-			case H262_START_CODE_PICPARM:
-				if (h262_picparm(str, seqparm, picparm))
-					goto err;
-				if (vs_end(str))
-					goto err;
-				h262_print_picparm(picparm);
-				break;
-			case H262_START_CODE_GOP:
-				if (h262_gop(str, gop))
-					goto err;
-				if (vs_end(str))
-					goto err;
-				h262_print_gop(gop);
-				break;
-			case H262_START_CODE_EXTENSION:
-				if (vs_u(str, &ext_start_code, 4)) goto err;
-				printf("Extension start code: %d\n", ext_start_code);
-				switch (ext_start_code) {
-					case H262_EXT_SEQUENCE:
-						if (h262_seqparm_ext(str, seqparm))
-							goto err;
-						if (vs_end(str))
-							goto err;
-						h262_print_seqparm(seqparm);
-						break;
-					case H262_EXT_PIC_CODING:
-						if (h262_picparm_ext(str, seqparm, picparm))
-							goto err;
-						if (vs_end(str))
-							goto err;
-						h262_print_picparm(picparm);
-						break;
-					default:
-						fprintf(stderr, "Unknown extension start code\n");
+	int64_t pos;
+	int res;
+	uint32_t start_code;
+	uint32_t ext_start_code;
+	if (vs_start(str, &start_code)) goto err;
+	if (stats) {
+		if (start_code == H262_START_CODE_SEQPARM || start_code == H262_START_CODE_PICPARM
+				|| start_code == H262_START_CODE_GOP || start_code == H262_START_CODE_END)
+			end_picture(stats, out);
+	} else {
+		fprintf(out, "Start code: %02x\n", start_code);
+	}
+	switch (start_code) {
+		case H262_START_CODE_SEQPARM:
+			if (h262_seqparm(str, &ctx->seqparm))
+				goto err;
+			if (vs_end(str))
+				goto err;
+			if (!stats)
+				h262_print_seqparm(out, &ctx->seqparm);
+			break;
+		case H262_START_CODE_PICPARM:
+			if (h262_picparm(str, &ctx->seqparm, &ctx->picparm))
+				goto err;
+			if (vs_end(str))
+				goto err;
+			if (stats) {
+				stats->inpic = 1;
+				stats->pic_type = ctx->picparm.picture_coding_type & 7;
+			} else {
+				h262_print_picparm(out, &ctx->picparm);
+			}
+			break;
+		case H262_START_CODE_GOP:
+			if (h262_gop(str, &ctx->gop))
+				goto err;
+			if (vs_end(str))
+				goto err;
+			if (!stats)
+				h262_print_gop(out, &ctx->gop);
+			break;
+		case H262_START_CODE_EXTENSION:
+			if (vs_u(str, &ext_start_code, 4)) goto err;
+			if (!stats)
+				fprintf(out, "Extension start code: %d\n", ext_start_code);
+			switch (ext_start_code) {
+				case H262_EXT_SEQUENCE:
+					if (h262_seqparm_ext(str, &ctx->seqparm))
 						goto err;
-				}
-				break;
-			case H262_START_CODE_END:
-				printf ("End of sequence.\n");
-				break;
-			default:
-				if (start_code >= H262_START_CODE_SLICE_BASE && start_code <= H262_START_CODE_SLICE_LAST) {
-					slice = calloc (sizeof *slice, 1);
-					slice->mbs = calloc (sizeof *slice->mbs, picparm->pic_size_in_mbs);
-					slice->slice_vertical_position = start_code - H262_START_CODE_SLICE_BASE;
-					if (seqparm->vertical_size > 2800) {
-						uint32_t svp_ext;
-						if (vs_u(str, &svp_ext, 3)) {
-							h262_del_slice(slice);
-							goto err;
-						}
-						if (slice->slice_vertical_position >= 0x80) {
-							fprintf(stderr, "Invalid slice start code for large picture\n");
-							goto err;
-						}
-						slice->slice_vertical_position += svp_ext * 0x80;
-					}
-					if (slice->slice_vertical_position >= picparm->pic_height_in_mbs) {
-						fprintf(stderr, "slice_vertical_position too large\n");
+					if (vs_end(str))
 						goto err;
-					}
-					if (h262_slice(str, seqparm, picparm, slice)) {
-						h262_print_slice(seqparm, picparm, slice);
+					if (!stats)
+						h262_print_seqparm(out, &ctx->seqparm);
+					break;
+				case H262_EXT_PIC_CODING:
+					if (h262_picparm_ext(str, &ctx->seqparm, &ctx->picparm))
+						goto err;
+					if (vs_end(str))
+						goto err;
+					if (!stats)
+						h262_print_picparm(out, &ctx->picparm);
+					break;
+				default:
+					fprintf(stderr, "Unknown extension start code\n");
+					goto err;
+			}
+			break;
+		case H262_START_CODE_END:
+			if (!stats)
+				fprintf (out, "End of sequence.\n");
+			break;
+		default:
+			if (start_code >= H262_START_CODE_SLICE_BASE && start_code <= H262_START_CODE_SLICE_LAST) {
+				slice = calloc (sizeof *slice, 1);
+				slice->mbs = calloc (sizeof *slice->mbs, ctx->picparm.pic_size_in_mbs);
+				slice->slice_vertical_position = start_code - H262_START_CODE_SLICE_BASE;
+				if (ctx->seqparm.vertical_size > 2800) {
+					uint32_t svp_ext;
+					if (vs_u(str, &svp_ext, 3)) {
 						h262_del_slice(slice);
 						goto err;
 					}
-					h262_print_slice(seqparm, picparm, slice);
-					if (vs_end(str)) {
-						h262_del_slice(slice);
+					if (slice->slice_vertical_position >= 0x80) {
+						fprintf(stderr, "Invalid slice start code for large picture\n");
 						goto err;
 					}
-					h262_del_slice(slice);
-					break;
+					slice->slice_vertical_position += svp_ext * 0x80;
+				}
+				if (slice->slice_vertical_position >= ctx->picparm.pic_height_in_mbs) {
+					fprintf(stderr, "slice_vertical_position too large\n");
+					goto err;
+				}
+				if (stats) {
+					stats->inpic = 1;
+					slice->stats = &stats->pic.se;
+				}
+				pos = vs_tell(str);
+				res = h262_slice(str, &ctx->seqparm, &ctx->picparm, slice);
+				if (stats) {
+					stats->pic.slice_bits += vs_tell(str) - pos;
+					count_slice(&stats->pic, &ctx->picparm, slice);
 				} else {
-					fprintf(stderr, "Unknown start code\n");
+					h262_print_slice(out, &ctx->seqparm, &ctx->picparm, slice);
+				}
+				if (res) {
+					h262_del_slice(slice);
 					goto err;
 				}
-		}
-		printf("NAL decoded successfully\n\n");
-		continue;
+				if (vs_end(str)) {
+					h262_del_slice(slice);
+					goto err;
+				}
+				h262_del_slice(slice);
+				break;
+			} else {
+				fprintf(stderr, "Unknown start code\n");
+				goto err;
+			}
+	}
+	if (!stats)
+		fprintf(out, "NAL decoded successfully\n\n");
+	return 0;
 err:
-		res = vs_search_start(str);
-		if (res == -1)
+	res = vs_search_start(str);
+	if (res == -1)
+		return -1;
+	if (!res)
+		return 1;
+	if (!stats)
+		fprintf(out, "\n");
+	return 0;
+}
+
+/* headers and extensions go in ctx, slices only read it */
+static int deh262_parallel(const void *ctx, uint32_t start_code) {
+	switch (start_code) {
+		case H262_START_CODE_SEQPARM:
+		case H262_START_CODE_PICPARM:
+		case H262_START_CODE_GOP:
+		case H262_START_CODE_EXTENSION:
+			return 0;
+		default:
 			return 1;
-		if (!res)
-			break;
-		printf("\n");
 	}
-	return 0;
+}
+
+static const struct vs_step_ops deh262_ops = {
+	sizeof(struct deh262_ctx),
+	0,
+	deh262_step,
+	deh262_parallel,
+};
+
+int main(int argc, char **argv) {
+	int c, i, res, first = 1;
+	int jobs = 1;
+	struct deh262_ctx *ctx = calloc(sizeof *ctx, 1);
+	while ((c = getopt (argc, argv, "j:s")) != -1)
+		switch (c) {
+			case 'j':
+				jobs = strtol(optarg, 0, 0);
+				break;
+			case 's':
+				/* JSON counts per picture and for the whole stream instead of the dump */
+				ctx->stats = calloc(sizeof *ctx->stats, 1);
+				break;
+		}
+	if (ctx->stats)
+		jobs = 1;
+	struct bitstream *str = vs_new_decode_fd(VS_H262, 0);
+	res = vs_run_steps(str, &deh262_ops, ctx, jobs, stdout);
+	if (ctx->stats) {
+		struct deh262_stats *stats = ctx->stats;
+		end_picture(stats, stdout);
+		printf("{\"type\": \"stream\", \"pictures\": %d, \"picture_types\": {", stats->pics);
+		for (i = 0; i < 8; i++) {
+			if (!stats->total[i].pictures)
+				continue;
+			printf("%s\"%s\": {\"pictures\": %" PRIu64 ", ", first ? "" : ", ", pic_type_names[i], stats->total[i].pictures);
+			print_counts(stdout, &stats->total[i]);
+			printf("}");
+			first = 0;
+		}
+		printf("}}\n");
+		free(stats);
+	}
+	return res == -1;
 }
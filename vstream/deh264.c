@@ -26,200 +26,512 @@
 #include "vstream.h"
 #include "util.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
 
-int main() {
-	uint8_t *bytes = 0;
-	int bytesnum = 0;
-	int bytesmax = 0;
-	int c;
-	while ((c = getchar()) != EOF) {
-		ADDARRAY(bytes, c);
+/* what -s counts for the slices of one slice type */
+struct deh264_counts {
+	uint64_t slices;
+	uint64_t mbs;
+	uint64_t header_bits;
+	uint64_t data_bits;
+	uint64_t mb_type[H264_MB_TYPE_UNAVAIL];
+	uint64_t sub_mb_type[H264_SUB_MB_TYPE_B_END];
+	uint64_t mb_qp_delta[128];	/* offset by 64 */
+	uint64_t coded_block_pattern[48];
+	struct h264_stats se;
+};
+
+struct deh264_stats {
+	/* by slice_type, for the current picture and for everything so far */
+	struct deh264_counts pic[5];
+	struct deh264_counts total[5];
+	int pics;
+	int inpic;
+	/* the last slice, to tell when a new picture starts */
+	struct h264_slice last;
+	uint32_t last_pps;
+};
+
+/* what -o keeps between slices */
+struct deh264_recon {
+	FILE *file;
+	struct h264_picture pic;
+	int inpic;
+	struct h264_slice last;
+	uint32_t last_pps;
+};
+
+struct deh264_ctx {
+	struct h264_seqparm *seqparms[32];
+	struct h264_seqparm *subseqparms[32];
+	struct h264_picparm *picparms[256];
+	int last_idr;
+	/* with -s, shared by all steps, which then have to run in order */
+	struct deh264_stats *stats;
+	/* with -o, likewise */
+	struct deh264_recon *recon;
+};
+
+static void add_hist(uint64_t *dst, const uint64_t *src, int num) {
+	int i;
+	for (i = 0; i < num; i++)
+		dst[i] += src[i];
+}
+
+static void add_counts(struct deh264_counts *dst, const struct deh264_counts *src) {
+	dst->slices += src->slices;
+	dst->mbs += src->mbs;
+	dst->header_bits += src->header_bits;
+	dst->data_bits += src->data_bits;
+	add_hist(dst->mb_type, src->mb_type, H264_MB_TYPE_UNAVAIL);
+	add_hist(dst->sub_mb_type, src->sub_mb_type, H264_SUB_MB_TYPE_B_END);
+	add_hist(dst->mb_qp_delta, src->mb_qp_delta, 128);
+	add_hist(dst->coded_block_pattern, src->coded_block_pattern, 48);
+	add_hist(dst->se.se_bits, src->se.se_bits, H264_STATS_SE_NUM);
+	add_hist(dst->se.se_num, src->se.se_num, H264_STATS_SE_NUM);
+	add_hist(dst->se.ctx_bins, src->se.ctx_bins, H264_STATS_CTXIDX_NUM);
+	dst->se.bypass_bins += src->se.bypass_bins;
+	dst->se.terminate_bins += src->se.terminate_bins;
+	add_hist(dst->se.total_coeff, src->se.total_coeff, 65);
+}
+
+/* the nonzero entries of hist, as a JSON object keyed by name or by index - offset */
+static void print_hist(FILE *out, const char *name, const uint64_t *hist, int num, int offset, const char *(*names)(uint32_t)) {
+	int i, first = 1;
+	fprintf(out, ", \"%s\": {", name);
+	for (i = 0; i < num; i++) {
+		if (!hist[i])
+			continue;
+		if (names)
+			fprintf(out, "%s\"%s\": %" PRIu64, first ? "" : ", ", names(i), hist[i]);
+		else
+			fprintf(out, "%s\"%d\": %" PRIu64, first ? "" : ", ", i - offset, hist[i]);
+		first = 0;
 	}
-	struct bitstream *str = vs_new_decode(VS_H264, bytes, bytesnum);
-	struct h264_seqparm *seqparms[32] = { 0 };
-	struct h264_seqparm *subseqparms[32] = { 0 };
-	struct h264_picparm *picparms[256] = { 0 };
-	int res;
-	int last_idr = 0;
+	fprintf(out, "}");
+}
+
+static void print_counts(FILE *out, const struct deh264_counts *counts) {
+	int i, first = 1;
+	fprintf(out, "\"slices\": %" PRIu64 ", \"mbs\": %" PRIu64, counts->slices, counts->mbs);
+	fprintf(out, ", \"header_bits\": %" PRIu64 ", \"data_bits\": %" PRIu64, counts->header_bits, counts->data_bits);
+	print_hist(out, "mb_type", counts->mb_type, H264_MB_TYPE_UNAVAIL, 0, h264_mb_type_name);
+	print_hist(out, "sub_mb_type", counts->sub_mb_type, H264_SUB_MB_TYPE_B_END, 0, h264_sub_mb_type_name);
+	print_hist(out, "mb_qp_delta", counts->mb_qp_delta, 128, 64, 0);
+	print_hist(out, "coded_block_pattern", counts->coded_block_pattern, 48, 0, 0);
+	print_hist(out, "total_coeff", counts->se.total_coeff, 65, 0, 0);
+	fprintf(out, ", \"syntax_elements\": {");
+	for (i = 0; i < H264_STATS_SE_NUM; i++) {
+		if (!counts->se.se_num[i])
+			continue;
+		fprintf(out, "%s\"%s\": {\"num\": %" PRIu64 ", \"bits\": %.2f}", first ? "" : ", ", h264_stats_se_name(i), counts->se.se_num[i], counts->se.se_bits[i] / 65536.0);
+		first = 0;
+	}
+	fprintf(out, "}");
+	if (counts->se.bypass_bins || counts->se.terminate_bins) {
+		fprintf(out, ", \"bypass_bins\": %" PRIu64 ", \"terminate_bins\": %" PRIu64, counts->se.bypass_bins, counts->se.terminate_bins);
+		print_hist(out, "ctx_bins", counts->se.ctx_bins, H264_STATS_CTXIDX_NUM, 0, 0);
+	}
+}
+
+static void print_types(FILE *out, const struct deh264_counts *counts) {
+	int i, first = 1;
+	fprintf(out, ", \"slice_types\": {");
+	for (i = 0; i < 5; i++) {
+		if (!counts[i].slices)
+			continue;
+		fprintf(out, "%s\"%s\": {", first ? "" : ", ", h264_slice_type_name(i));
+		print_counts(out, &counts[i]);
+		fprintf(out, "}");
+		first = 0;
+	}
+	fprintf(out, "}");
+}
+
+static void end_picture(struct deh264_stats *stats, FILE *out) {
+	int i;
+	if (!stats->inpic)
+		return;
+	fprintf(out, "{\"type\": \"picture\", \"picture\": %d", stats->pics++);
+	print_types(out, stats->pic);
+	fprintf(out, "}\n");
+	for (i = 0; i < 5; i++) {
+		add_counts(&stats->total[i], &stats->pic[i]);
+		memset(&stats->pic[i], 0, sizeof stats->pic[i]);
+	}
+	stats->inpic = 0;
+}
+
+/* 7.4.1.2.4, less the redundant pictures */
+static int new_picture(int inpic, const struct h264_slice *last, uint32_t last_pps, struct h264_slice *slice) {
+	if (!inpic)
+		return 1;
+	if (slice->frame_num != last->frame_num
+			|| slice->picparm->pic_parameter_set_id != last_pps
+			|| slice->field_pic_flag != last->field_pic_flag
+			|| slice->bottom_field_flag != last->bottom_field_flag
+			|| !slice->nal_ref_idc != !last->nal_ref_idc
+			|| slice->idr_pic_flag != last->idr_pic_flag
+			|| (slice->idr_pic_flag && slice->idr_pic_id != last->idr_pic_id))
+		return 1;
+	if (slice->seqparm->pic_order_cnt_type == 0)
+		return slice->pic_order_cnt_lsb != last->pic_order_cnt_lsb
+			|| slice->delta_pic_order_cnt_bottom != last->delta_pic_order_cnt_bottom;
+	if (slice->seqparm->pic_order_cnt_type == 1)
+		return slice->delta_pic_order_cnt[0] != last->delta_pic_order_cnt[0]
+			|| slice->delta_pic_order_cnt[1] != last->delta_pic_order_cnt[1];
+	return 0;
+}
+
+static void count_slice(struct deh264_counts *counts, struct h264_slice *slice) {
+	uint32_t addr = slice->first_mb_in_slice * (1 + slice->mbaff_frame_flag);
+	int i;
+	counts->slices++;
+	if (addr > slice->last_mb_in_slice || slice->last_mb_in_slice >= slice->pic_size_in_mbs)
+		return;
 	while (1) {
-		uint32_t start_code;
-		if (vs_start(str, &start_code)) goto err;
-		if (start_code & 0x80) {
-			fprintf(stderr, "forbidden_zero_bit not 0\n");
-			goto err;
+		struct h264_macroblock *mb = &slice->mbs[addr];
+		counts->mbs++;
+		if (mb->mb_type < H264_MB_TYPE_UNAVAIL)
+			counts->mb_type[mb->mb_type]++;
+		if (mb->mb_type == H264_MB_TYPE_P_8X8 || mb->mb_type == H264_MB_TYPE_P_8X8REF0 || mb->mb_type == H264_MB_TYPE_B_8X8)
+			for (i = 0; i < 4; i++)
+				if (mb->sub_mb_type[i] < H264_SUB_MB_TYPE_B_END)
+					counts->sub_mb_type[mb->sub_mb_type[i]]++;
+		if (mb->mb_type != H264_MB_TYPE_P_SKIP && mb->mb_type != H264_MB_TYPE_B_SKIP && mb->mb_type != H264_MB_TYPE_I_PCM) {
+			if (mb->coded_block_pattern < 48)
+				counts->coded_block_pattern[mb->coded_block_pattern]++;
+			if (mb->coded_block_pattern || h264_is_intra_16x16_mb_type(mb->mb_type)) {
+				int d = mb->mb_qp_delta + 64;
+				counts->mb_qp_delta[d < 0 ? 0 : d > 127 ? 127 : d]++;
+			}
 		}
-		uint32_t nal_ref_idc = start_code >> 5;
-		uint32_t nal_unit_type = start_code & 0x1f;
-		printf("NAL unit:\n");
-		printf("\tnal_ref_idc = %d\n", nal_ref_idc);
-		printf("\tnal_unit_type = %d\n", nal_unit_type);
-		struct h264_seqparm *sp;
-		struct h264_picparm *pp;
-		struct h264_slice *slice;
-		uint32_t idx;
-		uint32_t additional_extension_flag = 0;
-		switch (nal_unit_type) {
-			case H264_NAL_UNIT_TYPE_SLICE_NONIDR:
-			case H264_NAL_UNIT_TYPE_SLICE_IDR:
-			case H264_NAL_UNIT_TYPE_SLICE_AUX:
-				slice = calloc (sizeof *slice, 1);
-				slice->nal_ref_idc = nal_ref_idc;
-				slice->nal_unit_type = nal_unit_type;
-				if (nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_IDR)
-					last_idr = 1;
-				if (nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_NONIDR)
-					last_idr = 0;
-				/* for AUX, keep IDR status of last slice */
-				slice->idr_pic_flag = last_idr;
-				if (h264_slice_header(str, seqparms, picparms, slice)) {
-					h264_del_slice(slice);
-					goto err;
-				}
-				h264_print_slice_header(slice);
-				slice->mbs = calloc (sizeof *slice->mbs, slice->pic_size_in_mbs);
-				if (h264_slice_data(str, slice)) {
-					h264_print_slice_data(slice);
-					h264_del_slice(slice);
-					goto err;
-				}
-				h264_print_slice_data(slice);
+		if (addr == slice->last_mb_in_slice)
+			break;
+		addr = h264_next_mb_addr(slice, addr);
+		if (addr >= slice->pic_size_in_mbs)
+			break;
+	}
+}
+
+static int deh264_step(struct bitstream *str, void *pctx, void *scratch, FILE *out) {
+	struct deh264_ctx *ctx = pctx;
+	struct h264_slice_buf *slicebuf = scratch;
+	struct deh264_stats *stats = ctx->stats;
+	struct deh264_recon *recon = ctx->recon;
+	int64_t pos;
+	int res;
+	uint32_t start_code;
+	if (vs_start(str, &start_code)) goto err;
+	if (start_code & 0x80) {
+		fprintf(stderr, "forbidden_zero_bit not 0\n");
+		goto err;
+	}
+	uint32_t nal_ref_idc = start_code >> 5;
+	uint32_t nal_unit_type = start_code & 0x1f;
+	/* 7.4.1.2.3: these come before the first slice of a picture */
+	int first = (nal_unit_type >= H264_NAL_UNIT_TYPE_SEI && nal_unit_type <= H264_NAL_UNIT_TYPE_END_STREAM)
+		|| (nal_unit_type >= H264_NAL_UNIT_TYPE_PREFIX_NAL_UNIT && nal_unit_type <= 18);
+	if (recon && first)
+		recon->inpic = 0;
+	if (stats) {
+		if (first)
+			end_picture(stats, out);
+	} else {
+		fprintf(out, "NAL unit:\n");
+		fprintf(out, "\tnal_ref_idc = %d\n", nal_ref_idc);
+		fprintf(out, "\tnal_unit_type = %d\n", nal_unit_type);
+	}
+	struct h264_seqparm *sp;
+	struct h264_picparm *pp;
+	struct h264_slice *slice;
+	uint32_t idx;
+	uint32_t additional_extension_flag = 0;
+	switch (nal_unit_type) {
+		case H264_NAL_UNIT_TYPE_SLICE_NONIDR:
+		case H264_NAL_UNIT_TYPE_SLICE_IDR:
+		case H264_NAL_UNIT_TYPE_SLICE_AUX:
+			slice = calloc (sizeof *slice, 1);
+			slice->nal_ref_idc = nal_ref_idc;
+			slice->nal_unit_type = nal_unit_type;
+			if (nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_IDR)
+				ctx->last_idr = 1;
+			if (nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_NONIDR)
+				ctx->last_idr = 0;
+			/* for AUX, keep IDR status of last slice */
+			slice->idr_pic_flag = ctx->last_idr;
+			pos = vs_tell(str);
+			if (h264_slice_header(str, ctx->seqparms, ctx->picparms, slice)) {
 				h264_del_slice(slice);
-				break;
-			case H264_NAL_UNIT_TYPE_SEQPARM:
-				sp = calloc (sizeof *sp, 1);
-				if (h264_seqparm(str, sp)) {
-					h264_del_seqparm(sp);
-					goto err;
-				}
-				if (vs_end(str)) {
-					h264_del_seqparm(sp);
-					goto err;
-				}
-				h264_print_seqparm(sp);
-				if (sp->seq_parameter_set_id > 31) {
-					fprintf(stderr, "seq_parameter_set_id out of bounds\n");
-					goto err;
+				goto err;
+			}
+			if (stats) {
+				if (nal_unit_type != H264_NAL_UNIT_TYPE_SLICE_AUX && new_picture(stats->inpic, &stats->last, stats->last_pps, slice)) {
+					end_picture(stats, out);
+					stats->inpic = 1;
 				}
-				if (seqparms[sp->seq_parameter_set_id]) {
-					h264_del_seqparm(seqparms[sp->seq_parameter_set_id]);
+				stats->last = *slice;
+				stats->last_pps = slice->picparm->pic_parameter_set_id;
+				stats->pic[slice->slice_type].header_bits += vs_tell(str) - pos;
+				pos = vs_tell(str);
+				slice->stats = &stats->pic[slice->slice_type].se;
+			} else {
+				h264_print_slice_header(out, slice);
+			}
+			/* auxiliary and redundant pictures aren't drawn */
+			if (recon && nal_unit_type != H264_NAL_UNIT_TYPE_SLICE_AUX && !slice->redundant_pic_cnt) {
+				if (new_picture(recon->inpic, &recon->last, recon->last_pps, slice)) {
+					if (h264_picture_start(&recon->pic, slice, recon->file)) {
+						h264_del_slice(slice);
+						return -1;
+					}
+					recon->inpic = 1;
 				}
-				seqparms[sp->seq_parameter_set_id] = sp;
+				recon->last = *slice;
+				recon->last_pps = slice->picparm->pic_parameter_set_id;
+			}
+			h264_slice_buf_attach(slicebuf, slice);
+			res = h264_slice_data(str, slice);
+			if (!res && recon && nal_unit_type != H264_NAL_UNIT_TYPE_SLICE_AUX && !slice->redundant_pic_cnt)
+				h264_recon_slice(&recon->pic, slice);
+			if (stats) {
+				stats->pic[slice->slice_type].data_bits += vs_tell(str) - pos;
+				count_slice(&stats->pic[slice->slice_type], slice);
+			} else {
+				h264_print_slice_data(out, slice);
+			}
+			h264_slice_buf_detach(slicebuf, slice);
+			h264_del_slice(slice);
+			if (res)
+				goto err;
+			break;
+		case H264_NAL_UNIT_TYPE_SEQPARM:
+			sp = calloc (sizeof *sp, 1);
+			if (h264_seqparm(str, sp)) {
+				h264_del_seqparm(sp);
+				goto err;
+			}
+			if (vs_end(str)) {
+				h264_del_seqparm(sp);
+				goto err;
+			}
+			if (!stats)
+				h264_print_seqparm(out, sp);
+			if (sp->seq_parameter_set_id > 31) {
+				fprintf(stderr, "seq_parameter_set_id out of bounds\n");
+				goto err;
+			}
+			if (ctx->seqparms[sp->seq_parameter_set_id]) {
+				h264_del_seqparm(ctx->seqparms[sp->seq_parameter_set_id]);
+			}
+			ctx->seqparms[sp->seq_parameter_set_id] = sp;
+			break;
+		case H264_NAL_UNIT_TYPE_PICPARM:
+			pp = calloc (sizeof *pp, 1);
+			if (h264_picparm(str, ctx->seqparms, ctx->subseqparms, pp)) {
+				h264_del_picparm(pp);
+				goto err;
+			}
+			if (vs_end(str)) {
+				h264_del_picparm(pp);
+				goto err;
+			}
+			if (!stats)
+				h264_print_picparm(out, pp);
+			if (pp->pic_parameter_set_id > 255) {
+				fprintf(stderr, "pic_parameter_set_id out of bounds\n");
+				goto err;
+			}
+			if (ctx->picparms[pp->pic_parameter_set_id]) {
+				h264_del_picparm(ctx->picparms[pp->pic_parameter_set_id]);
+			}
+			ctx->picparms[pp->pic_parameter_set_id] = pp;
+			break;
+		case H264_NAL_UNIT_TYPE_SEQPARM_EXT:
+			if (h264_seqparm_ext(str, ctx->seqparms, &idx))
+				goto err;
+			if (vs_end(str))
+				goto err;
+			if (!stats)
+				h264_print_seqparm_ext(out, ctx->seqparms[idx]);
+			break;
+		case H264_NAL_UNIT_TYPE_ACC_UNIT_DELIM: {
+			uint32_t primary_pic_type;
+			if (vs_u(str, &primary_pic_type, 3)) goto err;
+			if (vs_end(str)) goto err;
+			if (stats)
 				break;
-			case H264_NAL_UNIT_TYPE_PICPARM:
-				pp = calloc (sizeof *pp, 1);
-				if (h264_picparm(str, seqparms, subseqparms, pp)) {
-					h264_del_picparm(pp);
-					goto err;
-				}
-				if (vs_end(str)) {
-					h264_del_picparm(pp);
-					goto err;
-				}
-				h264_print_picparm(pp);
-				if (pp->pic_parameter_set_id > 255) {
-					fprintf(stderr, "pic_parameter_set_id out of bounds\n");
-					goto err;
-				}
-				if (picparms[pp->pic_parameter_set_id]) {
-					h264_del_picparm(picparms[pp->pic_parameter_set_id]);
+			fprintf (out, "Access unit delimiter:\n");
+			static const char *const names[8] = {
+				"I",
+				"P+I",
+				"P+B+I",
+				"SI",
+				"SP+SI",
+				"I+SI",
+				"P+I+SP+SI",
+				"P+B+I+SP+SI",
+			};
+			fprintf (out, "\tprimary_pic_type = %d [%s]\n", primary_pic_type, names[primary_pic_type]);
+			break;
+		}
+		case H264_NAL_UNIT_TYPE_END_SEQ:
+			if (!stats)
+				fprintf (out, "End of sequence.\n");
+			break;
+		case H264_NAL_UNIT_TYPE_END_STREAM:
+			if (!stats)
+				fprintf (out, "End of stream.\n");
+			break;
+		case H264_NAL_UNIT_TYPE_SUBSET_SEQPARM:
+			sp = calloc (sizeof *sp, 1);
+			if (h264_seqparm(str, sp)) {
+				h264_del_seqparm(sp);
+				goto err;
+			}
+			switch (sp->profile_idc) {
+				case H264_PROFILE_SCALABLE_BASELINE:
+				case H264_PROFILE_SCALABLE_HIGH:
+					if (h264_seqparm_svc(str, sp)) {
+						h264_del_seqparm(sp);
+						goto err;
+					}
+					break;
+				case H264_PROFILE_MULTIVIEW_HIGH:
+				case H264_PROFILE_STEREO_HIGH:
+					if (h264_seqparm_mvc(str, sp)) {
+						h264_del_seqparm(sp);
+						goto err;
+					}
+					break;
+				default:
+					break;
+			}
+			if (vs_u(str, &additional_extension_flag, 1)) {
+				h264_del_seqparm(sp);
+				goto err;
+			}
+			if (additional_extension_flag) {
+				fprintf(stderr, "WARNING: additional data in subset seqparm extension\n");
+				while (vs_has_more_data(str)) {
+					if (vs_u(str, &additional_extension_flag, 1)) {
+						h264_del_seqparm(sp);
+						goto err;
+					}
 				}
-				picparms[pp->pic_parameter_set_id] = pp;
-				break;
-			case H264_NAL_UNIT_TYPE_SEQPARM_EXT:
-				if (h264_seqparm_ext(str, seqparms, &idx))
-					goto err;
-				if (vs_end(str))
-					goto err;
-				h264_print_seqparm_ext(seqparms[idx]);
-				break;
-			case H264_NAL_UNIT_TYPE_ACC_UNIT_DELIM: {
-				uint32_t primary_pic_type;
-				if (vs_u(str, &primary_pic_type, 3)) goto err;
-				if (vs_end(str)) goto err;
-				printf ("Access unit delimiter:\n");
-				static const char *const names[8] = {
-					"I",
-					"P+I",
-					"P+B+I",
-					"SI",
-					"SP+SI",
-					"I+SI",
-					"P+I+SP+SI",
-					"P+B+I+SP+SI",
-				};
-				printf ("\tprimary_pic_type = %d [%s]\n", primary_pic_type, names[primary_pic_type]);
-				break;
 			}
-			case H264_NAL_UNIT_TYPE_END_SEQ:
-				printf ("End of sequence.\n");
+			if (vs_end(str)) {
+				h264_del_seqparm(sp);
+				goto err;
+			}
+			if (!stats)
+				h264_print_seqparm(out, sp);
+			if (sp->seq_parameter_set_id > 31) {
+				fprintf(stderr, "seq_parameter_set_id out of bounds\n");
+				goto err;
+			}
+			if (ctx->subseqparms[sp->seq_parameter_set_id]) {
+				h264_del_seqparm(ctx->subseqparms[sp->seq_parameter_set_id]);
+			}
+			ctx->subseqparms[sp->seq_parameter_set_id] = sp;
+			break;
+		default:
+			fprintf(stderr, "Unknown NAL type\n");
+			goto err;
+	}
+	if (!stats)
+		fprintf(out, "NAL decoded successfully\n\n");
+	return 0;
+err:
+	res = vs_search_start(str);
+	if (res == -1)
+		return -1;
+	if (!res)
+		return 1;
+	if (!stats)
+		fprintf(out, "\n");
+	return 0;
+}
+
+/* parameter sets go in ctx, everything else only reads it */
+static int deh264_parallel(const void *ctx, uint32_t start_code) {
+	switch (start_code & 0x1f) {
+		case H264_NAL_UNIT_TYPE_SEQPARM:
+		case H264_NAL_UNIT_TYPE_PICPARM:
+		case H264_NAL_UNIT_TYPE_SEQPARM_EXT:
+		case H264_NAL_UNIT_TYPE_SUBSET_SEQPARM:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+static void deh264_predict(void *pctx, uint32_t start_code) {
+	struct deh264_ctx *ctx = pctx;
+	if (start_code & 0x80)
+		return;
+	if ((start_code & 0x1f) == H264_NAL_UNIT_TYPE_SLICE_IDR)
+		ctx->last_idr = 1;
+	if ((start_code & 0x1f) == H264_NAL_UNIT_TYPE_SLICE_NONIDR)
+		ctx->last_idr = 0;
+}
+
+static void deh264_scratch_fini(void *scratch) {
+	h264_slice_buf_free(scratch);
+}
+
+static const struct vs_step_ops deh264_ops = {
+	sizeof(struct deh264_ctx),
+	sizeof(struct h264_slice_buf),
+	deh264_step,
+	deh264_parallel,
+	deh264_predict,
+	deh264_scratch_fini,
+};
+
+int main(int argc, char **argv) {
+	int c, res;
+	int jobs = 1;
+	struct deh264_ctx ctx = { 0 };
+	while ((c = getopt (argc, argv, "j:so:")) != -1)
+		switch (c) {
+			case 'j':
+				jobs = strtol(optarg, 0, 0);
 				break;
-			case H264_NAL_UNIT_TYPE_END_STREAM:
-				printf ("End of stream.\n");
+			case 's':
+				/* JSON counts per picture and for the whole stream instead of the dump */
+				ctx.stats = calloc(sizeof *ctx.stats, 1);
 				break;
-			case H264_NAL_UNIT_TYPE_SUBSET_SEQPARM:
-				sp = calloc (sizeof *sp, 1);
-				if (h264_seqparm(str, sp)) {
-					h264_del_seqparm(sp);
-					goto err;
-				}
-				switch (sp->profile_idc) {
-					case H264_PROFILE_SCALABLE_BASELINE:
-					case H264_PROFILE_SCALABLE_HIGH:
-						if (h264_seqparm_svc(str, sp)) {
-							h264_del_seqparm(sp);
-							goto err;
-						}
-						break;
-					case H264_PROFILE_MULTIVIEW_HIGH:
-					case H264_PROFILE_STEREO_HIGH:
-						if (h264_seqparm_mvc(str, sp)) {
-							h264_del_seqparm(sp);
-							goto err;
-						}
-						break;
-					default:
-						break;
-				}
-				if (vs_u(str, &additional_extension_flag, 1)) {
-					h264_del_seqparm(sp);
-					goto err;
-				}
-				if (additional_extension_flag) {
-					fprintf(stderr, "WARNING: additional data in subset seqparm extension\n");
-					while (vs_has_more_data(str)) {
-						if (vs_u(str, &additional_extension_flag, 1)) {
-							h264_del_seqparm(sp);
-							goto err;
-						}
-					}
-				}
-				if (vs_end(str)) {
-					h264_del_seqparm(sp);
-					goto err;
-				}
-				h264_print_seqparm(sp);
-				if (sp->seq_parameter_set_id > 31) {
-					fprintf(stderr, "seq_parameter_set_id out of bounds\n");
-					goto err;
+			case 'o':
+				/* reconstructed pictures as raw YUV, see h264_recon.c */
+				ctx.recon = calloc(sizeof *ctx.recon, 1);
+				ctx.recon->file = fopen(optarg, "wb");
+				if (!ctx.recon->file) {
+					perror(optarg);
+					return 1;
 				}
-				if (subseqparms[sp->seq_parameter_set_id]) {
-					h264_del_seqparm(subseqparms[sp->seq_parameter_set_id]);
-				}
-				subseqparms[sp->seq_parameter_set_id] = sp;
 				break;
-			default:
-				fprintf(stderr, "Unknown NAL type\n");
-				goto err;
 		}
-		printf("NAL decoded successfully\n\n");
-		continue;
-err:
-		res = vs_search_start(str);
-		if (res == -1)
-			return 1;
-		if (!res)
-			break;
-		printf("\n");
+	if (ctx.stats || ctx.recon)
+		jobs = 1;
+	struct bitstream *str = vs_new_decode_fd(VS_H264, 0);
+	res = vs_run_steps(str, &deh264_ops, &ctx, jobs, stdout);
+	if (ctx.stats) {
+		struct deh264_stats *stats = ctx.stats;
+		end_picture(stats, stdout);
+		printf("{\"type\": \"stream\", \"pictures\": %d", stats->pics);
+		print_types(stdout, stats->total);
+		printf("}\n");
+		free(stats);
 	}
-	return 0;
+	if (ctx.recon) {
+		if (h264_picture_write(&ctx.recon->pic, ctx.recon->file) || fclose(ctx.recon->file))
+			res = -1;
+		h264_picture_free(&ctx.recon->pic);
+		free(ctx.recon);
+	}
+	return res == -1;
 }
@@ -234,13 +234,7 @@ int h261_block(struct bitstream *str, int32_t *block, int intra) {
 				}
 				tmp = abs(coeff) | run << 12;
 				sign = coeff < 0;
-				int j;
-				for (j = 0; tab[j].blen; j++) {
-					if (tab[j].val == tmp) {
-						break;
-					}
-				}
-				if (tab[j].val != tmp)
+				if (!vs_vlc_find(tab, tmp))
 					tmp = 0xfffff;
 				eb = coeff & 0xff;
 				i++;
@@ -459,6 +453,17 @@ static const struct vs_vlc_val cbp_vlc[] = {
 	{ 0 },
 };
 
+/* every VLC table above, for the tests */
+const struct vs_vlc_val *const h261_vlc_tables[] = {
+	block_vlc,
+	block_0_vlc,
+	mba_vlc,
+	mtype_vlc,
+	mvd_vlc,
+	cbp_vlc,
+	0,
+};
+
 int h261_gob(struct bitstream *str, struct h261_gob *gob) {
 	if (vs_u(str, &gob->gquant, 5)) return 1;
 	uint32_t gei = 0;
@@ -707,11 +707,26 @@ static const struct vs_vlc_val block_intra_vlc[] = {
 	{ 0 },
 };
 
-int h262_block(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, int32_t *block, int intra, int chroma) {
+/* with stats, charges what is read from here on to se; H262_STATS_SE_NUM charges nothing */
+static void stats_se(struct bitstream *str, struct h262_stats *stats, enum h262_stats_se se) {
+	int64_t pos;
+	if (!stats)
+		return;
+	pos = vs_tell(str);
+	if (stats->cur_se != H262_STATS_SE_NUM)
+		stats->se_bits[stats->cur_se] += pos - stats->cur_pos;
+	if (se != H262_STATS_SE_NUM)
+		stats->se_num[se]++;
+	stats->cur_se = se;
+	stats->cur_pos = pos;
+}
+
+int h262_block(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, int32_t *block, int intra, int chroma, struct h262_stats *stats) {
 	int i = 0;
 	if (intra) {
 		uint32_t dcs;
 		uint32_t dcd;
+		stats_se(str, stats, H262_STATS_DCT_DC);
 		if (str->dir == VS_ENCODE) {
 			dcs = 0;
 			while (abs(block[0]) >= (1 << dcs))
@@ -738,6 +753,7 @@ int h262_block(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_
 	}
 	if (picparm->picture_coding_type == H262_PIC_TYPE_D)
 		return 0;
+	stats_se(str, stats, H262_STATS_DCT_COEFFS);
 	while (1) {
 		uint32_t tmp, run, el, eb1, eb2, sign;
 		int32_t coeff;
@@ -763,17 +779,11 @@ int h262_block(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_
 				el = coeff & 0xfff;
 				tmp = abs(coeff) | run << 12;
 				sign = coeff < 0;
-				int j;
-				for (j = 0; tab[j].blen; j++) {
-					if (tab[j].val == tmp) {
-						break;
-					}
-				}
-				if (tab[j].val != tmp)
+				if (!vs_vlc_find(tab, tmp))
 					tmp = 0xfffff;
 				if (tmp == 0xfffff && !seqparm->is_ext) {
 					/* make MPEG1 escape codes */
-					if (abs(coeff) < 127) {
+					if (abs(coeff) < 128) {
 						eb1 = coeff & 0xff;
 					} else if (abs(coeff) < 255) {
 						if (coeff < 0)
@@ -896,12 +906,31 @@ static const struct vs_vlc_val mbf_d_vlc[] = {
 	{ 0 },
 };
 
-int h262_macroblock(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_macroblock *mb, uint32_t *qsc) {
+/* every VLC table above, for the tests */
+const struct vs_vlc_val *const h262_vlc_tables[] = {
+	mbai_vlc,
+	motion_code_vlc,
+	dmvector_vlc,
+	cbp_vlc,
+	dcs_luma_vlc,
+	dcs_chroma_vlc,
+	block_vlc,
+	block_0_vlc,
+	block_intra_vlc,
+	mbf_i_vlc,
+	mbf_p_vlc,
+	mbf_b_vlc,
+	mbf_d_vlc,
+	0,
+};
+
+int h262_macroblock(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_macroblock *mb, uint32_t *qsc, struct h262_stats *stats) {
 	uint32_t mb_flags = mb->macroblock_quant
 		| mb->macroblock_motion_forward << 1
 		| mb->macroblock_motion_backward << 2
 		| mb->macroblock_pattern << 3
 		| mb->macroblock_intra << 4;
+	stats_se(str, stats, H262_STATS_MB_MODES);
 	switch (picparm->picture_coding_type) {
 		case H262_PIC_TYPE_I:
 			if (vs_vlc(str, &mb_flags, mbf_i_vlc)) return 1;
@@ -958,17 +987,20 @@ int h262_macroblock(struct bitstream *str, struct h262_seqparm *seqparm, struct
 		if (vs_infer(str, &mb->dct_type, 0)) return 1;
 	}
 	if (mb->macroblock_quant) {
+		stats_se(str, stats, H262_STATS_QUANTISER_SCALE_CODE);
 		if (vs_u(str, &mb->quantiser_scale_code, 5)) return 1;
 	} else {
 		if (vs_infer(str, &mb->quantiser_scale_code, *qsc)) return 1;
 	}
 	*qsc = mb->quantiser_scale_code;
 	if (mb->macroblock_motion_forward || (mb->macroblock_intra && picparm->concealment_motion_vectors)) {
+		stats_se(str, stats, H262_STATS_MOTION_VECTORS);
 		if (h262_motion_vectors(str, seqparm, picparm, mb, 0)) return 1;
 	} else {
 		if (h262_infer_vectors(str, seqparm, picparm, mb, 0)) return 1;
 	}
 	if (mb->macroblock_motion_backward) {
+		stats_se(str, stats, H262_STATS_MOTION_VECTORS);
 		if (h262_motion_vectors(str, seqparm, picparm, mb, 1)) return 1;
 	} else {
 		if (h262_infer_vectors(str, seqparm, picparm, mb, 1)) return 1;
@@ -979,14 +1011,20 @@ int h262_macroblock(struct bitstream *str, struct h262_seqparm *seqparm, struct
 	if (mb->macroblock_intra) {
 		if (vs_infer(str, &mb->coded_block_pattern, (1 << block_count[seqparm->chroma_format]) - 1)) return 1;
 	} else if (mb->macroblock_pattern) {
+		stats_se(str, stats, H262_STATS_CODED_BLOCK_PATTERN);
 		if (h262_coded_block_pattern(str, seqparm->chroma_format, &mb->coded_block_pattern)) return 1;
 	} else {
 		if (vs_infer(str, &mb->coded_block_pattern, 0)) return 1;
 	}
-	int i;
+	int i, j, n;
 	for (i = 0; i < block_count[seqparm->chroma_format]; i++)
 		if (mb->coded_block_pattern & 1 << i) {
-			if (h262_block(str, seqparm, picparm, mb->block[i], mb->macroblock_intra, i >= 4)) return 1;
+			if (h262_block(str, seqparm, picparm, mb->block[i], mb->macroblock_intra, i >= 4, stats)) return 1;
+			if (stats) {
+				for (j = n = 0; j < 64; j++)
+					n += mb->block[i][j] != 0;
+				stats->total_coeff[n]++;
+			}
 		}
 	if (picparm->picture_coding_type == H262_PIC_TYPE_D)
 		if (vs_mark(str, 1, 1)) return 1;
@@ -1006,6 +1044,9 @@ int h262_slice(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_
 		}
 	}
 	uint32_t tmp = slice->first_mb_in_slice % picparm->pic_width_in_mbs;
+	if (slice->stats)
+		slice->stats->cur_se = H262_STATS_SE_NUM;
+	stats_se(str, slice->stats, H262_STATS_MB_ADDR_INC);
 	if (h262_mb_addr_inc(str, &tmp)) return 1;
 	if (tmp >= picparm->pic_width_in_mbs) {
 		fprintf(stderr, "Initial mb_addr_inc too large\n");
@@ -1015,12 +1056,15 @@ int h262_slice(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_
 	uint32_t qsc = slice->quantiser_scale_code;
 	uint32_t curr_mb_addr = slice->first_mb_in_slice;
 	while (1) {
-		if (h262_macroblock(str, seqparm, picparm, &slice->mbs[curr_mb_addr], &qsc)) return 1;
+		if (h262_macroblock(str, seqparm, picparm, &slice->mbs[curr_mb_addr], &qsc, slice->stats)) return 1;
 		if (str->dir == VS_DECODE) {
 			slice->last_mb_in_slice = curr_mb_addr;
 			curr_mb_addr++;
-			if (!vs_has_more_data(str))
+			if (!vs_has_more_data(str)) {
+				stats_se(str, slice->stats, H262_STATS_SE_NUM);
 				return 0;
+			}
+			stats_se(str, slice->stats, H262_STATS_MB_ADDR_INC);
 			if (h262_mb_addr_inc(str, &tmp)) return 1;
 			if (curr_mb_addr >= picparm->pic_size_in_mbs) {
 				fprintf(stderr, "MB index overflow\n");
@@ -1044,17 +1088,20 @@ int h262_slice(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_
 			}
 		} else {
 			if (slice->last_mb_in_slice == curr_mb_addr) {
+				stats_se(str, slice->stats, H262_STATS_SE_NUM);
 				return 0;
 			}
+			curr_mb_addr++;
 			tmp = 0;
 			while (slice->last_mb_in_slice != curr_mb_addr && slice->mbs[curr_mb_addr].macroblock_skipped) {
 				tmp++;
 				curr_mb_addr++;
 			}
-			if (slice->last_mb_in_slice == curr_mb_addr) {
+			if (slice->mbs[curr_mb_addr].macroblock_skipped) {
 				fprintf(stderr, "Last MB in slice is skipped\n");
 				return 1;
 			}
+			stats_se(str, slice->stats, H262_STATS_MB_ADDR_INC);
 			if (h262_mb_addr_inc(str, &tmp)) return 1;
 		}
 	}
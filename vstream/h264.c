@@ -57,9 +57,41 @@ void h264_del_slice(struct h264_slice *slice) {
 	free(slice->dec_ref_base_pic_marking.mmcos);
 	free(slice->sgmap);
 	free(slice->mbs);
+	free(slice->coeffs);
 	free(slice);
 }
 
+void h264_slice_buf_attach(struct h264_slice_buf *buf, struct h264_slice *slice) {
+	if (buf->mbsmax < slice->pic_size_in_mbs) {
+		buf->mbsmax = slice->pic_size_in_mbs;
+		free(buf->mbs);
+		buf->mbs = calloc(sizeof *buf->mbs, buf->mbsmax);
+	}
+	slice->mbs = buf->mbs;
+	slice->coeffs = buf->coeffs;
+	slice->coeffsnum = 0;
+	slice->coeffsmax = buf->coeffsmax;
+}
+
+void h264_slice_buf_detach(struct h264_slice_buf *buf, struct h264_slice *slice) {
+	/* the arena may have been reallocated */
+	buf->coeffs = slice->coeffs;
+	buf->coeffsmax = slice->coeffsmax;
+	slice->mbs = 0;
+	slice->coeffs = 0;
+	slice->coeffsnum = 0;
+	slice->coeffsmax = 0;
+}
+
+void h264_slice_buf_free(struct h264_slice_buf *buf) {
+	free(buf->mbs);
+	free(buf->coeffs);
+	buf->mbs = 0;
+	buf->mbsmax = 0;
+	buf->coeffs = 0;
+	buf->coeffsmax = 0;
+}
+
 int h264_scaling_list(struct bitstream *str, uint32_t *scaling_list, int size, uint32_t *use_default_flag) {
 	uint32_t lastScale = 8;
 	uint32_t nextScale = 8;
@@ -610,7 +642,8 @@ int h264_picparm(struct bitstream *str, struct h264_seqparm **seqparms, struct h
 			}
 			/* brain damage workaround end */
 			int i;
-			for (i = 0; i < (picparm->chroma_format_idc == 3 ? 12 : 8); i++) {
+			/* the 8x8 lists are only there with transform_8x8_mode_flag */
+			for (i = 0; i < 6 + (picparm->chroma_format_idc == 3 ? 6 : 2) * picparm->transform_8x8_mode_flag; i++) {
 				if (vs_u(str, &picparm->pic_scaling_list_present_flag[i], 1)) return 1;
 				if (picparm->pic_scaling_list_present_flag[i]) {
 					if (i < 6) {
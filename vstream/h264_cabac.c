@@ -1279,6 +1279,74 @@ static const uint8_t transIdxMPS[64] = {
 	49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 62, 63,
 };
 
+/* log2(x) in 1/65536 units, for charging bins to h264_stats */
+static const uint32_t log2Tab[512] = {
+	0, 0, 65536, 103872, 131072, 152170, 169408, 183983,
+	196608, 207744, 217706, 226717, 234944, 242512, 249519, 256042,
+	262144, 267876, 273280, 278392, 283242, 287855, 292253, 296456,
+	300480, 304340, 308048, 311616, 315055, 318373, 321578, 324678,
+	327680, 330589, 333412, 336153, 338816, 341407, 343928, 346384,
+	348778, 351113, 353391, 355616, 357789, 359914, 361992, 364026,
+	366016, 367966, 369876, 371748, 373584, 375385, 377152, 378887,
+	380591, 382264, 383909, 385525, 387114, 388677, 390214, 391727,
+	393216, 394682, 396125, 397547, 398948, 400328, 401689, 403030,
+	404352, 405656, 406943, 408212, 409464, 410700, 411920, 413125,
+	414314, 415488, 416649, 417795, 418927, 420046, 421152, 422245,
+	423325, 424394, 425450, 426495, 427528, 428550, 429562, 430562,
+	431552, 432532, 433502, 434462, 435412, 436353, 437284, 438206,
+	439120, 440025, 440921, 441809, 442688, 443560, 444423, 445279,
+	446127, 446967, 447800, 448626, 449445, 450256, 451061, 451859,
+	452650, 453435, 454213, 454985, 455750, 456510, 457263, 458010,
+	458752, 459488, 460218, 460942, 461661, 462375, 463083, 463786,
+	464484, 465177, 465864, 466547, 467225, 467898, 468566, 469229,
+	469888, 470543, 471192, 471838, 472479, 473115, 473748, 474376,
+	475000, 475620, 476236, 476848, 477456, 478060, 478661, 479257,
+	479850, 480439, 481024, 481606, 482185, 482759, 483331, 483898,
+	484463, 485024, 485582, 486136, 486688, 487236, 487781, 488323,
+	488861, 489397, 489930, 490459, 490986, 491510, 492031, 492549,
+	493064, 493577, 494086, 494593, 495098, 495599, 496098, 496594,
+	497088, 497579, 498068, 498554, 499038, 499519, 499998, 500474,
+	500948, 501419, 501889, 502355, 502820, 503282, 503742, 504200,
+	504656, 505109, 505561, 506010, 506457, 506902, 507345, 507786,
+	508224, 508661, 509096, 509528, 509959, 510388, 510815, 511240,
+	511663, 512084, 512503, 512921, 513336, 513750, 514162, 514572,
+	514981, 515387, 515792, 516195, 516597, 516997, 517395, 517791,
+	518186, 518579, 518971, 519361, 519749, 520136, 520521, 520904,
+	521286, 521667, 522046, 522423, 522799, 523173, 523546, 523918,
+	524288, 524657, 525024, 525390, 525754, 526117, 526478, 526839,
+	527197, 527555, 527911, 528266, 528619, 528971, 529322, 529672,
+	530020, 530367, 530713, 531057, 531400, 531742, 532083, 532422,
+	532761, 533098, 533434, 533768, 534102, 534434, 534765, 535095,
+	535424, 535752, 536079, 536404, 536728, 537052, 537374, 537695,
+	538015, 538334, 538651, 538968, 539284, 539598, 539912, 540225,
+	540536, 540847, 541156, 541465, 541772, 542079, 542384, 542689,
+	542992, 543295, 543596, 543897, 544197, 544495, 544793, 545090,
+	545386, 545681, 545975, 546268, 546560, 546852, 547142, 547432,
+	547721, 548008, 548295, 548581, 548867, 549151, 549434, 549717,
+	549999, 550280, 550560, 550839, 551118, 551396, 551672, 551948,
+	552224, 552498, 552772, 553045, 553317, 553588, 553859, 554128,
+	554397, 554666, 554933, 555200, 555466, 555731, 555995, 556259,
+	556522, 556784, 557046, 557307, 557567, 557826, 558085, 558343,
+	558600, 558857, 559113, 559368, 559622, 559876, 560129, 560382,
+	560634, 560885, 561135, 561385, 561634, 561883, 562130, 562378,
+	562624, 562870, 563115, 563360, 563604, 563847, 564090, 564332,
+	564574, 564815, 565055, 565294, 565534, 565772, 566010, 566247,
+	566484, 566720, 566955, 567190, 567425, 567658, 567891, 568124,
+	568356, 568588, 568818, 569049, 569278, 569508, 569736, 569964,
+	570192, 570419, 570645, 570871, 571097, 571322, 571546, 571770,
+	571993, 572216, 572438, 572660, 572881, 573101, 573322, 573541,
+	573760, 573979, 574197, 574415, 574632, 574848, 575064, 575280,
+	575495, 575710, 575924, 576138, 576351, 576564, 576776, 576988,
+	577199, 577410, 577620, 577830, 578039, 578248, 578457, 578665,
+	578872, 579079, 579286, 579492, 579698, 579903, 580108, 580313,
+	580517, 580720, 580923, 581126, 581328, 581530, 581731, 581932,
+	582133, 582333, 582533, 582732, 582931, 583129, 583327, 583525,
+	583722, 583919, 584115, 584311, 584507, 584702, 584897, 585091,
+	585285, 585478, 585672, 585864, 586057, 586249, 586440, 586631,
+	586822, 587013, 587203, 587392, 587582, 587771, 587959, 588147,
+	588335, 588522, 588709, 588896, 589082, 589268, 589454, 589639,
+};
+
 static inline int clip3(int a, int b, int c) {
 	if (c < a)
 		return a;
@@ -1326,6 +1394,8 @@ int h264_cabac_init_arith (struct bitstream *str, struct h264_cabac_context *cab
 		cabac->bitsOutstanding = 0;
 	} else {
 		cabac->codIRange = 510;
+		cabac->win = 0;
+		cabac->winbits = 0;
 		if (vs_u(str, &cabac->codIOffset, 9))
 			return 1;
 		if (cabac->codIOffset >= 510) {
@@ -1336,6 +1406,34 @@ int h264_cabac_init_arith (struct bitstream *str, struct h264_cabac_context *cab
 	return 0;
 }
 
+/*
+ * Next n bits of the slice data for codIOffset, 1 <= n <= 32; decode only.
+ * Bits are fetched from the bitstream a word at a time and kept in the
+ * window until the engine shifts them in, and given back by a terminating
+ * bin, which is where anything else may read the bitstream.
+ */
+static inline int get_bits(struct bitstream *str, struct h264_cabac_context *cabac, int n, uint32_t *val) {
+	if (cabac->winbits < n) {
+		uint32_t tmp;
+		int got = vs_prefetch(str, &tmp, 32);
+		if (got < 0)
+			return 1;
+		if (got)
+			cabac->win |= (uint64_t)tmp << (64 - cabac->winbits - got);
+		cabac->winbits += got;
+		if (cabac->winbits < n) {
+			/* end of NAL, have the bitstream report it */
+			cabac->win = 0;
+			cabac->winbits = 0;
+			return vs_u(str, val, n);
+		}
+	}
+	*val = cabac->win >> (64 - n);
+	cabac->win <<= n;
+	cabac->winbits -= n;
+	return 0;
+}
+
 static int put_bit(struct bitstream *str, struct h264_cabac_context *cabac, uint32_t bit) {
 	uint32_t nbit = !bit;
 	if (cabac->firstBitFlag) {
@@ -1357,26 +1455,31 @@ static int put_bit(struct bitstream *str, struct h264_cabac_context *cabac, uint
 }
 
 int h264_cabac_renorm(struct bitstream *str, struct h264_cabac_context *cabac) {
+	if (str->dir == VS_DECODE) {
+		if (cabac->codIRange < 256) {
+			/* all the doublings at once, codIRange is never 0 */
+			int shift = __builtin_clz(cabac->codIRange) - 23;
+			uint32_t tmp;
+			if (get_bits(str, cabac, shift, &tmp))
+				return 1;
+			cabac->codIRange <<= shift;
+			cabac->codIOffset = cabac->codIOffset << shift | tmp;
+		}
+		return 0;
+	}
 	while (cabac->codIRange < 256) {
 		cabac->codIRange <<= 1;
 		cabac->codIOffset <<= 1;
-		if (str->dir == VS_ENCODE) {
-			if (cabac->codIOffset < 512) {
-				if (put_bit(str, cabac, 0))
-					return 1;
-			} else if (cabac->codIOffset >= 1024) {
-				if (put_bit(str, cabac, 1))
-					return 1;
-				cabac->codIOffset -= 1024;
-			} else {
-				cabac->bitsOutstanding++;
-				cabac->codIOffset -= 512;
-			}
-		} else {
-			uint32_t tmp;
-			if (vs_u(str, &tmp, 1))
+		if (cabac->codIOffset < 512) {
+			if (put_bit(str, cabac, 0))
+				return 1;
+		} else if (cabac->codIOffset >= 1024) {
+			if (put_bit(str, cabac, 1))
 				return 1;
-			cabac->codIOffset |= tmp;
+			cabac->codIOffset -= 1024;
+		} else {
+			cabac->bitsOutstanding++;
+			cabac->codIOffset -= 512;
 		}
 	}
 	return 0;
@@ -1387,6 +1490,7 @@ int h264_cabac_decision(struct bitstream *str, struct h264_cabac_context *cabac,
 		return h264_cabac_bypass(str, cabac, binVal);
 	if (ctxIdx == H264_CABAC_CTXIDX_TERMINATE)
 		return h264_cabac_terminate(str, cabac, binVal);
+	uint32_t range = cabac->codIRange;
 	int qCodIRangeIdx = cabac->codIRange >> 6 & 3;
 	int codIRangeLPS = rangeTabLPS[cabac->pStateIdx[ctxIdx]][qCodIRangeIdx];
 	cabac->codIRange -= codIRangeLPS;
@@ -1404,6 +1508,10 @@ int h264_cabac_decision(struct bitstream *str, struct h264_cabac_context *cabac,
 			*binVal = cabac->valMPS[ctxIdx];
 		}
 	}
+	if (cabac->slice->stats) {
+		cabac->slice->stats->ctx_bins[ctxIdx]++;
+		cabac->cost += log2Tab[range] - log2Tab[cabac->codIRange];
+	}
 	if (*binVal == cabac->valMPS[ctxIdx]) {
 		cabac->pStateIdx[ctxIdx] = transIdxMPS[cabac->pStateIdx[ctxIdx]];
 	} else {
@@ -1435,7 +1543,7 @@ int h264_cabac_bypass(struct bitstream *str, struct h264_cabac_context *cabac, u
 		}
 	} else {
 		uint32_t tmp;
-		if (vs_u(str, &tmp, 1))
+		if (get_bits(str, cabac, 1, &tmp))
 			return 1;
 		cabac->codIOffset |= tmp;
 		if (cabac->codIOffset >= cabac->codIRange) {
@@ -1445,11 +1553,39 @@ int h264_cabac_bypass(struct bitstream *str, struct h264_cabac_context *cabac, u
 			*binVal = 0;
 		}
 	}
+	if (cabac->slice->stats) {
+		cabac->slice->stats->bypass_bins++;
+		cabac->cost += 1 << 16;
+	}
 	cabac->BinCount++;
 	return 0;
 }
 
+/* n bypass bins at once, first one in the top bit; decode only */
+static int h264_cabac_bypass_bits(struct bitstream *str, struct h264_cabac_context *cabac, int n, uint32_t *val) {
+	uint32_t tmp;
+	uint64_t x;
+	*val = 0;
+	while (n) {
+		/* codIOffset < codIRange < 2^9, so the quotient fits in step bits */
+		int step = n > 16 ? 16 : n;
+		if (get_bits(str, cabac, step, &tmp))
+			return 1;
+		x = (uint64_t)cabac->codIOffset << step | tmp;
+		*val = *val << step | (uint32_t)(x / cabac->codIRange);
+		cabac->codIOffset = x % cabac->codIRange;
+		if (cabac->slice->stats) {
+			cabac->slice->stats->bypass_bins += step;
+			cabac->cost += step << 16;
+		}
+		cabac->BinCount += step;
+		n -= step;
+	}
+	return 0;
+}
+
 int h264_cabac_terminate(struct bitstream *str, struct h264_cabac_context *cabac, uint32_t *binVal) {
+	uint32_t range = cabac->codIRange;
 	cabac->codIRange -= 2;
 	if (str->dir == VS_ENCODE) {
 		if (*binVal) {
@@ -1471,12 +1607,20 @@ int h264_cabac_terminate(struct bitstream *str, struct h264_cabac_context *cabac
 	} else {
 		if (cabac->codIOffset >= cabac->codIRange) {
 			*binVal = 1;
+			/* whatever follows is read directly */
+			vs_unread(str, cabac->winbits);
+			cabac->win = 0;
+			cabac->winbits = 0;
 		} else {
 			*binVal = 0;
 			if (h264_cabac_renorm(str, cabac))
 				return 1;
 		}
 	}
+	if (cabac->slice->stats) {
+		cabac->slice->stats->terminate_bins++;
+		cabac->cost += log2Tab[range] - log2Tab[*binVal ? 2 : range - 2];
+	}
 	cabac->BinCount++;
 	return 0;
 }
@@ -1604,10 +1748,8 @@ int h264_cabac_ueg(struct bitstream *str, struct h264_cabac_context *cabac, int
 				rval += 1 << k;
 				k++;
 			}
-			while (k--) {
-				if (h264_cabac_bypass(str, cabac, &tmp)) return 1;
-				rval += tmp << k;
-			}
+			if (h264_cabac_bypass_bits(str, cabac, k, &tmp)) return 1;
+			rval += tmp;
 		}
 	}
 	if (rval && sign) {
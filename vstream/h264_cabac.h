@@ -183,6 +183,11 @@ struct h264_cabac_context {
 	int firstBitFlag;
 	int bitsOutstanding;
 	int BinCount;
+	/* decode only: bits read ahead of codIOffset, at the top of win */
+	uint64_t win;
+	int winbits;
+	/* with slice->stats: what the bins so far are worth, in 1/65536 bits */
+	uint64_t cost;
 };
 
 struct h264_cabac_se_val {
@@ -204,6 +209,21 @@ int h264_cabac_terminate(struct bitstream *str, struct h264_cabac_context *cabac
 int h264_cabac_se(struct bitstream *str, struct h264_cabac_context *cabac, const struct h264_cabac_se_val *tab, int *ctxIdx, uint32_t *val);
 int h264_cabac_tu(struct bitstream *str, struct h264_cabac_context *cabac, int *ctxIdx, int numidx, uint32_t cMax, uint32_t *val);
 int h264_cabac_ueg(struct bitstream *str, struct h264_cabac_context *cabac, int *ctxIdx, int numidx, int k, int sign, uint32_t uCoff, int32_t *val);
+
+/* with slice->stats, charges what is read from here on to se; H264_STATS_SE_NUM charges nothing */
+static inline void h264_stats_se(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, enum h264_stats_se se) {
+	struct h264_stats *stats = slice->stats;
+	uint64_t pos;
+	if (!stats)
+		return;
+	pos = cabac ? cabac->cost : (uint64_t)vs_tell(str) << 16;
+	if (stats->cur_se != H264_STATS_SE_NUM)
+		stats->se_bits[stats->cur_se] += pos - stats->cur_pos;
+	if (se != H264_STATS_SE_NUM)
+		stats->se_num[se]++;
+	stats->cur_se = se;
+	stats->cur_pos = pos;
+}
 void h264_cabac_destroy(struct h264_cabac_context *cabac);
 
 #endif
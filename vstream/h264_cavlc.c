@@ -525,6 +525,7 @@ static const struct vs_vlc_val total_zeros_1[] = {
 	{ 13,  9, 0,0,0,0,0,0,0,1,1 },
 	{ 14,  9, 0,0,0,0,0,0,0,1,0 },
 	{ 15,  9, 0,0,0,0,0,0,0,0,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_2[] = {
@@ -543,6 +544,7 @@ static const struct vs_vlc_val total_zeros_2[] = {
 	{ 12,  6, 0,0,0,0,1,0 },
 	{ 13,  6, 0,0,0,0,0,1 },
 	{ 14,  6, 0,0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_3[] = {
@@ -560,6 +562,7 @@ static const struct vs_vlc_val total_zeros_3[] = {
 	{ 11,  6, 0,0,0,0,0,1 },
 	{ 12,  5, 0,0,0,0,1 },
 	{ 13,  6, 0,0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_4[] = {
@@ -576,6 +579,7 @@ static const struct vs_vlc_val total_zeros_4[] = {
 	{ 10,  5, 0,0,0,1,0 },
 	{ 11,  5, 0,0,0,0,1 },
 	{ 12,  5, 0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_5[] = {
@@ -591,6 +595,7 @@ static const struct vs_vlc_val total_zeros_5[] = {
 	{  9,  5, 0,0,0,0,1 },
 	{ 10,  4, 0,0,0,1 },
 	{ 11,  5, 0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_6[] = {
@@ -605,6 +610,7 @@ static const struct vs_vlc_val total_zeros_6[] = {
 	{  8,  4, 0,0,0,1 },
 	{  9,  3, 0,0,1 },
 	{ 10,  6, 0,0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_7[] = {
@@ -618,6 +624,7 @@ static const struct vs_vlc_val total_zeros_7[] = {
 	{  7,  4, 0,0,0,1 },
 	{  8,  3, 0,0,1 },
 	{  9,  6, 0,0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_8[] = {
@@ -630,6 +637,7 @@ static const struct vs_vlc_val total_zeros_8[] = {
 	{  6,  3, 0,1,0 },
 	{  7,  3, 0,0,1 },
 	{  8,  6, 0,0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_9[] = {
@@ -641,6 +649,7 @@ static const struct vs_vlc_val total_zeros_9[] = {
 	{  5,  3, 0,0,1 },
 	{  6,  2, 0,1 },
 	{  7,  5, 0,0,0,0,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_10[] = {
@@ -651,6 +660,7 @@ static const struct vs_vlc_val total_zeros_10[] = {
 	{  4,  2, 1,0 },
 	{  5,  2, 0,1 },
 	{  6,  4, 0,0,0,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_11[] = {
@@ -660,6 +670,7 @@ static const struct vs_vlc_val total_zeros_11[] = {
 	{  3,  3, 0,1,0 },
 	{  4,  1, 1 },
 	{  5,  3, 0,1,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_12[] = {
@@ -668,6 +679,7 @@ static const struct vs_vlc_val total_zeros_12[] = {
 	{  2,  2, 0,1 },
 	{  3,  1, 1 },
 	{  4,  3, 0,0,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_13[] = {
@@ -675,17 +687,20 @@ static const struct vs_vlc_val total_zeros_13[] = {
 	{  1,  3, 0,0,1 },
 	{  2,  1, 1 },
 	{  3,  2, 0,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_14[] = {
 	{  0,  2, 0,0 },
 	{  1,  2, 0,1 },
 	{  2,  1, 1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_15[] = {
 	{  0,  1, 0 },
 	{  1,  1, 1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c1_1[] = {
@@ -693,17 +708,20 @@ static const struct vs_vlc_val total_zeros_c1_1[] = {
 	{  1,  2, 0,1 },
 	{  2,  3, 0,0,1 },
 	{  3,  3, 0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c1_2[] = {
 	{  0,  1, 1 },
 	{  1,  2, 0,1 },
 	{  2,  2, 0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c1_3[] = {
 	{  0,  1, 1 },
 	{  1,  1, 0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_1[] = {
@@ -715,6 +733,7 @@ static const struct vs_vlc_val total_zeros_c2_1[] = {
 	{  5,  4, 0,0,0,1 },
 	{  6,  5, 0,0,0,0,1 },
 	{  7,  5, 0,0,0,0,0 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_2[] = {
@@ -725,6 +744,7 @@ static const struct vs_vlc_val total_zeros_c2_2[] = {
 	{  4,  3, 1,0,1 },
 	{  5,  3, 1,1,0 },
 	{  6,  3, 1,1,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_3[] = {
@@ -734,6 +754,7 @@ static const struct vs_vlc_val total_zeros_c2_3[] = {
 	{  3,  2, 1,0 },
 	{  4,  3, 1,1,0 },
 	{  5,  3, 1,1,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_4[] = {
@@ -742,6 +763,7 @@ static const struct vs_vlc_val total_zeros_c2_4[] = {
 	{  2,  2, 0,1 },
 	{  3,  2, 1,0 },
 	{  4,  3, 1,1,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_5[] = {
@@ -749,17 +771,20 @@ static const struct vs_vlc_val total_zeros_c2_5[] = {
 	{  1,  2, 0,1 },
 	{  2,  2, 1,0 },
 	{  3,  2, 1,1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_6[] = {
 	{  0,  2, 0,0 },
 	{  1,  2, 0,1 },
 	{  2,  1, 1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val total_zeros_c2_7[] = {
 	{  0,  1, 0 },
 	{  1,  1, 1 },
+	{ 0 },
 };
 
 static const struct vs_vlc_val *const total_zeros_tab[16] = {
@@ -907,6 +932,49 @@ static const struct vs_vlc_val *const run_before_tab[16] = {
 	run_before_x,
 };
 
+/* every VLC table above, for the tests */
+const struct vs_vlc_val *const h264_vlc_tables[] = {
+	coeff_token_0,
+	coeff_token_2,
+	coeff_token_4,
+	coeff_token_8,
+	coeff_token_m1,
+	coeff_token_m2,
+	total_zeros_1,
+	total_zeros_2,
+	total_zeros_3,
+	total_zeros_4,
+	total_zeros_5,
+	total_zeros_6,
+	total_zeros_7,
+	total_zeros_8,
+	total_zeros_9,
+	total_zeros_10,
+	total_zeros_11,
+	total_zeros_12,
+	total_zeros_13,
+	total_zeros_14,
+	total_zeros_15,
+	total_zeros_c1_1,
+	total_zeros_c1_2,
+	total_zeros_c1_3,
+	total_zeros_c2_1,
+	total_zeros_c2_2,
+	total_zeros_c2_3,
+	total_zeros_c2_4,
+	total_zeros_c2_5,
+	total_zeros_c2_6,
+	total_zeros_c2_7,
+	run_before_1,
+	run_before_2,
+	run_before_3,
+	run_before_4,
+	run_before_5,
+	run_before_6,
+	run_before_x,
+	0,
+};
+
 int h264_run_before(struct bitstream *str, int zerosLeft, uint32_t *val) {
 	if (zerosLeft)
 		return vs_vlc(str, val, run_before_tab[zerosLeft]);
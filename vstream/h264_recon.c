@@ -0,0 +1,1335 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Reconstruction of what a picture's slice data fully determines: intra
+ * prediction (8.3), scaling and inverse transforms of the residual (8.5),
+ * and I_PCM samples.  There are no reference pictures, so inter macroblocks
+ * get a flat mid-grey prediction with their residual added on top, and there
+ * is no deblocking filter.  Pictures made of intra slices come out the way a
+ * conforming decoder has them before deblocking; anything predicted from an
+ * inter macroblock doesn't.  SI macroblocks are left grey, and MBAFF frames
+ * aren't supported at all.
+ *
+ * Samples are uint16_t whatever the bit depth.  A field picture draws every
+ * other line of the frame, so that both fields of a frame end up in one
+ * h264_picture_write.
+ *
+ * The inverse transforms are the hot part; they come in plain C, SSE2 and
+ * AVX2 versions, picked at run time like the start code scan in bitstream.c.
+ * They compute in 32 bits.  Streams whose intermediate values break the
+ * range limits of 8.5.12 and 8.5.13 (16 bits at 8-bit depth) aren't
+ * conforming, and can decode differently from decoders that compute in 16
+ * bits; intra prediction then spreads the differences.
+ */
+
+#include "h264.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#include <immintrin.h>
+#endif
+
+/* how a macroblock was predicted, for struct h264_recon_mb */
+enum {
+	PRED_INTER,
+	PRED_4X4,
+	PRED_8X8,
+	PRED_INTRA,	/* Intra_16x16 and I_PCM */
+};
+
+/* which neighbouring samples of a block can be used for intra prediction */
+enum {
+	AV_LEFT = 1,
+	AV_TOP = 2,
+	AV_TOPRIGHT = 4,
+	AV_CORNER = 8,
+};
+
+/* 8.5.6: coefficient index to raster position */
+static const uint8_t zigzag4x4[16] = { 0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15 };
+static const uint8_t field4x4[16] = { 0, 4, 1, 8, 12, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 };
+
+/* 8.5.7 */
+static const uint8_t zigzag8x8[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+static const uint8_t field8x8[64] = {
+	0, 8, 16, 1, 9, 24, 32, 17, 2, 25, 40, 48, 56, 33, 10, 3,
+	18, 41, 49, 57, 26, 11, 4, 19, 34, 42, 50, 58, 27, 12, 5, 20,
+	35, 43, 51, 59, 28, 13, 6, 21, 36, 44, 52, 60, 29, 14, 22, 37,
+	45, 53, 61, 30, 7, 15, 38, 46, 54, 62, 23, 31, 39, 47, 55, 63,
+};
+
+/* 8.5.11.1: the 4:2:2 chroma DC coefficients go into a 2 wide, 4 high matrix like this */
+static const uint8_t chroma_dc_422[8] = { 0, 2, 1, 4, 6, 3, 5, 7 };
+
+/* Table 7-3 and 7-4, in zigzag order */
+static const uint32_t default_4x4[2][16] = {
+	{ 6, 13, 13, 20, 20, 20, 28, 28, 28, 28, 32, 32, 32, 37, 37, 42 },
+	{ 10, 14, 14, 20, 20, 20, 24, 24, 24, 24, 27, 27, 27, 30, 30, 34 },
+};
+static const uint32_t default_8x8[2][64] = {
+	{
+		6, 10, 10, 13, 11, 13, 16, 16, 16, 16, 18, 18, 18, 18, 18, 23,
+		23, 23, 23, 23, 23, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27,
+		27, 27, 27, 27, 29, 29, 29, 29, 29, 29, 29, 31, 31, 31, 31, 31,
+		31, 33, 33, 33, 33, 33, 36, 36, 36, 36, 38, 38, 38, 40, 40, 42,
+	}, {
+		9, 13, 13, 15, 13, 15, 17, 17, 17, 17, 19, 19, 19, 19, 19, 21,
+		21, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 24, 24, 24, 24,
+		24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27, 27,
+		27, 28, 28, 28, 28, 28, 30, 30, 30, 30, 32, 32, 32, 33, 33, 35,
+	},
+};
+static const uint32_t flat[64] = {
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+};
+
+/* 8.5.9: normAdjust4x4 for both positions even, both odd, and the rest */
+static const int norm4x4[6][3] = {
+	{ 10, 16, 13 },
+	{ 11, 18, 14 },
+	{ 13, 20, 16 },
+	{ 14, 23, 18 },
+	{ 16, 25, 20 },
+	{ 18, 29, 23 },
+};
+
+/* 8.5.9: normAdjust8x8, in the order of the conditions there */
+static const int norm8x8[6][6] = {
+	{ 20, 18, 32, 19, 25, 24 },
+	{ 22, 19, 35, 21, 28, 26 },
+	{ 26, 23, 42, 24, 33, 31 },
+	{ 28, 25, 45, 26, 35, 33 },
+	{ 32, 28, 51, 30, 40, 38 },
+	{ 36, 32, 58, 34, 46, 43 },
+};
+
+/* Table 8-15, QPc for qPI from 30 on */
+static const int chroma_qp[22] = {
+	29, 30, 31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39,
+};
+
+struct recon {
+	struct h264_picture *pic;
+	struct h264_slice *slice;
+	/* per macroblock state of the colour plane being coded */
+	struct h264_recon_mb *mbs;
+	int slicenum;
+	int field_scan;
+	int constrained;
+	int bypass_allowed;
+	/* LevelScale4x4 and LevelScale8x8, by list and qP % 6, in raster order */
+	int32_t ls4[6][6][16];
+	int32_t ls8[6][6][64];
+	/* the first line of the picture in each plane, and the step to the next one */
+	uint16_t *base[3];
+	int pitch[3];
+	/* macroblock size in samples, and bit depth */
+	int mbw[3];
+	int mbh[3];
+	int bd[3];
+	/* planes coded with the luma process, and how many */
+	int lplanes[3];
+	int nlplanes;
+	/* the current macroblock */
+	int mbx;
+	int mby;
+	struct h264_recon_mb *cur;
+	int qpy;
+	int qp[3];	/* QP'Y, QP'Cb, QP'Cr */
+	int bypass;
+	/* 4x4 blocks of the current plane reconstructed so far */
+	uint32_t done;
+};
+
+static int32_t clamp_coeff(int64_t v) {
+	/* plenty for conforming streams, and keeps the transforms from overflowing on broken ones */
+	if (v < -(1 << 22))
+		return -(1 << 22);
+	if (v > (1 << 22) - 1)
+		return (1 << 22) - 1;
+	return v;
+}
+
+static inline int clip(int v, int max) {
+	return v < 0 ? 0 : v > max ? max : v;
+}
+
+/*
+ * 8.5.12.2 and 8.5.13.2: the inverse transforms, rows first, then columns,
+ * then the final (x + 32) >> 6.  They work in place on raster order blocks.
+ */
+
+void h264_idct4x4_c(int32_t *blk) {
+	int i;
+	for (i = 0; i < 8; i++) {
+		int32_t *d = i < 4 ? blk + 4 * i : blk + i - 4;
+		int s = i < 4 ? 1 : 4;
+		int32_t e0 = d[0] + d[2 * s];
+		int32_t e1 = d[0] - d[2 * s];
+		int32_t e2 = (d[s] >> 1) - d[3 * s];
+		int32_t e3 = d[s] + (d[3 * s] >> 1);
+		d[0] = e0 + e3;
+		d[s] = e1 + e2;
+		d[2 * s] = e1 - e2;
+		d[3 * s] = e0 - e3;
+	}
+	for (i = 0; i < 16; i++)
+		blk[i] = (blk[i] + 32) >> 6;
+}
+
+static void idct8_c(int32_t *d, int s) {
+	int32_t e0 = d[0] + d[4 * s];
+	int32_t e1 = d[5 * s] - d[3 * s] - d[7 * s] - (d[7 * s] >> 1);
+	int32_t e2 = d[0] - d[4 * s];
+	int32_t e3 = d[s] + d[7 * s] - d[3 * s] - (d[3 * s] >> 1);
+	int32_t e4 = (d[2 * s] >> 1) - d[6 * s];
+	int32_t e5 = d[7 * s] + d[5 * s] - d[s] + (d[5 * s] >> 1);
+	int32_t e6 = d[2 * s] + (d[6 * s] >> 1);
+	int32_t e7 = d[3 * s] + d[5 * s] + d[s] + (d[s] >> 1);
+	int32_t f0 = e0 + e6;
+	int32_t f1 = e1 + (e7 >> 2);
+	int32_t f2 = e2 + e4;
+	int32_t f3 = e3 + (e5 >> 2);
+	int32_t f4 = e2 - e4;
+	int32_t f5 = (e3 >> 2) - e5;
+	int32_t f6 = e0 - e6;
+	int32_t f7 = e7 - (e1 >> 2);
+	d[0] = f0 + f7;
+	d[s] = f2 + f5;
+	d[2 * s] = f4 + f3;
+	d[3 * s] = f6 + f1;
+	d[4 * s] = f6 - f1;
+	d[5 * s] = f4 - f3;
+	d[6 * s] = f2 - f5;
+	d[7 * s] = f0 - f7;
+}
+
+void h264_idct8x8_c(int32_t *blk) {
+	int i;
+	for (i = 0; i < 8; i++)
+		idct8_c(blk + 8 * i, 1);
+	for (i = 0; i < 8; i++)
+		idct8_c(blk + i, 8);
+	for (i = 0; i < 64; i++)
+		blk[i] = (blk[i] + 32) >> 6;
+}
+
+/*
+ * The SIMD versions hold a row in a vector and run the 1-D transform on all
+ * rows at once, so each pass starts with a transpose.
+ */
+
+#ifdef __SSE2__
+static void transpose4_sse2(__m128i *v) {
+	__m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+	__m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+	__m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+	__m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+	v[0] = _mm_unpacklo_epi64(t0, t1);
+	v[1] = _mm_unpackhi_epi64(t0, t1);
+	v[2] = _mm_unpacklo_epi64(t2, t3);
+	v[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+static void idct4_sse2(__m128i *v) {
+	__m128i e0 = _mm_add_epi32(v[0], v[2]);
+	__m128i e1 = _mm_sub_epi32(v[0], v[2]);
+	__m128i e2 = _mm_sub_epi32(_mm_srai_epi32(v[1], 1), v[3]);
+	__m128i e3 = _mm_add_epi32(v[1], _mm_srai_epi32(v[3], 1));
+	v[0] = _mm_add_epi32(e0, e3);
+	v[1] = _mm_add_epi32(e1, e2);
+	v[2] = _mm_sub_epi32(e1, e2);
+	v[3] = _mm_sub_epi32(e0, e3);
+}
+
+static void h264_idct4x4_sse2(int32_t *blk) {
+	const __m128i round = _mm_set1_epi32(32);
+	__m128i v[4];
+	int i;
+	for (i = 0; i < 4; i++)
+		v[i] = _mm_loadu_si128((const __m128i *)(blk + 4 * i));
+	transpose4_sse2(v);
+	idct4_sse2(v);
+	transpose4_sse2(v);
+	idct4_sse2(v);
+	for (i = 0; i < 4; i++)
+		_mm_storeu_si128((__m128i *)(blk + 4 * i), _mm_srai_epi32(_mm_add_epi32(v[i], round), 6));
+}
+
+/* m[row][half], as four 4x4 transposes */
+static void transpose8_sse2(__m128i m[8][2]) {
+	__m128i out[8][2], t[4];
+	int r, c, i;
+	for (r = 0; r < 2; r++)
+		for (c = 0; c < 2; c++) {
+			for (i = 0; i < 4; i++)
+				t[i] = m[4 * c + i][r];
+			transpose4_sse2(t);
+			for (i = 0; i < 4; i++)
+				out[4 * r + i][c] = t[i];
+		}
+	memcpy(m, out, sizeof out);
+}
+
+static void idct8_sse2(__m128i m[8][2], int h) {
+	__m128i d0 = m[0][h], d1 = m[1][h], d2 = m[2][h], d3 = m[3][h];
+	__m128i d4 = m[4][h], d5 = m[5][h], d6 = m[6][h], d7 = m[7][h];
+	__m128i e0 = _mm_add_epi32(d0, d4);
+	__m128i e1 = _mm_sub_epi32(_mm_sub_epi32(d5, d3), _mm_add_epi32(d7, _mm_srai_epi32(d7, 1)));
+	__m128i e2 = _mm_sub_epi32(d0, d4);
+	__m128i e3 = _mm_sub_epi32(_mm_add_epi32(d1, d7), _mm_add_epi32(d3, _mm_srai_epi32(d3, 1)));
+	__m128i e4 = _mm_sub_epi32(_mm_srai_epi32(d2, 1), d6);
+	__m128i e5 = _mm_sub_epi32(_mm_add_epi32(d7, d5), _mm_sub_epi32(d1, _mm_srai_epi32(d5, 1)));
+	__m128i e6 = _mm_add_epi32(d2, _mm_srai_epi32(d6, 1));
+	__m128i e7 = _mm_add_epi32(_mm_add_epi32(d3, d5), _mm_add_epi32(d1, _mm_srai_epi32(d1, 1)));
+	__m128i f0 = _mm_add_epi32(e0, e6);
+	__m128i f1 = _mm_add_epi32(e1, _mm_srai_epi32(e7, 2));
+	__m128i f2 = _mm_add_epi32(e2, e4);
+	__m128i f3 = _mm_add_epi32(e3, _mm_srai_epi32(e5, 2));
+	__m128i f4 = _mm_sub_epi32(e2, e4);
+	__m128i f5 = _mm_sub_epi32(_mm_srai_epi32(e3, 2), e5);
+	__m128i f6 = _mm_sub_epi32(e0, e6);
+	__m128i f7 = _mm_sub_epi32(e7, _mm_srai_epi32(e1, 2));
+	m[0][h] = _mm_add_epi32(f0, f7);
+	m[1][h] = _mm_add_epi32(f2, f5);
+	m[2][h] = _mm_add_epi32(f4, f3);
+	m[3][h] = _mm_add_epi32(f6, f1);
+	m[4][h] = _mm_sub_epi32(f6, f1);
+	m[5][h] = _mm_sub_epi32(f4, f3);
+	m[6][h] = _mm_sub_epi32(f2, f5);
+	m[7][h] = _mm_sub_epi32(f0, f7);
+}
+
+static void h264_idct8x8_sse2(int32_t *blk) {
+	const __m128i round = _mm_set1_epi32(32);
+	__m128i m[8][2];
+	int i;
+	for (i = 0; i < 8; i++) {
+		m[i][0] = _mm_loadu_si128((const __m128i *)(blk + 8 * i));
+		m[i][1] = _mm_loadu_si128((const __m128i *)(blk + 8 * i + 4));
+	}
+	transpose8_sse2(m);
+	idct8_sse2(m, 0);
+	idct8_sse2(m, 1);
+	transpose8_sse2(m);
+	idct8_sse2(m, 0);
+	idct8_sse2(m, 1);
+	for (i = 0; i < 8; i++) {
+		_mm_storeu_si128((__m128i *)(blk + 8 * i), _mm_srai_epi32(_mm_add_epi32(m[i][0], round), 6));
+		_mm_storeu_si128((__m128i *)(blk + 8 * i + 4), _mm_srai_epi32(_mm_add_epi32(m[i][1], round), 6));
+	}
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define H264_HAVE_AVX2
+__attribute__((target("avx2")))
+static void transpose8_avx2(__m256i *v) {
+	__m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+	__m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+	__m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+	__m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+	__m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+	v[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	v[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	v[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	v[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+__attribute__((target("avx2")))
+static void idct8_avx2(__m256i *v) {
+	__m256i e0 = _mm256_add_epi32(v[0], v[4]);
+	__m256i e1 = _mm256_sub_epi32(_mm256_sub_epi32(v[5], v[3]), _mm256_add_epi32(v[7], _mm256_srai_epi32(v[7], 1)));
+	__m256i e2 = _mm256_sub_epi32(v[0], v[4]);
+	__m256i e3 = _mm256_sub_epi32(_mm256_add_epi32(v[1], v[7]), _mm256_add_epi32(v[3], _mm256_srai_epi32(v[3], 1)));
+	__m256i e4 = _mm256_sub_epi32(_mm256_srai_epi32(v[2], 1), v[6]);
+	__m256i e5 = _mm256_sub_epi32(_mm256_add_epi32(v[7], v[5]), _mm256_sub_epi32(v[1], _mm256_srai_epi32(v[5], 1)));
+	__m256i e6 = _mm256_add_epi32(v[2], _mm256_srai_epi32(v[6], 1));
+	__m256i e7 = _mm256_add_epi32(_mm256_add_epi32(v[3], v[5]), _mm256_add_epi32(v[1], _mm256_srai_epi32(v[1], 1)));
+	__m256i f0 = _mm256_add_epi32(e0, e6);
+	__m256i f1 = _mm256_add_epi32(e1, _mm256_srai_epi32(e7, 2));
+	__m256i f2 = _mm256_add_epi32(e2, e4);
+	__m256i f3 = _mm256_add_epi32(e3, _mm256_srai_epi32(e5, 2));
+	__m256i f4 = _mm256_sub_epi32(e2, e4);
+	__m256i f5 = _mm256_sub_epi32(_mm256_srai_epi32(e3, 2), e5);
+	__m256i f6 = _mm256_sub_epi32(e0, e6);
+	__m256i f7 = _mm256_sub_epi32(e7, _mm256_srai_epi32(e1, 2));
+	v[0] = _mm256_add_epi32(f0, f7);
+	v[1] = _mm256_add_epi32(f2, f5);
+	v[2] = _mm256_add_epi32(f4, f3);
+	v[3] = _mm256_add_epi32(f6, f1);
+	v[4] = _mm256_sub_epi32(f6, f1);
+	v[5] = _mm256_sub_epi32(f4, f3);
+	v[6] = _mm256_sub_epi32(f2, f5);
+	v[7] = _mm256_sub_epi32(f0, f7);
+}
+
+__attribute__((target("avx2")))
+static void h264_idct8x8_avx2(int32_t *blk) {
+	const __m256i round = _mm256_set1_epi32(32);
+	__m256i v[8];
+	int i;
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_loadu_si256((const __m256i *)(blk + 8 * i));
+	transpose8_avx2(v);
+	idct8_avx2(v);
+	transpose8_avx2(v);
+	idct8_avx2(v);
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)(blk + 8 * i), _mm256_srai_epi32(_mm256_add_epi32(v[i], round), 6));
+}
+#endif
+
+void h264_idct4x4(int32_t *blk) {
+#ifdef __SSE2__
+	h264_idct4x4_sse2(blk);
+#else
+	h264_idct4x4_c(blk);
+#endif
+}
+
+void h264_idct8x8(int32_t *blk) {
+#ifdef H264_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		h264_idct8x8_avx2(blk);
+		return;
+	}
+#endif
+#ifdef __SSE2__
+	h264_idct8x8_sse2(blk);
+#else
+	h264_idct8x8_c(blk);
+#endif
+}
+
+/* Table 7-2: one level's lists, falling back to fb, or to the defaults if fb is 0 */
+static void pick_lists(const uint32_t **l4, const uint32_t **l8, const uint32_t *present, const uint32_t *use_default, uint32_t (*list4)[16], uint32_t (*list8)[64], const uint32_t **fb4, const uint32_t **fb8) {
+	int i;
+	for (i = 0; i < 6; i++) {
+		if (present[i])
+			l4[i] = use_default[i] ? default_4x4[i >= 3] : list4[i];
+		else if (i == 0 || i == 3)
+			l4[i] = fb4 ? fb4[i] : default_4x4[i >= 3];
+		else
+			l4[i] = l4[i - 1];
+	}
+	for (i = 0; i < 6; i++) {
+		if (present[6 + i])
+			l8[i] = use_default[6 + i] ? default_8x8[i & 1] : list8[i];
+		else if (i < 2)
+			l8[i] = fb8 ? fb8[i] : default_8x8[i & 1];
+		else
+			l8[i] = l8[i - 2];
+	}
+}
+
+/* 8.5.9: LevelScale4x4 and LevelScale8x8 out of the scaling lists in effect */
+static void level_scales(struct recon *r) {
+	struct h264_seqparm *sp = r->slice->seqparm;
+	struct h264_picparm *pp = r->slice->picparm;
+	const uint32_t *s4[6], *s8[6], *l4[6], *l8[6];
+	int i, m, k;
+	if (sp->seq_scaling_matrix_present_flag) {
+		pick_lists(s4, s8, sp->seq_scaling_list_present_flag, sp->use_default_scaling_matrix_flag, sp->seq_scaling_list_4x4, sp->seq_scaling_list_8x8, 0, 0);
+	} else {
+		for (i = 0; i < 6; i++)
+			s4[i] = s8[i] = flat;
+	}
+	if (pp->pic_scaling_matrix_present_flag) {
+		pick_lists(l4, l8, pp->pic_scaling_list_present_flag, pp->use_default_scaling_matrix_flag, pp->pic_scaling_list_4x4, pp->pic_scaling_list_8x8, sp->seq_scaling_matrix_present_flag ? s4 : 0, sp->seq_scaling_matrix_present_flag ? s8 : 0);
+	} else {
+		memcpy(l4, s4, sizeof l4);
+		memcpy(l8, s8, sizeof l8);
+	}
+	for (i = 0; i < 6; i++)
+		for (m = 0; m < 6; m++) {
+			for (k = 0; k < 16; k++) {
+				int x = zigzag4x4[k] & 3, y = zigzag4x4[k] >> 2;
+				int n = !(x & 1) && !(y & 1) ? 0 : (x & 1) && (y & 1) ? 1 : 2;
+				r->ls4[i][m][zigzag4x4[k]] = l4[i][k] * norm4x4[m][n];
+			}
+			for (k = 0; k < 64; k++) {
+				int x = zigzag8x8[k] & 7, y = zigzag8x8[k] >> 3;
+				int n;
+				if (!(x & 3) && !(y & 3))
+					n = 0;
+				else if ((x & 1) && (y & 1))
+					n = 1;
+				else if ((x & 3) == 2 && (y & 3) == 2)
+					n = 2;
+				else if ((!(x & 3) && (y & 1)) || ((x & 1) && !(y & 3)))
+					n = 3;
+				else if ((!(x & 3) && (y & 3) == 2) || ((x & 3) == 2 && !(y & 3)))
+					n = 4;
+				else
+					n = 5;
+				r->ls8[i][m][zigzag8x8[k]] = l8[i][k] * norm8x8[m][n];
+			}
+		}
+}
+
+static uint16_t *mbpix(struct recon *r, int p, int x, int y) {
+	return r->base[p] + (r->mby * r->mbh[p] + y) * r->pitch[p] + r->mbx * r->mbw[p] + x;
+}
+
+static int blk4x4idx(int x, int y) {
+	return 8 * (y >> 3) + 4 * (x >> 3) + 2 * ((y >> 2) & 1) + ((x >> 2) & 1);
+}
+
+/* 6.4.12 for non-MBAFF pictures: the neighbouring macroblock dx, dy away, if already reconstructed in this slice */
+static struct h264_recon_mb *nb_mb(struct recon *r, int dx, int dy) {
+	int x = r->mbx + dx, y = r->mby + dy;
+	struct h264_recon_mb *m;
+	if (x < 0 || x >= r->slice->pic_width_in_mbs || y < 0)
+		return 0;
+	m = &r->mbs[y * r->slice->pic_width_in_mbs + x];
+	return m->slice == r->slicenum ? m : 0;
+}
+
+/* ... and whether its samples can be used for intra prediction */
+static int intra_nb(struct recon *r, int dx, int dy) {
+	struct h264_recon_mb *m = nb_mb(r, dx, dy);
+	return m && !(r->constrained && m->pred == PRED_INTER);
+}
+
+/* whether the sample at x, y, relative to the current 16x16 macroblock, can be used for intra prediction */
+static int sample_avail(struct recon *r, int x, int y) {
+	if (y >= 0 && x >= 16)
+		return 0;
+	if (y >= 0 && x >= 0)
+		return r->done >> blk4x4idx(x, y) & 1;
+	return intra_nb(r, x < 0 ? -1 : x < 16 ? 0 : 1, y < 0 ? -1 : 0);
+}
+
+/*
+ * The neighbouring samples: p[x, -1] for x = -1..tn-1 go to top[0..tn], and
+ * p[-1, y] for y = -1..ln-1 to left[0..ln], so p[-1, -1] is in both.
+ * Anything unavailable is mid-grey, which conforming streams never use.
+ */
+#define T(x) top[1 + (x)]
+#define L(y) left[1 + (y)]
+#define F2(a, b) (((a) + (b) + 1) >> 1)
+#define F3(a, b, c) (((a) + 2 * (b) + (c) + 2) >> 2)
+
+static void load_nb(struct recon *r, int p, int bx, int by, int tn, int tvalid, int ln, int avail, int *top, int *left) {
+	const uint16_t *src = mbpix(r, p, bx, by);
+	int pitch = r->pitch[p];
+	int def = 1 << (r->bd[p] - 1);
+	int i;
+	top[0] = left[0] = avail & AV_CORNER ? src[-pitch - 1] : def;
+	for (i = 0; i < tn; i++) {
+		if (!(avail & AV_TOP))
+			T(i) = def;
+		else if (i < tvalid || avail & AV_TOPRIGHT)
+			T(i) = src[-pitch + i];
+		else
+			T(i) = src[-pitch + tvalid - 1];
+	}
+	for (i = 0; i < ln; i++)
+		L(i) = avail & AV_LEFT ? src[i * pitch - 1] : def;
+}
+
+/* 8.3.2.2.1 */
+static void filter8x8(int *top, int *left, int avail) {
+	int t[16], l[8], c = top[0];
+	int i;
+	if (avail & AV_TOP) {
+		t[0] = avail & AV_CORNER ? F3(top[0], T(0), T(1)) : (3 * T(0) + T(1) + 2) >> 2;
+		for (i = 1; i < 15; i++)
+			t[i] = F3(T(i - 1), T(i), T(i + 1));
+		t[15] = (T(14) + 3 * T(15) + 2) >> 2;
+	}
+	if (avail & AV_CORNER) {
+		if ((avail & (AV_TOP | AV_LEFT)) == (AV_TOP | AV_LEFT))
+			c = F3(T(0), top[0], L(0));
+		else if (avail & AV_TOP)
+			c = (3 * top[0] + T(0) + 2) >> 2;
+		else if (avail & AV_LEFT)
+			c = (3 * top[0] + L(0) + 2) >> 2;
+	}
+	if (avail & AV_LEFT) {
+		l[0] = avail & AV_CORNER ? F3(top[0], L(0), L(1)) : (3 * L(0) + L(1) + 2) >> 2;
+		for (i = 1; i < 7; i++)
+			l[i] = F3(L(i - 1), L(i), L(i + 1));
+		l[7] = (L(6) + 3 * L(7) + 2) >> 2;
+	}
+	if (avail & AV_TOP)
+		memcpy(&T(0), t, sizeof t);
+	if (avail & AV_LEFT)
+		memcpy(&L(0), l, sizeof l);
+	top[0] = left[0] = c;
+}
+
+/* 8.3.1.2 and 8.3.2.2: the nine Intra_4x4 and Intra_8x8 modes, for an n x n block */
+static void pred_nxn(uint16_t *dst, int pitch, int n, int mode, const int *top, const int *left, int avail, int bd) {
+	int log2n = n == 4 ? 2 : 3;
+	int x, y, z, v, dc = 1 << (bd - 1), st = 0, sl = 0;
+	if (mode == 2) {
+		for (x = 0; x < n; x++) {
+			st += T(x);
+			sl += L(x);
+		}
+		if ((avail & (AV_TOP | AV_LEFT)) == (AV_TOP | AV_LEFT))
+			dc = (st + sl + n) >> (log2n + 1);
+		else if (avail & AV_LEFT)
+			dc = (sl + n / 2) >> log2n;
+		else if (avail & AV_TOP)
+			dc = (st + n / 2) >> log2n;
+	}
+	for (y = 0; y < n; y++)
+		for (x = 0; x < n; x++) {
+			switch (mode) {
+				case 0:
+					v = T(x);
+					break;
+				case 1:
+					v = L(y);
+					break;
+				default:
+				case 2:
+					v = dc;
+					break;
+				case 3:
+					if (x == n - 1 && y == n - 1)
+						v = (T(2 * n - 2) + 3 * T(2 * n - 1) + 2) >> 2;
+					else
+						v = F3(T(x + y), T(x + y + 1), T(x + y + 2));
+					break;
+				case 4:
+					if (x > y)
+						v = F3(T(x - y - 2), T(x - y - 1), T(x - y));
+					else if (x < y)
+						v = F3(L(y - x - 2), L(y - x - 1), L(y - x));
+					else
+						v = F3(T(0), T(-1), L(0));
+					break;
+				case 5:
+					z = 2 * x - y;
+					if (z >= 0 && !(z & 1))
+						v = F2(T(x - (y >> 1) - 1), T(x - (y >> 1)));
+					else if (z >= 0)
+						v = F3(T(x - (y >> 1) - 2), T(x - (y >> 1) - 1), T(x - (y >> 1)));
+					else if (z == -1)
+						v = F3(L(0), L(-1), T(0));
+					else
+						v = F3(L(y - 2 * x - 1), L(y - 2 * x - 2), L(y - 2 * x - 3));
+					break;
+				case 6:
+					z = 2 * y - x;
+					if (z >= 0 && !(z & 1))
+						v = F2(L(y - (x >> 1) - 1), L(y - (x >> 1)));
+					else if (z >= 0)
+						v = F3(L(y - (x >> 1) - 2), L(y - (x >> 1) - 1), L(y - (x >> 1)));
+					else if (z == -1)
+						v = F3(L(0), L(-1), T(0));
+					else
+						v = F3(T(x - 2 * y - 1), T(x - 2 * y - 2), T(x - 2 * y - 3));
+					break;
+				case 7:
+					if (!(y & 1))
+						v = F2(T(x + (y >> 1)), T(x + (y >> 1) + 1));
+					else
+						v = F3(T(x + (y >> 1)), T(x + (y >> 1) + 1), T(x + (y >> 1) + 2));
+					break;
+				case 8:
+					z = x + 2 * y;
+					if (z < 2 * n - 3 && !(z & 1))
+						v = F2(L(y + (x >> 1)), L(y + (x >> 1) + 1));
+					else if (z < 2 * n - 3)
+						v = F3(L(y + (x >> 1)), L(y + (x >> 1) + 1), L(y + (x >> 1) + 2));
+					else if (z == 2 * n - 3)
+						v = (L(n - 2) + 3 * L(n - 1) + 2) >> 2;
+					else
+						v = L(n - 1);
+					break;
+			}
+			dst[y * pitch + x] = v;
+		}
+}
+
+/* 8.3.1.2 and 8.3.2.2: predicts the n x n block at bx, by of plane p */
+static void pred_block(struct recon *r, int p, int bx, int by, int n, int mode) {
+	int top[17], left[9];
+	int avail = 0;
+	if (sample_avail(r, bx - 1, by - 1))
+		avail |= AV_CORNER;
+	if (sample_avail(r, bx, by - 1))
+		avail |= AV_TOP;
+	if (sample_avail(r, bx + n, by - 1))
+		avail |= AV_TOPRIGHT;
+	if (sample_avail(r, bx - 1, by))
+		avail |= AV_LEFT;
+	load_nb(r, p, bx, by, 2 * n, n, n, avail, top, left);
+	if (n == 8)
+		filter8x8(top, left, avail);
+	pred_nxn(mbpix(r, p, bx, by), r->pitch[p], n, mode, top, left, avail, r->bd[p]);
+}
+
+static int mb_avail(struct recon *r) {
+	int avail = 0;
+	if (intra_nb(r, -1, -1))
+		avail |= AV_CORNER;
+	if (intra_nb(r, 0, -1))
+		avail |= AV_TOP;
+	if (intra_nb(r, -1, 0))
+		avail |= AV_LEFT;
+	return avail;
+}
+
+/* 8.3.3 */
+static void pred16x16(struct recon *r, int p, int mode) {
+	uint16_t *dst = mbpix(r, p, 0, 0);
+	int pitch = r->pitch[p], max = (1 << r->bd[p]) - 1;
+	int top[17], left[17];
+	int avail = mb_avail(r);
+	int x, y, v = 1 << (r->bd[p] - 1), st = 0, sl = 0;
+	load_nb(r, p, 0, 0, 16, 16, 16, avail, top, left);
+	if (mode == 2) {
+		for (x = 0; x < 16; x++) {
+			st += T(x);
+			sl += L(x);
+		}
+		if ((avail & (AV_TOP | AV_LEFT)) == (AV_TOP | AV_LEFT))
+			v = (st + sl + 16) >> 5;
+		else if (avail & AV_LEFT)
+			v = (sl + 8) >> 4;
+		else if (avail & AV_TOP)
+			v = (st + 8) >> 4;
+	}
+	if (mode == 3) {
+		int h = 0, vv = 0, a, b, c;
+		for (x = 0; x < 8; x++) {
+			h += (x + 1) * (T(8 + x) - T(6 - x));
+			vv += (x + 1) * (L(8 + x) - L(6 - x));
+		}
+		a = 16 * (L(15) + T(15));
+		b = (5 * h + 32) >> 6;
+		c = (5 * vv + 32) >> 6;
+		for (y = 0; y < 16; y++)
+			for (x = 0; x < 16; x++)
+				dst[y * pitch + x] = clip((a + b * (x - 7) + c * (y - 7) + 16) >> 5, max);
+		return;
+	}
+	for (y = 0; y < 16; y++)
+		for (x = 0; x < 16; x++)
+			dst[y * pitch + x] = mode == 0 ? T(x) : mode == 1 ? L(y) : v;
+}
+
+/* 8.3.4, for 4:2:0 and 4:2:2 */
+static void pred_chroma(struct recon *r, int p, int mode) {
+	uint16_t *dst = mbpix(r, p, 0, 0);
+	int pitch = r->pitch[p], max = (1 << r->bd[p]) - 1;
+	int w = r->mbw[p], h = r->mbh[p];
+	int top[17], left[17];
+	int avail = mb_avail(r);
+	int x, y, i;
+	load_nb(r, p, 0, 0, w, w, h, avail, top, left);
+	if (mode == 0) {
+		for (i = 0; i < w * h / 16; i++) {
+			int xo = (i & 1) * 4, yo = (i >> 1) * 4;
+			int st = 0, sl = 0, v = 1 << (r->bd[p] - 1);
+			int t = avail & AV_TOP, l = avail & AV_LEFT;
+			for (x = 0; x < 4; x++) {
+				st += T(xo + x);
+				sl += L(yo + x);
+			}
+			if (xo == yo || (xo && yo)) {
+				if (t && l)
+					v = (st + sl + 4) >> 3;
+				else if (l)
+					v = (sl + 2) >> 2;
+				else if (t)
+					v = (st + 2) >> 2;
+			} else if (xo) {
+				if (t)
+					v = (st + 2) >> 2;
+				else if (l)
+					v = (sl + 2) >> 2;
+			} else {
+				if (l)
+					v = (sl + 2) >> 2;
+				else if (t)
+					v = (st + 2) >> 2;
+			}
+			for (y = 0; y < 4; y++)
+				for (x = 0; x < 4; x++)
+					dst[(yo + y) * pitch + xo + x] = v;
+		}
+		return;
+	}
+	if (mode == 3) {
+		int ycf = h == 16 ? 4 : 0;
+		int hh = 0, vv = 0, a, b, c;
+		for (x = 0; x < 4; x++)
+			hh += (x + 1) * (T(4 + x) - T(2 - x));
+		for (y = 0; y < 4 + ycf; y++)
+			vv += (y + 1) * (L(4 + ycf + y) - L(2 + ycf - y));
+		a = 16 * (L(h - 1) + T(w - 1));
+		b = (34 * hh + 32) >> 6;
+		c = ((34 - 29 * (h == 16)) * vv + 32) >> 6;
+		for (y = 0; y < h; y++)
+			for (x = 0; x < w; x++)
+				dst[y * pitch + x] = clip((a + b * (x - 3) + c * (y - 3 - ycf) + 16) >> 5, max);
+		return;
+	}
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			dst[y * pitch + x] = mode == 1 ? L(y) : T(x);
+}
+
+#undef T
+#undef L
+#undef F2
+#undef F3
+
+/* 8.3.1.1 and 8.3.2.1: Intra4x4PredMode (n 4) or Intra8x8PredMode (n 8) of the block at bx, by */
+static int pred_mode(struct recon *r, int bx, int by, int n, uint32_t prev_flag, uint32_t rem) {
+	int modes[2], k, pred;
+	for (k = 0; k < 2; k++) {
+		int x = k ? bx : bx - 1, y = k ? by - 1 : by;
+		struct h264_recon_mb *m = nb_mb(r, x < 0 ? -1 : 0, y < 0 ? -1 : 0);
+		int blk = blk4x4idx(x & 15, y & 15);
+		if (!m || (m->pred == PRED_INTER && r->constrained))
+			break;
+		if (m->pred == PRED_4X4 && n == 8)
+			modes[k] = m->modes[(blk & ~3) | (k ? 2 : 1)];
+		else if (m->pred == PRED_4X4 || m->pred == PRED_8X8)
+			modes[k] = m->modes[blk];
+		else
+			modes[k] = 2;
+	}
+	if (k < 2)
+		pred = 2;
+	else
+		pred = modes[0] < modes[1] ? modes[0] : modes[1];
+	if (prev_flag)
+		return pred;
+	return rem < pred ? rem : rem + 1;
+}
+
+/* 8.5.15: the transform bypass DPCM for vertical (hor 0) and horizontal (hor 1) prediction */
+static void bypass_dpcm(int32_t *res, int pitch, int w, int h, int hor) {
+	int x, y;
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++) {
+			if (hor && x)
+				res[y * pitch + x] += res[y * pitch + x - 1];
+			else if (!hor && y)
+				res[y * pitch + x] += res[(y - 1) * pitch + x];
+		}
+}
+
+static void add_res(uint16_t *dst, int pitch, const int32_t *res, int rpitch, int w, int h, int bd) {
+	int max = (1 << bd) - 1;
+	int x, y;
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			dst[y * pitch + x] = clip(dst[y * pitch + x] + res[y * rpitch + x], max);
+}
+
+static void fill(uint16_t *dst, int pitch, int w, int h, int v) {
+	int x, y;
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			dst[y * pitch + x] = v;
+}
+
+/*
+ * 8.5.12: scaling and transform of a 4x4 block given in coefficient order,
+ * into res.  With hasdc, list[0] is ignored and dc is the already scaled DC.
+ */
+static void residual4x4(struct recon *r, int32_t *res, int pitch, const int32_t *list, int li, int qp, int hasdc, int32_t dc) {
+	const uint8_t *scan = r->field_scan ? field4x4 : zigzag4x4;
+	const int32_t *ls = r->ls4[li][qp % 6];
+	int32_t d[16] = { 0 };
+	int i, nz = hasdc && dc;
+	for (i = hasdc; i < 16; i++) {
+		if (!list[i])
+			continue;
+		nz = 1;
+		if (r->bypass)
+			d[scan[i]] = clamp_coeff(list[i]);
+		else if (qp >= 24)
+			d[scan[i]] = clamp_coeff((int64_t)list[i] * ls[scan[i]] << (qp / 6 - 4));
+		else
+			d[scan[i]] = clamp_coeff(((int64_t)list[i] * ls[scan[i]] + (1 << (3 - qp / 6))) >> (4 - qp / 6));
+	}
+	if (hasdc)
+		d[0] = dc;
+	if (nz && !r->bypass)
+		h264_idct4x4(d);
+	for (i = 0; i < 4; i++)
+		memcpy(res + i * pitch, d + 4 * i, sizeof *d * 4);
+}
+
+/* 8.5.13 */
+static void residual8x8(struct recon *r, int32_t *res, int pitch, const int32_t *list, int li, int qp) {
+	const uint8_t *scan = r->field_scan ? field8x8 : zigzag8x8;
+	const int32_t *ls = r->ls8[li][qp % 6];
+	int32_t d[64] = { 0 };
+	int i, nz = 0;
+	for (i = 0; i < 64; i++) {
+		if (!list[i])
+			continue;
+		nz = 1;
+		if (r->bypass)
+			d[scan[i]] = clamp_coeff(list[i]);
+		else if (qp >= 36)
+			d[scan[i]] = clamp_coeff((int64_t)list[i] * ls[scan[i]] << (qp / 6 - 6));
+		else
+			d[scan[i]] = clamp_coeff(((int64_t)list[i] * ls[scan[i]] + (1 << (5 - qp / 6))) >> (6 - qp / 6));
+	}
+	if (nz && !r->bypass)
+		h264_idct8x8(d);
+	for (i = 0; i < 8; i++)
+		memcpy(res + i * pitch, d + 8 * i, sizeof *d * 8);
+}
+
+static void hadamard4(int64_t *v, int s) {
+	int64_t a = v[0], b = v[s], c = v[2 * s], d = v[3 * s];
+	v[0] = a + b + c + d;
+	v[s] = a + b - c - d;
+	v[2 * s] = a - b - c + d;
+	v[3 * s] = a - b + c - d;
+}
+
+/* 8.5.10: the Intra_16x16 DC of one plane, into dc by 4x4 block position in raster order */
+static void luma_dc(struct recon *r, const int32_t *list, int li, int qp, int32_t *dc) {
+	const uint8_t *scan = r->field_scan ? field4x4 : zigzag4x4;
+	int32_t ls = r->ls4[li][qp % 6][0];
+	int64_t f[16];
+	int i;
+	for (i = 0; i < 16; i++)
+		f[scan[i]] = list[i];
+	if (!r->bypass) {
+		for (i = 0; i < 4; i++)
+			hadamard4(f + i, 4);
+		for (i = 0; i < 4; i++)
+			hadamard4(f + 4 * i, 1);
+	}
+	for (i = 0; i < 16; i++) {
+		if (r->bypass)
+			dc[i] = clamp_coeff(f[i]);
+		else if (qp >= 36)
+			dc[i] = clamp_coeff(f[i] * ls << (qp / 6 - 6));
+		else
+			dc[i] = clamp_coeff((f[i] * ls + (1 << (5 - qp / 6))) >> (6 - qp / 6));
+	}
+}
+
+/* 8.5.11: the chroma DC of one component, into dc by 4x4 block in raster order */
+static void chroma_dc(struct recon *r, const int32_t *list, int li, int qp, int32_t *dc) {
+	int n = r->slice->chroma_array_type == 2 ? 8 : 4;
+	int64_t f[8];
+	int i;
+	for (i = 0; i < n; i++)
+		f[n == 8 ? chroma_dc_422[i] : i] = list[i];
+	if (r->bypass) {
+		for (i = 0; i < n; i++)
+			dc[i] = clamp_coeff(f[i]);
+		return;
+	}
+	if (n == 8) {
+		/* qP,DC is qP + 3 */
+		int32_t ls = r->ls4[li][(qp + 3) % 6][0];
+		int sh = (qp + 3) / 6;
+		hadamard4(f, 2);
+		hadamard4(f + 1, 2);
+		for (i = 0; i < 8; i += 2) {
+			int64_t a = f[i], b = f[i + 1];
+			f[i] = a + b;
+			f[i + 1] = a - b;
+		}
+		for (i = 0; i < 8; i++) {
+			if (sh >= 6)
+				dc[i] = clamp_coeff(f[i] * ls << (sh - 6));
+			else
+				dc[i] = clamp_coeff((f[i] * ls + (1 << (5 - sh))) >> (6 - sh));
+		}
+	} else {
+		int32_t ls = r->ls4[li][qp % 6][0];
+		int64_t c[4] = {
+			f[0] + f[1] + f[2] + f[3],
+			f[0] - f[1] + f[2] - f[3],
+			f[0] + f[1] - f[2] - f[3],
+			f[0] - f[1] - f[2] + f[3],
+		};
+		for (i = 0; i < 4; i++)
+			dc[i] = clamp_coeff((c[i] * ls << (qp / 6)) >> 5);
+	}
+}
+
+/* one plane coded with the luma process: comp is 0 for luma, 1 and 2 for 4:4:4 Cb and Cr */
+static void luma_plane(struct recon *r, struct h264_macroblock *mb, int p, int comp) {
+	struct h264_slice *slice = r->slice;
+	struct h264_recon_mb *cur = r->cur;
+	int inter = cur->pred == PRED_INTER;
+	int qp = r->qp[comp];
+	int li4 = (inter ? 3 : 0) + comp, li8 = comp * 2 + inter;
+	int32_t list[64], res[256];
+	int i, j;
+	r->done = 0;
+	if (cur->pred == PRED_4X4 || cur->pred == PRED_8X8) {
+		int n = cur->pred == PRED_8X8 ? 8 : 4;
+		for (i = 0; i < 256 / (n * n); i++) {
+			int bx, by, mode;
+			if (n == 8) {
+				bx = (i & 1) * 8;
+				by = (i >> 1) * 8;
+			} else {
+				bx = 8 * (i >> 2 & 1) + 4 * (i & 1);
+				by = 8 * (i >> 3) + 4 * (i >> 1 & 1);
+			}
+			if (!comp) {
+				if (n == 8) {
+					mode = pred_mode(r, bx, by, 8, mb->prev_intra8x8_pred_mode_flag[i], mb->rem_intra8x8_pred_mode[i]);
+					for (j = 0; j < 4; j++)
+						cur->modes[4 * i + j] = mode;
+				} else {
+					cur->modes[i] = pred_mode(r, bx, by, 4, mb->prev_intra4x4_pred_mode_flag[i], mb->rem_intra4x4_pred_mode[i]);
+				}
+			}
+			mode = cur->modes[n == 8 ? 4 * i : i];
+			pred_block(r, p, bx, by, n, mode);
+			if (mb->coded_block_pattern >> (n == 8 ? i : i >> 2) & 1) {
+				h264_mb_get_block(slice, mb, n == 8 ? H264_COEFF_LUMA_8X8 : H264_COEFF_LUMA_4X4, comp, i, list);
+				if (n == 8)
+					residual8x8(r, res, 8, list, li8, qp);
+				else
+					residual4x4(r, res, 4, list, li4, qp, 0, 0);
+				if (r->bypass && mode < 2)
+					bypass_dpcm(res, n, n, n, mode);
+				add_res(mbpix(r, p, bx, by), r->pitch[p], res, n, n, n, r->bd[p]);
+			}
+			r->done |= (n == 8 ? 0xf : 1) << (n == 8 ? 4 * i : i);
+		}
+		return;
+	}
+	memset(res, 0, sizeof res);
+	if (cur->pred == PRED_INTER) {
+		fill(mbpix(r, p, 0, 0), r->pitch[p], 16, 16, 1 << (r->bd[p] - 1));
+		if (mb->transform_size_8x8_flag) {
+			for (i = 0; i < 4; i++)
+				if (mb->coded_block_pattern >> i & 1) {
+					h264_mb_get_block(slice, mb, H264_COEFF_LUMA_8X8, comp, i, list);
+					residual8x8(r, res + (i >> 1) * 128 + (i & 1) * 8, 16, list, li8, qp);
+				}
+		} else {
+			for (i = 0; i < 16; i++)
+				if (mb->coded_block_pattern >> (i >> 2) & 1) {
+					int bx = 8 * (i >> 2 & 1) + 4 * (i & 1), by = 8 * (i >> 3) + 4 * (i >> 1 & 1);
+					h264_mb_get_block(slice, mb, H264_COEFF_LUMA_4X4, comp, i, list);
+					residual4x4(r, res + by * 16 + bx, 16, list, li4, qp, 0, 0);
+				}
+		}
+	} else {
+		int mode = (mb->mb_type - H264_MB_TYPE_I_16X16_0_0_0) % 4;
+		int32_t dc[16];
+		pred16x16(r, p, mode);
+		h264_mb_get_block(slice, mb, H264_COEFF_LUMA_DC, comp, 0, list);
+		luma_dc(r, list, li4, qp, dc);
+		for (i = 0; i < 16; i++) {
+			int bx = 8 * (i >> 2 & 1) + 4 * (i & 1), by = 8 * (i >> 3) + 4 * (i >> 1 & 1);
+			list[0] = 0;
+			if (mb->coded_block_pattern & 0xf)
+				h264_mb_get_block(slice, mb, H264_COEFF_LUMA_AC, comp, i, list + 1);
+			else
+				memset(list + 1, 0, 15 * sizeof *list);
+			residual4x4(r, res + by * 16 + bx, 16, list, li4, qp, 1, dc[by + bx / 4]);
+		}
+		if (r->bypass && mode < 2)
+			bypass_dpcm(res, 16, 16, 16, mode);
+	}
+	add_res(mbpix(r, p, 0, 0), r->pitch[p], res, 16, 16, 16, r->bd[p]);
+}
+
+/* Cb and Cr for 4:2:0 and 4:2:2 */
+static void chroma(struct recon *r, struct h264_macroblock *mb) {
+	struct h264_slice *slice = r->slice;
+	int inter = r->cur->pred == PRED_INTER;
+	int w = r->mbw[1], h = r->mbh[1];
+	int mode = mb->intra_chroma_pred_mode;
+	int32_t list[16], dc[8], res[128];
+	int i, j;
+	for (i = 0; i < 2; i++) {
+		int p = 1 + i, qp = r->qp[p], li = (inter ? 4 : 1) + i;
+		if (inter)
+			fill(mbpix(r, p, 0, 0), r->pitch[p], w, h, 1 << (r->bd[p] - 1));
+		else
+			pred_chroma(r, p, mode);
+		if (!(mb->coded_block_pattern & 0x30))
+			continue;
+		h264_mb_get_block(slice, mb, H264_COEFF_CHROMA_DC, i, 0, list);
+		chroma_dc(r, list, li, qp, dc);
+		for (j = 0; j < w * h / 16; j++) {
+			list[0] = 0;
+			if (mb->coded_block_pattern & 0x20)
+				h264_mb_get_block(slice, mb, H264_COEFF_CHROMA_AC, i, j, list + 1);
+			else
+				memset(list + 1, 0, 15 * sizeof *list);
+			residual4x4(r, res + (j >> 1) * 4 * w + (j & 1) * 4, w, list, li, qp, 1, dc[j]);
+		}
+		if (r->bypass && !inter && (mode == 1 || mode == 2))
+			bypass_dpcm(res, w, w, h, mode == 1);
+		add_res(mbpix(r, p, 0, 0), r->pitch[p], res, w, w, h, r->bd[p]);
+	}
+}
+
+static void pcm(struct recon *r, struct h264_macroblock *mb) {
+	int32_t samples[512];
+	int i, j, x, y;
+	h264_mb_get_block(r->slice, mb, H264_COEFF_PCM_LUMA, 0, 0, samples);
+	for (y = 0; y < 16; y++)
+		for (x = 0; x < 16; x++)
+			mbpix(r, r->lplanes[0], x, y)[0] = clip(samples[y * 16 + x], (1 << r->bd[r->lplanes[0]]) - 1);
+	if (!r->slice->chroma_array_type)
+		return;
+	h264_mb_get_block(r->slice, mb, H264_COEFF_PCM_CHROMA, 0, 0, samples);
+	for (i = 0, j = 0; i < 2; i++)
+		for (y = 0; y < r->mbh[1 + i]; y++)
+			for (x = 0; x < r->mbw[1 + i]; x++)
+				mbpix(r, 1 + i, x, y)[0] = clip(samples[j++], (1 << r->bd[1 + i]) - 1);
+}
+
+static void recon_mb(struct recon *r, struct h264_macroblock *mb) {
+	struct h264_slice *slice = r->slice;
+	struct h264_recon_mb *cur = r->cur;
+	int offy = 6 * slice->bit_depth_luma_minus8;
+	int offc = 6 * slice->bit_depth_chroma_minus8;
+	int i;
+	cur->slice = r->slicenum;
+	if (mb->mb_type == H264_MB_TYPE_I_PCM) {
+		cur->pred = PRED_INTRA;
+		pcm(r, mb);
+		return;
+	}
+	if (mb->mb_type == H264_MB_TYPE_I_NXN)
+		cur->pred = mb->transform_size_8x8_flag ? PRED_8X8 : PRED_4X4;
+	else if (h264_is_intra_16x16_mb_type(mb->mb_type))
+		cur->pred = PRED_INTRA;
+	else
+		cur->pred = PRED_INTER;
+	/* 7.4.5 and 8.5.8, kept in range even if mb_qp_delta isn't */
+	if (h264_is_intra_16x16_mb_type(mb->mb_type) || (mb->coded_block_pattern && !h264_is_skip_mb_type(mb->mb_type))) {
+		int qp = (r->qpy + mb->mb_qp_delta + 52 + 2 * offy) % (52 + offy);
+		r->qpy = (qp < 0 ? qp + 52 + offy : qp) - offy;
+	}
+	r->qp[0] = r->qpy + offy;
+	for (i = 0; i < 2; i++) {
+		int qpi = r->qpy + (i ? slice->picparm->second_chroma_qp_index_offset : slice->picparm->chroma_qp_index_offset);
+		qpi = qpi < -offc ? -offc : qpi > 51 ? 51 : qpi;
+		r->qp[1 + i] = (qpi < 30 ? qpi : chroma_qp[qpi - 30]) + offc;
+	}
+	r->bypass = r->bypass_allowed && !r->qp[0];
+	if (mb->mb_type == H264_MB_TYPE_SI || h264_is_skip_mb_type(mb->mb_type)) {
+		for (i = 0; i < 3; i++)
+			if (r->mbw[i])
+				fill(mbpix(r, i, 0, 0), r->pitch[i], r->mbw[i], r->mbh[i], 1 << (r->bd[i] - 1));
+		cur->pred = PRED_INTER;
+		return;
+	}
+	for (i = 0; i < r->nlplanes; i++)
+		luma_plane(r, mb, r->lplanes[i], i);
+	if (slice->chroma_array_type == 1 || slice->chroma_array_type == 2)
+		chroma(r, mb);
+}
+
+int h264_recon_slice(struct h264_picture *pic, struct h264_slice *slice) {
+	struct h264_seqparm *sp = slice->seqparm;
+	struct recon *r;
+	uint32_t addr;
+	int i, separate = sp->separate_colour_plane_flag;
+	if (slice->mbaff_frame_flag) {
+		fprintf(stderr, "MBAFF reconstruction not supported\n");
+		return 1;
+	}
+	if (!pic->planes[0] || pic->width[0] != slice->pic_width_in_mbs * 16
+			|| pic->height[0] != slice->pic_height_in_mbs * 16 << slice->field_pic_flag
+			|| pic->mbsnum < slice->pic_size_in_mbs * (separate ? 3 : 1)) {
+		fprintf(stderr, "Slice doesn't fit the picture being reconstructed\n");
+		return 1;
+	}
+	addr = slice->first_mb_in_slice;
+	if (addr > slice->last_mb_in_slice || slice->last_mb_in_slice >= slice->pic_size_in_mbs)
+		return 0;
+	r = calloc(sizeof *r, 1);
+	r->pic = pic;
+	r->slice = slice;
+	r->slicenum = pic->slices++;
+	r->mbs = pic->mbs + (separate ? slice->colour_plane_id * slice->pic_size_in_mbs : 0);
+	r->field_scan = slice->field_pic_flag;
+	r->constrained = slice->picparm->constrained_intra_pred_flag;
+	r->bypass_allowed = sp->qpprime_y_zero_transform_bypass_flag;
+	level_scales(r);
+	for (i = 0; i < 3; i++) {
+		r->base[i] = pic->planes[i] + (slice->bottom_field_flag ? pic->width[i] : 0);
+		r->pitch[i] = pic->width[i] << slice->field_pic_flag;
+	}
+	if (separate) {
+		r->lplanes[0] = slice->colour_plane_id;
+		r->nlplanes = 1;
+		r->mbw[r->lplanes[0]] = r->mbh[r->lplanes[0]] = 16;
+		r->bd[r->lplanes[0]] = slice->bit_depth_luma_minus8 + 8;
+	} else {
+		r->nlplanes = slice->chroma_array_type == 3 ? 3 : 1;
+		for (i = 0; i < r->nlplanes; i++)
+			r->lplanes[i] = i;
+		r->mbw[0] = r->mbh[0] = 16;
+		r->bd[0] = slice->bit_depth_luma_minus8 + 8;
+		for (i = 1; i < 3 && slice->chroma_array_type; i++) {
+			r->mbw[i] = slice->chroma_array_type == 3 ? 16 : 8;
+			r->mbh[i] = slice->chroma_array_type == 1 ? 8 : 16;
+			r->bd[i] = slice->bit_depth_chroma_minus8 + 8;
+		}
+	}
+	r->qpy = slice->sliceqpy;
+	if (r->qpy < -6 * (int)slice->bit_depth_luma_minus8)
+		r->qpy = -6 * slice->bit_depth_luma_minus8;
+	if (r->qpy > 51)
+		r->qpy = 51;
+	while (1) {
+		r->mbx = addr % slice->pic_width_in_mbs;
+		r->mby = addr / slice->pic_width_in_mbs;
+		r->cur = &r->mbs[addr];
+		recon_mb(r, &slice->mbs[addr]);
+		if (addr == slice->last_mb_in_slice)
+			break;
+		addr = h264_next_mb_addr(slice, addr);
+		if (addr >= slice->pic_size_in_mbs)
+			break;
+	}
+	free(r);
+	return 0;
+}
+
+int h264_picture_start(struct h264_picture *pic, const struct h264_slice *slice, FILE *out) {
+	const struct h264_seqparm *sp = slice->seqparm;
+	int structure = slice->field_pic_flag ? 1 + slice->bottom_field_flag : 0;
+	int width = slice->pic_width_in_mbs * 16;
+	int height = slice->pic_height_in_mbs * 16 << slice->field_pic_flag;
+	uint32_t num = slice->pic_size_in_mbs * (sp->separate_colour_plane_flag ? 3 : 1);
+	uint32_t i;
+	int p;
+	if (pic->planes[0] && (pic->chroma_format_idc != sp->chroma_format_idc
+			|| pic->bit_depth_luma != slice->bit_depth_luma_minus8 + 8
+			|| pic->bit_depth_chroma != slice->bit_depth_chroma_minus8 + 8
+			|| pic->width[0] != width || pic->height[0] != height)) {
+		if (h264_picture_write(pic, out))
+			return 1;
+		for (p = 0; p < 3; p++) {
+			free(pic->planes[p]);
+			pic->planes[p] = 0;
+		}
+	} else if (pic->fields & (structure ? structure : 3)) {
+		if (h264_picture_write(pic, out))
+			return 1;
+	}
+	if (!pic->planes[0]) {
+		pic->chroma_format_idc = sp->chroma_format_idc;
+		pic->bit_depth_luma = slice->bit_depth_luma_minus8 + 8;
+		pic->bit_depth_chroma = slice->bit_depth_chroma_minus8 + 8;
+		/* monochrome comes out as 4:2:0 with grey chroma */
+		for (p = 0; p < 3; p++) {
+			int bd = p ? pic->bit_depth_chroma : pic->bit_depth_luma;
+			pic->width[p] = p && pic->chroma_format_idc != 3 ? width / 2 : width;
+			pic->height[p] = p && pic->chroma_format_idc < 2 ? height / 2 : height;
+			pic->planes[p] = malloc(pic->width[p] * pic->height[p] * sizeof *pic->planes[p]);
+			for (i = 0; i < pic->width[p] * pic->height[p]; i++)
+				pic->planes[p][i] = 1 << (bd - 1);
+		}
+	}
+	if (num > pic->mbsmax) {
+		pic->mbsmax = num;
+		pic->mbs = realloc(pic->mbs, num * sizeof *pic->mbs);
+	}
+	pic->mbsnum = num;
+	for (i = 0; i < num; i++)
+		pic->mbs[i].slice = -1;
+	pic->fields |= structure ? structure : 3;
+	pic->slices = 0;
+	return 0;
+}
+
+int h264_picture_write(struct h264_picture *pic, FILE *out) {
+	int wide = pic->bit_depth_luma > 8 || pic->bit_depth_chroma > 8;
+	uint8_t *line;
+	int p, x, y;
+	if (!pic->fields)
+		return 0;
+	pic->fields = 0;
+	line = malloc(pic->width[0] * 2);
+	for (p = 0; p < 3; p++)
+		for (y = 0; y < pic->height[p]; y++) {
+			const uint16_t *src = pic->planes[p] + y * pic->width[p];
+			for (x = 0; x < pic->width[p]; x++) {
+				if (wide) {
+					line[2 * x] = src[x];
+					line[2 * x + 1] = src[x] >> 8;
+				} else {
+					line[x] = src[x];
+				}
+			}
+			if (fwrite(line, pic->width[p] << wide, 1, out) != 1) {
+				fprintf(stderr, "Failed to write reconstructed picture\n");
+				free(line);
+				return 1;
+			}
+		}
+	free(line);
+	return 0;
+}
+
+void h264_picture_free(struct h264_picture *pic) {
+	int p;
+	for (p = 0; p < 3; p++)
+		free(pic->planes[p]);
+	free(pic->mbs);
+	memset(pic, 0, sizeof *pic);
+}
@@ -27,6 +27,7 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 int h264_residual_cavlc(struct bitstream *str, struct h264_slice *slice, int32_t *block, int *num, int cat, int idx, int start, int end, int maxnumcoeff) {
@@ -64,6 +65,7 @@ int h264_residual_cavlc(struct bitstream *str, struct h264_slice *slice, int32_t
 		if (trailing_ones > 3)
 			trailing_ones = 3;
 	}
+	h264_stats_se(str, 0, slice, H264_STATS_COEFF_TOKEN);
 	if (h264_coeff_token(str, slice, cat, idx, &trailing_ones, &total_coeff)) return 1;
 	if (num)
 		*num = total_coeff;
@@ -74,6 +76,7 @@ int h264_residual_cavlc(struct bitstream *str, struct h264_slice *slice, int32_t
 		else
 			suffixLength = 0;
 		for (i = 0; i < total_coeff; i++) {
+			h264_stats_se(str, 0, slice, H264_STATS_COEFF_LEVEL);
 			if (i < trailing_ones) {
 				uint32_t s = tb[i] < 0;
 				if (vs_u(str, &s, 1)) return 1;
@@ -94,12 +97,14 @@ int h264_residual_cavlc(struct bitstream *str, struct h264_slice *slice, int32_t
 			mode = 0;
 		}
 		if (total_coeff < end - start + 1) {
+			h264_stats_se(str, 0, slice, H264_STATS_TOTAL_ZEROS);
 			if (h264_total_zeros(str, mode, total_coeff, &total_zeros)) return 1;
 		} else {
 			if (vs_infer(str, &total_zeros, 0)) return 1;
 		}
 		int zerosLeft = total_zeros;
 		for (i = 0; i < total_coeff - 1; i++) {
+			h264_stats_se(str, 0, slice, H264_STATS_RUN_BEFORE);
 			if (h264_run_before(str, zerosLeft, &run[i])) return 1;
 			zerosLeft -= run[i];
 			if (zerosLeft < 0) {
@@ -128,6 +133,7 @@ int h264_residual_cabac(struct bitstream *str, struct h264_cabac_context *cabac,
 			coded_block_flag = 1;
 	if (coded) {
 		if (maxnumcoeff != 64 || slice->chroma_array_type == 3) {
+			h264_stats_se(str, cabac, slice, H264_STATS_CODED_BLOCK_FLAG);
 			if (h264_coded_block_flag(str, cabac, cat, idx, &coded_block_flag)) return 1;
 		} else {
 			if (vs_infer(str, &coded_block_flag, 1)) return 1;
@@ -208,6 +214,7 @@ int h264_residual_cabac(struct bitstream *str, struct h264_cabac_context *cabac,
 		}
 		int numcoeff = end + 1;
 		for (i = start; i < numcoeff - 1; i++) {
+			h264_stats_se(str, cabac, slice, H264_STATS_SIGNIFICANCE_MAP);
 			if (h264_significant_coeff_flag(str, cabac, field, cat, i, 0, &significant_coeff_flag[i])) return 1;
 			if (significant_coeff_flag[i]) {
 				if (h264_significant_coeff_flag(str, cabac, field, cat, i, 1, &last_significant_coeff_flag[i])) return 1;
@@ -226,6 +233,7 @@ int h264_residual_cabac(struct bitstream *str, struct h264_cabac_context *cabac,
 			if (significant_coeff_flag[i]) {
 				int32_t cam1 = abs(block[i]) - 1;
 				uint32_t s = block[i] < 0;
+				h264_stats_se(str, cabac, slice, H264_STATS_COEFF_LEVEL);
 				if (h264_coeff_abs_level_minus1(str, cabac, cat, num1, numgt1, &cam1)) return 1;
 				if (h264_cabac_bypass(str, cabac, &s)) return 1;
 				if (cam1)
@@ -251,7 +259,7 @@ int h264_residual_cabac(struct bitstream *str, struct h264_cabac_context *cabac,
 	return 0;
 }
 
-int h264_residual_block(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, int32_t *block, int *num, int cat, int idx, int start, int end, int maxnumcoeff, int coded) {
+static int residual_block(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, int32_t *block, int *num, int cat, int idx, int start, int end, int maxnumcoeff, int coded) {
 	if (!cabac) {
 		if (!coded) {
 			int i;
@@ -276,6 +284,36 @@ int h264_residual_block(struct bitstream *str, struct h264_cabac_context *cabac,
 	}
 }
 
+int h264_residual_block(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, int32_t *block, int *num, int cat, int idx, int start, int end, int maxnumcoeff, int coded) {
+	int i, n = 0;
+	if (residual_block(str, cabac, slice, mb, block, num, cat, idx, start, end, maxnumcoeff, coded))
+		return 1;
+	if (slice->stats && coded) {
+		for (i = 0; i < maxnumcoeff; i++)
+			n += block[i] != 0;
+		slice->stats->total_coeff[n]++;
+	}
+	return 0;
+}
+
+/* on encode, fetches the block to be written; on decode, starts from an empty one */
+static void load_block(struct bitstream *str, struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, int32_t *block) {
+	if (str->dir == VS_ENCODE)
+		h264_mb_get_block(slice, mb, kind, comp, idx, block);
+	else
+		memset(block, 0, h264_coeff_block_size(kind) * sizeof *block);
+}
+
+static int residual_stored_block(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int blkidx, int *num, int cat, int idx, int start, int end, int maxnumcoeff, int coded) {
+	int32_t block[64];
+	load_block(str, slice, mb, kind, comp, blkidx, block);
+	int res = h264_residual_block(str, cabac, slice, mb, block, num, cat, idx, start, end, maxnumcoeff, coded);
+	/* a partially decoded block is kept for printing */
+	if (str->dir == VS_DECODE)
+		h264_mb_add_block(slice, mb, kind, comp, blkidx, block);
+	return res;
+}
+
 int h264_residual_luma(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb, int start, int end, int which) {
 	static const int cattab[3][4] = {
 		{ H264_CTXBLOCKCAT_LUMA_DC, H264_CTXBLOCKCAT_LUMA_AC, H264_CTXBLOCKCAT_LUMA_4X4, H264_CTXBLOCKCAT_LUMA_8X8 }, 
@@ -283,7 +321,7 @@ int h264_residual_luma(struct bitstream *str, struct h264_cabac_context *cabac,
 		{ H264_CTXBLOCKCAT_CR_DC, H264_CTXBLOCKCAT_CR_AC, H264_CTXBLOCKCAT_CR_4X4, H264_CTXBLOCKCAT_CR_8X8 }, 
 	};
 	if (start == 0 && h264_is_intra_16x16_mb_type(mb->mb_type)) {
-		if (h264_residual_block(str, cabac, slice, mb, mb->block_luma_dc[which], 0, cattab[which][0], 0, 0, 15, 16, 1)) return 1;
+		if (residual_stored_block(str, cabac, slice, mb, H264_COEFF_LUMA_DC, which, 0, 0, cattab[which][0], 0, 0, 15, 16, 1)) return 1;
 	} else {
 		mb->coded_block_flag[which][16] = 0;
 	}
@@ -292,37 +330,40 @@ int h264_residual_luma(struct bitstream *str, struct h264_cabac_context *cabac,
 	int ss = (h264_is_intra_16x16_mb_type(mb->mb_type) ? (start?start-1:0) : start);
 	int se = (h264_is_intra_16x16_mb_type(mb->mb_type) ? end - 1 : end);
 	if (!mb->transform_size_8x8_flag || !cabac) {
+		int32_t block8x8[64];
 		for (i = 0; i < 16; i++) {
 			int32_t tmp[16];
-			int cat;
+			int cat, kind;
 			if (mb->transform_size_8x8_flag) {
+				/* CAVLC codes 8x8 blocks as 4 interleaved 4x4 blocks */
+				if (!(i & 3))
+					load_block(str, slice, mb, H264_COEFF_LUMA_8X8, which, i >> 2, block8x8);
 				for (j = 0; j < 16; j++)
-					tmp[j] = mb->block_luma_8x8[which][i >> 2][4 * j + (i & 3)];
+					tmp[j] = block8x8[4 * j + (i & 3)];
+				kind = H264_COEFF_LUMA_8X8;
 				cat = cattab[which][3];
-			} else if (h264_is_intra_16x16_mb_type(mb->mb_type)) {
-				for (j = 0; j < 15; j++)
-					tmp[j] = mb->block_luma_ac[which][i][j];
-				cat = cattab[which][1];
 			} else {
-				for (j = 0; j < 16; j++)
-					tmp[j] = mb->block_luma_4x4[which][i][j];
-				cat = cattab[which][2];
+				kind = (h264_is_intra_16x16_mb_type(mb->mb_type) ? H264_COEFF_LUMA_AC : H264_COEFF_LUMA_4X4);
+				load_block(str, slice, mb, kind, which, i, tmp);
+				cat = cattab[which][kind == H264_COEFF_LUMA_AC ? 1 : 2];
 			}
-			if (h264_residual_block(str, cabac, slice, mb, tmp, &mb->total_coeff[which][i], cat, i, ss, se, n, mb->coded_block_pattern >> (i >> 2) & 1)) return 1;
-			if (mb->transform_size_8x8_flag) {
-				for (j = 0; j < 16; j++)
-					mb->block_luma_8x8[which][i >> 2][4 * j + (i & 3)] = tmp[j];
-			} else if (h264_is_intra_16x16_mb_type(mb->mb_type)) {
-				for (j = 0; j < 15; j++)
-					mb->block_luma_ac[which][i][j] = tmp[j];
-			} else {
+			if (h264_residual_block(str, cabac, slice, mb, tmp, &mb->total_coeff[which][i], cat, i, ss, se, n, mb->coded_block_pattern >> (i >> 2) & 1)) {
+				if (kind == H264_COEFF_LUMA_8X8 && str->dir == VS_DECODE)
+					h264_mb_add_block(slice, mb, kind, which, i >> 2, block8x8);
+				return 1;
+			}
+			if (kind == H264_COEFF_LUMA_8X8) {
 				for (j = 0; j < 16; j++)
-					mb->block_luma_4x4[which][i][j] = tmp[j];
+					block8x8[4 * j + (i & 3)] = tmp[j];
+				if ((i & 3) == 3 && str->dir == VS_DECODE)
+					h264_mb_add_block(slice, mb, kind, which, i >> 2, block8x8);
+			} else if (str->dir == VS_DECODE) {
+				h264_mb_add_block(slice, mb, kind, which, i, tmp);
 			}
 		}
 	} else {
 		for (i = 0; i < 4; i++) {
-			if (h264_residual_block(str, cabac, slice, mb, mb->block_luma_8x8[which][i], 0, cattab[which][3], i, 4*start, 4*end + 3, 64, mb->coded_block_pattern >> i & 1)) return 1;
+			if (residual_stored_block(str, cabac, slice, mb, H264_COEFF_LUMA_8X8, which, i, 0, cattab[which][3], i, 4*start, 4*end + 3, 64, mb->coded_block_pattern >> i & 1)) return 1;
 		}
 	}
 	return 0;
@@ -333,11 +374,11 @@ int h264_residual(struct bitstream *str, struct h264_cabac_context *cabac, struc
 	if (slice->chroma_array_type == 1 || slice->chroma_array_type == 2) {
 		int i, j;
 		for (i = 0; i < 2; i++) {
-			if (h264_residual_block(str, cabac, slice, mb, mb->block_chroma_dc[i], 0, H264_CTXBLOCKCAT_CHROMA_DC, i, 0, 4 * slice->chroma_array_type - 1, 4 * slice->chroma_array_type, (mb->coded_block_pattern & 0x30) && start == 0)) return 1;
+			if (residual_stored_block(str, cabac, slice, mb, H264_COEFF_CHROMA_DC, i, 0, 0, H264_CTXBLOCKCAT_CHROMA_DC, i, 0, 4 * slice->chroma_array_type - 1, 4 * slice->chroma_array_type, (mb->coded_block_pattern & 0x30) && start == 0)) return 1;
 		}
 		for (i = 0; i < 2; i++) {
 			for (j = 0; j < 4 * slice->chroma_array_type; j++) {
-				if (h264_residual_block(str, cabac, slice, mb, mb->block_chroma_ac[i][j], &mb->total_coeff[i+1][j], H264_CTXBLOCKCAT_CHROMA_AC, i * 8 + j, (start?start-1:0), end-1, 15, mb->coded_block_pattern & 0x20)) return 1;
+				if (residual_stored_block(str, cabac, slice, mb, H264_COEFF_CHROMA_AC, i, j, &mb->total_coeff[i+1][j], H264_CTXBLOCKCAT_CHROMA_AC, i * 8 + j, (start?start-1:0), end-1, 15, mb->coded_block_pattern & 0x20)) return 1;
 			}
 		}
 	} else if (slice->chroma_array_type == 3) {
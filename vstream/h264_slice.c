@@ -27,6 +27,7 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int h264_mb_slice_group(struct h264_slice *slice, uint32_t mbaddr) {
 	if (mbaddr >= slice->pic_size_in_mbs)
@@ -61,6 +62,106 @@ uint32_t h264_next_mb_addr(struct h264_slice *slice, uint32_t mbaddr) {
 	return mbaddr;
 }
 
+/*
+ * Coefficient storage: each macroblock owns the range coeffs_start..coeffs_end
+ * of slice->coeffs, holding a header word for each stored block (kind, comp,
+ * idx, and count of nonzero entries), followed by (position, value) pairs.
+ * While decoding, macroblocks are filled in order and each one's range just
+ * grows at the end of the arena.  Writing to any other macroblock first moves
+ * its blocks to the end; the old copy stays unused until the arena is reset
+ * by the next h264_slice_data decode.
+ */
+
+static const int coeff_block_size[] = {
+	[H264_COEFF_LUMA_DC] = 16,
+	[H264_COEFF_LUMA_AC] = 15,
+	[H264_COEFF_LUMA_4X4] = 16,
+	[H264_COEFF_LUMA_8X8] = 64,
+	[H264_COEFF_CHROMA_DC] = 8,
+	[H264_COEFF_CHROMA_AC] = 15,
+	[H264_COEFF_PCM_LUMA] = 256,
+	[H264_COEFF_PCM_CHROMA] = 512,
+};
+
+#define COEFF_HDR(kind, comp, idx) ((kind) << 24 | (comp) << 20 | (idx) << 12)
+#define COEFF_HDR_NUM 0xfff
+
+int h264_coeff_block_size(enum h264_coeff_block kind) {
+	return coeff_block_size[kind];
+}
+
+void h264_mb_get_block(const struct h264_slice *slice, const struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, int32_t *block) {
+	int32_t hdr = COEFF_HDR(kind, comp, idx);
+	int i, j;
+	memset(block, 0, coeff_block_size[kind] * sizeof *block);
+	for (i = mb->coeffs_start; i < mb->coeffs_end; i += 1 + 2 * (slice->coeffs[i] & COEFF_HDR_NUM)) {
+		if ((slice->coeffs[i] & ~COEFF_HDR_NUM) == hdr) {
+			const int32_t *pairs = &slice->coeffs[i + 1];
+			for (j = 0; j < (slice->coeffs[i] & COEFF_HDR_NUM); j++)
+				block[pairs[2 * j]] = pairs[2 * j + 1];
+			return;
+		}
+	}
+}
+
+static void coeffs_reserve(struct h264_slice *slice, int num) {
+	if (slice->coeffsnum + num <= slice->coeffsmax)
+		return;
+	if (!slice->coeffsmax)
+		slice->coeffsmax = 0x1000;
+	while (slice->coeffsnum + num > slice->coeffsmax)
+		slice->coeffsmax *= 2;
+	slice->coeffs = realloc(slice->coeffs, slice->coeffsmax * sizeof *slice->coeffs);
+}
+
+/* makes mb's blocks the last ones in the arena, so they can grow in place */
+static void coeffs_move_to_end(struct h264_slice *slice, struct h264_macroblock *mb) {
+	int len = mb->coeffs_end - mb->coeffs_start;
+	if (mb->coeffs_end == slice->coeffsnum)
+		return;
+	coeffs_reserve(slice, len);
+	memcpy(&slice->coeffs[slice->coeffsnum], &slice->coeffs[mb->coeffs_start], len * sizeof *slice->coeffs);
+	mb->coeffs_start = slice->coeffsnum;
+	slice->coeffsnum += len;
+	mb->coeffs_end = slice->coeffsnum;
+}
+
+void h264_mb_add_block(struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, const int32_t *block) {
+	int size = coeff_block_size[kind];
+	int i, n = 0;
+	coeffs_move_to_end(slice, mb);
+	coeffs_reserve(slice, 1 + 2 * size);
+	int32_t *dst = &slice->coeffs[slice->coeffsnum];
+	for (i = 0; i < size; i++) {
+		if (block[i]) {
+			dst[1 + 2 * n] = i;
+			dst[2 + 2 * n] = block[i];
+			n++;
+		}
+	}
+	if (!n)
+		return;
+	dst[0] = COEFF_HDR(kind, comp, idx) | n;
+	slice->coeffsnum += 1 + 2 * n;
+	mb->coeffs_end = slice->coeffsnum;
+}
+
+void h264_mb_set_block(struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int comp, int idx, const int32_t *block) {
+	int32_t hdr = COEFF_HDR(kind, comp, idx);
+	int i;
+	coeffs_move_to_end(slice, mb);
+	for (i = mb->coeffs_start; i < mb->coeffs_end; i += 1 + 2 * (slice->coeffs[i] & COEFF_HDR_NUM)) {
+		if ((slice->coeffs[i] & ~COEFF_HDR_NUM) == hdr) {
+			int len = 1 + 2 * (slice->coeffs[i] & COEFF_HDR_NUM);
+			memmove(&slice->coeffs[i], &slice->coeffs[i + len], (mb->coeffs_end - i - len) * sizeof *slice->coeffs);
+			slice->coeffsnum -= len;
+			mb->coeffs_end -= len;
+			break;
+		}
+	}
+	h264_mb_add_block(slice, mb, kind, comp, idx, block);
+}
+
 static const struct h264_macroblock mb_unavail_intra = {
 	/* filled with "default" values assumed by prediction for unavailable mbs, to avoid special cases */
 	.mb_type = H264_MB_TYPE_UNAVAIL,
@@ -365,12 +466,14 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 		if (!h264_is_intra_16x16_mb_type(mb->mb_type)) {
 			if (!mb->transform_size_8x8_flag) {
 				for (i = 0; i < 16; i++) {
+					h264_stats_se(str, cabac, slice, H264_STATS_INTRA_PRED_MODE);
 					if (h264_prev_intra_pred_mode_flag(str, cabac, &mb->prev_intra4x4_pred_mode_flag[i])) return 1;
 					if (!mb->prev_intra4x4_pred_mode_flag[i])
 						if (h264_rem_intra_pred_mode(str, cabac, &mb->rem_intra4x4_pred_mode[i])) return 1;
 				}
 			} else {
 				for (i = 0; i < 4; i++) {
+					h264_stats_se(str, cabac, slice, H264_STATS_INTRA_PRED_MODE);
 					if (h264_prev_intra_pred_mode_flag(str, cabac, &mb->prev_intra8x8_pred_mode_flag[i])) return 1;
 					if (!mb->prev_intra8x8_pred_mode_flag[i])
 						if (h264_rem_intra_pred_mode(str, cabac, &mb->rem_intra8x8_pred_mode[i])) return 1;
@@ -378,6 +481,7 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 			}
 		}
 		if (slice->chroma_array_type == 1 || slice->chroma_array_type == 2) {
+			h264_stats_se(str, cabac, slice, H264_STATS_INTRA_CHROMA_PRED_MODE);
 			if (h264_intra_chroma_pred_mode(str, cabac, &mb->intra_chroma_pred_mode)) return 1;
 		} else {
 			if (vs_infer(str, &mb->intra_chroma_pred_mode, 0)) return 1;
@@ -413,6 +517,7 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 		for (i = 0; i < 4; i++) {
 			if (ifrom[i] == -1) {
 				if (pmode[i] & 1) {
+					h264_stats_se(str, cabac, slice, H264_STATS_REF_IDX);
 					if (h264_ref_idx(str, cabac, i, 0, max, &mb->ref_idx[0][i])) return 1;
 				} else {
 					if (vs_infer(str, &mb->ref_idx[0][i], 0)) return 1;
@@ -427,6 +532,7 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 		for (i = 0; i < 4; i++) {
 			if (ifrom[i] == -1) {
 				if (pmode[i] & 2) {
+					h264_stats_se(str, cabac, slice, H264_STATS_REF_IDX);
 					if (h264_ref_idx(str, cabac, i, 1, max, &mb->ref_idx[1][i])) return 1;
 				} else {
 					if (vs_infer(str, &mb->ref_idx[1][i], 0)) return 1;
@@ -438,6 +544,7 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 		for (i = 0; i < 4; i++) {
 			if (ifrom[i] == -1) {
 				if (pmode[i] & 1) {
+					h264_stats_se(str, cabac, slice, H264_STATS_MVD);
 					if (h264_mvd(str, cabac, i * 4, 0, 0, &mb->mvd[0][i*4][0])) return 1;
 					if (h264_mvd(str, cabac, i * 4, 1, 0, &mb->mvd[0][i*4][1])) return 1;
 				} else {
@@ -456,6 +563,7 @@ int h264_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, struct
 		for (i = 0; i < 4; i++) {
 			if (ifrom[i] == -1) {
 				if (pmode[i] & 2) {
+					h264_stats_se(str, cabac, slice, H264_STATS_MVD);
 					if (h264_mvd(str, cabac, i * 4, 0, 1, &mb->mvd[1][i*4][0])) return 1;
 					if (h264_mvd(str, cabac, i * 4, 1, 1, &mb->mvd[1][i*4][1])) return 1;
 				} else {
@@ -485,6 +593,7 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 	int pmode[4];
 	int ifrom[16];
 	for (i = 0; i < 4; i++) {
+		h264_stats_se(str, cabac, slice, H264_STATS_SUB_MB_TYPE);
 		if (h264_sub_mb_type(str, cabac, slice->slice_type, &mb->sub_mb_type[i])) return 1;
 		pmode[i] = sub_mb_part_info[mb->sub_mb_type[i]][1];
 		int sm = sub_mb_part_info[mb->sub_mb_type[i]][0];
@@ -517,6 +626,7 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 		max *= 2, max++;
 	for (i = 0; i < 4; i++) {
 		if (pmode[i] & 1 && mb->mb_type != H264_MB_TYPE_P_8X8REF0) {
+			h264_stats_se(str, cabac, slice, H264_STATS_REF_IDX);
 			if (h264_ref_idx(str, cabac, i, 0, max, &mb->ref_idx[0][i])) return 1;
 		} else {
 			if (vs_infer(str, &mb->ref_idx[0][i], 0)) return 1;
@@ -527,6 +637,7 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 		max *= 2, max++;
 	for (i = 0; i < 4; i++) {
 		if (pmode[i] & 2) {
+			h264_stats_se(str, cabac, slice, H264_STATS_REF_IDX);
 			if (h264_ref_idx(str, cabac, i, 1, max, &mb->ref_idx[1][i])) return 1;
 		} else {
 			if (vs_infer(str, &mb->ref_idx[1][i], 0)) return 1;
@@ -535,6 +646,7 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 	for (i = 0; i < 16; i++) {
 		if (ifrom[i] == -1) {
 			if (pmode[i/4] & 1) {
+				h264_stats_se(str, cabac, slice, H264_STATS_MVD);
 				if (h264_mvd(str, cabac, i, 0, 0, &mb->mvd[0][i][0])) return 1;
 				if (h264_mvd(str, cabac, i, 1, 0, &mb->mvd[0][i][1])) return 1;
 			} else {
@@ -549,6 +661,7 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 	for (i = 0; i < 16; i++) {
 		if (ifrom[i] == -1) {
 			if (pmode[i/4] & 2) {
+				h264_stats_se(str, cabac, slice, H264_STATS_MVD);
 				if (h264_mvd(str, cabac, i, 0, 1, &mb->mvd[1][i][0])) return 1;
 				if (h264_mvd(str, cabac, i, 1, 1, &mb->mvd[1][i][1])) return 1;
 			} else {
@@ -564,19 +677,38 @@ int h264_sub_mb_pred(struct bitstream *str, struct h264_cabac_context *cabac, st
 	return 0;
 }
 
+static int pcm_samples(struct bitstream *str, struct h264_slice *slice, struct h264_macroblock *mb, enum h264_coeff_block kind, int num, int bits) {
+	int32_t samples[512];
+	int i, res = 0;
+	h264_mb_get_block(slice, mb, kind, 0, 0, samples);
+	for (i = 0; i < num && !res; i++) {
+		uint32_t tmp = samples[i];
+		res = vs_u(str, &tmp, bits);
+		samples[i] = tmp;
+	}
+	/* keep what was read even on failure, for printing */
+	if (str->dir == VS_DECODE)
+		h264_mb_add_block(slice, mb, kind, 0, 0, samples);
+	return res;
+}
+
 int h264_macroblock_layer(struct bitstream *str, struct h264_cabac_context *cabac, struct h264_slice *slice, struct h264_macroblock *mb) {
 	struct h264_picparm *picparm = slice->picparm;
 	struct h264_seqparm *seqparm = slice->seqparm;
+	h264_stats_se(str, cabac, slice, H264_STATS_MB_TYPE);
 	if (h264_mb_type(str, cabac, slice->slice_type, &mb->mb_type)) return 1;
 	if (mb->mb_type == H264_MB_TYPE_I_PCM) {
+		int64_t pcmpos = vs_tell(str);
+		h264_stats_se(str, cabac, slice, H264_STATS_PCM_SAMPLES);
 		if (vs_align_byte(str, VS_ALIGN_0)) return 1;
-		int i;
-		for (i = 0; i < 256; i++)
-			if (vs_u(str, &mb->pcm_sample_luma[i], slice->bit_depth_luma_minus8 + 8)) return 1;
+		if (pcm_samples(str, slice, mb, H264_COEFF_PCM_LUMA, 256, slice->bit_depth_luma_minus8 + 8)) return 1;
 		if (slice->chroma_array_type) {
-			for (i = 0; i < (64 << slice->chroma_array_type); i++)
-				if (vs_u(str, &mb->pcm_sample_chroma[i], slice->bit_depth_chroma_minus8 + 8)) return 1;
+			if (pcm_samples(str, slice, mb, H264_COEFF_PCM_CHROMA, 64 << slice->chroma_array_type, slice->bit_depth_chroma_minus8 + 8)) return 1;
 		}
+		int i;
+		/* these go around the arithmetic decoder, so cost it nothing */
+		if (cabac && slice->stats)
+			slice->stats->se_bits[H264_STATS_PCM_SAMPLES] += (uint64_t)(vs_tell(str) - pcmpos) << 16;
 		if (cabac)
 			if (h264_cabac_init_arith(str, cabac)) return 1;
 		if (vs_infers(str, &mb->mb_qp_delta, 0)) return 1;
@@ -613,6 +745,7 @@ int h264_macroblock_layer(struct bitstream *str, struct h264_cabac_context *caba
 		} else {
 			if (mb->mb_type == H264_MB_TYPE_I_NXN || mb->mb_type == H264_MB_TYPE_SI) {
 				if (picparm->transform_8x8_mode_flag) {
+					h264_stats_se(str, cabac, slice, H264_STATS_TRANSFORM_SIZE_8X8_FLAG);
 					if (h264_transform_size_8x8_flag(str, cabac, &mb->transform_size_8x8_flag)) return 1;
 				} else {
 					if (vs_infer(str, &mb->transform_size_8x8_flag, 0)) return 1;
@@ -622,9 +755,11 @@ int h264_macroblock_layer(struct bitstream *str, struct h264_cabac_context *caba
 		}
 		if (mb->mb_type == H264_MB_TYPE_I_NXN || mb->mb_type == H264_MB_TYPE_SI || mb->mb_type >= H264_MB_TYPE_I_END) {
 			int has_chroma = slice->chroma_array_type < 3 && slice->chroma_array_type != 0;
+			h264_stats_se(str, cabac, slice, H264_STATS_CODED_BLOCK_PATTERN);
 			if (h264_coded_block_pattern(str, cabac, mb->mb_type, has_chroma, &mb->coded_block_pattern)) return 1;
 			if (mb->mb_type >= H264_MB_TYPE_I_END) {
 				if ((mb->coded_block_pattern & 0xf) && picparm->transform_8x8_mode_flag && noSubMbPartSizeLessThan8x8Flag && (mb->mb_type != H264_MB_TYPE_B_DIRECT_16X16 || seqparm->direct_8x8_inference_flag)) {
+					h264_stats_se(str, cabac, slice, H264_STATS_TRANSFORM_SIZE_8X8_FLAG);
 					if (h264_transform_size_8x8_flag(str, cabac, &mb->transform_size_8x8_flag)) return 1;
 				} else {
 					if (vs_infer(str, &mb->transform_size_8x8_flag, 0)) return 1;
@@ -638,6 +773,7 @@ int h264_macroblock_layer(struct bitstream *str, struct h264_cabac_context *caba
 			if (vs_infer(str, &mb->transform_size_8x8_flag, 0)) return 1;
 		}
 		if (mb->coded_block_pattern || h264_is_intra_16x16_mb_type(mb->mb_type)) {
+			h264_stats_se(str, cabac, slice, H264_STATS_MB_QP_DELTA);
 			if (h264_mb_qp_delta(str, cabac, &mb->mb_qp_delta)) return 1;
 		} else {
 			if (vs_infers(str, &mb->mb_qp_delta, 0)) return 1;
@@ -698,18 +834,33 @@ static int infer_skip(struct bitstream *str, struct h264_slice *slice, struct h2
 	return 0;
 }
 
+/* the macroblock array and coefficient arena may hold data of an earlier slice */
+static void clear_mb(struct bitstream *str, struct h264_slice *slice) {
+	if (str->dir == VS_DECODE)
+		memset(&slice->mbs[slice->curr_mb_addr], 0, sizeof *slice->mbs);
+}
+
 int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 	slice->prev_mb_addr = -1;
 	slice->curr_mb_addr = slice->first_mb_in_slice * (1 + slice->mbaff_frame_flag);
-	if (str->dir == VS_DECODE)
+	if (str->dir == VS_DECODE) {
 		slice->last_mb_in_slice = slice->curr_mb_addr;
+		slice->coeffsnum = 0;
+	}
+	if (slice->stats)
+		slice->stats->cur_se = H264_STATS_SE_NUM;
 	uint32_t skip_type = (slice->slice_type == H264_SLICE_TYPE_B ? H264_MB_TYPE_B_SKIP : H264_MB_TYPE_P_SKIP);
 	if (slice->picparm->entropy_coding_mode_flag) {
+		if (slice->curr_mb_addr >= slice->pic_size_in_mbs) {
+			fprintf(stderr, "MB index out of range!\n");
+			return 1;
+		}
 		if (vs_align_byte(str, VS_ALIGN_1)) return 1;
 		struct h264_cabac_context *cabac = h264_cabac_new(slice);
 		if (h264_cabac_init_arith(str, cabac)) { h264_cabac_destroy(cabac); return 1; }
 		while (1) {
 			uint32_t mb_skip_flag = 0;
+			clear_mb(str, slice);
 			if (slice->slice_type != H264_SLICE_TYPE_I && slice->slice_type != H264_SLICE_TYPE_SI) {
 				if (str->dir == VS_ENCODE) {
 					mb_skip_flag = slice->mbs[slice->curr_mb_addr].mb_type == skip_type;
@@ -725,6 +876,7 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 					ival = inferred_mb_field_decoding_flag(slice);
 				}
 				slice->mbs[slice->curr_mb_addr].mb_field_decoding_flag = ival;
+				h264_stats_se(str, cabac, slice, H264_STATS_MB_SKIP);
 				if (h264_mb_skip_flag(str, cabac, &mb_skip_flag)) { h264_cabac_destroy(cabac); return 1; }
 				slice->mbs[slice->curr_mb_addr].mb_field_decoding_flag = save;
 			}
@@ -734,9 +886,11 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 				if (slice->mbaff_frame_flag) {
 					uint32_t first_addr = slice->curr_mb_addr & ~1;
 					if (slice->curr_mb_addr == first_addr) {
+						h264_stats_se(str, cabac, slice, H264_STATS_MB_FIELD_DECODING_FLAG);
 						if (h264_mb_field_decoding_flag(str, cabac, &slice->mbs[first_addr].mb_field_decoding_flag)) { h264_cabac_destroy(cabac); return 1; }
 					} else {
 						if (slice->mbs[first_addr].mb_type == skip_type) {
+							h264_stats_se(str, cabac, slice, H264_STATS_MB_FIELD_DECODING_FLAG);
 							if (h264_mb_field_decoding_flag(str, cabac, &slice->mbs[first_addr].mb_field_decoding_flag)) { h264_cabac_destroy(cabac); return 1; }
 						}
 						if (vs_infer(str, &slice->mbs[first_addr + 1].mb_field_decoding_flag, slice->mbs[first_addr].mb_field_decoding_flag)) { h264_cabac_destroy(cabac); return 1; }
@@ -748,9 +902,11 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 			}
 			if (!slice->mbaff_frame_flag || (slice->curr_mb_addr & 1)) {
 				uint32_t end_of_slice_flag = slice->last_mb_in_slice == slice->curr_mb_addr;
+				h264_stats_se(str, cabac, slice, H264_STATS_END_OF_SLICE_FLAG);
 				if (h264_cabac_terminate(str, cabac, &end_of_slice_flag)) { h264_cabac_destroy(cabac); return 1; }
 				if (end_of_slice_flag) {
 					slice->last_mb_in_slice = slice->curr_mb_addr;
+					h264_stats_se(str, cabac, slice, H264_STATS_SE_NUM);
 					h264_cabac_destroy(cabac);
 					/* XXX: cabac_zero_word crap */
 					return vs_align_byte(str, VS_ALIGN_0);
@@ -782,10 +938,12 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 						slice->prev_mb_addr = slice->curr_mb_addr;
 						slice->curr_mb_addr = h264_next_mb_addr(slice, slice->curr_mb_addr);
 					}
+					h264_stats_se(str, 0, slice, H264_STATS_MB_SKIP);
 					if (vs_ue(str, &mb_skip_run)) return 1;
 					if (end)
 						goto out_cavlc;
 				} else {
+					h264_stats_se(str, 0, slice, H264_STATS_MB_SKIP);
 					if (vs_ue(str, &mb_skip_run)) return 1;
 					while (mb_skip_run--) {
 						if (slice->curr_mb_addr >= slice->pic_size_in_mbs) {
@@ -793,6 +951,7 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 							return 1;
 						}
 						slice->last_mb_in_slice = slice->curr_mb_addr;
+						clear_mb(str, slice);
 						slice->mbs[slice->curr_mb_addr].mb_type = skip_type;
 						if (infer_skip(str, slice, &slice->mbs[slice->curr_mb_addr])) return 1;
 						slice->prev_mb_addr = slice->curr_mb_addr;
@@ -810,13 +969,17 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 				fprintf(stderr, "MB index out of range!\n");
 				return 1;
 			}
+			clear_mb(str, slice);
 			if (slice->mbaff_frame_flag) {
 				uint32_t first_addr = slice->curr_mb_addr & ~1;
 				if (slice->curr_mb_addr == first_addr) {
+					h264_stats_se(str, 0, slice, H264_STATS_MB_FIELD_DECODING_FLAG);
 					if (h264_mb_field_decoding_flag(str, 0, &slice->mbs[first_addr].mb_field_decoding_flag)) return 1;
 				} else {
-					if (slice->mbs[first_addr].mb_type == skip_type)
+					if (slice->mbs[first_addr].mb_type == skip_type) {
+						h264_stats_se(str, 0, slice, H264_STATS_MB_FIELD_DECODING_FLAG);
 						if (h264_mb_field_decoding_flag(str, 0, &slice->mbs[first_addr].mb_field_decoding_flag)) return 1;
+					}
 					if (vs_infer(str, &slice->mbs[first_addr + 1].mb_field_decoding_flag, slice->mbs[first_addr].mb_field_decoding_flag)) return 1;
 				}
 			} else {
@@ -844,6 +1007,7 @@ int h264_slice_data(struct bitstream *str, struct h264_slice *slice) {
 			}
 		}
 out_cavlc:
+		h264_stats_se(str, 0, slice, H264_STATS_SE_NUM);
 		if (vs_end(str)) return 1;
 		return 0;
 	}
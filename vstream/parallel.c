@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "vstream.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Runs the steps of a decoder main loop on a few threads.
+ *
+ * All start codes are found up front.  As long as the next unit is one that
+ * parallel() allows, the main thread doesn't wait for the unit before it:
+ * it assumes the step will leave off at the next start code, applies
+ * predict() to its copy of ctx, and hands out a job starting there with
+ * a bitstream of its own and output going to a buffer.  Jobs are retired in
+ * stream order: a job is only accepted if the step before it really left
+ * off at its start code, which is not the case when that step hit an error
+ * and vs_search_start skipped some start codes, or when the step wandered
+ * past one.  Otherwise all jobs in flight are thrown away and decoding goes
+ * on from the last accepted step.  The same happens to the jobs after one
+ * that left ctx other than predict() guessed.  Any other unit waits for all
+ * jobs in flight and then runs on the main thread, so ctx is exactly what
+ * the serial loop would have had.
+ */
+
+struct vs_job {
+	int start;	/* the start code the job was started at */
+	int done;
+	int res;	/* what step returned */
+	struct bitstream *str;
+	char *buf;
+	size_t bufsize;
+	void *ctx;	/* ctx before the step, then after it */
+	void *guess;	/* ctx after the step, as predict had it */
+};
+
+struct vs_pool {
+	const struct vs_step_ops *ops;
+	struct bitstream *str;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* ring of jobs, indexed by sequence numbers modulo jobsmax */
+	struct vs_job *jobs;
+	int jobsmax;
+	int retired, taken, queued;
+	int quit;
+};
+
+static int start_index(const int *starts, int num, int pos) {
+	int lo = 0, hi = num;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (starts[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < num && starts[lo] == pos ? lo : -1;
+}
+
+static void free_str(struct bitstream *str) {
+	/* the bytes belong to the caller's bitstream */
+	str->bytes = 0;
+	vs_destroy(str);
+}
+
+static void *step_worker(void *arg) {
+	struct vs_pool *pool = arg;
+	const struct vs_step_ops *ops = pool->ops;
+	void *scratch = calloc(ops->scratchsize + 1, 1);
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (!pool->quit && pool->taken == pool->queued)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->taken == pool->queued)
+			break;
+		struct vs_job *job = &pool->jobs[pool->taken++ % pool->jobsmax];
+		pthread_mutex_unlock(&pool->lock);
+		FILE *out = open_memstream(&job->buf, &job->bufsize);
+		job->str = vs_new_decode(pool->str->type, pool->str->bytes, pool->str->bytesnum);
+		job->str->bytepos = job->start;
+		job->res = ops->step(job->str, job->ctx, scratch, out);
+		fclose(out);
+		pthread_mutex_lock(&pool->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (ops->scratch_fini)
+		ops->scratch_fini(scratch);
+	free(scratch);
+	return 0;
+}
+
+static struct vs_job *wait_oldest(struct vs_pool *pool) {
+	struct vs_job *job = &pool->jobs[pool->retired % pool->jobsmax];
+	pthread_mutex_lock(&pool->lock);
+	while (!job->done)
+		pthread_cond_wait(&pool->cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	pool->retired++;
+	return job;
+}
+
+static void drop_job(struct vs_job *job, int keep_str) {
+	if (!keep_str)
+		free_str(job->str);
+	free(job->buf);
+	job->buf = 0;
+	job->done = 0;
+}
+
+static void drop_all(struct vs_pool *pool) {
+	while (pool->retired != pool->queued)
+		drop_job(wait_oldest(pool), 0);
+}
+
+int vs_run_steps(struct bitstream *str, const struct vs_step_ops *ops, void *ctx, int jobs, FILE *out) {
+	void *scratch = calloc(ops->scratchsize + 1, 1);
+	int res = 0;
+	if (jobs <= 1 || str->dir != VS_DECODE || str->type == VS_H261 || str->type == VS_H263) {
+		while (!res)
+			res = vs_refill(str) ? -1 : ops->step(str, ctx, scratch, out);
+	} else if (vs_read_all(str)) {
+		/* the start codes are all found up front, so it's all read in first */
+		res = -1;
+	} else {
+		struct vs_pool pool = { ops, str };
+		pthread_t threads[jobs];
+		int started[jobs];
+		int startsnum;
+		int *starts = vs_find_starts(str->bytes, str->bytesnum, &startsnum);
+		/* the bitstream and ctx as the last step run or accepted left them */
+		struct bitstream *cur = str;
+		void *cur_ctx = malloc(ops->ctxsize);
+		int i, k = -1, nstarted = 0;
+		pool.jobsmax = 4 * jobs;
+		pool.jobs = calloc(sizeof *pool.jobs, pool.jobsmax);
+		for (i = 0; i < pool.jobsmax; i++) {
+			pool.jobs[i].ctx = malloc(ops->ctxsize);
+			pool.jobs[i].guess = malloc(ops->ctxsize);
+		}
+		pthread_mutex_init(&pool.lock, 0);
+		pthread_cond_init(&pool.cond, 0);
+		for (i = 0; i < jobs; i++)
+			nstarted += started[i] = !pthread_create(&threads[i], 0, step_worker, &pool);
+		memcpy(cur_ctx, ctx, ops->ctxsize);
+		while (!res) {
+			if (pool.retired == pool.queued) {
+				int pos = vs_next_start(cur);
+				k = pos == -1 ? -1 : start_index(starts, startsnum, pos);
+			}
+			if (nstarted && k != -1 && k < startsnum && pool.queued - pool.retired < pool.jobsmax
+					&& ops->parallel(ctx, str->bytes[starts[k] + 3])) {
+				struct vs_job *job = &pool.jobs[pool.queued % pool.jobsmax];
+				uint32_t start_code = str->bytes[starts[k] + 3];
+				job->start = starts[k++];
+				memcpy(job->ctx, ctx, ops->ctxsize);
+				if (ops->predict)
+					ops->predict(ctx, start_code);
+				memcpy(job->guess, ctx, ops->ctxsize);
+				pthread_mutex_lock(&pool.lock);
+				pool.queued++;
+				pthread_cond_signal(&pool.cond);
+				pthread_mutex_unlock(&pool.lock);
+			} else if (pool.retired != pool.queued) {
+				struct vs_job *job = wait_oldest(&pool);
+				if (vs_next_start(cur) != job->start) {
+					/* the guess was wrong, go back to cur */
+					drop_job(job, 0);
+					drop_all(&pool);
+					memcpy(ctx, cur_ctx, ops->ctxsize);
+					continue;
+				}
+				fwrite(job->buf, 1, job->bufsize, out);
+				if (cur != str)
+					free_str(cur);
+				cur = job->str;
+				memcpy(cur_ctx, job->ctx, ops->ctxsize);
+				res = job->res;
+				drop_job(job, 1);
+				if (res || memcmp(job->ctx, job->guess, ops->ctxsize)) {
+					drop_all(&pool);
+					memcpy(ctx, cur_ctx, ops->ctxsize);
+				}
+			} else {
+				res = ops->step(cur, ctx, scratch, out);
+				memcpy(cur_ctx, ctx, ops->ctxsize);
+			}
+		}
+		pthread_mutex_lock(&pool.lock);
+		pool.quit = 1;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+		for (i = 0; i < jobs; i++)
+			if (started[i])
+				pthread_join(threads[i], 0);
+		pthread_cond_destroy(&pool.cond);
+		pthread_mutex_destroy(&pool.lock);
+		if (cur != str)
+			free_str(cur);
+		for (i = 0; i < pool.jobsmax; i++) {
+			free(pool.jobs[i].ctx);
+			free(pool.jobs[i].guess);
+		}
+		free(pool.jobs);
+		free(cur_ctx);
+		free(starts);
+	}
+	if (ops->scratch_fini)
+		ops->scratch_fini(scratch);
+	free(scratch);
+	return res;
+}
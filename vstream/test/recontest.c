@@ -0,0 +1,103 @@
+#include "h264.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks the SIMD inverse transforms against the plain C ones on random
+ * blocks, then reconstructs a tiny made-up picture - an I_PCM macroblock and
+ * an Intra_16x16 DC one predicted from it - and checks its samples.
+ */
+
+static uint64_t rstate = 0x853c49e6748fea9bull;
+
+static uint32_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate >> 32;
+}
+
+static int fails;
+
+static void check_idct(int n, void (*fun)(int32_t *), void (*ref)(int32_t *), int num) {
+	int32_t blk[64], rblk[64];
+	int i, j;
+	for (i = 0; i < num; i++) {
+		/* mostly small and sparse like real residuals, sometimes anything in range */
+		int range = rnd() % 4 ? 1 << (rnd() % 10) : 1 << 15;
+		for (j = 0; j < n * n; j++)
+			blk[j] = rnd() % 3 ? 0 : (int32_t)(rnd() % (2 * range + 1)) - range;
+		memcpy(rblk, blk, sizeof rblk);
+		fun(blk);
+		ref(rblk);
+		if (memcmp(blk, rblk, n * n * sizeof *blk))
+			if (fails++ < 16)
+				fprintf(stderr, "idct%dx%d: block %d differs from C\n", n, n, i);
+	}
+}
+
+static void check_samples(struct h264_picture *pic, int p, int x0, int w, int h, int val) {
+	int x, y;
+	for (y = 0; y < h; y++)
+		for (x = x0; x < x0 + w; x++)
+			if (pic->planes[p][y * pic->width[p] + x] != val) {
+				if (fails++ < 16)
+					fprintf(stderr, "recon: plane %d (%d, %d) is %d, expected %d\n", p, x, y, pic->planes[p][y * pic->width[p] + x], val);
+				return;
+			}
+}
+
+static void check_recon(void) {
+	struct h264_seqparm sp = { 0 };
+	struct h264_picparm pp = { 0 };
+	struct h264_slice *slice = calloc(sizeof *slice, 1);
+	struct h264_picture pic = { 0 };
+	int32_t pl[256], pc[512], dc[16] = { 0 };
+	int i;
+	sp.chroma_format_idc = 1;
+	sp.frame_mbs_only_flag = 1;
+	slice->seqparm = &sp;
+	slice->picparm = &pp;
+	slice->slice_type = H264_SLICE_TYPE_I;
+	slice->chroma_array_type = 1;
+	slice->pic_width_in_mbs = 2;
+	slice->pic_height_in_mbs = 1;
+	slice->pic_size_in_mbs = 2;
+	slice->sliceqpy = 26;
+	slice->last_mb_in_slice = 1;
+	slice->mbs = calloc(sizeof *slice->mbs, 2);
+	slice->mbs[0].mb_type = H264_MB_TYPE_I_PCM;
+	for (i = 0; i < 256; i++)
+		pl[i] = 100;
+	for (i = 0; i < 128; i++)
+		pc[i] = i < 64 ? 60 : 200;
+	h264_mb_set_block(slice, &slice->mbs[0], H264_COEFF_PCM_LUMA, 0, 0, pl);
+	h264_mb_set_block(slice, &slice->mbs[0], H264_COEFF_PCM_CHROMA, 0, 0, pc);
+	/* DC prediction from the left, plus a luma DC of 10 at QP 26: 8 more everywhere */
+	slice->mbs[1].mb_type = H264_MB_TYPE_I_16X16_2_0_0;
+	dc[0] = 10;
+	h264_mb_set_block(slice, &slice->mbs[1], H264_COEFF_LUMA_DC, 0, 0, dc);
+	if (h264_picture_start(&pic, slice, stdout) || h264_recon_slice(&pic, slice)) {
+		fails++;
+		fprintf(stderr, "recon: failed\n");
+	} else {
+		check_samples(&pic, 0, 0, 16, 16, 100);
+		check_samples(&pic, 0, 16, 16, 16, 108);
+		check_samples(&pic, 1, 0, 16, 8, 60);
+		check_samples(&pic, 2, 0, 16, 8, 200);
+	}
+	h264_picture_free(&pic);
+	h264_del_slice(slice);
+}
+
+int main(int argc, char **argv) {
+	int num = 100000;
+	if (argc > 1)
+		num = strtol(argv[1], 0, 0);
+	check_idct(4, h264_idct4x4, h264_idct4x4_c, num);
+	check_idct(8, h264_idct8x8, h264_idct8x8_c, num);
+	check_recon();
+	printf("%d blocks of each size checked, %d mismatches\n", num, fails);
+	return fails != 0;
+}
@@ -0,0 +1,102 @@
+#include "vstream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks vs_find_start, vs_find_starts and vs_search_start against plain
+ * byte loops on random buffers full of zeros and ones.
+ */
+
+static uint64_t rstate = 0x2545f4914f6cdd1dull;
+
+static uint32_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate >> 32;
+}
+
+static int fails;
+
+static int ref_find(const uint8_t *bytes, int num, int pos) {
+	int i;
+	for (i = pos < 0 ? 0 : pos; i + 2 < num; i++)
+		if (!bytes[i] && !bytes[i + 1] && bytes[i + 2] == 1)
+			return i;
+	return -1;
+}
+
+/* the byte-wise vs_search_start, returns 1 and leaves *pos at the 01 if found */
+static int ref_search(const uint8_t *bytes, int num, int *pos, int *zero_bytes) {
+	while (1) {
+		if (*pos >= num)
+			return 0;
+		if (*zero_bytes == 2 && bytes[*pos] == 1)
+			return 1;
+		if (bytes[*pos] == 0) {
+			if (*zero_bytes != 2)
+				(*zero_bytes)++;
+		} else {
+			*zero_bytes = 0;
+		}
+		(*pos)++;
+	}
+}
+
+static void check_buf(uint8_t *bytes, int num) {
+	int *starts, startsnum;
+	int i, j, pos;
+	starts = vs_find_starts(bytes, num, &startsnum);
+	for (i = 0, pos = 0; ; i++) {
+		pos = ref_find(bytes, num - 1, pos);
+		if (pos == -1)
+			break;
+		if (i >= startsnum || starts[i] != pos) {
+			if (fails++ < 16)
+				fprintf(stderr, "vs_find_starts: size %d: start %d missed\n", num, pos);
+			break;
+		}
+		pos += 3;
+	}
+	if (pos == -1 && i != startsnum)
+		if (fails++ < 16)
+			fprintf(stderr, "vs_find_starts: size %d: %d starts, expected %d\n", num, startsnum, i);
+	free(starts);
+	for (j = 0; j < 8; j++) {
+		pos = rnd() % (num + 1);
+		if (vs_find_start(bytes, num, pos) != ref_find(bytes, num, pos))
+			if (fails++ < 16)
+				fprintf(stderr, "vs_find_start: size %d pos %d: got %d, expected %d\n", num, pos, vs_find_start(bytes, num, pos), ref_find(bytes, num, pos));
+		struct bitstream *str = vs_new_decode(VS_H264, bytes, num);
+		int rpos = pos, rzero = rnd() % 3;
+		str->bytepos = pos;
+		str->zero_bytes = rzero;
+		int res = vs_search_start(str);
+		int rres = ref_search(bytes, num, &rpos, &rzero);
+		if (res != rres || str->bytepos != rpos || str->zero_bytes != rzero)
+			if (fails++ < 16)
+				fprintf(stderr, "vs_search_start: size %d pos %d: got %d at %d, expected %d at %d\n", num, pos, res, str->bytepos, rres, rpos);
+		str->bytes = 0;
+		vs_destroy(str);
+	}
+}
+
+int main(int argc, char **argv) {
+	int num = 20000;
+	int i, j;
+	if (argc > 1)
+		num = strtol(argv[1], 0, 0);
+	for (i = 0; i < num; i++) {
+		int size = rnd() % (i & 1 ? 100 : 1000);
+		uint8_t *bytes = malloc(size);
+		/* mostly zeros and ones, or mostly not */
+		int dense = rnd() % 2 ? 2 : 16 + rnd() % 200;
+		for (j = 0; j < size; j++)
+			bytes[j] = rnd() % dense;
+		check_buf(bytes, size);
+		free(bytes);
+	}
+	printf("%d buffers checked, %d mismatches\n", num, fails);
+	return fails != 0;
+}
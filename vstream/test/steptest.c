@@ -0,0 +1,241 @@
+#include "vstream.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+/*
+ * Runs vs_run_steps over random streams of made-up units on a few threads,
+ * and streamed in through a pipe or a file, and checks the output is what
+ * the serial loop prints with the whole stream in memory.  Some units skip
+ * the next one or change ctx behind predict's back, so that the parallel
+ * side has to throw away its guesses.
+ */
+
+static uint64_t rstate = 0x9e3779b97f4a7c15ull;
+
+static uint32_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate >> 32;
+}
+
+enum {
+	UNIT_SET = 0x10,	/* sets val, not parallel */
+	UNIT_DATA = 0x20,	/* prints its payload mixed with val, counted by predict */
+	UNIT_SKIP = 0x30,	/* swallows the next unit */
+	UNIT_ODD = 0x40,	/* flips val without predict knowing */
+	UNIT_BAD = 0x50,	/* fails after its payload */
+	UNIT_END = 0xb7,
+};
+
+struct stepctx {
+	uint32_t val;
+	uint32_t count;
+};
+
+static int step(struct bitstream *str, void *pctx, void *scratch, FILE *out) {
+	struct stepctx *ctx = pctx;
+	uint32_t code, len, byte, sum = 0, i;
+	int res;
+	if (vs_start(str, &code))
+		goto err;
+	if (code == UNIT_END) {
+		fprintf(out, "end\n");
+		return 1;
+	}
+	if (vs_u(str, &len, 8))
+		goto err;
+	for (i = 0; i < len; i++) {
+		if (vs_u(str, &byte, 8))
+			goto err;
+		sum = sum * 31 + byte;
+	}
+	switch (code) {
+		case UNIT_SET:
+			ctx->val = sum;
+			fprintf(out, "set %08x\n", sum);
+			break;
+		case UNIT_DATA:
+			fprintf(out, "data %u %08x\n", ctx->count++, sum ^ ctx->val);
+			break;
+		case UNIT_SKIP:
+			fprintf(out, "skip\n");
+			if (vs_start(str, &byte))
+				goto err;
+			goto err;
+		case UNIT_ODD:
+			ctx->val ^= 1;
+			fprintf(out, "odd\n");
+			break;
+		default:
+			fprintf(out, "bad %02x\n", code);
+			goto err;
+	}
+	return 0;
+err:
+	res = vs_search_start(str);
+	if (res == -1)
+		return -1;
+	if (!res)
+		return 1;
+	fprintf(out, "recovered\n");
+	return 0;
+}
+
+static int parallel(const void *ctx, uint32_t start_code) {
+	return start_code != UNIT_SET;
+}
+
+static void predict(void *pctx, uint32_t start_code) {
+	struct stepctx *ctx = pctx;
+	if (start_code == UNIT_DATA)
+		ctx->count++;
+}
+
+static const struct vs_step_ops ops = {
+	sizeof(struct stepctx),
+	0,
+	step,
+	parallel,
+	predict,
+};
+
+static char *run_str(struct bitstream *str, int jobs, int *res) {
+	struct stepctx ctx = { 0 };
+	char *buf;
+	size_t bufsize;
+	FILE *out = open_memstream(&buf, &bufsize);
+	*res = vs_run_steps(str, &ops, &ctx, jobs, out);
+	fclose(out);
+	return buf;
+}
+
+static char *run(uint8_t *bytes, int bytesnum, int jobs, int *res) {
+	struct bitstream *str = vs_new_decode(VS_H262, bytes, bytesnum);
+	char *buf = run_str(str, jobs, res);
+	str->bytes = 0;
+	vs_destroy(str);
+	return buf;
+}
+
+struct feed {
+	int fd;
+	const uint8_t *bytes;
+	int bytesnum;
+};
+
+/* writes the stream in small pieces, so that it gets read a bit at a time */
+static void *feeder(void *arg) {
+	struct feed *feed = arg;
+	uint32_t x = feed->bytesnum;
+	int pos = 0;
+	while (pos < feed->bytesnum) {
+		int n;
+		x = x * 1103515245 + 12345;
+		n = 1 + (x >> 16) % 64;
+		if (n > feed->bytesnum - pos)
+			n = feed->bytesnum - pos;
+		n = write(feed->fd, feed->bytes + pos, n);
+		if (n <= 0)
+			break;
+		pos += n;
+	}
+	close(feed->fd);
+	return 0;
+}
+
+static char *run_pipe(uint8_t *bytes, int bytesnum, int jobs, int *res) {
+	struct feed feed = { -1, bytes, bytesnum };
+	pthread_t thread;
+	int fds[2];
+	char *buf;
+	if (pipe(fds))
+		abort();
+	feed.fd = fds[1];
+	pthread_create(&thread, 0, feeder, &feed);
+	struct bitstream *str = vs_new_decode_fd(VS_H262, fds[0]);
+	buf = run_str(str, jobs, res);
+	vs_destroy(str);
+	close(fds[0]);
+	pthread_join(thread, 0);
+	return buf;
+}
+
+static char *run_file(uint8_t *bytes, int bytesnum, int jobs, int *res) {
+	FILE *f = tmpfile();
+	char *buf;
+	fwrite(bytes, 1, bytesnum, f);
+	fflush(f);
+	struct bitstream *str = vs_new_decode_fd(VS_H262, fileno(f));
+	buf = run_str(str, jobs, res);
+	vs_destroy(str);
+	fclose(f);
+	return buf;
+}
+
+static int fails;
+
+static void check(const char *sbuf, int sres, char *buf, int res, int i, const char *how, int jobs) {
+	if (res != sres || strcmp(sbuf, buf)) {
+		if (fails++ < 16)
+			fprintf(stderr, "stream %d: %s with %d jobs differs from serial\n", i, how, jobs);
+	}
+	free(buf);
+}
+
+int main(int argc, char **argv) {
+	static const uint32_t kinds[] = { UNIT_SET, UNIT_DATA, UNIT_DATA, UNIT_DATA, UNIT_DATA, UNIT_DATA, UNIT_SKIP, UNIT_ODD, UNIT_BAD };
+	static const int jobs[] = { 2, 3, 8 };
+	int num = 200;
+	int i, j, k;
+	if (argc > 1)
+		num = strtol(argv[1], 0, 0);
+	/* the reader may stop early */
+	signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < num; i++) {
+		uint8_t *bytes = 0;
+		int bytesnum = 0;
+		int bytesmax = 0;
+		int units = rnd() % 200;
+		/* skewed towards parallel units, sometimes all of them */
+		int nkinds = rnd() % 4 ? 9 : 6;
+		for (j = 0; j < units; j++) {
+			uint32_t len = rnd() % 40;
+			if (!(rnd() % 8))
+				ADDARRAY(bytes, 0);
+			ADDARRAY(bytes, 0);
+			ADDARRAY(bytes, 0);
+			ADDARRAY(bytes, 1);
+			ADDARRAY(bytes, kinds[rnd() % nkinds]);
+			ADDARRAY(bytes, len);
+			for (k = 0; k < len; k++)
+				ADDARRAY(bytes, 2 + rnd() % 254);
+		}
+		ADDARRAY(bytes, 0);
+		ADDARRAY(bytes, 0);
+		ADDARRAY(bytes, 1);
+		ADDARRAY(bytes, UNIT_END);
+		int sres, res;
+		char *sbuf = run(bytes, bytesnum, 1, &sres);
+		char *buf;
+		for (j = 0; j < sizeof jobs / sizeof *jobs; j++) {
+			buf = run(bytes, bytesnum, jobs[j], &res);
+			check(sbuf, sres, buf, res, i, "memory", jobs[j]);
+		}
+		buf = run_pipe(bytes, bytesnum, 1, &res);
+		check(sbuf, sres, buf, res, i, "pipe", 1);
+		buf = run_pipe(bytes, bytesnum, 3, &res);
+		check(sbuf, sres, buf, res, i, "pipe", 3);
+		buf = run_file(bytes, bytesnum, 1, &res);
+		check(sbuf, sres, buf, res, i, "file", 1);
+		free(sbuf);
+		free(bytes);
+	}
+	printf("%d streams checked, %d mismatches\n", num, fails);
+	return fails != 0;
+}
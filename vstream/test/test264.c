@@ -133,12 +133,13 @@ int main(int argc, char **argv) {
 			slice->mbs[i].transform_size_8x8_flag = 0;
 			slice->mbs[i].mb_qp_delta = 0;
 			slice->mbs[i].intra_chroma_pred_mode = 0;
-			for (j = 0; j < 256; j++) {
-				if (i & 1)
-					slice->mbs[i].pcm_sample_chroma[j] = j;
-				if (i & 2)
-					slice->mbs[i].pcm_sample_luma[j] = j;
-			}
+			int32_t pcm[512] = { 0 };
+			for (j = 0; j < 256; j++)
+				pcm[j] = j;
+			if (i & 1)
+				h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_PCM_CHROMA, 0, 0, pcm);
+			if (i & 2)
+				h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_PCM_LUMA, 0, 0, pcm);
 		} else {
 			if (h264_is_intra_16x16_mb_type(slice->mbs[i].mb_type)) {
 				int mbt = slice->mbs[i].mb_type;
@@ -147,41 +148,54 @@ int main(int argc, char **argv) {
 					infer_cbp |= 0xf;
 				slice->mbs[i].coded_block_pattern = infer_cbp;
 				slice->mbs[i].transform_size_8x8_flag = 0;
+				int32_t dc[16], ac[15];
 				for (j = 0; j < 16; j++) {
-					slice->mbs[i].block_luma_dc[0][j] = 0x100 + j;
+					dc[j] = 0x100 + j;
 					if (slice->mbs[i].coded_block_pattern >> (j >> 2) & 1) {
 						for (k = 0; k < 15; k++) {
 							if (j) {
-								slice->mbs[i].block_luma_ac[0][j][k] = j * 16 + k + 1;
+								ac[k] = j * 16 + k + 1;
 							}
 						}
+						if (j)
+							h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_LUMA_AC, 0, j, ac);
 					}
 				}
+				h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_LUMA_DC, 0, 0, dc);
 			} else {
 				if (!slice->mbs[i].coded_block_pattern)
 					slice->mbs[i].mb_qp_delta = 0;
+				int32_t b4x4[16], b8x8[4][64] = { { 0 } };
 				for (j = 0; j < 16; j++) {
 					if (slice->mbs[i].coded_block_pattern >> (j >> 2) & 1) {
 						for (k = 0; k < 16; k++) {
 							if (j) {
-								slice->mbs[i].block_luma_4x4[0][j][k] = j * 16 + k;
-								slice->mbs[i].block_luma_8x8[0][j>>2][(j&3)*16+k] = j*16 + k;
+								b4x4[k] = j * 16 + k;
+								b8x8[j>>2][(j&3)*16+k] = j*16 + k;
 							}
 						}
+						if (j)
+							h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_LUMA_4X4, 0, j, b4x4);
 					}
 				}
+				for (j = 0; j < 4; j++)
+					h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_LUMA_8X8, 0, j, b8x8[j]);
 			}
 			if (slice->mbs[i].coded_block_pattern & 0x30) {
+				int32_t dc[8] = { 0 };
 				for (k = 0; k < 4; k++) {
-					slice->mbs[i].block_chroma_dc[i&1][k] = -0x10 + k;
+					dc[k] = -0x10 + k;
 				}
+				h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_CHROMA_DC, i&1, 0, dc);
 			}
 			if (slice->mbs[i].coded_block_pattern & 0x20) {
+				int32_t ac[15];
 				for (j = 0; j < 4; j++) {
 					for (k = 0; k < 15; k++) {
-						if (j != 1)
-							slice->mbs[i].block_chroma_ac[i>>1&1][j][k] = k - 0x1000 + j * 0x100;
+						ac[k] = k - 0x1000 + j * 0x100;
 					}
+					if (j != 1)
+						h264_mb_set_block(slice, &slice->mbs[i], H264_COEFF_CHROMA_AC, i>>1&1, j, ac);
 				}
 			}
 		}
@@ -203,10 +217,10 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 	if (h264_slice_data(nstr, slice)) {
-		h264_print_slice_data(slice);
+		h264_print_slice_data(stdout, slice);
 		return 1;
 	}
-	h264_print_slice_data(slice);
+	h264_print_slice_data(stdout, slice);
 
 	fprintf (stderr, "All ok!\n");
 
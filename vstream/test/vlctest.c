@@ -0,0 +1,172 @@
+#include "vstream.h"
+#include "h261.h"
+#include "h262.h"
+#include "h264.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Round-trips every entry of every VLC table through vs_vlc, and checks
+ * the decoder against a plain linear match on random bit strings.
+ */
+
+static uint64_t rstate = 0x2545f4914f6cdd1dull;
+
+static uint32_t rnd(void) {
+	rstate ^= rstate << 13;
+	rstate ^= rstate >> 7;
+	rstate ^= rstate << 17;
+	return rstate >> 32;
+}
+
+static int fails;
+
+/* first entry whose code starts bits[], -1 if none */
+static int ref_match(const struct vs_vlc_val *tab, const int *bits, int num) {
+	int i, j;
+	for (i = 0; tab[i].blen; i++) {
+		if (tab[i].blen > num)
+			continue;
+		for (j = 0; j < tab[i].blen; j++)
+			if (tab[i].bits[j] != bits[j])
+				break;
+		if (j == tab[i].blen)
+			return i;
+	}
+	return -1;
+}
+
+static int ref_find(const struct vs_vlc_val *tab, uint32_t val) {
+	int i;
+	for (i = 0; tab[i].blen; i++)
+		if (tab[i].val == val)
+			return i;
+	return -1;
+}
+
+static struct bitstream *reopen(struct bitstream *str) {
+	struct bitstream *res = vs_new_decode(str->type, str->bytes, str->bytesnum);
+	uint32_t val;
+	str->bytes = 0;
+	vs_destroy(str);
+	if (vs_start(res, &val))
+		abort();
+	return res;
+}
+
+/* writes a NAL of in[], decodes a VLC from it, and checks it took what the linear match takes */
+static void check_decode(const char *name, const struct vs_vlc_val *tab, const int *in, int num) {
+	struct bitstream *str = vs_new_encode(VS_H264);
+	int bits[128];
+	uint32_t val = 1, tmp;
+	int i, k;
+	for (i = 0; i < num; i++)
+		bits[i] = in[i];
+	/* what vs_end would add */
+	bits[num++] = 1;
+	while (num % 8)
+		bits[num++] = 0;
+	k = ref_match(tab, bits, num);
+	vs_start(str, &val);
+	for (i = 0; i < num; i++) {
+		tmp = bits[i];
+		vs_u(str, &tmp, 1);
+	}
+	str = reopen(str);
+	if (vs_vlc(str, &val, tab)) {
+		if (k != -1 && fails++ < 16)
+			fprintf(stderr, "%s: entry %d failed to decode\n", name, k);
+	} else if (k == -1) {
+		if (fails++ < 16)
+			fprintf(stderr, "%s: invalid code decoded to %x\n", name, val);
+	} else if (val != tab[k].val) {
+		if (fails++ < 16)
+			fprintf(stderr, "%s: entry %d decoded to %x, expected %x\n", name, k, val, tab[k].val);
+	} else {
+		/* the bits after the code must still be there */
+		for (i = tab[k].blen; i < num; i++) {
+			if (vs_u(str, &tmp, 1) || tmp != (uint32_t)bits[i]) {
+				if (fails++ < 16)
+					fprintf(stderr, "%s: entry %d consumed wrong number of bits\n", name, k);
+				break;
+			}
+		}
+	}
+	vs_destroy(str);
+}
+
+/* encodes val, and checks the bits are those of the first entry with that value */
+static void check_encode(const char *name, const struct vs_vlc_val *tab, uint32_t val) {
+	struct bitstream *str = vs_new_encode(VS_H264);
+	int k = ref_find(tab, val);
+	uint32_t tmp = 1, marker = 0x5a;
+	int j;
+	vs_start(str, &tmp);
+	tmp = val;
+	if (vs_vlc(str, &tmp, tab)) {
+		if (fails++ < 16)
+			fprintf(stderr, "%s: value %x failed to encode\n", name, val);
+		vs_destroy(str);
+		return;
+	}
+	vs_u(str, &marker, 8);
+	vs_end(str);
+	str = reopen(str);
+	for (j = 0; j < tab[k].blen; j++) {
+		if (vs_u(str, &tmp, 1) || tmp != (uint32_t)tab[k].bits[j])
+			break;
+	}
+	if (j != tab[k].blen || vs_u(str, &tmp, 8) || tmp != marker) {
+		if (fails++ < 16)
+			fprintf(stderr, "%s: value %x encoded wrong\n", name, val);
+	}
+	vs_destroy(str);
+}
+
+static void check_table(const char *name, const struct vs_vlc_val *tab, int num) {
+	int bits[96];
+	int i, j;
+	for (i = 0; tab[i].blen; i++) {
+		for (j = 0; j < tab[i].blen; j++)
+			bits[j] = tab[i].bits[j];
+		for (; j < tab[i].blen + 40; j++)
+			bits[j] = rnd() & 1;
+		check_decode(name, tab, bits, j);
+		check_encode(name, tab, tab[i].val);
+		/* cut short */
+		check_decode(name, tab, bits, tab[i].blen - 1);
+	}
+	if (vs_vlc_find(tab, 0xdeadbeef) || !vs_vlc_find(tab, tab[0].val))
+		if (fails++ < 16)
+			fprintf(stderr, "%s: vs_vlc_find broken\n", name);
+	for (i = 0; i < num; i++) {
+		/* codes tend to start with long runs of zeros */
+		int zeros = rnd() % 20;
+		for (j = 0; j < 64; j++)
+			bits[j] = j < zeros ? 0 : rnd() & 1;
+		if (ref_match(tab, bits, 64) == -1 && rnd() % 64)
+			continue;
+		check_decode(name, tab, bits, 64);
+	}
+}
+
+static void check_tables(const char *prefix, const struct vs_vlc_val *const *tabs, int num) {
+	int i;
+	for (i = 0; tabs[i]; i++) {
+		char name[64];
+		snprintf(name, sizeof name, "%s table %d", prefix, i);
+		check_table(name, tabs[i], num);
+	}
+	printf("%s: %d tables checked\n", prefix, i);
+}
+
+int main(int argc, char **argv) {
+	int num = 2000;
+	if (argc > 1)
+		num = strtol(argv[1], 0, 0);
+	check_tables("h261", h261_vlc_tables, num);
+	check_tables("h262", h262_vlc_tables, num);
+	check_tables("h264", h264_vlc_tables, num);
+	printf("%d mismatches\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,953 @@
+/*
+ * Copyright (C) 2026 The envytools authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * vstream-bench generates H.261, H.262 and H.264 streams with the encode
+ * side of vstream, in a few resolutions and slice layouts, and with CAVLC and
+ * CABAC for H.264, then times parsing them.  It reports macroblocks and
+ * megabits per second, CABAC bins per second, and allocations per macroblock
+ * as JSON.
+ *
+ * Before timing, every unit is parsed once more and written back out with
+ * the encode side, and the result compared to the unit in the stream, so a
+ * faster parser that reads anything differently shows up as a mismatch.
+ * Files given on the command line are put through the same as a
+ * conformance corpus instead of the generated streams.
+ */
+
+#include "h261.h"
+#include "h262.h"
+#include "h264.h"
+#include "vstream.h"
+#include "util.h"
+#include "bench.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+struct bench_stream {
+	const char *name;
+	enum vs_type type;
+	/* in macroblocks */
+	int width;
+	int height;
+	/* per picture for H.264, per macroblock row for H.262 */
+	int slices;
+	int cabac;
+	int mpeg1;
+};
+
+static const struct bench_stream streams[] = {
+	{ "h261-qcif", VS_H261, 11, 9, 1, 0, 0 },
+	{ "h261-cif", VS_H261, 22, 18, 1, 0, 0 },
+	{ "h262-mpeg1-cif", VS_H262, 22, 18, 1, 0, 1 },
+	{ "h262-sd", VS_H262, 45, 36, 1, 0, 0 },
+	{ "h262-sd-3slices", VS_H262, 45, 36, 3, 0, 0 },
+	{ "h264-cavlc-cif", VS_H264, 22, 18, 1, 0, 0 },
+	{ "h264-cavlc-720p-8slices", VS_H264, 80, 45, 8, 0, 0 },
+	{ "h264-cabac-cif", VS_H264, 22, 18, 1, 1, 0 },
+	{ "h264-cabac-720p-8slices", VS_H264, 80, 45, 8, 1, 0 },
+};
+
+static int rr(int n) {
+	return (bench_rnd() >> 32) % n;
+}
+
+static int pictures = 8;
+static int reps = 3;
+
+/* mostly zeros, then mostly small */
+static int32_t rcoeff(int max) {
+	int x = rr(16);
+	if (x < 9)
+		return 0;
+	if (x < 13)
+		return rr(2) ? 1 : -1;
+	if (x < 15)
+		return rr(20) - 10;
+	return rr(2 * max) - max;
+}
+
+static int gen_h261(struct bitstream *str, const struct bench_stream *bs) {
+	static const uint32_t mtypes[] = {
+		H261_MTYPE_FLAG_CODED,
+		H261_MTYPE_FLAG_CODED | H261_MTYPE_FLAG_MC | H261_MTYPE_FLAG_FIL,
+		H261_MTYPE_FLAG_MC | H261_MTYPE_FLAG_FIL,
+		H261_MTYPE_FLAG_INTRA,
+		H261_MTYPE_FLAG_CODED | H261_MTYPE_FLAG_QUANT,
+		H261_MTYPE_FLAG_CODED | H261_MTYPE_FLAG_QUANT | H261_MTYPE_FLAG_MC | H261_MTYPE_FLAG_FIL,
+		H261_MTYPE_FLAG_INTRA | H261_MTYPE_FLAG_QUANT,
+		H261_MTYPE_FLAG_CODED | H261_MTYPE_FLAG_MC,
+		H261_MTYPE_FLAG_MC,
+		H261_MTYPE_FLAG_CODED | H261_MTYPE_FLAG_QUANT | H261_MTYPE_FLAG_MC,
+	};
+	int cif = bs->width == 2 * H261_GOB_WIDTH;
+	struct h261_picparm picparm;
+	struct h261_gob *gob = calloc(sizeof *gob, 1);
+	uint32_t start_code;
+	int pic, gn, i, j, k;
+	for (pic = 0; pic < pictures; pic++) {
+		start_code = 0;
+		picparm.tr = pic & 31;
+		picparm.ptype = 1 | (cif ? 4 : 0);
+		if (vs_start(str, &start_code) || h261_picparm(str, &picparm))
+			return 1;
+		for (gn = 1; gn <= 12; gn++) {
+			/* QCIF only has GOBs 1, 3 and 5 */
+			if (!cif && (!(gn & 1) || gn > 5))
+				continue;
+			memset(gob, 0, sizeof *gob);
+			gob->gn = gn;
+			gob->gquant = 1 + rr(31);
+			uint32_t quant = gob->gquant;
+			for (i = 0; i < H261_GOB_MBS; i++) {
+				struct h261_macroblock *mb = &gob->mbs[i];
+				if (!rr(5))
+					continue;
+				mb->mtype = mtypes[rr(ARRAY_SIZE(mtypes))];
+				if (mb->mtype & H261_MTYPE_FLAG_QUANT)
+					quant = 1 + rr(31);
+				mb->mquant = quant;
+				if (mb->mtype & H261_MTYPE_FLAG_MC) {
+					mb->mvd[0] = rr(31) - 15;
+					mb->mvd[1] = rr(31) - 15;
+				}
+				if (mb->mtype & H261_MTYPE_FLAG_INTRA)
+					mb->cbp = 0x3f;
+				else if (mb->mtype & H261_MTYPE_FLAG_CODED)
+					mb->cbp = 1 + rr(63);
+				for (j = 0; j < 6; j++) {
+					int intra = mb->mtype & H261_MTYPE_FLAG_INTRA;
+					int32_t *block = mb->block[j];
+					if (!(mb->cbp & 1 << j))
+						continue;
+					/* intra DC 0xff is not allowed, and inter blocks need a coefficient */
+					if (intra)
+						block[0] = 1 + rr(254);
+					for (k = intra; k < 64; k++)
+						block[k] = rr(64) < 64 - k ? rcoeff(120) : 0;
+					if (!intra)
+						block[rr(64)] = rr(2) ? 2 : -1;
+				}
+			}
+			start_code = gn;
+			if (vs_start(str, &start_code) || h261_gob(str, gob))
+				return 1;
+		}
+	}
+	free(gob);
+	/* a GOB ends at the next start code, so finish with an empty picture */
+	start_code = 0;
+	picparm.tr = pic & 31;
+	if (vs_start(str, &start_code) || h261_picparm(str, &picparm))
+		return 1;
+	return vs_align_byte(str, VS_ALIGN_0);
+}
+
+static int gen_h262_slice(struct bitstream *str, struct h262_seqparm *seqparm, struct h262_picparm *picparm, struct h262_slice *slice) {
+	uint32_t qsc = slice->quantiser_scale_code;
+	uint32_t i;
+	int j, k;
+	for (i = slice->first_mb_in_slice; i <= slice->last_mb_in_slice; i++) {
+		struct h262_macroblock *mb = &slice->mbs[i];
+		memset(mb, 0, sizeof *mb);
+		if (picparm->picture_coding_type == H262_PIC_TYPE_P && i != slice->first_mb_in_slice && i != slice->last_mb_in_slice && !rr(4)) {
+			mb->macroblock_skipped = 1;
+			continue;
+		}
+		if (picparm->picture_coding_type == H262_PIC_TYPE_I || !rr(4)) {
+			mb->macroblock_intra = 1;
+			mb->coded_block_pattern = 0x3f;
+		} else {
+			int t = rr(3);
+			mb->macroblock_motion_forward = t != 1;
+			mb->macroblock_pattern = t != 0;
+			if (mb->macroblock_pattern)
+				mb->coded_block_pattern = 1 + rr(63);
+		}
+		mb->macroblock_quant = (mb->macroblock_intra || mb->macroblock_pattern) && !rr(4);
+		if (mb->macroblock_quant)
+			qsc = 1 + rr(31);
+		mb->quantiser_scale_code = qsc;
+		mb->frame_motion_type = H262_FRAME_MOTION_FRAME;
+		if (mb->macroblock_motion_forward) {
+			for (k = 0; k < 2; k++) {
+				mb->motion_code[0][0][k] = rr(33) - 16;
+				if (mb->motion_code[0][0][k])
+					mb->motion_residual[0][0][k] = rr(1 << (picparm->f_code[0][k] - 1));
+			}
+		}
+		for (j = 0; j < 6; j++) {
+			int32_t *block = mb->block[j];
+			if (!(mb->coded_block_pattern & 1 << j))
+				continue;
+			if (mb->macroblock_intra)
+				block[0] = rr(400) - 200;
+			for (k = mb->macroblock_intra; k < 64; k++)
+				block[k] = rr(64) < 64 - k ? rcoeff(seqparm->is_ext ? 2000 : 250) : 0;
+			if (!mb->macroblock_intra)
+				block[rr(64)] = rr(2) ? 3 : -2;
+		}
+	}
+	return h262_slice(str, seqparm, picparm, slice);
+}
+
+static int gen_h262(struct bitstream *str, const struct bench_stream *bs) {
+	struct h262_seqparm seqparm = { 0 };
+	struct h262_picparm picparm;
+	struct h262_gop gop = { 0 };
+	struct h262_slice slice = { 0 };
+	uint32_t start_code, ext_start_code;
+	int pic, row, i;
+	seqparm.horizontal_size = bs->width * 16;
+	seqparm.vertical_size = bs->height * 16;
+	seqparm.aspect_ratio_information = 1;
+	seqparm.frame_rate_code = 3;
+	seqparm.bit_rate = 10000;
+	seqparm.vbv_buffer_size = 100;
+	seqparm.is_ext = !bs->mpeg1;
+	seqparm.profile_and_level_indication = 0x48;
+	seqparm.progressive_sequence = 1;
+	seqparm.chroma_format = 1;
+	start_code = H262_START_CODE_SEQPARM;
+	if (vs_start(str, &start_code) || h262_seqparm(str, &seqparm) || vs_end(str))
+		return 1;
+	if (seqparm.is_ext) {
+		start_code = H262_START_CODE_EXTENSION;
+		ext_start_code = H262_EXT_SEQUENCE;
+		if (vs_start(str, &start_code) || vs_u(str, &ext_start_code, 4) || h262_seqparm_ext(str, &seqparm) || vs_end(str))
+			return 1;
+	}
+	/* an all-zero time code would make a start code */
+	gop.time_code_hours = 1;
+	gop.closed_gop = 1;
+	start_code = H262_START_CODE_GOP;
+	if (vs_start(str, &start_code) || h262_gop(str, &gop) || vs_end(str))
+		return 1;
+	slice.mbs = calloc(sizeof *slice.mbs, bs->width * bs->height);
+	for (pic = 0; pic < pictures; pic++) {
+		int ptype = pic && rr(4) ? H262_PIC_TYPE_P : H262_PIC_TYPE_I;
+		memset(&picparm, 0, sizeof picparm);
+		picparm.temporal_reference = pic;
+		picparm.picture_coding_type = ptype;
+		picparm.vbv_delay = 0xffff;
+		picparm.is_ext = seqparm.is_ext;
+		picparm.full_pel_forward_vector = ptype != H262_PIC_TYPE_P;
+		picparm.full_pel_backward_vector = 1;
+		picparm.picture_structure = H262_PIC_STRUCT_FRAME;
+		picparm.frame_pred_frame_dct = 1;
+		picparm.chroma_420_type = 1;
+		picparm.progressive_frame = 1;
+		if (seqparm.is_ext) {
+			picparm.forward_f_code = 7;
+			picparm.backward_f_code = 7;
+			picparm.f_code[0][0] = picparm.f_code[0][1] = ptype == H262_PIC_TYPE_P ? 2 + rr(3) : 15;
+			picparm.f_code[1][0] = picparm.f_code[1][1] = 15;
+			picparm.intra_dc_precision = rr(4);
+			picparm.q_scale_type = rr(2);
+			picparm.intra_vlc_format = rr(2);
+			picparm.alternate_scan = rr(2);
+		} else {
+			picparm.forward_f_code = ptype == H262_PIC_TYPE_P ? 2 : 7;
+			picparm.backward_f_code = 7;
+			picparm.f_code[0][0] = picparm.f_code[0][1] = picparm.forward_f_code;
+			picparm.f_code[1][0] = picparm.f_code[1][1] = 7;
+		}
+		start_code = H262_START_CODE_PICPARM;
+		if (vs_start(str, &start_code) || h262_picparm(str, &seqparm, &picparm) || vs_end(str))
+			return 1;
+		if (seqparm.is_ext) {
+			start_code = H262_START_CODE_EXTENSION;
+			ext_start_code = H262_EXT_PIC_CODING;
+			if (vs_start(str, &start_code) || vs_u(str, &ext_start_code, 4) || h262_picparm_ext(str, &seqparm, &picparm) || vs_end(str))
+				return 1;
+		}
+		for (row = 0; row < bs->height; row++) {
+			for (i = 0; i < bs->slices; i++) {
+				slice.slice_vertical_position = row;
+				slice.first_mb_in_slice = row * bs->width + bs->width * i / bs->slices;
+				slice.last_mb_in_slice = row * bs->width + bs->width * (i + 1) / bs->slices - 1;
+				slice.quantiser_scale_code = 1 + rr(31);
+				start_code = H262_START_CODE_SLICE_BASE + row;
+				if (vs_start(str, &start_code) || gen_h262_slice(str, &seqparm, &picparm, &slice) || vs_end(str))
+					return 1;
+			}
+		}
+	}
+	free(slice.mbs);
+	start_code = H262_START_CODE_END;
+	return vs_start(str, &start_code);
+}
+
+static void gen_h264_mb(struct h264_slice *slice, struct h264_macroblock *mb) {
+	static const int tt[4] = { 0, 2, 1, 3 };
+	int32_t block[64], block8x8[4][64];
+	int pick = rr(100);
+	int j, k;
+	memset(mb, 0, sizeof *mb);
+	if (slice->slice_type == H264_SLICE_TYPE_P && pick < 25) {
+		mb->mb_type = H264_MB_TYPE_P_SKIP;
+		return;
+	}
+	if (slice->slice_type == H264_SLICE_TYPE_P && pick < 70) {
+		int part = rr(4);
+		int32_t mv[16][2], ref[4];
+		mb->mb_type = H264_MB_TYPE_P_L0_16X16 + part;
+		for (j = 0; j < 4; j++)
+			ref[j] = rr(slice->num_ref_idx_l0_active_minus1 + 1);
+		for (j = 0; j < 16; j++) {
+			mv[j][0] = rr(40) - 20;
+			mv[j][1] = rr(40) - 20;
+		}
+		if (mb->mb_type == H264_MB_TYPE_P_8X8)
+			for (j = 0; j < 4; j++)
+				mb->sub_mb_type[j] = rr(4);
+		for (j = 0; j < 4; j++)
+			mb->ref_idx[0][j] = ref[part == 0 ? 0 : part == 1 ? (j & 2) : part == 2 ? (j & 1) : j];
+		/* the same vectors in every 4x4 block of a partition */
+		for (j = 0; j < 16; j++) {
+			int b8 = j >> 2, m;
+			if (part == 0)
+				m = 0;
+			else if (part == 1)
+				m = (b8 & 2) * 4;
+			else if (part == 2)
+				m = (b8 & 1) * 4;
+			else
+				m = b8 * 4 + ((j & 3) & tt[mb->sub_mb_type[b8]]);
+			mb->mvd[0][j][0] = mv[m][0];
+			mb->mvd[0][j][1] = mv[m][1];
+		}
+	} else if (pick % 10 == 0) {
+		/* 256 luma samples, then room for the 512 chroma ones of which 4:2:0 has 128 */
+		int32_t pcm[768] = { 0 };
+		mb->mb_type = H264_MB_TYPE_I_PCM;
+		mb->coded_block_pattern = 0x2f;
+		for (j = 0; j < 384; j++)
+			pcm[j] = rr(256);
+		h264_mb_set_block(slice, mb, H264_COEFF_PCM_LUMA, 0, 0, pcm);
+		h264_mb_set_block(slice, mb, H264_COEFF_PCM_CHROMA, 0, 0, pcm + 256);
+		return;
+	} else if (pick % 3 == 0) {
+		mb->mb_type = H264_MB_TYPE_I_NXN;
+		for (j = 0; j < 16; j++) {
+			mb->prev_intra4x4_pred_mode_flag[j] = rr(2);
+			mb->rem_intra4x4_pred_mode[j] = rr(8);
+		}
+		for (j = 0; j < 4; j++) {
+			mb->prev_intra8x8_pred_mode_flag[j] = rr(2);
+			mb->rem_intra8x8_pred_mode[j] = rr(8);
+		}
+		mb->intra_chroma_pred_mode = rr(4);
+	} else {
+		mb->mb_type = H264_MB_TYPE_I_16X16_0_0_0 + rr(24);
+		mb->intra_chroma_pred_mode = rr(4);
+	}
+	if (h264_is_intra_16x16_mb_type(mb->mb_type)) {
+		/* coded_block_pattern is part of the mb_type */
+		int idx = mb->mb_type - H264_MB_TYPE_I_16X16_0_0_0;
+		mb->coded_block_pattern = (idx >> 2) % 3 << 4;
+		if (mb->mb_type >= H264_MB_TYPE_I_16X16_0_0_1)
+			mb->coded_block_pattern |= 0xf;
+		for (j = 0; j < 16; j++) {
+			if (!(mb->coded_block_pattern & 0xf))
+				break;
+			for (k = 0; k < 15; k++)
+				block[k] = rcoeff(300);
+			h264_mb_set_block(slice, mb, H264_COEFF_LUMA_AC, 0, j, block);
+		}
+		for (j = 0; j < 16; j++)
+			block[j] = rcoeff(300);
+		h264_mb_set_block(slice, mb, H264_COEFF_LUMA_DC, 0, 0, block);
+		mb->mb_qp_delta = rr(5) - 2;
+	} else {
+		mb->coded_block_pattern = rr(48);
+		if (mb->mb_type == H264_MB_TYPE_I_NXN || ((mb->coded_block_pattern & 0xf) && mb->mb_type != H264_MB_TYPE_P_8X8))
+			mb->transform_size_8x8_flag = rr(2);
+		if (mb->coded_block_pattern)
+			mb->mb_qp_delta = rr(5) - 2;
+		memset(block8x8, 0, sizeof block8x8);
+		for (j = 0; j < 16; j++) {
+			if (!(mb->coded_block_pattern >> (j >> 2) & 1))
+				continue;
+			for (k = 0; k < 16; k++) {
+				block[k] = rcoeff(300);
+				block8x8[j >> 2][4 * k + (j & 3)] = block[k];
+			}
+			h264_mb_set_block(slice, mb, H264_COEFF_LUMA_4X4, 0, j, block);
+		}
+		for (j = 0; j < 4; j++)
+			h264_mb_set_block(slice, mb, H264_COEFF_LUMA_8X8, 0, j, block8x8[j]);
+	}
+	if (mb->coded_block_pattern & 0x30) {
+		for (j = 0; j < 2; j++) {
+			memset(block, 0, 8 * sizeof *block);
+			for (k = 0; k < 4; k++)
+				block[k] = rcoeff(300);
+			h264_mb_set_block(slice, mb, H264_COEFF_CHROMA_DC, j, 0, block);
+		}
+	}
+	if (mb->coded_block_pattern & 0x20) {
+		for (j = 0; j < 8; j++) {
+			for (k = 0; k < 15; k++)
+				block[k] = rcoeff(300);
+			h264_mb_set_block(slice, mb, H264_COEFF_CHROMA_AC, j >> 2, j & 3, block);
+		}
+	}
+}
+
+static int gen_h264(struct bitstream *str, const struct bench_stream *bs) {
+	struct h264_seqparm *seqparms[32] = { 0 }, *subseqparms[32] = { 0 };
+	struct h264_picparm *picparms[256] = { 0 };
+	struct h264_seqparm seqparm = { 0 };
+	struct h264_picparm picparm = { 0 };
+	struct h264_slice_buf buf = { 0 };
+	uint32_t start_code;
+	int size = bs->width * bs->height;
+	int pic, i, j;
+	seqparm.profile_idc = H264_PROFILE_HIGH;
+	seqparm.level_idc = 40;
+	seqparm.chroma_format_idc = 1;
+	seqparm.max_num_ref_frames = 4;
+	seqparm.pic_width_in_mbs_minus1 = bs->width - 1;
+	seqparm.pic_height_in_map_units_minus1 = bs->height - 1;
+	seqparm.frame_mbs_only_flag = 1;
+	seqparm.direct_8x8_inference_flag = 1;
+	seqparms[0] = &seqparm;
+	start_code = H264_NAL_UNIT_TYPE_SEQPARM | 3 << 5;
+	if (vs_start(str, &start_code) || h264_seqparm(str, &seqparm) || vs_end(str))
+		return 1;
+	picparm.entropy_coding_mode_flag = bs->cabac;
+	picparm.num_ref_idx_l0_default_active_minus1 = 3;
+	picparm.transform_8x8_mode_flag = 1;
+	picparms[0] = &picparm;
+	start_code = H264_NAL_UNIT_TYPE_PICPARM | 3 << 5;
+	if (vs_start(str, &start_code) || h264_picparm(str, seqparms, subseqparms, &picparm) || vs_end(str))
+		return 1;
+	for (pic = 0; pic < pictures; pic++) {
+		int idr = !pic || !rr(8);
+		int ptype = !idr && rr(4);
+		for (i = 0; i < bs->slices; i++) {
+			struct h264_slice *slice = calloc(sizeof *slice, 1);
+			slice->nal_ref_idc = 3;
+			slice->nal_unit_type = idr ? H264_NAL_UNIT_TYPE_SLICE_IDR : H264_NAL_UNIT_TYPE_SLICE_NONIDR;
+			slice->idr_pic_flag = idr;
+			slice->picparm = &picparm;
+			slice->seqparm = &seqparm;
+			slice->slice_type = ptype ? H264_SLICE_TYPE_P : H264_SLICE_TYPE_I;
+			slice->first_mb_in_slice = size * i / bs->slices;
+			slice->frame_num = pic & 15;
+			slice->pic_order_cnt_lsb = pic * 2 & 15;
+			slice->idr_pic_id = pic & 7;
+			slice->num_ref_idx_l0_active_minus1 = 3;
+			/* end of the empty ref_pic_list_modification lists */
+			slice->ref_pic_list_modification_l0.list[0].op = 3;
+			slice->ref_pic_list_modification_l1.list[0].op = 3;
+			slice->cabac_init_idc = rr(3);
+			slice->slice_qp_delta = rr(11) - 5;
+			slice->chroma_array_type = 1;
+			slice->pic_width_in_mbs = bs->width;
+			start_code = slice->nal_ref_idc << 5 | slice->nal_unit_type;
+			if (vs_start(str, &start_code) || h264_slice_header(str, seqparms, picparms, slice))
+				return 1;
+			h264_slice_buf_attach(&buf, slice);
+			slice->last_mb_in_slice = size * (i + 1) / bs->slices - 1;
+			for (j = slice->first_mb_in_slice; j <= slice->last_mb_in_slice; j++)
+				gen_h264_mb(slice, &slice->mbs[j]);
+			if (h264_slice_data(str, slice))
+				return 1;
+			h264_slice_buf_detach(&buf, slice);
+			h264_del_slice(slice);
+		}
+	}
+	h264_slice_buf_free(&buf);
+	start_code = H264_NAL_UNIT_TYPE_END_STREAM;
+	return vs_start(str, &start_code);
+}
+
+struct bench_result {
+	uint64_t units;
+	uint64_t failed_units;
+	/* units written back out, and how many of them came out the same */
+	uint64_t checked_units;
+	uint64_t identical_units;
+	uint64_t mbs;
+	uint64_t bins;
+};
+
+struct bench_h262 {
+	struct h262_seqparm seqparm;
+	struct h262_picparm picparm;
+	struct h262_gop gop;
+	uint32_t ext_start_code;
+	uint32_t svp_ext;
+	struct h262_slice slice;
+	uint32_t mbsmax;
+};
+
+struct bench_h264 {
+	struct h264_seqparm *seqparms[32];
+	struct h264_seqparm *subseqparms[32];
+	struct h264_picparm *picparms[256];
+	int last_idr;
+	struct h264_slice_buf buf;
+	/* only for counting bins */
+	struct h264_stats *stats;
+};
+
+/*
+ * Each of these parses one unit after its start code, and writes it out
+ * again to enc if not NULL.  They return 0 if done, 1 on error, 2 if the
+ * unit was skipped.
+ */
+
+static int unit_h261(struct bitstream *str, struct bitstream *enc, struct h261_picparm *picparm, struct h261_gob *gob, uint32_t start_code, struct bench_result *res) {
+	if (!start_code) {
+		if (h261_picparm(str, picparm))
+			return 1;
+		return enc && h261_picparm(enc, picparm);
+	}
+	if (start_code > 12) {
+		fprintf(stderr, "Invalid start code %d\n", start_code);
+		return 1;
+	}
+	gob->gn = start_code;
+	if (h261_gob(str, gob))
+		return 1;
+	res->mbs += H261_GOB_MBS;
+	return enc && h261_gob(enc, gob);
+}
+
+/* the same for both directions, except for where the slice's macroblocks come from */
+static int unit_h262_dir(struct bitstream *str, struct bench_h262 *ctx, uint32_t start_code) {
+	struct h262_slice *slice = &ctx->slice;
+	switch (start_code) {
+		case H262_START_CODE_SEQPARM:
+			return h262_seqparm(str, &ctx->seqparm) || vs_end(str);
+		case H262_START_CODE_PICPARM:
+			return h262_picparm(str, &ctx->seqparm, &ctx->picparm) || vs_end(str);
+		case H262_START_CODE_GOP:
+			return h262_gop(str, &ctx->gop) || vs_end(str);
+		case H262_START_CODE_EXTENSION:
+			if (vs_u(str, &ctx->ext_start_code, 4))
+				return 1;
+			switch (ctx->ext_start_code) {
+				case H262_EXT_SEQUENCE:
+					return h262_seqparm_ext(str, &ctx->seqparm) || vs_end(str);
+				case H262_EXT_PIC_CODING:
+					return h262_picparm_ext(str, &ctx->seqparm, &ctx->picparm) || vs_end(str);
+				default:
+					return 2;
+			}
+		case H262_START_CODE_END:
+			return 0;
+	}
+	if (start_code < H262_START_CODE_SLICE_BASE || start_code > H262_START_CODE_SLICE_LAST)
+		return 2;
+	slice->slice_vertical_position = start_code - H262_START_CODE_SLICE_BASE;
+	if (ctx->seqparm.vertical_size > 2800) {
+		if (vs_u(str, &ctx->svp_ext, 3))
+			return 1;
+		if (slice->slice_vertical_position >= 0x80) {
+			fprintf(stderr, "Invalid slice start code for large picture\n");
+			return 1;
+		}
+		slice->slice_vertical_position += ctx->svp_ext * 0x80;
+	}
+	if (slice->slice_vertical_position >= ctx->picparm.pic_height_in_mbs) {
+		fprintf(stderr, "slice_vertical_position too large\n");
+		return 1;
+	}
+	return h262_slice(str, &ctx->seqparm, &ctx->picparm, slice) || vs_end(str);
+}
+
+static int unit_h262(struct bitstream *str, struct bitstream *enc, struct bench_h262 *ctx, uint32_t start_code, struct bench_result *res) {
+	struct h262_slice *slice = &ctx->slice;
+	int r;
+	if (ctx->mbsmax < ctx->picparm.pic_size_in_mbs) {
+		ctx->mbsmax = ctx->picparm.pic_size_in_mbs;
+		free(slice->mbs);
+		slice->mbs = calloc(sizeof *slice->mbs, ctx->mbsmax);
+	}
+	r = unit_h262_dir(str, ctx, start_code);
+	if (r)
+		return r;
+	if (start_code >= H262_START_CODE_SLICE_BASE && start_code <= H262_START_CODE_SLICE_LAST)
+		res->mbs += slice->last_mb_in_slice - slice->first_mb_in_slice + 1;
+	return enc && unit_h262_dir(enc, ctx, start_code);
+}
+
+static int unit_h264_slice(struct bitstream *str, struct bitstream *enc, struct bench_h264 *ctx, uint32_t start_code, struct bench_result *res) {
+	struct h264_slice *slice = calloc(sizeof *slice, 1);
+	uint32_t addr;
+	int r = 1;
+	slice->nal_ref_idc = start_code >> 5;
+	slice->nal_unit_type = start_code & 0x1f;
+	if (slice->nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_IDR)
+		ctx->last_idr = 1;
+	if (slice->nal_unit_type == H264_NAL_UNIT_TYPE_SLICE_NONIDR)
+		ctx->last_idr = 0;
+	slice->idr_pic_flag = ctx->last_idr;
+	if (h264_slice_header(str, ctx->seqparms, ctx->picparms, slice)) {
+		h264_del_slice(slice);
+		return 1;
+	}
+	slice->stats = ctx->stats;
+	h264_slice_buf_attach(&ctx->buf, slice);
+	if (h264_slice_data(str, slice))
+		goto out;
+	addr = slice->first_mb_in_slice * (1 + slice->mbaff_frame_flag);
+	while (addr <= slice->last_mb_in_slice && addr < slice->pic_size_in_mbs) {
+		res->mbs++;
+		if (addr == slice->last_mb_in_slice)
+			break;
+		addr = h264_next_mb_addr(slice, addr);
+	}
+	slice->stats = 0;
+	r = enc && (h264_slice_header(enc, ctx->seqparms, ctx->picparms, slice) || h264_slice_data(enc, slice));
+out:
+	h264_slice_buf_detach(&ctx->buf, slice);
+	h264_del_slice(slice);
+	return r;
+}
+
+static int unit_h264(struct bitstream *str, struct bitstream *enc, struct bench_h264 *ctx, uint32_t start_code, struct bench_result *res) {
+	struct h264_seqparm *sp;
+	struct h264_picparm *pp;
+	uint32_t primary_pic_type;
+	if (start_code & 0x80) {
+		fprintf(stderr, "forbidden_zero_bit not 0\n");
+		return 1;
+	}
+	switch (start_code & 0x1f) {
+		case H264_NAL_UNIT_TYPE_SLICE_NONIDR:
+		case H264_NAL_UNIT_TYPE_SLICE_IDR:
+		case H264_NAL_UNIT_TYPE_SLICE_AUX:
+			return unit_h264_slice(str, enc, ctx, start_code, res);
+		case H264_NAL_UNIT_TYPE_SEQPARM:
+			sp = calloc(sizeof *sp, 1);
+			if (h264_seqparm(str, sp) || vs_end(str) || sp->seq_parameter_set_id > 31) {
+				h264_del_seqparm(sp);
+				return 1;
+			}
+			if (ctx->seqparms[sp->seq_parameter_set_id])
+				h264_del_seqparm(ctx->seqparms[sp->seq_parameter_set_id]);
+			ctx->seqparms[sp->seq_parameter_set_id] = sp;
+			return enc && (h264_seqparm(enc, sp) || vs_end(enc));
+		case H264_NAL_UNIT_TYPE_PICPARM:
+			pp = calloc(sizeof *pp, 1);
+			if (h264_picparm(str, ctx->seqparms, ctx->subseqparms, pp) || vs_end(str) || pp->pic_parameter_set_id > 255) {
+				h264_del_picparm(pp);
+				return 1;
+			}
+			if (ctx->picparms[pp->pic_parameter_set_id])
+				h264_del_picparm(ctx->picparms[pp->pic_parameter_set_id]);
+			ctx->picparms[pp->pic_parameter_set_id] = pp;
+			return enc && (h264_picparm(enc, ctx->seqparms, ctx->subseqparms, pp) || vs_end(enc));
+		case H264_NAL_UNIT_TYPE_ACC_UNIT_DELIM:
+			if (vs_u(str, &primary_pic_type, 3) || vs_end(str))
+				return 1;
+			return enc && (vs_u(enc, &primary_pic_type, 3) || vs_end(enc));
+		case H264_NAL_UNIT_TYPE_END_SEQ:
+		case H264_NAL_UNIT_TYPE_END_STREAM:
+			return 0;
+		default:
+			return 2;
+	}
+}
+
+static void bench_h264_fini(struct bench_h264 *ctx) {
+	int i;
+	for (i = 0; i < 32; i++)
+		if (ctx->seqparms[i])
+			h264_del_seqparm(ctx->seqparms[i]);
+	for (i = 0; i < 256; i++)
+		if (ctx->picparms[i])
+			h264_del_picparm(ctx->picparms[i]);
+	h264_slice_buf_free(&ctx->buf);
+}
+
+/* the unit starting at pos, less the zeros at its end */
+static int unit_len(const uint8_t *bytes, int num, int pos) {
+	int end = vs_find_start(bytes, num, pos + 3);
+	if (end == -1)
+		end = num;
+	while (end > pos && !bytes[end - 1])
+		end--;
+	return end - pos;
+}
+
+/* whether enc holds the same unit as bytes at pos */
+static int same_unit(const uint8_t *bytes, int num, int pos, struct bitstream *enc) {
+	int epos = vs_find_start(enc->bytes, enc->bytesnum, 0);
+	int len = unit_len(bytes, num, pos);
+	return epos != -1 && unit_len(enc->bytes, enc->bytesnum, epos) == len && !memcmp(enc->bytes + epos, bytes + pos, len);
+}
+
+/* whether enc holds the same bits as bytes, up to zeros at the end */
+static int same_bits(const uint8_t *bytes, int num, struct bitstream *enc) {
+	int len = num, elen = enc->bytesnum;
+	while (len && !bytes[len - 1])
+		len--;
+	while (elen && !enc->bytes[elen - 1])
+		elen--;
+	return len == elen && !memcmp(bytes, enc->bytes, len);
+}
+
+/* parses all of bytes, checking every unit if check is set */
+static void parse(enum vs_type type, uint8_t *bytes, int num, int check, struct bench_result *res) {
+	struct bitstream *str = vs_new_decode(type, bytes, num);
+	struct bitstream *enc = 0;
+	struct h261_picparm picparm = { 0 };
+	struct h261_gob *gob = 0;
+	struct bench_h262 ctx262 = { 0 };
+	struct bench_h264 ctx264 = { 0 };
+	struct h264_stats stats = { 0 };
+	uint32_t start_code;
+	int pos, r, i;
+	memset(res, 0, sizeof *res);
+	if (type == VS_H261) {
+		gob = calloc(sizeof *gob, 1);
+		/* H.261 start codes are not byte aligned, so check the stream as a whole */
+		if (check)
+			enc = vs_new_encode(type);
+	}
+	if (type == VS_H264 && check)
+		ctx264.stats = &stats;
+	while (1) {
+		if (type == VS_H261) {
+			if (vs_search_start(str) != 1)
+				break;
+		} else if (vs_next_start(str) == -1 && vs_search_start(str) != 1) {
+			break;
+		}
+		if (vs_start(str, &start_code))
+			break;
+		if (type != VS_H261 && check)
+			enc = vs_new_encode(type);
+		if (enc)
+			vs_start(enc, &start_code);
+		/* the 00 00 01 and the start code itself */
+		pos = str->bytepos - 4;
+		res->units++;
+		if (type == VS_H261)
+			r = unit_h261(str, enc, &picparm, gob, start_code, res);
+		else if (type == VS_H262)
+			r = unit_h262(str, enc, &ctx262, start_code, res);
+		else
+			r = unit_h264(str, enc, &ctx264, start_code, res);
+		if (r == 1)
+			res->failed_units++;
+		if (type != VS_H261 && enc) {
+			if (!r) {
+				res->checked_units++;
+				res->identical_units += same_unit(bytes, num, pos, enc);
+			}
+			vs_destroy(enc);
+			enc = 0;
+		}
+	}
+	if (type == VS_H261 && enc) {
+		/* the stream counts as one unit here */
+		vs_align_byte(enc, VS_ALIGN_0);
+		res->checked_units = 1;
+		res->identical_units = !res->failed_units && same_bits(bytes, num, enc);
+		vs_destroy(enc);
+	}
+	for (i = 0; i < H264_STATS_CTXIDX_NUM; i++)
+		res->bins += stats.ctx_bins[i];
+	res->bins += stats.bypass_bins + stats.terminate_bins;
+	free(gob);
+	free(ctx262.slice.mbs);
+	bench_h264_fini(&ctx264);
+	str->bytes = 0;
+	vs_destroy(str);
+}
+
+static const char *type_name(enum vs_type type) {
+	switch (type) {
+		case VS_H261:
+			return "h261";
+		case VS_H262:
+			return "h262";
+		case VS_H264:
+			return "h264";
+		default:
+			return "unknown";
+	}
+}
+
+/* times parsing bytes, prints the fields of one stream; returns 1 if any unit failed or came out different */
+static int bench(enum vs_type type, uint8_t *bytes, int num) {
+	struct bench_result check, res;
+	double best = 0;
+	long long nallocs = 0;
+	int i;
+	/* also the warmup */
+	parse(type, bytes, num, 1, &check);
+	for (i = 0; i < reps; i++) {
+		long long a = bench_allocs;
+		double start = bench_now();
+		parse(type, bytes, num, 0, &res);
+		double secs = bench_now() - start;
+		if (!i || secs < best)
+			best = secs;
+		nallocs = bench_allocs - a;
+	}
+	printf("\"format\": \"%s\", \"bytes\": %d, \"units\": %" PRIu64 ", \"mbs\": %" PRIu64 ", ", type_name(type), num, check.units, check.mbs);
+	printf("\"secs\": %.6f, \"mbs_per_sec\": %.0f, \"mbits_per_sec\": %.2f, ", best, check.mbs / best, num * 8 / best / 1e6);
+	if (type == VS_H264)
+		printf("\"bins\": %" PRIu64 ", \"bins_per_sec\": %.0f, ", check.bins, check.bins / best);
+	if (bench_have_allocs)
+		printf("\"allocs_per_mb\": %.4f, ", check.mbs ? (double)nallocs / check.mbs : 0.0);
+	else
+		printf("\"allocs_per_mb\": null, ");
+	printf("\"failed_units\": %" PRIu64 ", \"checked_units\": %" PRIu64 ", \"identical_units\": %" PRIu64, check.failed_units, check.checked_units, check.identical_units);
+	return check.failed_units || check.checked_units != check.identical_units;
+}
+
+static int bench_stream(const struct bench_stream *bs) {
+	struct bitstream *str = vs_new_encode(bs->type);
+	int res;
+	if (bs->type == VS_H261)
+		res = gen_h261(str, bs);
+	else if (bs->type == VS_H262)
+		res = gen_h262(str, bs);
+	else
+		res = gen_h264(str, bs);
+	printf("\t\t{ \"stream\": \"%s\", \"width\": %d, \"height\": %d, \"slices\": %d, ", bs->name, bs->width * 16, bs->height * 16, bs->slices);
+	if (bs->type == VS_H264)
+		printf("\"entropy\": \"%s\", ", bs->cabac ? "cabac" : "cavlc");
+	if (res) {
+		printf("\"error\": \"generating failed\" }");
+	} else {
+		res = bench(bs->type, str->bytes, str->bytesnum);
+		printf(" }");
+	}
+	vs_destroy(str);
+	return res;
+}
+
+static int bench_file(const char *name, int type) {
+	FILE *f = fopen(name, "rb");
+	uint8_t *bytes = 0;
+	int bytesnum = 0, bytesmax = 0;
+	int res = 1, c;
+	printf("\t\t{ \"file\": \"%s\", ", name);
+	if (!f) {
+		printf("\"error\": \"can't open\" }");
+		return 1;
+	}
+	if (type == -1) {
+		const char *ext = strrchr(name, '.');
+		ext = ext ? ext + 1 : "";
+		if (!strcasecmp(ext, "261") || !strcasecmp(ext, "h261"))
+			type = VS_H261;
+		else if (!strcasecmp(ext, "m1v") || !strcasecmp(ext, "m2v") || !strcasecmp(ext, "mpv") || !strcasecmp(ext, "262") || !strcasecmp(ext, "h262"))
+			type = VS_H262;
+		else if (!strcasecmp(ext, "264") || !strcasecmp(ext, "h264") || !strcasecmp(ext, "jsv") || !strcasecmp(ext, "jvt") || !strcasecmp(ext, "26l") || !strcasecmp(ext, "avc"))
+			type = VS_H264;
+	}
+	while ((c = getc(f)) != EOF)
+		ADDARRAY(bytes, c);
+	fclose(f);
+	if (type == -1)
+		printf("\"error\": \"unknown format\" }");
+	else if (!bytesnum)
+		printf("\"error\": \"empty\" }");
+	else {
+		res = bench(type, bytes, bytesnum);
+		printf(" }");
+	}
+	free(bytes);
+	return res;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: vstream-bench [-p PICTURES] [-r REPS] [-S SEED] [-t h261|h262|h264] [FILE...]\n"
+			"Reports vstream parsing throughput as JSON, on generated streams or on FILEs.\n"
+			"Every unit is also written back out and checked to come out the same.\n"
+			"\n"
+			"  -p PICTURES\tpictures per generated stream (default: 8)\n"
+			"  -r REPS\tparse each stream this many times, report the best (default: 3)\n"
+			"  -S SEED\tseed for generated streams\n"
+			"  -t FORMAT\tformat of FILEs, instead of guessing from the extension\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	uint64_t seed = 0x9e3779b97f4a7c15ull;
+	int type = -1;
+	int c, i;
+	int failed = 0;
+	while ((c = getopt(argc, argv, "p:r:S:t:h")) != -1)
+		switch (c) {
+			case 'p':
+				pictures = strtol(optarg, 0, 0);
+				break;
+			case 'r':
+				reps = strtol(optarg, 0, 0);
+				break;
+			case 'S':
+				seed = strtoull(optarg, 0, 0) | 1;
+				break;
+			case 't':
+				if (!strcmp(optarg, "h261"))
+					type = VS_H261;
+				else if (!strcmp(optarg, "h262"))
+					type = VS_H262;
+				else if (!strcmp(optarg, "h264"))
+					type = VS_H264;
+				else
+					usage();
+				break;
+			default:
+				usage();
+		}
+	if (pictures < 1 || reps < 1)
+		usage();
+	bench_rstate = seed;
+	printf("{\n\t\"pictures\": %d,\n\t\"reps\": %d,\n\t\"seed\": %llu,\n\t\"streams\": [\n", pictures, reps, (unsigned long long)seed);
+	if (optind < argc) {
+		for (i = optind; i < argc; i++) {
+			if (i != optind)
+				printf(",\n");
+			failed |= bench_file(argv[i], type);
+			fflush(stdout);
+		}
+	} else {
+		for (i = 0; i < ARRAY_SIZE(streams); i++) {
+			if (i)
+				printf(",\n");
+			failed |= bench_stream(&streams[i]);
+			fflush(stdout);
+		}
+	}
+	printf("\n\t]\n}\n");
+	return failed;
+}